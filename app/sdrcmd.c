@@ -67,6 +67,41 @@ static int getFloat(char *str, float *f)
  }
 
 
+static void showLatency(SdrLib *sdr)
+{
+    static char *names[] = { "ddc", "demod", "resampler", "audio", "codec" };
+    for (int i = 0 ; i < LATENCY_POINTS ; i++)
+        {
+        LatencyStats stats;
+        if (!sdrGetLatency(sdr, i, &stats))
+            continue;
+        trace("%-10s count:%lu min:%.1fms mean:%.1fms max:%.1fms", names[i],
+            stats.count, stats.min / 1000.0, stats.mean / 1000.0, stats.max / 1000.0);
+        for (int b = 0 ; b < LATENCY_BUCKETS ; b++)
+            {
+            if (stats.buckets[b])
+                trace("    < %8ldus : %lu", 2L << b, stats.buckets[b]);
+            }
+        }
+    EncoderStats enc;
+    if (sdrGetEncoderStats(sdr, 0, &enc))
+        trace("%-10s frames:%lu dropped:%lu silences:%lu backlog:%d/%d max:%d", "encoder",
+            enc.frames, enc.dropped, enc.silences, enc.backlog, enc.capacity, enc.maxBacklog);
+}
+
+
+static void showDevices(SdrLib *sdr)
+{
+    int count = sdrGetDeviceCount(sdr);
+    int sel = sdrGetSelectedDevice(sdr);
+    for (int i = 0 ; i < count ; i++)
+        {
+        trace("%c%2d: %s serial:'%s'", (i == sel) ? '*' : ' ', i,
+            sdrGetDeviceName(sdr, i), sdrGetDeviceSerial(sdr, i));
+        }
+}
+
+
 int parseAndExecute(SdrLib *sdr, char *buf)
 {
     int len = strlen(buf);
@@ -98,6 +133,51 @@ int parseAndExecute(SdrLib *sdr, char *buf)
         {
         sdrStop(sdr);
         }
+    else if (equ(cmd, "device") || equ(cmd, "d"))
+        {
+        if (!p0)
+            showDevices(sdr);
+        else
+            {
+            double idx;
+            if (getDouble(p0, &idx))
+                sdrSelectDevice(sdr, (int)idx);
+            }
+        }
+    else if (equ(cmd, "latency"))
+        {
+        if (p0 && equ(p0, "reset"))
+            sdrResetLatency(sdr);
+        else
+            showLatency(sdr);
+        }
+    else if (equ(cmd, "blocks"))
+        {
+        if (!p0)
+            trace("blocks: %s", (sdrGetBlockMode(sdr) == BLOCKS_SMALL) ? "small" : "large");
+        else if (equ(p0, "small"))
+            sdrSetBlockMode(sdr, BLOCKS_SMALL);
+        else if (equ(p0, "large"))
+            sdrSetBlockMode(sdr, BLOCKS_LARGE);
+        else
+            error("blocks must be small or large");
+        }
+    else if (equ(cmd, "resampler"))
+        {
+        if (!p0)
+            trace("resampler: %s", (sdrGetResampleMode(sdr) == RESAMPLE_FARROW) ? "farrow" : "polyphase");
+        else if (equ(p0, "polyphase"))
+            sdrSetResampleMode(sdr, RESAMPLE_POLYPHASE);
+        else if (equ(p0, "farrow"))
+            sdrSetResampleMode(sdr, RESAMPLE_FARROW);
+        else
+            error("resampler must be polyphase or farrow");
+        }
+    else if (equ(cmd, "calibrate"))
+        {
+        if (!sdrCalibrateKernels(sdr))
+            error("Kernel calibration failed");
+        }
     else if (equ(cmd, "freq")||equ(cmd, "f"))
         {
         if (!p0)
@@ -135,6 +215,22 @@ int parseAndExecute(SdrLib *sdr, char *buf)
                 }
             }
         }
+    else if (equ(cmd, "squelch") || equ(cmd, "sq"))
+        {
+        if (!p0)
+            {
+            float level = sdrGetSquelch(sdr);
+            trace("squelch: %f", level);
+            }
+        else if (equ(p0, "off"))
+            sdrSetSquelch(sdr, -200.0);
+        else
+            {
+            float level;
+            if (getFloat(p0, &level))
+                sdrSetSquelch(sdr, level);
+            }
+        }
     else if (equ(cmd, "vfo") || equ(cmd, "v"))
         {
         if (!p0)
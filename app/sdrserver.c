@@ -13,8 +13,11 @@
 #include <unistd.h> //for getopt()
 #include <ctype.h>
 
+#include <pthread.h>
+
 #include <wsserver.h>
 #include <sdrlib.h>
+#include <fanout.h>
 
 
 #ifndef TRUE
@@ -59,33 +62,79 @@ struct SdrServer
 {
     SdrLib *sdr;
     WsServer *wsServer;
+    int raw;   //stream Opus packets one at a time, rather than in Ogg bundles
 };
 
 
-static void codecOutput(unsigned char *dat, int len, void *context)
+/**
+ * One for each websocket client.  Its audio comes from a listener on
+ * channel 0, so that however many clients there are, each encoding
+ * is done once.
+ */
+typedef struct
+{
+    WsHandler *ws;
+    Listener  *listener;
+    pthread_t sender;
+} Client;
+
+
+/**
+ * The encodings a client may ask for, as in ws://host/sdr?ulaw
+ */
+static char *encodingNames[ENCODINGS] = { "opus16", "opus32", "opus64", "pcm16", "ulaw" };
+
+static int clientEncoding(char *resourceName)
+{
+    char *query = strchr(resourceName, '?');
+    if (query)
+        {
+        for (int e = 0 ; e < ENCODINGS ; e++)
+            if (strcmp(query + 1, encodingNames[e]) == 0)
+                return e;
+        }
+    return ENCODING_OPUS_32K;
+}
+
+
+/**
+ * Send the client its packets, so that a slow client holds up only
+ * itself, and never the dsp
+ */
+static void *clientSender(void *ctx)
 {
-    SdrServer *svr = (SdrServer *)context; 
-    WsHandler *ws = wsGetClientWs(svr->wsServer);
-    if (ws)
+    Client *client = (Client *)ctx;
+    Packet *packet;
+    while ((packet = listenerNext(client->listener)))
         {
-        wsSendBinary(ws, dat, len);
-        } 
+        wsSendBinary(client->ws, packet->data, packet->size);
+        packetUnref(packet);
+        }
+    return NULL;
 }
 
 
-SdrServer *svrCreate()
+SdrServer *svrCreate(int raw)
 {
     SdrServer *svr = (SdrServer *)malloc(sizeof(SdrServer));
     if (!svr)
         {
         return NULL;
         }
-    svr->sdr = sdrCreate(svr, NULL, codecOutput);  //TODO: important to supply these values
+    //the clients listen, rather than taking channel 0's codec output
+    svr->sdr = sdrCreate(svr, NULL, NULL);
     if (!svr->sdr)
         {
         free(svr);
         return NULL;
         }
+    svr->raw = raw;
+    if (raw)
+        {
+        //a client can keep up with small blocks, or there is no point
+        sdrSetCodecFormat(svr->sdr, CODEC_RAW);
+        sdrSetBlockMode(svr->sdr, BLOCKS_SMALL);
+        }
     return svr;
 }
 
@@ -131,6 +180,41 @@ static int getFloat(char *str, float *f)
  }
 
 
+static void showLatency(SdrLib *sdr)
+{
+    static char *names[] = { "ddc", "demod", "resampler", "audio", "codec" };
+    for (int i = 0 ; i < LATENCY_POINTS ; i++)
+        {
+        LatencyStats stats;
+        if (!sdrGetLatency(sdr, i, &stats))
+            continue;
+        trace("%-10s count:%lu min:%.1fms mean:%.1fms max:%.1fms", names[i],
+            stats.count, stats.min / 1000.0, stats.mean / 1000.0, stats.max / 1000.0);
+        for (int b = 0 ; b < LATENCY_BUCKETS ; b++)
+            {
+            if (stats.buckets[b])
+                trace("    < %8ldus : %lu", 2L << b, stats.buckets[b]);
+            }
+        }
+    EncoderStats enc;
+    if (sdrGetEncoderStats(sdr, 0, &enc))
+        trace("%-10s frames:%lu dropped:%lu silences:%lu backlog:%d/%d max:%d", "encoder",
+            enc.frames, enc.dropped, enc.silences, enc.backlog, enc.capacity, enc.maxBacklog);
+}
+
+
+static void showDevices(SdrLib *sdr)
+{
+    int count = sdrGetDeviceCount(sdr);
+    int sel = sdrGetSelectedDevice(sdr);
+    for (int i = 0 ; i < count ; i++)
+        {
+        trace("%c%2d: %s serial:'%s'", (i == sel) ? '*' : ' ', i,
+            sdrGetDeviceName(sdr, i), sdrGetDeviceSerial(sdr, i));
+        }
+}
+
+
 int parseAndExecute(SdrLib *sdr, char *buf)
 {
     int len = strlen(buf);
@@ -162,6 +246,24 @@ int parseAndExecute(SdrLib *sdr, char *buf)
         {
         sdrStop(sdr);
         }
+    else if (equ(cmd, "device") || equ(cmd, "d"))
+        {
+        if (!p0)
+            showDevices(sdr);
+        else
+            {
+            double idx;
+            if (getDouble(p0, &idx))
+                sdrSelectDevice(sdr, (int)idx);
+            }
+        }
+    else if (equ(cmd, "latency"))
+        {
+        if (p0 && equ(p0, "reset"))
+            sdrResetLatency(sdr);
+        else
+            showLatency(sdr);
+        }
     else if (equ(cmd, "freq")||equ(cmd, "f"))
         {
         if (!p0)
@@ -266,12 +368,47 @@ static void onOpen(WsHandler *ws, char *msg)
 {
     SdrServer *svr = (SdrServer *) ws->context;
     SdrLib *sdr = svr->sdr;
+    int encoding = clientEncoding(ws->resourceName);
+    Client *client = (Client *)malloc(sizeof(Client));
+    if (!client)
+        return;
+    client->ws = ws;
+    client->listener = sdrListen(sdr, 0, encoding);
+    if (!client->listener)
+        {
+        error("Could not listen for client");
+        free(client);
+        return;
+        }
+    if (svr->raw && encoding < ENCODING_PCM16)
+        {
+        //the decoder setup, once, ahead of the packets
+        unsigned char head[64];
+        int len = sdrGetCodecHeader(sdr, head, sizeof(head));
+        if (len)
+            wsSendBinary(ws, head, len);
+        }
+    if (pthread_create(&(client->sender), NULL, clientSender, client))
+        {
+        error("Could not start sender for client");
+        listenerDelete(client->listener);
+        free(client);
+        return;
+        }
+    ws->user = client;
+    trace("client listening, encoding %s", encodingNames[encoding]);
 }
 
 static void onClose(WsHandler *ws, char *msg)
 {
-    SdrServer *svr = (SdrServer *) ws->context;
-    SdrLib *sdr = svr->sdr;
+    Client *client = (Client *) ws->user;
+    if (!client)
+        return;
+    listenerClose(client->listener);
+    pthread_join(client->sender, NULL);
+    listenerDelete(client->listener);
+    free(client);
+    ws->user = NULL;
 }
 
 static void onMessage(WsHandler *ws, unsigned char *data, int len)
@@ -293,9 +430,9 @@ static void onError(WsHandler *ws, char *msg)
 
 
 
-static int doRun(char *dir, int port)
+static int doRun(char *dir, int port, int raw)
 {
-    SdrServer *ctx = svrCreate();
+    SdrServer *ctx = svrCreate(raw);
     if (!ctx)
         {
         return FALSE;
@@ -324,7 +461,8 @@ static void usage(char *progname)
         "Usage: %s { options }\n"
         "    where options are:\n"
         "-d <root_directory>\n"
-        "-p <port_number>\n";
+        "-p <port_number>\n"
+        "-r    stream raw Opus packets, with small blocks\n";
 
     fprintf(stderr, msg, progname);
 }
@@ -334,8 +472,9 @@ int main(int argc, char **argv)
 {
     char *dir = ".";
     int port = 8888;
+    int raw = FALSE;
     int c;
-    while ((c = getopt (argc, argv, "d:p:")) != -1)
+    while ((c = getopt (argc, argv, "d:p:r")) != -1)
         {
         switch (c)
             {
@@ -345,12 +484,15 @@ int main(int argc, char **argv)
             case 'p':
                 port = atoi(optarg);
                 break;
+            case 'r':
+                raw = TRUE;
+                break;
             default:
                 usage(argv[0]);
                 return -1;
             }
         }
-    if (doRun(dir, port))
+    if (doRun(dir, port, raw))
         return 0;
     else
         return -1;
@@ -26,12 +26,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <complex.h>
 #include <pthread.h>
 #include <rtl-sdr.h>
 
 #include "device.h"
+#include "event.h"
+#include "kernel.h"
+#include "latency.h"
 #include "ringbuffer.h"
+#include "thread.h"
 
 #ifndef TRUE
 #define TRUE  1
@@ -43,21 +48,50 @@
 
 
 /**
- * Set this to rtl-sdr's default async callback buffer size
- * divided by 2, since two bytes will make 1 complex
- * 262144 / 2 = 131072
+ * rtl-sdr's default async transfer size, in bytes.
+ * Two bytes will make 1 complex, so 262144 / 2 = 131072 samples
  */
-#define BUFSIZE (16 * 32 * 512 / 2)
+#define DEFAULT_TRANSFER_SIZE (16 * 32 * 512)
+
+/**
+ * Largest transfer we allow, in bytes
+ */
+#define MAX_TRANSFER_SIZE (1024 * 1024)
+
+/**
+ * Number of blocks the ring buffer can hold before we must drop data
+ */
+#define DEFAULT_QUEUE_DEPTH 100
+
+/**
+ * One element of the ring buffer.  The samples, plus
+ * whatever we know about them.
+ */
+typedef struct
+{
+    BlockInfo info;
+    int size;
+    float complex data[];
+} Block;
 
 typedef struct
 {
+    int index;          //which of the attached dongles we drive
+    int cpu;            //cpu for the async thread, or -1
+    int priority;       //realtime priority for the async thread, or 0
     rtlsdr_dev_t *dev;
-    float complex lut[256 * 256 * sizeof(float complex)];
     float gainscale;
     pthread_t asyncThread;
     ringbuffer *ringBuffer;
+    Event *dataReady;   //signaled whenever a block is queued
     Parent *par;
     int isOpen;
+    int transferCount;  //number of USB transfers in flight, 0 for the default
+    int transferSize;   //bytes per USB transfer
+    int queueDepth;     //number of blocks in the ring buffer
+    unsigned long seq;  //sequence number of the next block
+    unsigned long long sampleCount; //samples delivered by the device since open
+    int dropped;        //blocks dropped since the last one we queued
 } Context;
 
 
@@ -126,20 +160,40 @@ static double getCenterFrequency(void *context)
 
 
 
-static int read(void *context, float complex *buf, int buflen)
+static int read(void *context, float complex *buf, int buflen, BlockInfo *info)
 {
     Context *ctx = (Context *)context;
     if (!ctx->isOpen)
         return 0;
     ringbuffer *rb = ctx->ringBuffer;
-    if (buflen < BUFSIZE)
+    Block *blk = (Block *)ringbuffer_rpeek(rb);
+    if (!blk)
+        return 0; 
+    int size = blk->size;
+    if (buflen < size)
         {
         ctx->par->error("buflen param is too small");
         return 0;
         }
-    if (!ringbuffer_read(rb, buf))
-        return 0; 
-    return BUFSIZE;
+    memcpy(buf, blk->data, size * sizeof(float complex));
+    if (info)
+        *info = blk->info;
+    ringbuffer_radvance(rb);
+    return size;
+}
+
+
+static int waitForData(void *context, int timeoutMs)
+{
+    Context *ctx = (Context *)context;
+    if (!ctx->isOpen)
+        return FALSE;
+    if (!ringbuffer_is_empty(ctx->ringBuffer))
+        return TRUE;
+    //if a block arrives between the test above and here, the
+    //event stays signaled and the wait returns at once
+    eventWait(ctx->dataReady, timeoutMs);
+    return !ringbuffer_is_empty(ctx->ringBuffer);
 }
 
 
@@ -147,26 +201,33 @@ static int read(void *context, float complex *buf, int buflen)
 static void async_read_callback(unsigned char *buf, uint32_t len, void *context)
 {
     Context *ctx = (Context *)context;
-    float complex *lut = ctx->lut;
-    unsigned char *b = buf;
     int count = len>>1;
-    if (count > BUFSIZE)
+    if (count > ctx->transferSize / 2)
         {
         ctx->par->error("read buffer too small");
         return;
         }
+    unsigned long seq = ctx->seq++;
+    unsigned long long sampleCount = ctx->sampleCount;
+    ctx->sampleCount += count;
     ringbuffer *rb = ctx->ringBuffer;
-    float complex *cpx = (float complex *)ringbuffer_wpeek(rb);
-    if (cpx)
+    Block *blk = (Block *)ringbuffer_wpeek(rb);
+    if (!blk)
         {
-        int i = count;
-        while (i--)
-            {
-            int hi = (int)*b++;
-            int lo = (int)*b++;
-            *cpx++ = lut[(hi<<8) + lo];
-            }
+        //the reader is not keeping up.  let it know on the next block
+        ctx->dropped++;
+        }
+    else
+        {
+        blk->info.timestamp   = latencyNow();
+        blk->info.seq         = seq;
+        blk->info.sampleCount = sampleCount;
+        blk->info.dropped     = ctx->dropped;
+        ctx->dropped = 0;
+        blk->size = count;
+        kernels.convertU8(blk->data, buf, count);
         ringbuffer_wadvance(rb);
+        eventSignal(ctx->dataReady);
         }
     //ctx->par->trace("len:%d", len);
 }
@@ -186,7 +247,11 @@ static int transmit(void *context, int truefalse)
 static void *asyncLoop(void *context)
 {
     Context *ctx = (Context *)context;
-    rtlsdr_read_async(ctx->dev, async_read_callback, ctx, 0, 0);
+    char name[16];
+    snprintf(name, sizeof(name), "rtl-usb-%d", ctx->index);
+    threadApply(name, ctx->cpu, ctx->priority);
+    rtlsdr_read_async(ctx->dev, async_read_callback, ctx,
+        ctx->transferCount, ctx->transferSize);
     return NULL;
 }
 
@@ -196,12 +261,10 @@ static int open(void *context)
     if (ctx->isOpen)
         return 0;
     rtlsdr_dev_t *dev = NULL;
-    int devCount = rtlsdr_get_device_count();
-    ctx->par->trace("devices:%d", devCount);
-    int ret = rtlsdr_open(&dev, 0);
+    int ret = rtlsdr_open(&dev, ctx->index);
     if (!dev)
         {
-        ctx->par->error("Could not open device");
+        ctx->par->error("Could not open device %d", ctx->index);
         return 0;
         }
 
@@ -220,8 +283,18 @@ static int open(void *context)
     setCenterFrequency(ctx, 93700000.0);
     
     ret = rtlsdr_reset_buffer(dev);
+    ctx->seq         = 0;
+    ctx->sampleCount = 0;
+    ctx->dropped     = 0;
+    int blockSize = sizeof(Block) + (ctx->transferSize / 2) * sizeof(float complex);
+    ctx->ringBuffer = ringbuffer_create(ctx->queueDepth, blockSize);
+    if (!ctx->ringBuffer)
+        {
+        ctx->par->error("Could not allocate %d blocks of %d bytes", ctx->queueDepth, blockSize);
+        rtlsdr_close(dev);
+        return FALSE;
+        }
     ctx->isOpen = 1;
-    ctx->ringBuffer = ringbuffer_create(100, BUFSIZE * sizeof (float complex));
     int rc = pthread_create(&(ctx->asyncThread), NULL, asyncLoop, ctx);
     if (rc)
         {
@@ -232,6 +305,42 @@ static int open(void *context)
     return 1;
 }
 
+static int setBuffering(void *context, int transferCount, int transferSize, int queueDepth)
+{
+    Context *ctx = (Context *)context;
+    if (transferSize > 0)
+        {
+        //librtlsdr wants a multiple of 512 bytes
+        transferSize = (transferSize + 511) & ~511;
+        if (transferSize > MAX_TRANSFER_SIZE)
+            transferSize = MAX_TRANSFER_SIZE;
+        ctx->transferSize = transferSize;
+        }
+    if (transferCount > 0)
+        ctx->transferCount = transferCount;
+    if (queueDepth > 1)
+        {
+        long long blockSize = sizeof(Block) + (ctx->transferSize / 2) * sizeof(float complex);
+        if (queueDepth * blockSize > INT_MAX)
+            {
+            ctx->par->error("queue depth %d is too large", queueDepth);
+            return FALSE;
+            }
+        ctx->queueDepth = queueDepth;
+        }
+    ctx->par->trace("transfers:%d transferSize:%d queueDepth:%d",
+        ctx->transferCount, ctx->transferSize, ctx->queueDepth);
+    return TRUE;
+}
+
+static int setThreadPolicy(void *context, int cpu, int priority)
+{
+    Context *ctx = (Context *)context;
+    ctx->cpu      = cpu;
+    ctx->priority = priority;
+    return TRUE;
+}
+
 static int isOpen(void *context)
 {
     Context *ctx = (Context *)context;
@@ -244,6 +353,7 @@ static int close(void *context)
     Context *ctx = (Context *)context;
     //do shutdowny things here
     ctx->isOpen = 0;
+    eventSignal(ctx->dataReady); //wake up any reader
     rtlsdr_cancel_async(ctx->dev);
     rtlsdr_close(ctx->dev);
     ringbuffer_delete(ctx->ringBuffer);
@@ -253,12 +363,21 @@ static int close(void *context)
 static int delete(void *context)
 {
     Context *ctx = (Context *)context;
+    eventDelete(ctx->dataReady);
     free(ctx);   
     return 1;
 }
 
 
-int deviceCreate(Device *dv, Parent *parent)
+int deviceCount(Parent *parent)
+{
+    int count = rtlsdr_get_device_count();
+    parent->trace("rtl devices:%d", count);
+    return count;
+}
+
+
+int deviceCreateIndex(Device *dv, Parent *parent, int index)
 {
     Context *ctx = (Context *)malloc(sizeof(Context));
     if (!ctx)
@@ -267,20 +386,28 @@ int deviceCreate(Device *dv, Parent *parent)
         }
     memset(ctx, 0, sizeof(Context));
     ctx->par = parent;
-    int idx = 0;
-    int hi,lo;
-    for (hi = 0 ; hi < 256 ; hi++)
+    ctx->index = index;
+    ctx->cpu   = -1;
+    ctx->transferCount = 0;
+    ctx->transferSize  = DEFAULT_TRANSFER_SIZE;
+    ctx->queueDepth    = DEFAULT_QUEUE_DEPTH;
+    ctx->dataReady     = eventCreate();
+    if (!ctx->dataReady)
         {
-        float hival = ((float)(hi - 127)) / 128.0; 
-        for (lo = 0; lo < 256 ; lo++)
-            {
-            float loval = ((float)(lo - 127)) / 128.0;
-            ctx->lut[idx++] = hival+loval*I; 
-            }    
+        free(ctx);
+        return 0;
         }
+    //this module has its own copy of the kernel bindings
+    kernelLoadProfile(NULL);
+    
+    char manufacturer[256];
+    char product[256];
+    if (rtlsdr_get_device_usb_strings(index, manufacturer, product, dv->serial))
+        dv->serial[0] = '\0';
     
     dv->type               = DEVICE_SDR,
     dv->name               = "RTL - SDR Device";
+    dv->index              = index;
     dv->ctx                = (void *)ctx;
     dv->open               = open;
     dv->isOpen             = isOpen;
@@ -293,8 +420,17 @@ int deviceCreate(Device *dv, Parent *parent)
     dv->setCenterFrequency = setCenterFrequency;
     dv->getCenterFrequency = getCenterFrequency;
     dv->read               = read;
+    dv->waitForData        = waitForData;
     dv->write              = write;
     dv->transmit           = transmit;
+    dv->setBuffering       = setBuffering;
+    dv->setThreadPolicy    = setThreadPolicy;
     return 1;
 }
 
+
+int deviceCreate(Device *dv, Parent *parent)
+{
+    return deviceCreateIndex(dv, parent, 0);
+}
+
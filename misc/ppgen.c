@@ -0,0 +1,235 @@
+/**
+ * Generates fully unrolled filter kernels for the sizes that sdrlib
+ * uses most, and a dispatcher that finds them at run time.  The
+ * build runs this and compiles its output into the library.
+ *
+ * This replaces PpGen.scala, which sketched the same idea for a
+ * fixed set of hand-windowed decimators.  Here the decimator sizes
+ * come from the library's own filter design, for the same spec that
+ * decimatorCreate() asks for, so that the specialized kernels are the
+ * ones it will actually look up.
+ *
+ * usage:  ppgen output.c
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "design.h"
+#include "samplerate.h"
+#include "private.h"
+
+
+/**
+ * Every odd size up to this gets an unrolled dot product
+ */
+#define GEN_SMALL_SIZES 63
+
+/**
+ * Integer decimation factors to specialize
+ */
+#define GEN_MIN_FACTOR 2
+#define GEN_MAX_FACTOR 10
+
+/**
+ * Separate sums, so that the adds do not wait on each other
+ */
+#define GEN_ACCUMULATORS 4
+
+
+static int sizes[DESIGN_MAX_TAPS + 1];  //TRUE if a dot product is wanted
+static int factorSizes[GEN_MAX_FACTOR + 1]; //the decimator size for each factor, or 0
+
+
+/**
+ * The size decimatorCreate() will get for a factor.  Only the
+ * ratios in the spec matter, so any rates will do.
+ */
+static int decimatorSize(int factor)
+{
+    float lowRate  = 1000.0;
+    float highRate = lowRate * factor;
+    FilterSpec spec;
+    spec.lo     = 0.0;
+    spec.hi     = lowRate * RESAMPLER_PASS;
+    spec.width  = lowRate * RESAMPLER_WIDTH;
+    spec.ripple = SAMPLERATE_RIPPLE;
+    spec.atten  = SAMPLERATE_ATTEN;
+    spec.rate   = highRate;
+    float *coeffs = (float *)malloc(DESIGN_MAX_TAPS * sizeof(float));
+    int size = designFilter(&spec, coeffs);
+    free(coeffs);
+    return size;
+}
+
+
+/**
+ * The folded sum for one accumulator:  taps a, a+N, a+2N ...
+ */
+static void genFold(FILE *out, int size, int acc)
+{
+    int half = size / 2;
+    int first = TRUE;
+    for (int k = acc ; k < half ; k += GEN_ACCUMULATORS)
+        {
+        fprintf(out, "%s(x[%d] + x[%d]) * h[%d]", (first) ? "" : "\n        + ",
+            k, size - 1 - k, k);
+        first = FALSE;
+        }
+    if (acc == 0)
+        fprintf(out, "%sx[%d] * h[%d]", (first) ? "" : "\n        + ", half, half);
+    else if (first)
+        fprintf(out, "0.0");
+}
+
+
+static void genDot(FILE *out, const char *type, const char *name, int size)
+{
+    fprintf(out, "static %s %s%d(const %s *x, const float *h, int n)\n",
+        type, name, size, type);
+    fprintf(out, "{\n");
+    int accs = (size / 2 < GEN_ACCUMULATORS) ? 1 : GEN_ACCUMULATORS;
+    for (int a = 0 ; a < accs ; a++)
+        {
+        fprintf(out, "    %s s%d = ", type, a);
+        if (accs == 1)
+            {
+            //too short to split
+            int half = size / 2;
+            for (int k = 0 ; k < half ; k++)
+                fprintf(out, "(x[%d] + x[%d]) * h[%d]\n        + ", k, size - 1 - k, k);
+            fprintf(out, "x[%d] * h[%d]", half, half);
+            }
+        else
+            genFold(out, size, a);
+        fprintf(out, ";\n");
+        }
+    if (accs == 1)
+        fprintf(out, "    return s0;\n");
+    else
+        fprintf(out, "    return (s0 + s1) + (s2 + s3);\n");
+    fprintf(out, "}\n\n");
+}
+
+
+static void genDecimator(FILE *out, int size, int factor)
+{
+    fprintf(out,
+        "static int decimC%d_%d(float complex *delayLine, int *delayIndex, int *phase,\n"
+        "                       const float *h, const float complex *in, int len, float complex *out)\n"
+        "{\n"
+        "    int idx   = *delayIndex;\n"
+        "    int ph    = *phase;\n"
+        "    int count = 0;\n"
+        "    for (int i = 0 ; i < len ; i++)\n"
+        "        {\n"
+        "        delayLine[idx] = delayLine[idx + DESIGN_MAX_TAPS] = in[i];\n"
+        "        if (!ph)\n"
+        "            out[count++] = dotSymC%d(delayLine + idx, h, %d);\n"
+        "        if (++ph == %d)\n"
+        "            ph = 0;\n"
+        "        idx = (idx) ? idx - 1 : DESIGN_MAX_TAPS - 1;\n"
+        "        }\n"
+        "    *delayIndex = idx;\n"
+        "    *phase      = ph;\n"
+        "    return count;\n"
+        "}\n\n", size, factor, size, size, factor);
+}
+
+
+static void genDispatch(FILE *out)
+{
+    fprintf(out, "DotFunc *kernelGenDot(int size)\n{\n    switch (size)\n        {\n");
+    for (int n = 0 ; n <= DESIGN_MAX_TAPS ; n++)
+        if (sizes[n])
+            fprintf(out, "        case %d: return dotSym%d;\n", n, n);
+    fprintf(out, "        default: return NULL;\n        }\n}\n\n\n");
+
+    fprintf(out, "DotFuncC *kernelGenDotC(int size)\n{\n    switch (size)\n        {\n");
+    for (int n = 0 ; n <= DESIGN_MAX_TAPS ; n++)
+        if (sizes[n])
+            fprintf(out, "        case %d: return dotSymC%d;\n", n, n);
+    fprintf(out, "        default: return NULL;\n        }\n}\n\n\n");
+
+    fprintf(out, "DecimateFuncC *kernelGenDecimatorC(int size, int factor)\n{\n");
+    for (int f = GEN_MIN_FACTOR ; f <= GEN_MAX_FACTOR ; f++)
+        if (factorSizes[f])
+            fprintf(out, "    if (factor == %d && size == %d)\n        return decimC%d_%d;\n",
+                f, factorSizes[f], factorSizes[f], f);
+    fprintf(out, "    return NULL;\n}\n\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+        {
+        fprintf(stderr, "usage: %s output.c\n", argv[0]);
+        return 1;
+        }
+    FILE *out = fopen(argv[1], "w");
+    if (!out)
+        {
+        error("could not open %s", argv[1]);
+        return 1;
+        }
+
+    for (int n = 3 ; n <= GEN_SMALL_SIZES ; n += 2)
+        sizes[n] = TRUE;
+    for (int f = GEN_MIN_FACTOR ; f <= GEN_MAX_FACTOR ; f++)
+        {
+        int size = decimatorSize(f);
+        //past this, unrolling only makes the code bigger
+        if (size > 0 && size <= REMEZ_MAX_TAPS)
+            {
+            factorSizes[f] = size;
+            sizes[size] = TRUE;
+            }
+        }
+
+    fprintf(out, "/**\n * Generated by misc/ppgen.c.  Do not edit.\n */\n\n");
+    fprintf(out, "#include <stdlib.h>\n#include <complex.h>\n\n");
+    fprintf(out, "#include \"design.h\"\n#include \"kernelgen.h\"\n\n\n");
+    for (int n = 0 ; n <= DESIGN_MAX_TAPS ; n++)
+        {
+        if (sizes[n])
+            {
+            genDot(out, "float", "dotSym", n);
+            genDot(out, "float complex", "dotSymC", n);
+            }
+        }
+    fprintf(out, "\n");
+    for (int f = GEN_MIN_FACTOR ; f <= GEN_MAX_FACTOR ; f++)
+        if (factorSizes[f])
+            genDecimator(out, factorSizes[f], f);
+    fprintf(out, "\n");
+    genDispatch(out);
+    if (fclose(out))
+        {
+        error("could not write %s", argv[1]);
+        return 1;
+        }
+    return 0;
+}
+
@@ -0,0 +1,150 @@
+/**
+ * Automatic gain control
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "agc.h"
+#include "private.h"
+
+
+/**
+ * How far a one-pole tracker moves toward its target in one block,
+ * for a time constant.  A time of 0 moves all the way.
+ */
+static float agcCoef(float seconds, float rate)
+{
+    if (seconds <= 0.0 || rate <= 0.0)
+        return 1.0;
+    return 1.0 - exp(-AGC_BLOCK / (seconds * rate));
+}
+
+
+static void agcSetCoeffs(Agc *agc)
+{
+    agc->attackCoef = agcCoef(agc->attack, agc->rate);
+    agc->decayCoef  = agcCoef(agc->decay, agc->rate);
+    agc->hangBlocks = (int)(agc->hang * agc->rate / AGC_BLOCK);
+}
+
+
+Agc *agcCreate()
+{
+    Agc *agc = (Agc *)smalloc(sizeof(Agc));
+    if (!agc)
+        return NULL;
+    memset(agc, 0, sizeof(Agc));
+    agc->attack = AGC_ATTACK;
+    agc->decay  = AGC_DECAY;
+    agc->hang   = AGC_HANG;
+    agcSetCoeffs(agc);
+    agcReset(agc);
+    return agc;
+}
+
+
+void agcDelete(Agc *agc)
+{
+    free(agc);
+}
+
+
+/**
+ * Start from full gain, as for silence, and let the first peak pull it down
+ */
+void agcReset(Agc *agc)
+{
+    agc->envelope = AGC_TARGET / AGC_MAX_GAIN;
+    agc->gain     = AGC_MAX_GAIN;
+    agc->hangLeft = 0;
+}
+
+
+void agcSetRate(Agc *agc, float rate)
+{
+    agc->rate = rate;
+    agcSetCoeffs(agc);
+}
+
+
+void agcSetTimes(Agc *agc, float attack, float decay, float hang)
+{
+    agc->attack = attack;
+    agc->decay  = decay;
+    agc->hang   = hang;
+    agcSetCoeffs(agc);
+}
+
+
+void agcUpdate(Agc *agc, float *data, int size)
+{
+    float envelope = agc->envelope;
+    float gain     = agc->gain;
+    float floor    = AGC_TARGET / AGC_MAX_GAIN;
+    while (size > 0)
+        {
+        int n = (size < AGC_BLOCK) ? size : AGC_BLOCK;
+        float peak = 0.0;
+        for (int i = 0 ; i < n ; i++)
+            {
+            float v = fabsf(data[i]);
+            peak = (v > peak) ? v : peak;
+            }
+        //track in dB, so the times mean the same for a fall of 40dB as of 6dB.
+        //A short block moves the envelope less.
+        float scale = (float)n / AGC_BLOCK;
+        float level = (peak > floor) ? peak : floor;
+        if (peak > envelope)
+            {
+            envelope *= powf(level / envelope, agc->attackCoef * scale);
+            agc->hangLeft = agc->hangBlocks;
+            }
+        else if (agc->hangLeft > 0)
+            agc->hangLeft--;
+        else
+            envelope *= powf(level / envelope, agc->decayCoef * scale);
+        //a slow attack may lag, but never so far that the peak clips
+        if (peak * AGC_TARGET > envelope)
+            envelope = peak * AGC_TARGET;
+        if (envelope < floor)
+            envelope = floor;
+        float target = AGC_TARGET / envelope;
+        //ramp across the block so the gain never steps, from no
+        //higher than this block's peak allows
+        if (peak * gain > 1.0)
+            gain = 1.0 / peak;
+        float step = (target - gain) / n;
+        for (int i = 0 ; i < n ; i++)
+            {
+            gain += step;
+            data[i] *= gain;
+            }
+        gain = target;
+        data += n;
+        size -= n;
+        }
+    agc->envelope = envelope;
+    agc->gain     = gain;
+}
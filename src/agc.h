@@ -0,0 +1,99 @@
+#ifndef _AGC_H_
+#define _AGC_H_
+
+/**
+ * Automatic gain control, between the demodulators and the resampler,
+ * so that every channel reaches the codec at about the same level.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sdrlib.h"
+
+
+/**
+ * The envelope is measured over blocks of this many samples, and the
+ * gain moves once per block, in a ramp across it
+ */
+#define AGC_BLOCK (64)
+
+/**
+ * The peak level the output is brought to, leaving headroom for the codec
+ */
+#define AGC_TARGET (0.5)
+
+/**
+ * The most gain, about 60dB, so that silence is not brought up to noise
+ */
+#define AGC_MAX_GAIN (1000.0)
+
+/**
+ * Default times, in seconds
+ */
+#define AGC_ATTACK (0.002)
+#define AGC_DECAY  (0.5)
+#define AGC_HANG   (0.25)
+
+
+struct Agc
+{
+    float rate;      //input rate, set by agcSetRate()
+    float attack;    //time for the envelope to rise to a louder peak
+    float decay;     //time for it to fall back, once the hang is over
+    float hang;      //time the envelope holds after a peak before decaying
+    float attackCoef; //per AGC_BLOCK, for these at rate
+    float decayCoef;
+    int   hangBlocks;
+    int   hangLeft;  //blocks until the envelope may decay
+    float envelope;  //tracked peak level of the input
+    float gain;      //applied at the end of the last block
+};
+
+
+Agc *agcCreate();
+
+void agcDelete(Agc *agc);
+
+/**
+ * Forget the level, such as after a gap in the input or a change of mode
+ */
+void agcReset(Agc *agc);
+
+/**
+ * Tell the agc its input rate, which its times are counted in
+ */
+void agcSetRate(Agc *agc, float rate);
+
+/**
+ * Set the attack, decay and hang times, in seconds
+ */
+void agcSetTimes(Agc *agc, float attack, float decay, float hang);
+
+/**
+ * Level a block of samples in place.  The gain for each AGC_BLOCK is
+ * found from its peak before it is applied, so a sudden loud signal
+ * is caught without clipping.
+ */
+void agcUpdate(Agc *agc, float *data, int size);
+
+
+#endif /* _AGC_H_ */
@@ -34,15 +34,90 @@
 #include <portaudio.h>
 
 #include "audio.h"
+#include "thread.h"
 #include "private.h"
 
-#define SAMPLE_RATE 44100.0
+/**
+ * The Opus encoders' own rate, so that the one resampler output can
+ * go to the speaker and the codecs alike
+ */
+#define SAMPLE_RATE 48000.0
 
 
 
 static PaStreamCallback paCallback;
 
 
+/**
+ * Hold the queue at a depth that suits the buffer size
+ */
+static void audioResetDrift(Audio *audio)
+{
+    float target = AUDIO_QUEUE_TARGET * audio->framesPerBuffer;
+    float least  = AUDIO_QUEUE_MIN * audio->sampleRate;
+    driftReset(&(audio->drift), (target > least) ? target : least);
+}
+
+
+/**
+ * Open and start the stream, with buffers of framesPerBuffer
+ */
+static int audioOpen(Audio *audio)
+{
+    PaStreamParameters parms;
+    parms.device = Pa_GetDefaultOutputDevice();
+    parms.channelCount = 2;       /* stereo output */
+    parms.sampleFormat = paFloat32; /* 32 bit floating point output */
+    parms.hostApiSpecificStreamInfo = NULL;
+    //small buffers are no use unless the device is asked to keep up
+    const PaDeviceInfo *info = Pa_GetDeviceInfo(parms.device);
+    if (!info)
+        parms.suggestedLatency = 0.0;
+    else if (audio->framesPerBuffer < AUDIO_FRAMES_PER_BUFFER)
+        parms.suggestedLatency = info->defaultLowOutputLatency;
+    else
+        parms.suggestedLatency = info->defaultHighOutputLatency;
+ 
+    int err = Pa_OpenStream(
+            &(audio->stream),
+            NULL, /* no input */
+            &parms,
+            SAMPLE_RATE,
+            audio->framesPerBuffer,
+            paNoFlag,
+            paCallback,
+            (void *)audio );
+    if( err != paNoError )
+        {
+        error("audioOpen open: %s", Pa_GetErrorText(err) );
+        return FALSE;
+        }
+ 
+    err = Pa_StartStream( audio->stream );
+    if( err != paNoError )
+        {
+        error("audioOpen start: %s", Pa_GetErrorText(err) );
+        Pa_CloseStream(audio->stream);
+        return FALSE;
+        }
+    return TRUE;
+}
+
+
+/**
+ * Stop and close the stream
+ */
+static void audioClose(Audio *audio)
+{
+    int err = Pa_StopStream(audio->stream);
+    if (err != paNoError)
+        error("audioClose stop: %s", Pa_GetErrorText(err) );
+    err = Pa_CloseStream(audio->stream);
+    if (err != paNoError)
+        error("audioClose close: %s", Pa_GetErrorText(err) );
+}
+
+
 /**
  * Create a new Audio instance.
  * @return a new Audio instance
@@ -54,8 +129,17 @@ Audio *audioCreate()
         return audio;
     audio->sampleRate = SAMPLE_RATE;
     audio->gain = 0.0;
-    int elemSize = AUDIO_FRAMES_PER_BUFFER * sizeof(float);
-    audio->ringBuffer = ringbuffer_create(1024, elemSize);
+    audio->owner = NULL;
+    audio->busy = FALSE;
+    audio->threadReady = FALSE;
+    audio->framesPerBuffer = AUDIO_FRAMES_PER_BUFFER;
+    audio->pendingFrames = AUDIO_FRAMES_PER_BUFFER;
+    audio->streamOpen = FALSE;
+    audio->readPos = 0;
+    audio->queued = 0;
+    latencyReset(&(audio->latency));
+    audioResetDrift(audio);
+    audio->ringBuffer = ringbuffer_create(AUDIO_QUEUE_SLOTS, sizeof(AudioFrame));
     if (!audio->ringBuffer)
         {
         error("audioCreate: cannot initialize ringbuffer");
@@ -67,46 +151,59 @@ Audio *audioCreate()
     if ( err != paNoError )
         {
         error("audioCreate init: %s", Pa_GetErrorText(err) );
+        ringbuffer_delete(audio->ringBuffer);
         free(audio);
         return NULL;
         }
-    PaStreamParameters parms;
-    parms.device = Pa_GetDefaultOutputDevice();
-    parms.channelCount = 2;       /* stereo output */
-    parms.sampleFormat = paFloat32; /* 32 bit floating point output */
-    parms.hostApiSpecificStreamInfo = NULL;
- 
-    err = Pa_OpenStream(
-            &(audio->stream),
-            NULL, /* no input */
-            &parms,
-            SAMPLE_RATE,
-            AUDIO_FRAMES_PER_BUFFER,
-            paNoFlag,
-            paCallback,
-            (void *)audio );
-    if( err != paNoError )
+    if (!audioOpen(audio))
         {
-        error("audioCreate open: %s", Pa_GetErrorText(err) );
-        Pa_Terminate();
-        free(audio);
-        return NULL;
-        }
- 
-    err = Pa_StartStream( audio->stream );
-    if( err != paNoError )
-        {
-        error("audioCreate start: %s", Pa_GetErrorText(err) );
-        Pa_CloseStream(audio->stream);
         Pa_Terminate();
+        ringbuffer_delete(audio->ringBuffer);
         free(audio);
         return NULL;
         }
+    audio->streamOpen = TRUE;
  
     return audio;
 }
 
 
+int audioSetBlockTime(Audio *audio, float seconds)
+{
+    int frames = (int)(audio->sampleRate * seconds + 0.5);
+    if (frames <= 0 || frames > AUDIO_FRAMES_PER_BUFFER)
+        frames = AUDIO_FRAMES_PER_BUFFER;
+    __atomic_store_n(&(audio->pendingFrames), frames, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+
+/**
+ * Called by the producer, in audioPlay(), to pick up a change from
+ * audioSetBlockTime(), or to try again to open a stream that would not
+ */
+static int audioApplyBlockTime(Audio *audio)
+{
+    int frames = __atomic_load_n(&(audio->pendingFrames), __ATOMIC_ACQUIRE);
+    if (frames == audio->framesPerBuffer && audio->streamOpen)
+        return TRUE;
+    if (audio->streamOpen)
+        audioClose(audio);
+    audio->streamOpen = FALSE;
+    //the callback is stopped, so the queue is ours
+    ringbuffer *rb = audio->ringBuffer;
+    while (ringbuffer_rpeek(rb))
+        ringbuffer_radvance(rb);
+    audio->readPos = 0;
+    audio->queued = 0;
+    audio->framesPerBuffer = frames;
+    audioResetDrift(audio);
+    trace("audio buffers:%d frames", frames);
+    audio->streamOpen = audioOpen(audio);
+    return audio->streamOpen;
+}
+
+
 
 /**
  * Delete an Audio instance, stopping
@@ -118,13 +215,9 @@ void audioDelete(Audio *audio)
     if (!audio)
         return;
         
-    int err = Pa_StopStream(audio->stream);
-    if (err != paNoError)
-        error("audioDelete stop: %s", Pa_GetErrorText(err) );
-    err = Pa_CloseStream(audio->stream);
-    if (err != paNoError)
-        error("audioDelete close: %s", Pa_GetErrorText(err) );
-    err = Pa_Terminate();
+    if (audio->streamOpen)
+        audioClose(audio);
+    int err = Pa_Terminate();
     if ( err != paNoError )
         error("audioDelete terminate: %s", Pa_GetErrorText(err) );
     ringbuffer_delete(audio->ringBuffer);
@@ -132,6 +225,12 @@ void audioDelete(Audio *audio)
 }
 
 
+float audioGetDrift(Audio *audio)
+{
+    return audio->drift.ppm;
+}
+
+
 /**
  * Return the gain, 0-1
  * Convert to 0-40 db 
@@ -164,46 +263,188 @@ static int paCallback(const void *inputBuffer, void *outputBuffer,
     Audio *audio = (Audio *) userData;
     float gain = audio->gain;
     
+    //PortAudio owns this thread, so we can only place it from inside
+    if (!audio->threadReady)
+        {
+        threadSetup("sdr-audio", THREAD_AUDIO, -1);
+        audio->threadReady = TRUE;
+        }
+    
     ringbuffer *rb = audio->ringBuffer;
+    float *out = (float *)outputBuffer;
     
-    float *in = (float *) ringbuffer_rpeek(rb);
-    if (in)
+    //the buffers queued need not be the size PortAudio asks for
+    while (framesPerBuffer > 0)
         {
-        float *out = (float *)outputBuffer;
-        while (framesPerBuffer--)
+        AudioFrame *frame = (AudioFrame *) ringbuffer_rpeek(rb);
+        if (!frame)
             {
-            float v = (*in++) * gain;
-            //trace("v:%f",v);
-            *out++ = v;
-            *out++ = v;
+            //trace("underflow");
+            memset(out, 0, framesPerBuffer * 2 * sizeof(float));
+            break;
             }
-        ringbuffer_radvance(rb);
-        }
-    else
-        {
-        //trace("underflow");
-        memset(outputBuffer, 0, framesPerBuffer * 2 * sizeof(float));
+        int pos = audio->readPos;
+        if (!pos)
+            latencyRecord(&(audio->latency), frame->stamp);
+        unsigned long n = frame->size - pos;
+        if (n > framesPerBuffer)
+            n = framesPerBuffer;
+        if (frame->channels == 2)
+            {
+            float *in = frame->data + 2 * pos;
+            for (unsigned long i = 0 ; i < 2 * n ; i++)
+                *out++ = (*in++) * gain;
+            }
+        else
+            {
+            float *in = frame->data + pos;
+            for (unsigned long i = 0 ; i < n ; i++)
+                {
+                float v = (*in++) * gain;
+                *out++ = v;
+                *out++ = v;
+                }
+            }
+        framesPerBuffer -= n;
+        __atomic_sub_fetch(&(audio->queued), n, __ATOMIC_RELAXED);
+        pos += n;
+        if (pos >= frame->size)
+            {
+            pos = 0;
+            ringbuffer_radvance(rb);
+            }
+        audio->readPos = pos;
         }
     return paContinue;
 }
 
 
 #if 1
+void audioSetOwner(Audio *audio, void *owner)
+{
+    __atomic_store_n(&(audio->owner), owner, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Take the writing side of the queue, if the producer owns the speaker
+ * and no other is still in audioPlay() from before a handover
+ */
+static int audioAcquire(Audio *audio, void *producer)
+{
+    if (__atomic_load_n(&(audio->owner), __ATOMIC_ACQUIRE) != producer)
+        return FALSE;
+    int idle = FALSE;
+    return __atomic_compare_exchange_n(&(audio->busy), &idle, TRUE, FALSE,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+
+static void audioRelease(Audio *audio)
+{
+    __atomic_store_n(&(audio->busy), FALSE, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Take the queue, and bring the stream up to date with it
+ */
+static int audioBegin(Audio *audio, void *producer)
+{
+    if (!audioAcquire(audio, producer))
+        return FALSE;
+    if (!audioApplyBlockTime(audio))
+        {
+        audioRelease(audio);
+        return FALSE;
+        }
+    return TRUE;
+}
+
+
+/**
+ * Pass the frame just filled to paCallback, and steer the drift by
+ * how much is left to play.  That is counted in frames, since the
+ * buffers queued need not all be the same size, and one may be partly
+ * played already.
+ */
+static void audioCommit(Audio *audio, int size)
+{
+    //counted before the callback can see it, so never short
+    int queued = __atomic_add_fetch(&(audio->queued), size, __ATOMIC_RELAXED);
+    ringbuffer_wadvance(audio->ringBuffer);
+    driftUpdate(&(audio->drift), queued);
+}
+
+
 /**
  * Queue up data to be read by paCallback
  */
-int audioPlay(Audio *audio, float *data, int size)
+int audioPlay(Audio *audio, void *producer, float *data, int size, long long stamp)
 {
+    if (!audioBegin(audio, producer))
+        return FALSE;
     ringbuffer *rb = audio->ringBuffer;
-    int ret = ringbuffer_write(rb, data);
-    if (!ret)
+    AudioFrame *frame = (AudioFrame *) ringbuffer_wpeek(rb);
+    if (!frame)
         {
         error("Audio: ringBuffer full");
+        audioRelease(audio);
+        return FALSE;
         }
-    return ret;
+    if (size > AUDIO_FRAMES_PER_BUFFER)
+        size = AUDIO_FRAMES_PER_BUFFER;
+    frame->stamp = stamp;
+    frame->channels = 1;
+    frame->size = size;
+    memcpy(frame->data, data, size * sizeof(float));
+    audioCommit(audio, size);
+    audioRelease(audio);
+    return TRUE;
+}
+
+
+/**
+ * The same, with the samples already in the order PortAudio wants
+ * them, since a complex is a real and an imaginary float
+ */
+int audioPlayStereo(Audio *audio, void *producer, float complex *data, int size, long long stamp)
+{
+    if (!audioBegin(audio, producer))
+        return FALSE;
+    ringbuffer *rb = audio->ringBuffer;
+    AudioFrame *frame = (AudioFrame *) ringbuffer_wpeek(rb);
+    if (!frame)
+        {
+        error("Audio: ringBuffer full");
+        audioRelease(audio);
+        return FALSE;
+        }
+    if (size > AUDIO_FRAMES_PER_BUFFER)
+        size = AUDIO_FRAMES_PER_BUFFER;
+    frame->stamp = stamp;
+    frame->channels = 2;
+    frame->size = size;
+    memcpy(frame->data, data, size * sizeof(float complex));
+    audioCommit(audio, size);
+    audioRelease(audio);
+    return TRUE;
 }
 #else
-int audioPlay(Audio *audio, float *data, int size)
+int audioPlay(Audio *audio, void *producer, float *data, int size, long long stamp)
+{
+    PaStream *stream = audio->stream;
+    
+    int err = Pa_WriteStream(stream, data, size);
+    if (err != paNoError)
+        {
+        error("Audio write: %s", Pa_GetErrorText(err));
+        }
+    return err;
+}
+
+
+int audioPlayStereo(Audio *audio, void *producer, float complex *data, int size, long long stamp)
 {
     PaStream *stream = audio->stream;
     
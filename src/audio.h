@@ -31,10 +31,48 @@
 #include <pthread.h>
 
 #include "sdrlib.h"
+#include "drift.h"
+#include "latency.h"
 #include "ringbuffer.h"
 
+/**
+ * The most frames in a buffer, and the size PortAudio is given
+ * unless audioSetBlockTime() asks for smaller ones
+ */
 #define AUDIO_FRAMES_PER_BUFFER (16*1024)
 
+/**
+ * How many buffers to keep queued for PortAudio.  Enough to ride out
+ * a late block, and no more, since each one is latency.
+ */
+#define AUDIO_QUEUE_TARGET (2)
+
+/**
+ * The least to keep queued, in seconds, however small the buffers.
+ * Blocks of a few ms arrive with more jitter than that between them.
+ */
+#define AUDIO_QUEUE_MIN (0.030)
+
+/**
+ * Buffers the queue has room for.  The drift loop holds it at
+ * AUDIO_QUEUE_TARGET buffers, or AUDIO_QUEUE_MIN of small ones, which
+ * is a few, so this is enough for those and a burst of late blocks.
+ * Each slot has room for a full stereo buffer, 128kB.
+ */
+#define AUDIO_QUEUE_SLOTS (32)
+
+
+/**
+ * One element of the ring buffer
+ */
+typedef struct
+{
+    long long stamp; //acquisition time of the first sample
+    int channels;    //1, or 2 for left and right interleaved
+    int size;        //frames in data
+    float data[2 * AUDIO_FRAMES_PER_BUFFER];
+} AudioFrame;
+
 
 struct Audio
 {
@@ -42,6 +80,16 @@ struct Audio
     float sampleRate;
     float gain;
     ringbuffer *ringBuffer;
+    void *owner;      //the producer that may play, or NULL for none
+    int busy;         //a producer is in audioPlay(), so no other may be
+    Latency latency;  //age of samples when they are handed to PortAudio
+    Drift drift;      //holds the queue at AUDIO_QUEUE_TARGET buffers
+    int threadReady;  //the callback thread has had its policy applied
+    int framesPerBuffer; //what PortAudio asks for at each callback.  Belongs to the producer
+    int pendingFrames;   //asked for by audioSetBlockTime(), for the producer to apply
+    int streamOpen;   //FALSE if a reopen failed, so the producer tries again
+    int readPos;      //frames of the oldest queued buffer already played
+    int queued;       //frames queued and not yet played.  Only touched atomically
 };
 
 
@@ -51,10 +99,27 @@ struct Audio
  */  
 Audio *audioCreate();
 
+/**
+ * Hand the speaker to one producer.  The queue has room for only one,
+ * so the others' blocks are dropped, as are any of the new owner's
+ * that arrive while the old one is still on its way out of
+ * audioPlay().  This may be called from any thread.
+ * @param owner the producer, as it passes itself to audioPlay(), or NULL for none
+ */
+void audioSetOwner(Audio *audio, void *owner);
+
 /**
  * Send audio data to the player
+ * @param producer the caller, which must own the speaker to be heard
+ * @param stamp the acquisition time of the first sample
+ * @return TRUE if the data was queued, else FALSE
+ */
+int audioPlay(Audio *audio, void *producer, float *data, int size, long long stamp);
+
+/**
+ * Send stereo audio data to the player, as left + right * I
  */
-int audioPlay(Audio *audio, float *data, int size);
+int audioPlayStereo(Audio *audio, void *producer, float complex *data, int size, long long stamp);
 
 /**
  * Delete an Audio instance, stopping
@@ -64,6 +129,23 @@ int audioPlay(Audio *audio, float *data, int size);
 void audioDelete(Audio *audio);
 
 
+/**
+ * The correction for the difference between our clock and the sound
+ * card's, in ppm, for the resampler that feeds audioPlay()
+ */
+float audioGetDrift(Audio *audio);
+
+/**
+ * Set the length of the buffers handed to PortAudio, to match the
+ * blocks coming down the pipeline.  This may be called from any
+ * thread.  The stream is reopened, and anything queued dropped, by
+ * the producer that owns the speaker, at its next audioPlay(), since
+ * it is the one using the queue and the drift loop.
+ * @param seconds the length of a buffer, or 0 for AUDIO_FRAMES_PER_BUFFER frames
+ * @return TRUE if successful, else FALSE
+ */
+int audioSetBlockTime(Audio *audio, float seconds);
+
 /**
  * Return the gain, 0-1
  */
@@ -35,18 +35,26 @@
 
 
 
+/**
+ * Version 1, mono, no pre-skip, 48000 (0xbb80) little-endian,
+ * no gain, a single stream
+ */
+static const unsigned char opusHead[CODEC_HEAD_LEN] = {
+    'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 
+    1,                //version
+    1,                //nr channels  1 or 2
+    0, 0,             //16 bits, pre-skip
+    0x80, 0xbb, 0, 0, //samplerate, 32 bits, little-endian. 0xbb80 == 48000
+    0, 0,             //gain, 16 bits.  0 recommended
+    0                 // mapping, 0=single stream
+};
+
+
 static void sendHeader(ogg_stream_state *os)
 {
     ogg_stream_reset(os);
-    unsigned char head[] = {
-        'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 
-        1,                //version
-        1,                //nr channels  1 or 2
-        0, 0,             //16 bits, pre-skip
-        0x80, 0xbb, 0, 0, //samplerate, 32 bits, little-endian. 0xbb80 == 48000
-        0, 0,             //gain, 16 bits.  0 recommended
-        0                 // mapping, 0=single stream
-    };
+    unsigned char head[CODEC_HEAD_LEN];
+    memcpy(head, opusHead, CODEC_HEAD_LEN);
     ogg_packet op;
     op.packet     = head;
     op.bytes      = sizeof(head);
@@ -74,24 +82,64 @@ static void sendHeader(ogg_stream_state *os)
 
 
 Codec *codecCreate()
+{
+    return codecCreateEncoding(CODEC_OPUS_AUTO);
+}
+
+
+/**
+ * The bitrate for each Opus encoding
+ */
+static int codecBitrate(int encoding)
+{
+    switch (encoding)
+        {
+        case ENCODING_OPUS_16K: return 16000;
+        case ENCODING_OPUS_32K: return 32000;
+        case ENCODING_OPUS_64K: return 64000;
+        default: return OPUS_AUTO;
+        }
+}
+
+
+static int codecIsPcm(int encoding)
+{
+    return encoding == ENCODING_PCM16 || encoding == ENCODING_ULAW;
+}
+
+
+Codec *codecCreateEncoding(int encoding)
 {
     Codec *obj = (Codec *)malloc(sizeof(Codec));
     if (!obj)
         return NULL;
     memset(obj, 0, sizeof(Codec));
-    int err;
-    obj->enc = opus_encoder_create(48000, 1, OPUS_APPLICATION_AUDIO, &err);
-    if (err != OPUS_OK || obj->enc==NULL)
+    obj->encoding = encoding;
+    if (ogg_stream_init(&(obj->os), 1) < 0)
         {
         free(obj);
         return NULL;
         }
-    if (ogg_stream_init(&(obj->os), 1) < 0)
+    if (codecIsPcm(encoding))
+        {
+        //nothing to set up, so no need for Ogg either
+        obj->format    = CODEC_RAW;
+        obj->current   = CODEC_RAW;
+        obj->frameSize = CODEC_RAW_FRAME;
+        return obj;
+        }
+    int err;
+    obj->enc = opus_encoder_create(48000, 1, OPUS_APPLICATION_AUDIO, &err);
+    if (err != OPUS_OK || obj->enc==NULL)
         {
-        opus_encoder_destroy(obj->enc);
+        ogg_stream_clear(&(obj->os));
         free(obj);
         return NULL;
         }
+    opus_encoder_ctl(obj->enc, OPUS_SET_BITRATE(codecBitrate(encoding)));
+    obj->format    = CODEC_OGG;
+    obj->current   = CODEC_OGG;
+    obj->frameSize = FRAME_SIZE;
     sendHeader(&(obj->os));
     return obj;
 }
@@ -102,72 +150,220 @@ void codecDelete(Codec *obj)
 {
     if (obj)
         {
-        opus_encoder_destroy(obj->enc);
+        if (obj->enc)
+            opus_encoder_destroy(obj->enc);
         ogg_stream_clear(&(obj->os));
         free(obj);
         }
 }
 
 
-static void dumpBuf(unsigned char *buf, int len)
+void codecReset(Codec *obj)
+{
+    obj->inbufPtr      = 0;
+    obj->packetCount   = 0;
+    obj->seq           = 0;
+    obj->timestamp     = 0;
+    obj->silent        = FALSE;
+    obj->silentSamples = 0;
+    if (obj->enc)
+        {
+        opus_encoder_ctl(obj->enc, OPUS_RESET_STATE);
+        //drops the packets bundled so far, and begins a new stream
+        sendHeader(&(obj->os));
+        }
+}
+
+
+void codecSetFormat(Codec *obj, int format)
+{
+    if (codecIsPcm(obj->encoding))
+        return;
+    __atomic_store_n(&(obj->format), format, __ATOMIC_RELAXED);
+}
+
+
+int codecHeader(Codec *obj, unsigned char *buf)
+{
+    memcpy(buf, opusHead, CODEC_HEAD_LEN);
+    return CODEC_HEAD_LEN;
+}
+
+
+static void putLong(unsigned char *buf, unsigned int val)
+{
+    buf[0] = val & 0xff;
+    buf[1] = (val >> 8) & 0xff;
+    buf[2] = (val >> 16) & 0xff;
+    buf[3] = (val >> 24) & 0xff;
+}
+
+
+/**
+ * Send a CODEC_RAW packet, whose payload is already in place after
+ * the room left for its header.  With no payload, it marks silence.
+ */
+static void codecPacket(Codec *obj, int len, int samples, ByteOutputFunc *func, void *context)
+{
+    unsigned char *buf = obj->opusbuf;
+    putLong(buf, obj->seq++);
+    putLong(buf + 4, obj->timestamp);
+    obj->timestamp += samples;
+    if (func)
+        (*func)(buf, CODEC_RAW_HEADER + len, context);
+}
+
+
+/**
+ * G.711 mu-law, from a sample in -1..1
+ */
+static unsigned char ulaw(float v)
+{
+    int pcm = (int)(v * 32767.0);
+    if (pcm > 32767)
+        pcm = 32767;
+    else if (pcm < -32768)
+        pcm = -32768;
+    int sign = (pcm < 0) ? 0x80 : 0;
+    if (sign)
+        pcm = -pcm;
+    pcm += 0x84;  //bias, so that every segment has a leading 1
+    if (pcm > 0x7fff)
+        pcm = 0x7fff;
+    int exponent = 7;
+    for (int mask = 0x4000 ; !(pcm & mask) && exponent > 0 ; mask >>= 1)
+        exponent--;
+    int mantissa = (pcm >> (exponent + 3)) & 0x0f;
+    return ~(sign | (exponent << 4) | mantissa);
+}
+
+
+/**
+ * The frame in inbuf as PCM, into packet
+ * @return the number of bytes
+ */
+static int codecPcm(Codec *obj, unsigned char *packet)
+{
+    float *in = obj->inbuf;
+    int n = obj->frameSize;
+    if (obj->encoding == ENCODING_ULAW)
+        {
+        for (int i = 0 ; i < n ; i++)
+            packet[i] = ulaw(in[i]);
+        return n;
+        }
+    for (int i = 0 ; i < n ; i++)
+        {
+        float v = in[i] * 32767.0;
+        int pcm = (v > 32767.0) ? 32767 : (v < -32768.0) ? -32768 : (int)v;
+        packet[2 * i]     = pcm & 0xff;
+        packet[2 * i + 1] = (pcm >> 8) & 0xff;
+        }
+    return 2 * n;
+}
+
+
+/**
+ * Encode the frame in inbuf, into the Ogg stream or straight out
+ */
+static void codecFrame(Codec *obj, ByteOutputFunc *func, void *context)
+{
+    unsigned char *packet = obj->opusbuf + CODEC_RAW_HEADER;
+    int len;
+    if (!obj->enc)
+        len = codecPcm(obj, packet);
+    else
+        len = opus_encode_float(obj->enc, obj->inbuf, obj->frameSize, packet, OPUS_PACKET);
+    if (len < 0)
+        {
+        error("codec: %s", opus_strerror(len));
+        len = 0;
+        }
+    if (obj->current == CODEC_RAW)
+        {
+        codecPacket(obj, len, obj->frameSize, func, context);
+        return;
+        }
+    ogg_packet op;
+    op.packet = packet;
+    op.bytes  = len;
+    op.b_o_s=0;
+    op.e_o_s=0;
+    op.granulepos=0;
+    op.packetno=0; //currently ignored by libogg
+    ogg_stream_packetin(&(obj->os), &op);
+    obj->packetCount++;
+}
+
+
+/**
+ * End the Ogg stream, send it, and start the next one
+ */
+static void codecBundle(Codec *obj, ByteOutputFunc *func, void *context)
 {
-    FILE *f = fopen("dump.opus", "wb");
-    fwrite(buf, 1, len, f);
-    fclose(f);
+    obj->packetCount = 0;
+    ogg_packet op;
+    op.packet = obj->opusbuf;
+    op.bytes  = 0;
+    op.b_o_s=0;
+    op.e_o_s=1;
+    op.granulepos=0;
+    op.packetno=0; //currently ignored by libogg
+    ogg_stream_packetin(&(obj->os), &op);
+    ogg_page page;
+    unsigned char *buf = obj->oggbuf;
+    unsigned char *b = buf;
+    while (ogg_stream_flush(&(obj->os), &page))
+        {
+        memcpy(b, page.header, page.header_len);
+        b += page.header_len;
+        memcpy(b, page.body, page.body_len);
+        b += page.body_len;
+        }
+    int bufsize = b - buf;
+    if (func)
+        (*func)(buf, bufsize, context);
+    sendHeader(&(obj->os));
 }
 
 
+/**
+ * Between frames, pick up a change of format, sending off anything
+ * bundled in the old one
+ */
+static void codecPrepare(Codec *obj, ByteOutputFunc *func, void *context)
+{
+    int format = __atomic_load_n(&(obj->format), __ATOMIC_RELAXED);
+    if (format == obj->current)
+        return;
+    if (obj->packetCount > 0)
+        codecBundle(obj, func, context);
+    obj->current   = format;
+    obj->frameSize = (format == CODEC_RAW) ? CODEC_RAW_FRAME : FRAME_SIZE;
+}
+
 
 int codecEncode(Codec *obj, float *data, int datalen, ByteOutputFunc *func, void *context)
 {
     float *inbuf = obj->inbuf;
     int inptr    = obj->inbufPtr;
+    obj->silent  = FALSE;
     
     while (datalen--)
         {
+        if (!inptr)
+            {
+            codecPrepare(obj, func, context);
+            if (!obj->packetCount)
+                obj->outStamp = obj->stamp;
+            }
         inbuf[inptr++] = *data++;
-        if (inptr >= FRAME_SIZE)
+        if (inptr >= obj->frameSize)
             {
             inptr = 0;
-            int len = opus_encode_float(obj->enc, inbuf, FRAME_SIZE, obj->opusbuf, OPUS_PACKET);
-            ogg_packet op;
-            op.packet = obj->opusbuf;
-            op.bytes  = len;
-            op.b_o_s=0;
-            op.e_o_s=0;
-            op.granulepos=0;
-            op.packetno=0; //currently ignored by libogg
-            ogg_stream_packetin(&(obj->os), &op);
-            obj->packetCount++;
-            if (obj->packetCount >= 16)
-                {
-                obj->packetCount = 0;
-                ogg_packet op;
-                op.packet = obj->opusbuf;
-                op.bytes  = 0;
-                op.b_o_s=0;
-                op.e_o_s=1;
-                op.granulepos=0;
-                op.packetno=0; //currently ignored by libogg
-                ogg_stream_packetin(&(obj->os), &op);
-                ogg_page page;
-                unsigned char *buf = obj->oggbuf;
-                unsigned char *b = buf;
-                while (ogg_stream_flush(&(obj->os), &page))
-                    {
-                    memcpy(b, page.header, page.header_len);
-                    b += page.header_len;
-                    memcpy(b, page.body, page.body_len);
-                    b += page.body_len;
-                    }
-                int bufsize = b - buf;
-                for (int i = 0 ; i < 50 ; i++)
-                    printf("%d : %02x %c\n", i, buf[i], buf[i]);
-                dumpBuf(buf, bufsize);
-                if (func)
-                    (*func)(buf, bufsize, context);
-                sendHeader(&(obj->os));
-                }
+            codecFrame(obj, func, context);
+            if (obj->packetCount >= CODEC_BUNDLE)
+                codecBundle(obj, func, context);
             }
         }
         
@@ -177,5 +373,61 @@ int codecEncode(Codec *obj, float *data, int datalen, ByteOutputFunc *func, void
 }
 
 
+/**
+ * Mark silence, in whichever format is in use
+ */
+static void codecMarker(Codec *obj, ByteOutputFunc *func, void *context)
+{
+    if (obj->current == CODEC_RAW)
+        codecPacket(obj, 0, 0, func, context);
+    else if (func)
+        (*func)((unsigned char *)CODEC_SILENCE, CODEC_SILENCE_LEN, context);
+}
 
 
+int codecSilence(Codec *obj, int samples, ByteOutputFunc *func, void *context)
+{
+    if (!obj->silent)
+        {
+        if (obj->inbufPtr > 0)
+            {
+            memset(obj->inbuf + obj->inbufPtr, 0, (obj->frameSize - obj->inbufPtr) * sizeof(float));
+            obj->inbufPtr = 0;
+            codecFrame(obj, func, context);
+            }
+        if (obj->packetCount > 0)
+            codecBundle(obj, func, context);
+        codecPrepare(obj, func, context);
+        obj->silent        = TRUE;
+        obj->silentSamples = 0;
+        codecMarker(obj, func, context);
+        }
+    //the timestamps count the silence too, so that the audio after it
+    //lines up
+    if (obj->current == CODEC_RAW)
+        obj->timestamp += samples;
+    int span = obj->frameSize * CODEC_BUNDLE;
+    obj->silentSamples += samples;
+    while (obj->silentSamples >= span)
+        {
+        obj->silentSamples -= span;
+        codecMarker(obj, func, context);
+        }
+    return TRUE;
+}
+
+
+int codecSkip(Codec *obj, int samples, ByteOutputFunc *func, void *context)
+{
+    if (obj->inbufPtr > 0)
+        {
+        memset(obj->inbuf + obj->inbufPtr, 0, (obj->frameSize - obj->inbufPtr) * sizeof(float));
+        obj->inbufPtr = 0;
+        codecFrame(obj, func, context);
+        if (obj->packetCount >= CODEC_BUNDLE)
+            codecBundle(obj, func, context);
+        }
+    if (obj->current == CODEC_RAW)
+        obj->timestamp += samples;
+    return TRUE;
+}
@@ -1,3 +1,5 @@
+#ifndef _CODEC_H_
+#define _CODEC_H_
 /**
  * Audio codec definitions and implementations.
  * 
@@ -40,26 +42,82 @@
 #define OPUS_PACKET (1024 * 16)
 #define OGG_PACKET (1024 * 16)
 #define FRAME_SIZE (2880)
+
+/**
+ * Frames per Ogg stream sent to the client
+ */
+#define CODEC_BUNDLE (16)
+
+/**
+ * With CODEC_RAW, each packet is sent as soon as it is encoded, so
+ * the frames are shorter:  20ms at 48k
+ */
+#define CODEC_RAW_FRAME (960)
+
+/**
+ * With CODEC_RAW, each packet starts with its sequence number and the
+ * timestamp of its first sample, in samples at the codec's rate, each
+ * 32 bits little-endian.  Both wrap.
+ */
+#define CODEC_RAW_HEADER (8)
+
+/**
+ * The OpusHead packet, which a CODEC_RAW client needs once, when it
+ * connects, to set up its decoder
+ */
+#define CODEC_HEAD_LEN (19)
+
+/**
+ * For codecCreateEncoding(), Opus at whatever bitrate the encoder picks
+ */
+#define CODEC_OPUS_AUTO (-1)
+
+/**
+ * Sent in place of audio while a channel's squelch is closed:  once
+ * when it closes, then once for each bundle's worth of time, so that
+ * a client can tell a quiet channel from a lost one.  An Ogg page
+ * would start with "OggS".  With CODEC_RAW, the marker is instead a
+ * packet with a header and no audio, whose timestamp counts the
+ * silence.
+ */
+#define CODEC_SILENCE     "SLNC"
+#define CODEC_SILENCE_LEN (4)
+
 struct Codec
 {
-    OpusEncoder *enc;
+    int encoding;       //an Encoding, or CODEC_OPUS_AUTO
+    OpusEncoder *enc;   //NULL for the PCM encodings
     ogg_stream_state os;
     float inbuf[FRAME_SIZE];
     int inbufPtr;
     int packetCount;
-    unsigned char opusbuf[OPUS_PACKET];
+    int format;         //CodecFormat, as last requested
+    int current;        //the format in use by the dsp thread
+    int frameSize;      //samples per frame in the current format
+    unsigned int seq;       //of the next CODEC_RAW packet
+    unsigned int timestamp; //of the next CODEC_RAW packet
+    unsigned char opusbuf[CODEC_RAW_HEADER + OPUS_PACKET]; //room for the raw header first
     int oggSerial;
     unsigned char oggbuf[OGG_PACKET];
+    int silent;         //TRUE since codecSilence() took over from codecEncode()
+    int silentSamples;  //since the last silence marker
+    long long stamp;    //acquisition time of the data passed to codecEncode()
+    long long outStamp; //acquisition time of the oldest sample in the output
 };
 
 
 
 
 /**
- *
+ * Create a codec for Opus at whatever bitrate the encoder picks
  */
 Codec *codecCreate();
 
+/**
+ * Create a codec for one of the Encoding values, or CODEC_OPUS_AUTO
+ */
+Codec *codecCreateEncoding(int encoding);
+
 
 
 /**
@@ -73,6 +131,44 @@ void codecDelete(Codec *obj);
  */
 int codecEncode(Codec *obj, float *data, int datalen, ByteOutputFunc *func, void *context);
 
+/**
+ * Drop any partial frame and bundle, and start the stream over from
+ * sequence 0, as for a new client.  Only call this from the thread
+ * that encodes.
+ */
+void codecReset(Codec *obj);
+
+/**
+ * Choose between bundles of frames in Ogg streams and packets sent
+ * one at a time.  This may be called from any thread.  It takes
+ * effect at the next frame, after sending what was bundled so far.
+ * @param format CODEC_OGG or CODEC_RAW
+ */
+void codecSetFormat(Codec *obj, int format);
+
+/**
+ * Get the OpusHead packet for a CODEC_RAW client
+ * @param buf receives CODEC_HEAD_LEN bytes
+ * @return the number of bytes
+ */
+int codecHeader(Codec *obj, unsigned char *buf);
 
+/**
+ * Account for samples skipped by a closed squelch.  The first call
+ * after codecEncode() finishes off the audio so far, padded out to a
+ * whole frame, and sends it before the first marker.
+ * @param samples how many samples at the audio rate were skipped
+ */
+int codecSilence(Codec *obj, int samples, ByteOutputFunc *func, void *context);
+
+/**
+ * Account for samples dropped before they reached the codec.  The
+ * audio so far is finished off as for codecSilence(), but no marker is
+ * sent, so a CODEC_RAW client sees a jump in the timestamps, and can
+ * tell the gap from a closed squelch.
+ * @param samples how many samples at the audio rate were dropped
+ */
+int codecSkip(Codec *obj, int samples, ByteOutputFunc *func, void *context);
 
 
+#endif /* _CODEC_H_ */
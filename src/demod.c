@@ -25,7 +25,12 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "demod.h"
+#include "agc.h"
+#include "filter.h"
+#include "kernel.h"
+#include "samplerate.h"
 #include "private.h"
 
 
@@ -39,27 +44,58 @@ Demodulator *demodNullCreate()
     Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
     if (!dem)
         return NULL;
+    memset(dem, 0, sizeof(Demodulator));
     dem->update  = nullDemodulate;
     return dem;
 }
 
+/**
+ * The plain demodulators work a block at a time, and pass on what each
+ * input block makes in one call.  Only a block longer than outBuf
+ * takes more than one.
+ */
 static void amDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
 {
-    int bufPtr = dem->bufPtr;
-    float *buf = dem->outBuf;
-    while (size--)
+    dem->outStamp = dem->stamp;
+    while (size > 0)
         {
-        float complex cpx = *data++;
-        float v = cabsf(cpx);
-        //trace("v:%f",v);
-        buf[bufPtr++] = v;
-        if (bufPtr >= DEMOD_BUFSIZE)
+        int n = (size < DEMOD_BUFSIZE) ? size : DEMOD_BUFSIZE;
+        kernels.magnitude(dem->outBuf, data, n);
+        if (dem->agc)
+            agcUpdate(dem->agc, dem->outBuf, n);
+        func(dem->outBuf, n, context);
+        data += n;
+        size -= n;
+        }
+}
+
+
+/**
+ * Envelope, less its dc, which is mostly the carrier
+ */
+static void amFused(Demodulator *dem, float complex *data, int size,
+                    Resampler *resampler, FloatOutputFunc *func, void *context)
+{
+    float tile[DEMOD_TILE];
+    float alpha = dem->alpha;
+    float dc    = dem->state;
+    resampler->stamp = dem->stamp;
+    while (size > 0)
+        {
+        int n = (size < DEMOD_TILE) ? size : DEMOD_TILE;
+        kernels.magnitude(tile, data, n);
+        for (int i = 0 ; i < n ; i++)
             {
-            func(buf, DEMOD_BUFSIZE, context); 
-            bufPtr = 0;
+            dc += alpha * (tile[i] - dc);
+            tile[i] -= dc;
             }
+        if (dem->agc)
+            agcUpdate(dem->agc, tile, n);
+        resamplerUpdate(resampler, tile, n, func, context);
+        data += n;
+        size -= n;
         }
-    dem->bufPtr  = bufPtr;
+    dem->state = dc;
 }
 
 
@@ -68,41 +104,81 @@ Demodulator *demodAmCreate()
     Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
     if (!dem)
         return NULL;
-    dem->bufPtr  = 0;
+    memset(dem, 0, sizeof(Demodulator));
     dem->lastVal = 0;
     dem->update  = amDemodulate;
+    dem->fused   = amFused;
+    dem->tau     = 1.0 / (TWOPI * DEMOD_DC_CUTOFF);
     return dem;
 }
 
 static void fmDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
 {
-    int bufPtr = dem->bufPtr;
-    float *buf = dem->outBuf;
+    float complex prod[DEMOD_TILE];
     float complex lastVal = dem->lastVal;
-    while (size--)
+    dem->outStamp = dem->stamp;
+    while (size > 0)
         {
-        float complex cpx = *data++;
-        float complex prod = cpx * conj(lastVal);
-        lastVal = cpx;
-        
-        // limit (remove the amplitude variations)
-        float m = cabsf(prod);
-        if (m > 0.0)
-            prod /= m;
-            
-        //get the angle
-        float v = cargf(prod);
-        
-        //trace("v:%f",v);
-        buf[bufPtr++] = v;
-        if (bufPtr >= DEMOD_BUFSIZE)
+        int n = (size < DEMOD_BUFSIZE) ? size : DEMOD_BUFSIZE;
+        for (int done = 0 ; done < n ; done += DEMOD_TILE)
             {
-            func(buf, DEMOD_BUFSIZE, context); 
-            bufPtr = 0;
+            int t = (n - done < DEMOD_TILE) ? n - done : DEMOD_TILE;
+            //the angle does not depend on the amplitude, so no need to limit
+            for (int i = 0 ; i < t ; i++)
+                {
+                float complex cpx = data[done + i];
+                prod[i] = cpx * conjf(lastVal);
+                lastVal = cpx;
+                }
+            kernels.phase(dem->outBuf + done, prod, t);
             }
+        func(dem->outBuf, n, context);
+        data += n;
+        size -= n;
         }
     dem->lastVal = lastVal;
-    dem->bufPtr  = bufPtr;
+}
+
+
+/**
+ * Phase difference between samples, through the de-emphasis filter.
+ * The angle does not depend on the amplitude, so there is no need
+ * to limit first.
+ */
+static void fmFused(Demodulator *dem, float complex *data, int size,
+                    Resampler *resampler, FloatOutputFunc *func, void *context)
+{
+    float tile[DEMOD_TILE];
+    float complex prod[DEMOD_TILE];
+    float lastRe = crealf(dem->lastVal);
+    float lastIm = cimagf(dem->lastVal);
+    float alpha  = (dem->alpha > 0.0) ? dem->alpha : 1.0;
+    float y      = dem->state;
+    resampler->stamp = dem->stamp;
+    while (size > 0)
+        {
+        int n = (size < DEMOD_TILE) ? size : DEMOD_TILE;
+        for (int i = 0 ; i < n ; i++)
+            {
+            float re = crealf(data[i]);
+            float im = cimagf(data[i]);
+            //cpx * conj(lastVal)
+            prod[i] = (re * lastRe + im * lastIm) + (im * lastRe - re * lastIm) * I;
+            lastRe = re;
+            lastIm = im;
+            }
+        kernels.phase(tile, prod, n);
+        for (int i = 0 ; i < n ; i++)
+            {
+            y += alpha * (tile[i] - y);
+            tile[i] = y;
+            }
+        resamplerUpdate(resampler, tile, n, func, context);
+        data += n;
+        size -= n;
+        }
+    dem->lastVal = lastRe + lastIm * I;
+    dem->state   = y;
 }
 
                 
@@ -111,77 +187,328 @@ Demodulator *demodFmCreate()
     Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
     if (!dem)
         return NULL;
-    dem->bufPtr  = 0;
+    memset(dem, 0, sizeof(Demodulator));
     dem->lastVal = 0;
     dem->update  = fmDemodulate;
+    dem->fused   = fmFused;
+    dem->tau     = DEMOD_DEEMPHASIS;
     return dem;
 }
 
-static void lsbDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
+/**
+ * The decimation from the ddc rate to the split
+ */
+static int wfmFactor(float rate)
+{
+    int factor = (int)(rate / WFM_AUDIO_RATE);
+    return (factor > 1) ? factor : 1;
+}
+
+
+/**
+ * Start the pilot loop over, at 19khz and unlocked
+ */
+static void wfmResetLoop(Demodulator *dem)
+{
+    dem->pilot      = 1.0;
+    dem->pilotOmega = (dem->rate > 0.0) ? TWOPI * WFM_PILOT_FREQ / dem->rate : 0.0;
+    dem->pilotStep  = cos(dem->pilotOmega) + sin(dem->pilotOmega) * I;
+    dem->pilotLp    = 0.0;
+    dem->pilotCount = 0;
+    dem->locked     = FALSE;
+    dem->deemph     = 0.0;
+    dem->phase      = 0;
+}
+
+
+static void wfmTune(Demodulator *dem)
+{
+    float rate = dem->rate;
+    dem->factor = wfmFactor(rate);
+    wfmResetLoop(dem);
+    if (rate <= 0.0)
+        return;
+    dem->scale      = rate / (TWOPI * WFM_DEVIATION);
+    dem->pilotAlpha = 1.0 - exp(-TWOPI * WFM_PILOT_BW / rate);
+    float outRate   = rate / dem->factor;
+    dem->alpha = (dem->tau > 0.0) ? 1.0 - exp(-1.0 / (dem->tau * outRate)) : 0.0;
+    firSetLP(dem->fir, WFM_AUDIO_CUTOFF, rate, W_BLACKMAN);
+}
+
+
+/**
+ * Broadcast FM stereo.  The multiplex is the sum, the 19khz pilot, and
+ * the difference on a 38khz subcarrier at twice the pilot's phase:
+ *
+ *     (L + R) + p sin(wt) + (L - R) sin(2wt)
+ *
+ * The discriminator and the pilot loop run at the ddc rate, which they
+ * must, but they are cheap.  Each sample is paired with its product
+ * with the subcarrier, as real and imaginary, and one complex lowpass
+ * takes both down to the audio rate, computing only the outputs it
+ * keeps.  The sum and difference become left and right, and are
+ * de-emphasized, only at that rate.
+ */
+static void wfmStereo(Demodulator *dem, float complex *data, int size,
+                      Resampler *resampler, ComplexOutputFunc *func, void *context)
 {
-    int bufPtr = dem->bufPtr;
-    float *buf = dem->outBuf;
-    while (size--)
+    float tile[DEMOD_TILE];
+    float complex prod[DEMOD_TILE];
+    float complex out[DEMOD_TILE];
+    float complex lastVal   = dem->lastVal;
+    float complex pilot     = dem->pilot;
+    float complex pilotStep = dem->pilotStep;
+    float complex lp        = dem->pilotLp;
+    float pilotAlpha = dem->pilotAlpha;
+    float scale      = dem->scale;
+    int   count      = dem->pilotCount;
+    int   locked     = dem->locked;
+    int   stereoOk   = (dem->rate >= WFM_MIN_RATE);
+    float center     = (dem->rate > 0.0) ? TWOPI * WFM_PILOT_FREQ / dem->rate : 0.0;
+    float pull       = (dem->rate > 0.0) ? TWOPI * WFM_PILOT_PULL / dem->rate : 0.0;
+    float alpha      = (dem->alpha > 0.0) ? dem->alpha : 1.0;
+    float complex y  = dem->deemph;
+    resampler->stamp = dem->stamp;
+    while (size > 0)
         {
-        float complex cpx = *data++;
-        float v = creal(cpx) - cimag(cpx);
-        //trace("v:%f",v);
-        buf[bufPtr++] = v;
-        if (bufPtr >= DEMOD_BUFSIZE)
+        int n = (size < DEMOD_TILE) ? size : DEMOD_TILE;
+        for (int i = 0 ; i < n ; i++)
+            {
+            prod[i] = data[i] * conjf(lastVal);
+            lastVal = data[i];
+            }
+        kernels.phase(tile, prod, n);
+        for (int i = 0 ; i < n ; i++)
+            {
+            float m = tile[i] * scale;
+            pilot *= pilotStep;
+            lp += pilotAlpha * (m * conjf(pilot) - lp);
+            //locked, the pilot is a quarter turn ahead of the oscillator,
+            //so the subcarrier is -sin(2 * oscillator)
+            float sub = -2.0 * crealf(pilot) * cimagf(pilot);
+            prod[i] = (locked) ? m + 2.0 * m * sub * I : m;
+            if (++count >= WFM_PLL_BLOCK)
+                {
+                count = 0;
+                float mag = cabsf(lp);
+                //lp is half the pilot's amplitude
+                locked = (stereoOk && mag > WFM_PILOT_MIN * 0.5);
+                if (mag > 0.0)
+                    {
+                    float err = cimagf(lp) / mag;
+                    float omega = dem->pilotOmega + WFM_PLL_GAIN * WFM_PLL_GAIN * 0.25 * err;
+                    omega = (omega > center + pull) ? center + pull :
+                            (omega < center - pull) ? center - pull : omega;
+                    dem->pilotOmega = omega;
+                    pilotStep = cosf(omega) + sinf(omega) * I;
+                    float turn = WFM_PLL_GAIN * err;
+                    pilot *= cosf(turn) + sinf(turn) * I;
+                    pilot /= cabsf(pilot);
+                    }
+                }
+            }
+        int outs = firDecimateC(dem->fir, out, prod, n, dem->factor, &(dem->phase));
+        for (int i = 0 ; i < outs ; i++)
             {
-            func(buf, DEMOD_BUFSIZE, context); 
-            bufPtr = 0;
+            float s = crealf(out[i]);
+            float d = cimagf(out[i]);
+            y += alpha * ((0.5 * (s + d) + 0.5 * (s - d) * I) - y);
+            out[i] = y;
             }
+        if (outs)
+            resamplerUpdateC(resampler, out, outs, func, context);
+        data += n;
+        size -= n;
         }
-    dem->bufPtr  = bufPtr;
+    dem->lastVal    = lastVal;
+    dem->pilot      = pilot;
+    dem->pilotStep  = pilotStep;
+    dem->pilotLp    = lp;
+    dem->pilotCount = count;
+    dem->locked     = locked;
+    dem->deemph     = y;
 }
 
 
-Demodulator *demodLsbCreate()
+/**
+ * Without a stereo path to take it, this plays the plain discriminator
+ */
+Demodulator *demodWfmCreate()
 {
     Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
     if (!dem)
         return NULL;
-    dem->bufPtr  = 0;
-    dem->lastVal = 0;
-    dem->update  = lsbDemodulate;
+    memset(dem, 0, sizeof(Demodulator));
+    dem->fir = firCreate(WFM_TAPS);
+    if (!dem->fir)
+        {
+        free(dem);
+        return NULL;
+        }
+    dem->update = fmDemodulate;
+    dem->stereo = wfmStereo;
+    dem->tau    = DEMOD_DEEMPHASIS;
+    dem->factor = 1;
+    wfmResetLoop(dem);
     return dem;
 }
 
-static void usbDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
+
+/**
+ * Weaver's method.  Mix the middle of our sideband down to 0, and
+ * lowpass to half its width, which takes out the other sideband and
+ * anything beyond ours.  Then mix back up, and the real part is the audio.
+ */
+static void ssbDemodulate(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context)
 {
-    int bufPtr = dem->bufPtr;
-    float *buf = dem->outBuf;
-    while (size--)
+    float complex tile[DEMOD_TILE];
+    Fir *fir = dem->fir;
+    dem->outStamp = dem->stamp;
+    while (size > 0)
         {
-        float complex cpx = *data++;
-        float v = creal(cpx) + cimag(cpx);
-        //trace("v:%f",v);
-        buf[bufPtr++] = v * 100.0;
-        if (bufPtr >= DEMOD_BUFSIZE)
+        int n = (size < DEMOD_BUFSIZE) ? size : DEMOD_BUFSIZE;
+        float *out = dem->outBuf;
+        if (dem->silent)
+            memset(out, 0, n * sizeof(float));
+        else
             {
-            func(buf, DEMOD_BUFSIZE, context); 
-            bufPtr = 0;
+            for (int done = 0 ; done < n ; done += DEMOD_TILE)
+                {
+                int t = (n - done < DEMOD_TILE) ? n - done : DEMOD_TILE;
+                kernels.rotate(tile, data + done, t, &(dem->downPhase), dem->downStep);
+                for (int i = 0 ; i < t ; i++)
+                    tile[i] = firUpdateC(fir, tile[i]);
+                kernels.rotate(tile, tile, t, &(dem->upPhase), dem->upStep);
+                for (int i = 0 ; i < t ; i++)
+                    out[done + i] = crealf(tile[i]);
+                }
+            //heal
+            dem->downPhase /= cabsf(dem->downPhase);
+            dem->upPhase   /= cabsf(dem->upPhase);
+            if (dem->agc)
+                agcUpdate(dem->agc, out, n);
             }
+        func(out, n, context);
+        data += n;
+        size -= n;
         }
-    dem->bufPtr  = bufPtr;
 }
 
 
-Demodulator *demodUsbCreate()
+/**
+ * Set the mixers and the lowpass for the part of the passband on our side
+ */
+static void ssbTune(Demodulator *dem)
+{
+    float lo = dem->pbLo;
+    float hi = dem->pbHi;
+    if (dem->sideband > 0)
+        {
+        lo = (lo > 0.0) ? lo : 0.0;
+        hi = (hi > 0.0) ? hi : 0.0;
+        }
+    else
+        {
+        lo = (lo < 0.0) ? lo : 0.0;
+        hi = (hi < 0.0) ? hi : 0.0;
+        }
+    float half = (hi - lo) * 0.5;
+    dem->silent = (half <= 0.0 || dem->rate <= 0.0);
+    if (dem->silent)
+        return;
+    float omega = TWOPI * (lo + hi) * 0.5 / dem->rate;
+    dem->downStep = cos(omega) - sin(omega) * I;
+    dem->upStep   = cos(omega) + sin(omega) * I;
+    firSetLP(dem->fir, half, dem->rate, W_BLACKMAN);
+}
+
+
+static Demodulator *ssbCreate(int sideband)
 {
     Demodulator *dem = (Demodulator *)smalloc(sizeof(Demodulator));
     if (!dem)
         return NULL;
-    dem->bufPtr  = 0;
-    dem->lastVal = 0;
-    dem->update  = usbDemodulate;
+    memset(dem, 0, sizeof(Demodulator));
+    dem->fir = firCreate(DEMOD_SSB_TAPS);
+    if (!dem->fir)
+        {
+        free(dem);
+        return NULL;
+        }
+    dem->update    = ssbDemodulate;
+    dem->sideband  = sideband;
+    dem->silent    = TRUE;
+    dem->downPhase = 1.0;
+    dem->upPhase   = 1.0;
     return dem;
 }
 
 
+Demodulator *demodLsbCreate()
+{
+    return ssbCreate(-1);
+}
+
+
+Demodulator *demodUsbCreate()
+{
+    return ssbCreate(1);
+}
+
+
 void demodDelete(Demodulator *dem)
 {
+    if (dem)
+        firDelete(dem->fir);
     free(dem);
 }
 
+
+void demodReset(Demodulator *dem)
+{
+    dem->lastVal = 0;
+    dem->state   = 0.0;
+    if (dem->fir)
+        firReset(dem->fir);
+    if (dem->agc)
+        agcReset(dem->agc);
+    if (dem->stereo)
+        wfmResetLoop(dem);
+}
+
+
+void demodSetRate(Demodulator *dem, float rate)
+{
+    dem->rate  = rate;
+    dem->alpha = (rate > 0.0 && dem->tau > 0.0) ? 1.0 - exp(-1.0 / (dem->tau * rate)) : 0.0;
+    if (dem->sideband)
+        ssbTune(dem);
+    if (dem->stereo)
+        wfmTune(dem);
+}
+
+
+void demodSetPassband(Demodulator *dem, float pbLo, float pbHi)
+{
+    dem->pbLo = pbLo;
+    dem->pbHi = pbHi;
+    if (dem->sideband)
+        ssbTune(dem);
+}
+
+
+void demodSetDeemphasis(Demodulator *dem, float tau)
+{
+    //the AM demodulator uses tau for its dc tracker
+    if (dem->update == fmDemodulate)
+        {
+        dem->tau = tau;
+        demodSetRate(dem, dem->rate);
+        }
+}
+
+
+float demodOutRate(Demodulator *dem, float rate)
+{
+    return (dem->stereo) ? rate / wfmFactor(rate) : rate;
+}
@@ -35,13 +35,123 @@
 
 #define DEMOD_BUFSIZE (16384)
 
+/**
+ * The fused kernels demodulate this many samples at a time into a
+ * buffer small enough to stay in L1, and hand it straight to the resampler
+ */
+#define DEMOD_TILE (256)
+
+/**
+ * FM broadcast de-emphasis time constant.  75us in the Americas
+ * and Korea, 50us nearly everywhere else.
+ */
+#define DEMOD_DEEMPHASIS (75.0e-6)
+
+/**
+ * The corner of the AM dc blocker, in Hz
+ */
+#define DEMOD_DC_CUTOFF (30.0)
+
+
+/**
+ * Length of the lowpass in the SSB demodulators.  At the usual
+ * rates of a few khz, this gives a transition band of a few hundred hz.
+ */
+#define DEMOD_SSB_TAPS (63)
+
+
+/**
+ * Broadcast FM stereo.  The ddc should give about 250khz, for a
+ * passband of +-100khz.  Below WFM_MIN_RATE there is no room for the
+ * stereo subcarrier, and it plays mono.
+ */
+#define WFM_MIN_RATE (120000.0)
+
+/**
+ * The MPX is split at no less than this rate, the lowest that keeps
+ * the pilot out of the audio
+ */
+#define WFM_AUDIO_RATE (38000.0)
+
+/**
+ * The lowpass that decimates to the audio rate.  It passes the 15khz
+ * audio and stops the pilot at 19khz.
+ */
+#define WFM_TAPS (255)
+#define WFM_AUDIO_CUTOFF (16500.0)
+
+/**
+ * Peak deviation, which is scaled to 1.0
+ */
+#define WFM_DEVIATION (75000.0)
+
+/**
+ * The pilot's smoothed level, relative to full deviation, below which
+ * it plays mono.  A pilot is usually 0.08 to 0.10.
+ */
+#define WFM_PILOT_MIN (0.02)
+
+/**
+ * The pilot loop moves once every WFM_PLL_BLOCK samples, by
+ * WFM_PLL_GAIN of its phase error, and may pull WFM_PILOT_PULL hz
+ * either side of 19khz.  The mixed pilot it locks to is smoothed
+ * to WFM_PILOT_BW hz.
+ */
+#define WFM_PILOT_FREQ (19000.0)
+#define WFM_PLL_BLOCK  (16)
+#define WFM_PLL_GAIN   (0.02)
+#define WFM_PILOT_PULL (20.0)
+#define WFM_PILOT_BW   (400.0)
+
+
+/**
+ * Demodulate, filter and resample to the audio rate in one go
+ */
+typedef void DemodFusedFunc(Demodulator *dem, float complex *data, int size,
+                            Resampler *resampler, FloatOutputFunc *func, void *context);
+
+
+/**
+ * The same, for modes with left and right.  The output is left + right * I.
+ */
+typedef void DemodStereoFunc(Demodulator *dem, float complex *data, int size,
+                             Resampler *resampler, ComplexOutputFunc *func, void *context);
+
 
 struct Demodulator
 {
     void (*update)(Demodulator *dem, float complex *data, int size, FloatOutputFunc *func, void *context);
+    DemodFusedFunc *fused; //NULL if the mode only has update
+    DemodStereoFunc *stereo; //NULL unless the mode gives left and right, and then used instead
     float complex lastVal;
-    int   bufPtr;
+    float rate;    //input rate, set by demodSetRate()
+    float tau;     //time constant of the FM de-emphasis or AM dc tracker, or 0
+    float alpha;   //the filter coefficient for tau at rate, or 0 for no filter
+    float state;   //the filter's last output, or the dc estimate
+    float pbLo;    //the passband, relative to the vfo, set by demodSetPassband()
+    float pbHi;
+    int   sideband;           //SSB:  +1 for upper, -1 for lower, 0 for neither
+    int   silent;             //SSB:  no part of the passband is on our side
+    Fir   *fir;               //SSB:  the lowpass between the two mixers
+    float complex downPhase;  //SSB:  the mixer to and from the middle of the sideband
+    float complex downStep;
+    float complex upPhase;
+    float complex upStep;
+    Agc   *agc;     //levels the output on its way to the resampler, or NULL.  Not owned
+    int   factor;             //WFM:  decimation from the ddc rate to the split
+    int   phase;              //WFM:  input samples since the last output
+    float scale;              //WFM:  radians per sample to deviation
+    float complex pilot;      //WFM:  the oscillator locked to the pilot
+    float complex pilotStep;
+    float pilotOmega;         //WFM:  its frequency, radians per sample
+    float complex pilotLp;    //WFM:  the pilot mixed to 0 and smoothed, for the loop
+    float pilotAlpha;
+    int   pilotCount;         //WFM:  samples until the loop next moves
+    int   locked;             //WFM:  TRUE while there is a pilot, and so stereo
+    float complex deemph;     //WFM:  left and right through the de-emphasis
     float outBuf[DEMOD_BUFSIZE];
+    long long stamp;    //acquisition time of the data passed to update
+    long long outStamp; //acquisition time of the samples passed to func
 };
 
 
@@ -51,8 +161,38 @@ Demodulator *demodAmCreate();
 Demodulator *demodFmCreate();
 Demodulator *demodLsbCreate();
 Demodulator *demodUsbCreate();
+Demodulator *demodWfmCreate();
 void demodDelete(Demodulator *dem);
 
+/**
+ * Forget any state carried from previous samples, such as after a gap in the input
+ */
+void demodReset(Demodulator *dem);
+
+/**
+ * Tell the demodulator its input rate, which its filters need.
+ * A rate of 0 turns the filters off.
+ */
+void demodSetRate(Demodulator *dem, float rate);
+
+/**
+ * Tell the demodulator the passband the ddc gives it, relative to
+ * the vfo.  The SSB demodulators take the part on their side.
+ */
+void demodSetPassband(Demodulator *dem, float pbLo, float pbHi);
+
+
+/**
+ * Set the FM de-emphasis time constant, 75us or 50us, or 0 for none
+ */
+void demodSetDeemphasis(Demodulator *dem, float tau);
+
+/**
+ * The rate a demodulator gives for an input rate.  This is the input
+ * rate, except for WFM, which decimates.
+ */
+float demodOutRate(Demodulator *dem, float rate);
+
 
 #endif /* _DEMOD_H_ */
 
@@ -0,0 +1,497 @@
+/**
+ * FIR filter design from a specification.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "design.h"
+#include "private.h"
+
+
+#define REMEZ_GRID_DENSITY    16
+#define REMEZ_MAX_ITERATIONS  40
+
+
+/**
+ * Turn the dB figures of a spec into linear deviations
+ */
+static void specDeviations(const FilterSpec *spec, double *dp, double *ds)
+{
+    double g = pow(10.0, spec->ripple / 20.0);
+    *dp = (g - 1.0) / (g + 1.0);
+    *ds = pow(10.0, -spec->atten / 20.0);
+}
+
+
+/**
+ * The attenuation a Kaiser window must give.  A bandpass is the
+ * difference of two lowpass designs, whose ripples can add, so it
+ * needs an extra 6dB.
+ */
+static double kaiserAtten(const FilterSpec *spec)
+{
+    double dp, ds;
+    specDeviations(spec, &dp, &ds);
+    double d = (dp < ds) ? dp : ds;
+    if (spec->lo > 0.0)
+        d /= 2.0;
+    return -20.0 * log10(d);
+}
+
+
+static int clampSize(double n)
+{
+    if (n > DESIGN_MAX_TAPS)
+        {
+        trace("filter wants %d taps, limiting to %d", (int)n, DESIGN_MAX_TAPS);
+        n = DESIGN_MAX_TAPS;
+        }
+    int size = (int)ceil(n);
+    if (size < 3)
+        size = 3;
+    return size | 1;
+}
+
+
+int designKaiserSize(const FilterSpec *spec)
+{
+    double a  = kaiserAtten(spec);
+    double df = spec->width / spec->rate;
+    return clampSize((a - 7.95) / (14.36 * df) + 1.0);
+}
+
+
+int designRemezSize(const FilterSpec *spec)
+{
+    double dp, ds;
+    specDeviations(spec, &dp, &ds);
+    double df = spec->width / spec->rate;
+    return clampSize((-20.0 * log10(sqrt(dp * ds)) - 13.0) / (14.6 * df) + 1.0);
+}
+
+
+
+//########################################################################
+//#  K A I S E R
+//########################################################################
+
+/**
+ * Modified Bessel function of the first kind, order 0
+ */
+static double bessel0(double x)
+{
+    double sum  = 1.0;
+    double term = 1.0;
+    double half = x / 2.0;
+    for (int k = 1 ; k < 50 ; k++)
+        {
+        term *= half / k;
+        double t2 = term * term;
+        sum += t2;
+        if (t2 < sum * 1.0e-12)
+            break;
+        }
+    return sum;
+}
+
+
+static double kaiserBeta(double a)
+{
+    if (a > 50.0)
+        return 0.1102 * (a - 8.7);
+    else if (a >= 21.0)
+        return 0.5842 * pow(a - 21.0, 0.4) + 0.07886 * (a - 21.0);
+    else
+        return 0.0;
+}
+
+
+static double sinc(double omega, int i)
+{
+    return (i == 0) ? omega / PI : sin(omega * i) / (PI * i);
+}
+
+
+int designKaiser(const FilterSpec *spec, float *coeffs, int size)
+{
+    if (!(size & 1))
+        {
+        error("designKaiser: size must be odd");
+        return FALSE;
+        }
+    double beta = kaiserBeta(kaiserAtten(spec));
+    double i0beta = bessel0(beta);
+    int center = (size - 1) / 2;
+    //put the cutoffs in the middle of the transition bands
+    double omegaHi = TWOPI * (spec->hi + spec->width / 2.0) / spec->rate;
+    double omegaLo = TWOPI * (spec->lo - spec->width / 2.0) / spec->rate;
+    int bandpass = (spec->lo > 0.0);
+    for (int idx = 0 ; idx < size ; idx++)
+        {
+        int i = idx - center;
+        double v = sinc(omegaHi, i);
+        if (bandpass)
+            v -= sinc(omegaLo, i);
+        double r = (center) ? (double)i / center : 0.0;
+        double w = bessel0(beta * sqrt(1.0 - r * r)) / i0beta;
+        coeffs[idx] = v * w;
+        }
+    //unity gain in the middle of the passband
+    double omegaMid = (bandpass) ? PI * (spec->lo + spec->hi) / spec->rate : 0.0;
+    double gain = 0.0;
+    for (int idx = 0 ; idx < size ; idx++)
+        gain += coeffs[idx] * cos(omegaMid * (idx - center));
+    if (gain != 0.0)
+        {
+        for (int idx = 0 ; idx < size ; idx++)
+            coeffs[idx] /= gain;
+        }
+    return TRUE;
+}
+
+
+
+//########################################################################
+//#  R E M E Z
+//########################################################################
+
+/**
+ * The amplitude response of a symmetric, odd length filter with
+ * M+1 unique taps is a polynomial of degree M in x = cos(omega).
+ * The Remez exchange looks for the M+2 frequencies where the weighted
+ * error reaches its peak, alternating in sign, and the polynomial
+ * that passes through them with equal error.  When those frequencies
+ * stop moving, the filter is the best possible for its length.
+ */
+typedef struct
+{
+    int    count;
+    double *x;       //cos(omega)
+    double *desired;
+    double *weight;
+    int    *band;
+} RemezGrid;
+
+
+/**
+ * Barycentric weights for interpolating through n points
+ */
+static void remezWeights(const double *x, int n, double *w)
+{
+    for (int k = 0 ; k < n ; k++)
+        {
+        double p = 1.0;
+        for (int i = 0 ; i < n ; i++)
+            {
+            if (i != k)
+                p *= 2.0 * (x[k] - x[i]); //the 2 keeps the product in range
+            }
+        w[k] = 1.0 / p;
+        }
+}
+
+
+/**
+ * Evaluate the interpolating polynomial at x
+ */
+static double remezEval(double x, const double *xs, const double *w, const double *y, int n)
+{
+    double num = 0.0;
+    double den = 0.0;
+    for (int k = 0 ; k < n ; k++)
+        {
+        double d = x - xs[k];
+        if (fabs(d) < 1.0e-14)
+            return y[k];
+        double t = w[k] / d;
+        num += t * y[k];
+        den += t;
+        }
+    return num / den;
+}
+
+
+int designRemez(const FilterSpec *spec, float *coeffs, int size, double *deviation)
+{
+    if (!(size & 1) || size < 3)
+        {
+        error("designRemez: size must be odd, and at least 3");
+        return FALSE;
+        }
+    int m = (size - 1) / 2;
+    int r = m + 2;
+    double dp, ds;
+    specDeviations(spec, &dp, &ds);
+    double stopWeight = dp / ds;
+
+    //bands, in cycles per sample, 0 to 0.5
+    double edges[6];
+    double desired[3];
+    double weights[3];
+    int nbands = 0;
+    double lo = spec->lo / spec->rate;
+    double hi = spec->hi / spec->rate;
+    double w  = spec->width / spec->rate;
+    if (lo > 0.0)
+        {
+        edges[0] = 0.0;
+        edges[1] = lo - w;
+        desired[0] = 0.0;
+        weights[0] = stopWeight;
+        nbands++;
+        }
+    edges[2*nbands]   = lo;
+    edges[2*nbands+1] = hi;
+    desired[nbands] = 1.0;
+    weights[nbands] = 1.0;
+    nbands++;
+    edges[2*nbands]   = hi + w;
+    edges[2*nbands+1] = 0.5;
+    desired[nbands] = 0.0;
+    weights[nbands] = stopWeight;
+    nbands++;
+    for (int b = 0 ; b < nbands ; b++)
+        {
+        if (edges[2*b] < 0.0 || edges[2*b+1] > 0.5 || edges[2*b] >= edges[2*b+1])
+            {
+            error("designRemez: bands do not fit between 0 and rate/2");
+            return FALSE;
+            }
+        }
+
+    //the dense grid
+    double step = 0.5 / (REMEZ_GRID_DENSITY * r);
+    int maxGrid = 0;
+    for (int b = 0 ; b < nbands ; b++)
+        maxGrid += (int)((edges[2*b+1] - edges[2*b]) / step) + 2;
+    RemezGrid grid;
+    grid.count   = 0;
+    grid.x       = (double *)malloc(maxGrid * sizeof(double));
+    grid.desired = (double *)malloc(maxGrid * sizeof(double));
+    grid.weight  = (double *)malloc(maxGrid * sizeof(double));
+    grid.band    = (int *)malloc(maxGrid * sizeof(int));
+    double *err   = (double *)malloc(maxGrid * sizeof(double));
+    int    *ext   = (int *)malloc((r + 1) * sizeof(int));
+    int    *cand  = (int *)malloc(maxGrid * sizeof(int));
+    double *ex    = (double *)malloc(r * sizeof(double));
+    double *ey    = (double *)malloc(r * sizeof(double));
+    double *ew    = (double *)malloc(r * sizeof(double));
+    int ret = FALSE;
+    if (!grid.x || !grid.desired || !grid.weight || !grid.band ||
+        !err || !ext || !cand || !ex || !ey || !ew)
+        {
+        error("designRemez: out of memory");
+        goto done;
+        }
+    for (int b = 0 ; b < nbands ; b++)
+        {
+        double f = edges[2*b];
+        while (1)
+            {
+            if (f > edges[2*b+1])
+                f = edges[2*b+1];
+            grid.x[grid.count]       = cos(TWOPI * f);
+            grid.desired[grid.count] = desired[b];
+            grid.weight[grid.count]  = weights[b];
+            grid.band[grid.count]    = b;
+            grid.count++;
+            if (f >= edges[2*b+1])
+                break;
+            f += step;
+            }
+        }
+    if (grid.count < r)
+        {
+        error("designRemez: grid too small");
+        goto done;
+        }
+
+    for (int k = 0 ; k < r ; k++)
+        ext[k] = (int)((double)k * (grid.count - 1) / (r - 1));
+
+    double delta = 0.0;
+    double maxErr = 0.0; //the peak weighted error of the latest polynomial
+    for (int iter = 0 ; iter < REMEZ_MAX_ITERATIONS ; iter++)
+        {
+        //the equal ripple deviation through the current extremals
+        for (int k = 0 ; k < r ; k++)
+            ex[k] = grid.x[ext[k]];
+        remezWeights(ex, r, ew);
+        double num = 0.0;
+        double den = 0.0;
+        double sign = 1.0;
+        for (int k = 0 ; k < r ; k++)
+            {
+            num += ew[k] * grid.desired[ext[k]];
+            den += sign * ew[k] / grid.weight[ext[k]];
+            sign = -sign;
+            }
+        delta = num / den;
+        //the polynomial through the first r-1 of them
+        sign = 1.0;
+        for (int k = 0 ; k < r - 1 ; k++)
+            {
+            ey[k] = grid.desired[ext[k]] - sign * delta / grid.weight[ext[k]];
+            sign = -sign;
+            }
+        remezWeights(ex, r - 1, ew);
+
+        maxErr = 0.0;
+        for (int j = 0 ; j < grid.count ; j++)
+            {
+            double a = remezEval(grid.x[j], ex, ew, ey, r - 1);
+            err[j] = grid.weight[j] * (grid.desired[j] - a);
+            if (fabs(err[j]) > maxErr)
+                maxErr = fabs(err[j]);
+            }
+
+        //local extrema of the error, including the band edges
+        int nc = 0;
+        for (int j = 0 ; j < grid.count ; j++)
+            {
+            double e = err[j];
+            int first = (j == 0 || grid.band[j-1] != grid.band[j]);
+            int last  = (j == grid.count - 1 || grid.band[j+1] != grid.band[j]);
+            int isExt;
+            if (e > 0.0)
+                isExt = (first || e >= err[j-1]) && (last || e > err[j+1]);
+            else
+                isExt = (first || e <= err[j-1]) && (last || e < err[j+1]);
+            if (isExt && fabs(e) >= fabs(delta) * 0.999)
+                {
+                //keep the signs alternating, keeping the larger of a pair
+                if (nc > 0 && ((err[cand[nc-1]] > 0.0) == (e > 0.0)))
+                    {
+                    if (fabs(e) > fabs(err[cand[nc-1]]))
+                        cand[nc-1] = j;
+                    }
+                else
+                    cand[nc++] = j;
+                }
+            }
+        //too many.  drop the smaller one at the ends
+        int start = 0;
+        while (nc - start > r)
+            {
+            if (fabs(err[cand[start]]) < fabs(err[cand[nc-1]]))
+                start++;
+            else
+                nc--;
+            }
+        if (nc - start < r)
+            break; //cannot improve on what we have
+        int changed = FALSE;
+        for (int k = 0 ; k < r ; k++)
+            {
+            if (ext[k] != cand[start + k])
+                changed = TRUE;
+            ext[k] = cand[start + k];
+            }
+        if (!changed || (maxErr - fabs(delta)) < maxErr * 1.0e-4)
+            break;
+        }
+
+    //sample the response at m+1 points, and turn it back into taps
+    {
+    double *amp = (double *)malloc((m + 1) * sizeof(double));
+    if (!amp)
+        {
+        error("designRemez: out of memory");
+        goto done;
+        }
+    for (int j = 0 ; j <= m ; j++)
+        amp[j] = remezEval(cos(PI * j / m), ex, ew, ey, r - 1);
+    for (int k = 0 ; k <= m ; k++)
+        {
+        double sum = 0.0;
+        for (int j = 0 ; j <= m ; j++)
+            {
+            double v = amp[j] * cos(PI * k * j / m);
+            sum += (j == 0 || j == m) ? v / 2.0 : v;
+            }
+        double a = sum * ((k == 0 || k == m) ? 1.0 : 2.0) / m;
+        //a[0] is the center tap, and a[k] is split between the two taps k away
+        if (k == 0)
+            coeffs[m] = a;
+        else
+            coeffs[m - k] = coeffs[m + k] = a / 2.0;
+        }
+    free(amp);
+    }
+    //what was achieved, which is more than delta if it stopped short
+    if (deviation)
+        *deviation = maxErr;
+    ret = TRUE;
+
+    done:
+    free(grid.x);
+    free(grid.desired);
+    free(grid.weight);
+    free(grid.band);
+    free(err);
+    free(ext);
+    free(cand);
+    free(ex);
+    free(ey);
+    free(ew);
+    return ret;
+}
+
+
+
+//########################################################################
+//#  C H O O S E
+//########################################################################
+
+
+int designFilter(const FilterSpec *spec, float *coeffs)
+{
+    if (spec->width <= 0.0 || spec->hi <= spec->lo || spec->hi + spec->width > spec->rate / 2.0)
+        {
+        error("designFilter: impossible spec %f-%f width %f at %f",
+            spec->lo, spec->hi, spec->width, spec->rate);
+        return 0;
+        }
+    int size = designRemezSize(spec);
+    if (size <= REMEZ_MAX_TAPS)
+        {
+        double dp, ds;
+        specDeviations(spec, &dp, &ds);
+        //the estimate is close, but can be a little short
+        for ( ; size <= REMEZ_MAX_TAPS ; size += 2)
+            {
+            double deviation;
+            if (!designRemez(spec, coeffs, size, &deviation))
+                break;
+            if (deviation <= dp)
+                return size;
+            }
+        }
+    size = designKaiserSize(spec);
+    if (!designKaiser(spec, coeffs, size))
+        return 0;
+    return size;
+}
+
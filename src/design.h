@@ -0,0 +1,104 @@
+#ifndef _DESIGN_H_
+#define _DESIGN_H_
+/**
+ * FIR filter design from a specification, rather than from a
+ * size chosen up front.  Given the passband, the width of the
+ * transition band, the ripple allowed in the passband and the
+ * attenuation wanted in the stopband, we estimate the shortest
+ * filter that meets it, and design it either as an equiripple
+ * (Parks-McClellan / Remez exchange) filter or, when that would be
+ * too slow to design, with a Kaiser window.
+ *
+ * All designs are linear phase, with an odd number of taps.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sdrlib.h"
+
+
+/**
+ * The longest filter we will design.  Filters size their delay
+ * lines for this, so that a retune never needs to reallocate.
+ */
+#define DESIGN_MAX_TAPS 4095
+
+/**
+ * Above this, Remez takes too long, and we use a Kaiser window
+ */
+#define REMEZ_MAX_TAPS 255
+
+
+/**
+ * What we want from a filter.  Frequencies are in Hz.
+ * The passband is lo..hi, or 0..hi for a lowpass.  The stopbands
+ * start 'width' Hz beyond each passband edge.
+ */
+typedef struct
+{
+    float lo;     //low passband edge, or 0 for a lowpass
+    float hi;     //high passband edge
+    float width;  //transition band width
+    float ripple; //peak to peak passband ripple, in dB
+    float atten;  //stopband attenuation, in dB
+    float rate;   //sample rate
+} FilterSpec;
+
+
+/**
+ * Estimate the number of taps for a Kaiser window design
+ */
+int designKaiserSize(const FilterSpec *spec);
+
+/**
+ * Estimate the number of taps for an equiripple design
+ */
+int designRemezSize(const FilterSpec *spec);
+
+/**
+ * Design a filter with a Kaiser window
+ * @param size the number of taps, which must be odd
+ * @return TRUE if successful, else FALSE
+ */
+int designKaiser(const FilterSpec *spec, float *coeffs, int size);
+
+/**
+ * Design an equiripple filter with the Remez exchange algorithm
+ * @param size the number of taps, which must be odd
+ * @param deviation if not NULL, receives the peak weighted error achieved,
+ *  which is the passband deviation, with the stopband's scaled to match.
+ *  If the exchange stopped short of converging, this is more than the
+ *  equal ripple it was aiming for.
+ * @return TRUE if successful, else FALSE
+ */
+int designRemez(const FilterSpec *spec, float *coeffs, int size, double *deviation);
+
+/**
+ * Design the shortest filter that meets the spec, choosing the method.
+ * @param coeffs must have room for DESIGN_MAX_TAPS values
+ * @return the number of taps, or 0 on failure
+ */
+int designFilter(const FilterSpec *spec, float *coeffs);
+
+
+#endif /* _DESIGN_H_ */
+
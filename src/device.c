@@ -77,6 +77,21 @@ static void *dload(char *fname)
 
 
 
+static Device *deviceAlloc()
+{
+    Device *dev = (Device *)malloc(sizeof(Device));
+    if (!dev)
+        {
+        error("creating Device info structure");
+        return NULL;
+        }
+    //so that optional functions not set by the plugin are NULL
+    memset(dev, 0, sizeof(Device));
+    return dev;
+}
+
+
+
 static int deviceScanDir(char *deviceDir, int type, Device **outbuf, int maxDevices)
 {
     parent.trace = trace;
@@ -108,17 +123,38 @@ static int deviceScanDir(char *deviceDir, int type, Device **outbuf, int maxDevi
         if (dlib)
             {
             //trace("got dynamic lib");
-            void *sym = dlsym(dlib, "deviceCreate");
-            if (sym)
+            void *countSym = dlsym(dlib, "deviceCount");
+            void *indexSym = dlsym(dlib, "deviceCreateIndex");
+            void *sym      = dlsym(dlib, "deviceCreate");
+            if (countSym && indexSym)
+                {
+                DeviceCountFunc *countFunc = (DeviceCountFunc *)countSym;
+                DeviceCreateIndexFunc *func = (DeviceCreateIndexFunc *)indexSym;
+                int nrDevices = countFunc(&parent);
+                for (int i = 0 ; i < nrDevices && count < maxDevices ; i++)
+                    {
+                    Device *dev = deviceAlloc();
+                    if (!dev)
+                        return count;
+                    dev->index = i;
+                    if (func(dev, &parent, i))
+                        {
+                        trace("Loaded device %d: %s '%s'", i, dev->name, dev->serial);
+                        outbuf[count++] = dev;
+                        }
+                    else
+                        {
+                        free(dev);
+                        }
+                    }
+                }
+            else if (sym)
                 {
                 //trace("got function");
                 DeviceOpenFunc *func = (DeviceOpenFunc *)sym;
-                Device *dev = (Device *)malloc(sizeof(Device));
+                Device *dev = deviceAlloc();
                 if (!dev)
-                    {
-                    error("creating Device info structure");
                     return count;
-                    }
                 int ret = func(dev, &parent);
                 if (ret)
                     {
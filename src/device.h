@@ -38,6 +38,33 @@ typedef enum
 } DeviceType;
 
 
+#define DEVICE_SERIAL_LEN 256
+
+
+/**
+ * Information about a block of samples returned by read()
+ */
+typedef struct
+{
+    /**
+     * Monotonic time, from latencyNow(), when the device delivered the block
+     */
+    long long timestamp;
+    /**
+     * Sequence number of the block, counting from 0 at open().  Blocks
+     * dropped by the device still use up a number.
+     */
+    unsigned long seq;
+    /**
+     * Index of the first sample of this block in the device's stream
+     */
+    unsigned long long sampleCount;
+    /**
+     * Number of blocks lost between the previous block and this one.
+     * If nonzero, the samples are not continuous with the last read.
+     */
+    int dropped;
+} BlockInfo;
 
 
 
@@ -51,6 +78,14 @@ struct Device
 {
     int    type;
     char   *name;
+    /**
+     * Index of this device among those driven by its plugin
+     */
+    int    index;
+    /**
+     * Serial number, if the device has one, else ""
+     */
+    char   serial[DEVICE_SERIAL_LEN];
     
     /**
      * Pointer to context information provided by the device.  This will be passed
@@ -112,9 +147,17 @@ struct Device
     
     /**
      * Read/write complex data to/from the device
+     * @param info if not NULL, receives information about the block read
      * @return number of samples read
      */
-    int (*read)(void *ctx, float complex *buf, int buflen);
+    int (*read)(void *ctx, float complex *buf, int buflen, BlockInfo *info);
+    /**
+     * Sleep until read() has data to return, or the timeout expires.
+     * May be NULL, in which case the caller must poll read().
+     * @param timeoutMs maximum time to wait, in milliseconds
+     * @return true if data is available, else false
+     */
+    int (*waitForData)(void *ctx, int timeoutMs);
     /**
      * Read/write complex data to/from the device
      * @return true if successful, else false
@@ -126,6 +169,24 @@ struct Device
      * @return true if successful, else false
      */
     int (*transmit)(void *ctx, int truefalse);
+
+    /**
+     * Set the number and size (in bytes) of the transfers the device
+     * keeps in flight, and the number of blocks it may queue for read()
+     * before it must drop data.  A value <= 0 leaves that setting alone.
+     * Takes effect at the next open().  May be NULL if not supported.
+     * @return true if successful, else false
+     */
+    int (*setBuffering)(void *ctx, int transferCount, int transferSize, int queueDepth);
+
+    /**
+     * Set how the threads the device starts for itself are placed.
+     * Takes effect at the next open().  May be NULL if not supported.
+     * @param cpu pin to this CPU, or -1 to let them run anywhere
+     * @param priority SCHED_FIFO priority, or 0 for normal scheduling
+     * @return true if successful, else false
+     */
+    int (*setThreadPolicy)(void *ctx, int cpu, int priority);
 };
 
 
@@ -146,8 +207,20 @@ struct Parent
 };
 
 
+/**
+ * Every plugin exports "deviceCreate", which fills in a Device
+ * for the first device it can drive.
+ */
 typedef int DeviceOpenFunc(Device *, Parent *);
 
+/**
+ * Plugins that can drive several devices at once also export
+ * "deviceCount", returning how many are attached, and "deviceCreateIndex",
+ * which fills in a Device for the one at the given index.
+ */
+typedef int DeviceCountFunc(Parent *);
+typedef int DeviceCreateIndexFunc(Device *, Parent *, int index);
+
 
 
 #endif /* _DEVICE_H_ */
@@ -0,0 +1,59 @@
+/**
+ * Clock drift compensation
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "drift.h"
+#include "private.h"
+
+
+void driftReset(Drift *drift, float target)
+{
+    drift->target   = target;
+    drift->level    = target;
+    drift->integral = 0.0;
+    drift->ppm      = 0.0;
+}
+
+
+/**
+ * A PI loop.  Too deep means we make samples faster than the sound
+ * card takes them, so the correction goes negative.
+ */
+float driftUpdate(Drift *drift, float depth)
+{
+    if (drift->target <= 0.0)
+        return 0.0;
+    drift->level += DRIFT_SMOOTH * (depth - drift->level);
+    float err = (drift->level - drift->target) / drift->target;
+    float integral = drift->integral - DRIFT_KI * err;
+    //stop winding up against the limit
+    if (integral > DRIFT_MAX)
+        integral = DRIFT_MAX;
+    else if (integral < -DRIFT_MAX)
+        integral = -DRIFT_MAX;
+    drift->integral = integral;
+    float ppm = integral - DRIFT_KP * err;
+    drift->ppm = (ppm > DRIFT_MAX) ? DRIFT_MAX : (ppm < -DRIFT_MAX) ? -DRIFT_MAX : ppm;
+    return drift->ppm;
+}
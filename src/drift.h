@@ -0,0 +1,77 @@
+#ifndef _DRIFT_H_
+#define _DRIFT_H_
+/**
+ * Clock drift compensation.  The device and the sound card each keep
+ * their own time, and however close their rates, the audio queue
+ * between them slowly fills or empties.  This watches how full it is
+ * and gives the resampler a correction, in parts per million, that
+ * holds it at a set depth, and so holds the latency steady.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sdrlib.h"
+
+
+/**
+ * The loop's gains, in ppm for an error of the whole target depth.
+ * It updates once per block, so the integral gain is per block.
+ */
+#define DRIFT_KP (100.0)
+#define DRIFT_KI (1.0)
+
+/**
+ * The most correction.  RTL crystals and sound cards are each
+ * usually within 100ppm.
+ */
+#define DRIFT_MAX (1000.0)
+
+/**
+ * How much of each new reading goes into the smoothed depth
+ */
+#define DRIFT_SMOOTH (0.05)
+
+
+struct Drift
+{
+    float target;   //the depth to hold, in samples
+    float level;    //the depth, smoothed
+    float integral; //ppm
+    float ppm;      //the correction to the output rate:  positive for more samples
+};
+
+
+/**
+ * Start over, with no correction
+ * @param target the depth to hold, in samples
+ */
+void driftReset(Drift *drift, float target);
+
+/**
+ * Take a reading of the queue's depth, once for each block put into it
+ * @param depth samples queued
+ * @return the correction, in ppm
+ */
+float driftUpdate(Drift *drift, float depth);
+
+
+#endif /* _DRIFT_H_ */
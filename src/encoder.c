@@ -0,0 +1,259 @@
+/**
+ * Runs a channel's codecs on a thread of their own.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "encoder.h"
+#include "event.h"
+#include "thread.h"
+#include "private.h"
+
+
+typedef struct
+{
+    Encoder *obj;
+    char name[16];
+} EncoderStart;
+
+
+/**
+ * The next frame to encode, or NULL if there is none
+ */
+static EncoderFrame *encoderPeek(Encoder *obj)
+{
+    unsigned long tail = obj->tail;
+    if (__atomic_load_n(&(obj->head), __ATOMIC_ACQUIRE) == tail)
+        return NULL;
+    return &(obj->frames[tail & (ENCODER_QUEUE - 1)]);
+}
+
+
+static void *encoderThread(void *ctx)
+{
+    EncoderStart *start = (EncoderStart *)ctx;
+    Encoder *obj = start->obj;
+    threadSetup(start->name, THREAD_ENCODER, -1);
+    free(start);
+    while (__atomic_load_n(&(obj->running), __ATOMIC_ACQUIRE))
+        {
+        EncoderFrame *frame;
+        while ((frame = encoderPeek(obj)))
+            {
+            float *buf = (frame->silent) ? NULL : frame->samples;
+            (*obj->func)(buf, frame->size, frame->lost, frame->stamp, obj->context);
+            //hand the frame back to the producer
+            __atomic_store_n(&(obj->tail), obj->tail + 1, __ATOMIC_RELEASE);
+            }
+        eventWait(obj->event, ENCODER_TIMEOUT_MS);
+        }
+    return NULL;
+}
+
+
+Encoder *encoderCreate(const char *name, EncoderFunc *func, void *context)
+{
+    Encoder *obj = (Encoder *)malloc(sizeof(Encoder));
+    if (!obj)
+        {
+        error("Could not allocate encoder");
+        return NULL;
+        }
+    memset(obj, 0, sizeof(Encoder));
+    obj->func    = func;
+    obj->context = context;
+    obj->frames  = (EncoderFrame *)malloc(ENCODER_QUEUE * sizeof(EncoderFrame));
+    obj->event   = eventCreate();
+    EncoderStart *start = (EncoderStart *)malloc(sizeof(EncoderStart));
+    if (!obj->frames || !obj->event || !start)
+        {
+        error("Could not allocate encoder");
+        free(start);
+        eventDelete(obj->event);
+        free(obj->frames);
+        free(obj);
+        return NULL;
+        }
+    start->obj = obj;
+    snprintf(start->name, sizeof(start->name), "%s", name);
+    obj->running = TRUE;
+    if (pthread_create(&(obj->thread), NULL, encoderThread, start))
+        {
+        error("Could not start encoder thread");
+        free(start);
+        eventDelete(obj->event);
+        free(obj->frames);
+        free(obj);
+        return NULL;
+        }
+    return obj;
+}
+
+
+void encoderDelete(Encoder *obj)
+{
+    if (!obj)
+        return;
+    __atomic_store_n(&(obj->running), FALSE, __ATOMIC_RELEASE);
+    eventSignal(obj->event);
+    pthread_join(obj->thread, NULL);
+    eventDelete(obj->event);
+    free(obj->frames);
+    free(obj);
+}
+
+
+/**
+ * The next frame to fill, or NULL if the queue is full
+ */
+static EncoderFrame *encoderReserve(Encoder *obj)
+{
+    unsigned long head = obj->head;
+    if (head - __atomic_load_n(&(obj->tail), __ATOMIC_ACQUIRE) >= ENCODER_QUEUE)
+        return NULL;
+    return &(obj->frames[head & (ENCODER_QUEUE - 1)]);
+}
+
+
+static void encoderCommit(Encoder *obj)
+{
+    unsigned long head = obj->head + 1;
+    __atomic_store_n(&(obj->head), head, __ATOMIC_RELEASE);
+    __atomic_store_n(&(obj->frameCount), obj->frameCount + 1, __ATOMIC_RELAXED);
+    int backlog = (int)(head - __atomic_load_n(&(obj->tail), __ATOMIC_ACQUIRE));
+    if (backlog > obj->maxBacklog)
+        __atomic_store_n(&(obj->maxBacklog), backlog, __ATOMIC_RELAXED);
+}
+
+
+static void encoderDrop(Encoder *obj, int samples)
+{
+    if (!obj->lost)
+        obj->lostFirst = !obj->silence;
+    obj->lost += samples;
+    __atomic_store_n(&(obj->dropped), obj->dropped + 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Queue one run of samples with none in them
+ * @param samples how many, set to 0 once queued
+ * @param lost TRUE for a gap, FALSE for squelch silence
+ * @return TRUE if there is none left, else FALSE
+ */
+static int encoderGap(Encoder *obj, int *samples, int lost)
+{
+    if (!*samples)
+        return TRUE;
+    EncoderFrame *frame = encoderReserve(obj);
+    if (!frame)
+        return FALSE;
+    frame->size   = *samples;
+    frame->silent = TRUE;
+    frame->lost   = lost;
+    frame->stamp  = 0;
+    encoderCommit(obj);
+    if (!lost)
+        __atomic_store_n(&(obj->silences), obj->silences + 1, __ATOMIC_RELAXED);
+    *samples = 0;
+    return TRUE;
+}
+
+
+/**
+ * Queue any gap for dropped samples, and any squelch silence, in the
+ * order they began, ahead of anything newer.
+ * @return TRUE if there is none left, else FALSE
+ */
+static int encoderCatchUp(Encoder *obj)
+{
+    if (obj->lostFirst)
+        return encoderGap(obj, &(obj->lost), TRUE) && encoderGap(obj, &(obj->silence), FALSE);
+    return encoderGap(obj, &(obj->silence), FALSE) && encoderGap(obj, &(obj->lost), TRUE);
+}
+
+
+int encoderPush(Encoder *obj, float *buf, int size, long long stamp)
+{
+    int ok = TRUE;
+    while (size > 0)
+        {
+        int n = (size < ENCODER_FRAME) ? size : ENCODER_FRAME;
+        EncoderFrame *frame = (encoderCatchUp(obj)) ? encoderReserve(obj) : NULL;
+        if (frame)
+            {
+            memcpy(frame->samples, buf, n * sizeof(float));
+            frame->size   = n;
+            frame->silent = FALSE;
+            frame->lost   = FALSE;
+            frame->stamp  = stamp;
+            encoderCommit(obj);
+            }
+        else
+            {
+            encoderDrop(obj, n);
+            ok = FALSE;
+            }
+        buf  += n;
+        size -= n;
+        }
+    eventSignal(obj->event);
+    return ok;
+}
+
+
+int encoderSilence(Encoder *obj, int samples)
+{
+    if (samples <= 0)
+        return TRUE;
+    //silence costs the same queued in one frame as in many, so it
+    //waits for room rather than being dropped
+    if (!obj->silence)
+        obj->lostFirst = (obj->lost > 0);
+    obj->silence += samples;
+    int ok = encoderCatchUp(obj);
+    eventSignal(obj->event);
+    return ok;
+}
+
+
+int encoderBacklog(Encoder *obj)
+{
+    unsigned long tail = __atomic_load_n(&(obj->tail), __ATOMIC_ACQUIRE);
+    return (int)(__atomic_load_n(&(obj->head), __ATOMIC_ACQUIRE) - tail);
+}
+
+
+void encoderGetStats(Encoder *obj, EncoderStats *stats)
+{
+    stats->frames     = __atomic_load_n(&(obj->frameCount), __ATOMIC_RELAXED);
+    stats->dropped    = __atomic_load_n(&(obj->dropped), __ATOMIC_RELAXED);
+    stats->silences   = __atomic_load_n(&(obj->silences), __ATOMIC_RELAXED);
+    stats->backlog    = encoderBacklog(obj);
+    stats->maxBacklog = __atomic_load_n(&(obj->maxBacklog), __ATOMIC_RELAXED);
+    stats->capacity   = ENCODER_QUEUE;
+}
+
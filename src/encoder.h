@@ -0,0 +1,140 @@
+#ifndef _ENCODER_H_
+#define _ENCODER_H_
+/**
+ * Runs a channel's codecs on a thread of their own, so that a slow
+ * encode, or a slow client behind it, never holds up the dsp.  The
+ * dsp thread queues its audio in fixed frames, and the encoder thread
+ * takes them off and encodes them.
+ *
+ * The queue is a bounded, lock-free ring with one producer and one
+ * consumer.  When it is full, the dsp thread drops the frame rather
+ * than wait, and the samples it held are encoded as silence once
+ * there is room, so that the stream keeps its timing.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <pthread.h>
+
+#include "sdrlib.h"
+
+
+/**
+ * The most samples in one queued frame.  Longer blocks are split.
+ */
+#define ENCODER_FRAME 1024
+
+/**
+ * Frames the queue holds, about 1.4s at 48kHz.  A power of 2.
+ */
+#define ENCODER_QUEUE 64
+
+/**
+ * How long the encoder thread sleeps waiting for audio before it
+ * checks again whether it should still be running
+ */
+#define ENCODER_TIMEOUT_MS 100
+
+
+/**
+ * Does the encoding, on the encoder thread
+ * @param buf the samples, or NULL for 'size' samples with none
+ * @param lost for no samples, TRUE if they were dropped, or FALSE if
+ *      they were squelched
+ */
+typedef void EncoderFunc(float *buf, int size, int lost, long long stamp, void *ctx);
+
+
+typedef struct
+{
+    int       size;   //samples
+    int       silent; //TRUE for 'size' samples of silence, with nothing in samples
+    int       lost;   //TRUE if that silence stands in for dropped samples
+    long long stamp;
+    float     samples[ENCODER_FRAME];
+} EncoderFrame;
+
+
+struct Encoder
+{
+    EncoderFrame  *frames;
+    EncoderFunc   *func;
+    void          *context;
+    Event         *event;    //wakes the encoder thread
+    pthread_t     thread;
+    int           running;
+    char          pad0[64];
+    unsigned long head;      //next frame to fill.  Only the producer writes this
+    unsigned long frameCount;
+    unsigned long dropped;
+    unsigned long silences;
+    int           maxBacklog;
+    int           lost;      //samples dropped, still to be queued as a gap
+    int           silence;   //samples squelched, still to be queued
+    int           lostFirst; //TRUE if the gap came before the silence
+    char          pad1[64];
+    unsigned long tail;      //next frame to encode.  Only the consumer writes this
+};
+
+
+/**
+ * Create a new Encoder, and start its thread
+ * @param name the thread name, 15 characters at most
+ * @param func called on the encoder thread for each frame
+ * @return a new Encoder instance, or NULL on failure
+ */
+Encoder *encoderCreate(const char *name, EncoderFunc *func, void *context);
+
+/**
+ * Stop the encoder thread and free the encoder.  Frames still
+ * queued are discarded.
+ */
+void encoderDelete(Encoder *obj);
+
+/**
+ * Queue audio for encoding.  Only one thread may call this and
+ * encoderSilence(), and it never waits.
+ * @return TRUE if all of it was queued, FALSE if some was dropped
+ */
+int encoderPush(Encoder *obj, float *buf, int size, long long stamp);
+
+/**
+ * Queue some samples of silence, as for a closed squelch.  These are
+ * never dropped.  If the queue is full, they wait, and are queued ahead
+ * of the next audio that fits.
+ * @return TRUE if queued, FALSE if waiting for room
+ */
+int encoderSilence(Encoder *obj, int samples);
+
+/**
+ * The number of frames waiting to be encoded
+ */
+int encoderBacklog(Encoder *obj);
+
+/**
+ * Read the statistics, from any thread
+ */
+void encoderGetStats(Encoder *obj, EncoderStats *stats);
+
+
+#endif /* _ENCODER_H_ */
+
@@ -0,0 +1,92 @@
+/**
+ * A simple auto-reset event
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+//for clock_gettime() with -std=c99
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "event.h"
+#include "private.h"
+
+
+Event *eventCreate()
+{
+    Event *event = (Event *)malloc(sizeof(Event));
+    if (!event)
+        return NULL;
+    pthread_mutex_init(&(event->mutex), NULL);
+    pthread_cond_init(&(event->cond), NULL);
+    event->signaled = FALSE;
+    return event;
+}
+
+
+void eventDelete(Event *event)
+{
+    if (event)
+        {
+        pthread_cond_destroy(&(event->cond));
+        pthread_mutex_destroy(&(event->mutex));
+        free(event);
+        }
+}
+
+
+void eventSignal(Event *event)
+{
+    pthread_mutex_lock(&(event->mutex));
+    event->signaled = TRUE;
+    pthread_cond_signal(&(event->cond));
+    pthread_mutex_unlock(&(event->mutex));
+}
+
+
+int eventWait(Event *event, int timeoutMs)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+        {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+        }
+    pthread_mutex_lock(&(event->mutex));
+    while (!event->signaled)
+        {
+        if (pthread_cond_timedwait(&(event->cond), &(event->mutex), &deadline) == ETIMEDOUT)
+            break;
+        }
+    int ret = event->signaled;
+    event->signaled = FALSE;
+    pthread_mutex_unlock(&(event->mutex));
+    return ret;
+}
+
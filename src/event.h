@@ -0,0 +1,69 @@
+#ifndef _EVENT_H_
+#define _EVENT_H_
+/**
+ * A simple auto-reset event, so that one thread can sleep
+ * until another tells it there is work to do.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <pthread.h>
+
+#include "sdrlib.h"
+
+
+struct Event
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int signaled;
+};
+
+
+/**
+ * Create a new Event instance, initially not signaled.
+ * @return a new Event instance
+ */
+Event *eventCreate();
+
+/**
+ * Free up event resources
+ */
+void eventDelete(Event *event);
+
+/**
+ * Wake up the waiting thread.  If nobody is waiting, the
+ * next call to eventWait() will return immediately.
+ */
+void eventSignal(Event *event);
+
+/**
+ * Sleep until the event is signaled, or the timeout expires.
+ * The event is reset before returning.
+ * @param timeoutMs maximum time to wait, in milliseconds
+ * @return TRUE if signaled, FALSE on timeout
+ */
+int eventWait(Event *event, int timeoutMs);
+
+
+#endif /* _EVENT_H_ */
+
@@ -0,0 +1,234 @@
+/**
+ * Encoded audio for many listeners
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fanout.h"
+#include "private.h"
+
+
+void packetRef(Packet *packet)
+{
+    __atomic_add_fetch(&(packet->refs), 1, __ATOMIC_RELAXED);
+}
+
+
+void packetUnref(Packet *packet)
+{
+    if (packet && __atomic_sub_fetch(&(packet->refs), 1, __ATOMIC_ACQ_REL) == 0)
+        free(packet);
+}
+
+
+Fanout *fanoutCreate()
+{
+    Fanout *fanout = (Fanout *)malloc(sizeof(Fanout));
+    if (!fanout)
+        return NULL;
+    memset(fanout, 0, sizeof(Fanout));
+    fanout->refs = 1;
+    pthread_mutex_init(&(fanout->mutex), NULL);
+    for (int e = 0 ; e < ENCODINGS ; e++)
+        {
+        fanout->outlets[e].fanout   = fanout;
+        fanout->outlets[e].encoding = e;
+        }
+    return fanout;
+}
+
+
+/**
+ * Take a listener off the list, and end its queue.  Called with the
+ * mutex held.
+ */
+static void fanoutDetach(Fanout *fanout, int index)
+{
+    Listener *listener = fanout->listeners[index];
+    fanout->listeners[index] = fanout->listeners[--fanout->count];
+    __atomic_sub_fetch(&(fanout->wanted[listener->encoding]), 1, __ATOMIC_RELAXED);
+    listener->closed = TRUE;
+    //there is always room, since the publisher leaves the last place
+    queuePush(listener->queue, NULL, 0);
+}
+
+
+/**
+ * Drop a reference, freeing the fanout when neither its owner nor any
+ * listener holds it
+ */
+static void fanoutUnref(Fanout *fanout)
+{
+    if (__atomic_sub_fetch(&(fanout->refs), 1, __ATOMIC_ACQ_REL) == 0)
+        {
+        pthread_mutex_destroy(&(fanout->mutex));
+        free(fanout);
+        }
+}
+
+
+void fanoutDelete(Fanout *fanout)
+{
+    if (!fanout)
+        return;
+    pthread_mutex_lock(&(fanout->mutex));
+    while (fanout->count > 0)
+        fanoutDetach(fanout, fanout->count - 1);
+    pthread_mutex_unlock(&(fanout->mutex));
+    //a listener still being closed keeps it until it is done
+    fanoutUnref(fanout);
+}
+
+
+Listener *fanoutListen(Fanout *fanout, int encoding)
+{
+    if (encoding < 0 || encoding >= ENCODINGS)
+        {
+        error("fanoutListen: no such encoding: %d", encoding);
+        return NULL;
+        }
+    Listener *listener = (Listener *)malloc(sizeof(Listener));
+    if (!listener)
+        return NULL;
+    //one more, for the NULL that ends it
+    listener->queue = queueCreate(FANOUT_QUEUE + 1);
+    if (!listener->queue)
+        {
+        free(listener);
+        return NULL;
+        }
+    listener->fanout   = fanout;
+    listener->closed   = FALSE;
+    listener->encoding = encoding;
+    listener->dropped  = 0;
+    pthread_mutex_lock(&(fanout->mutex));
+    int ok = (fanout->count < FANOUT_MAX_LISTENERS);
+    if (ok)
+        {
+        __atomic_add_fetch(&(fanout->refs), 1, __ATOMIC_RELAXED);
+        fanout->listeners[fanout->count++] = listener;
+        __atomic_add_fetch(&(fanout->wanted[encoding]), 1, __ATOMIC_RELAXED);
+        }
+    pthread_mutex_unlock(&(fanout->mutex));
+    if (!ok)
+        {
+        error("fanoutListen: too many listeners");
+        queueDelete(listener->queue);
+        free(listener);
+        return NULL;
+        }
+    return listener;
+}
+
+
+int fanoutWants(Fanout *fanout, int encoding)
+{
+    return __atomic_load_n(&(fanout->wanted[encoding]), __ATOMIC_RELAXED) > 0;
+}
+
+
+void fanoutPublish(Fanout *fanout, int encoding, unsigned char *data, int size)
+{
+    if (!fanoutWants(fanout, encoding))
+        return;
+    Packet *packet = (Packet *)malloc(sizeof(Packet) + size);
+    if (!packet)
+        return;
+    packet->refs     = 1;  //ours, until they are all handed out
+    packet->encoding = encoding;
+    packet->size     = size;
+    memcpy(packet->data, data, size);
+    pthread_mutex_lock(&(fanout->mutex));
+    for (int i = 0 ; i < fanout->count ; i++)
+        {
+        Listener *listener = fanout->listeners[i];
+        if (listener->encoding != encoding)
+            continue;
+        packetRef(packet);
+        //leave the last place for the NULL that ends the queue
+        if (!queueTryPush(listener->queue, packet, size, 1))
+            {
+            packetUnref(packet);
+            listener->dropped++;
+            }
+        }
+    pthread_mutex_unlock(&(fanout->mutex));
+    packetUnref(packet);
+}
+
+
+void fanoutOutput(unsigned char *data, int size, void *ctx)
+{
+    FanoutOutlet *outlet = (FanoutOutlet *)ctx;
+    fanoutPublish(outlet->fanout, outlet->encoding, data, size);
+}
+
+
+FanoutOutlet *fanoutOutlet(Fanout *fanout, int encoding)
+{
+    return &(fanout->outlets[encoding]);
+}
+
+
+Packet *listenerNext(Listener *listener)
+{
+    int size;
+    return (Packet *)queuePop(listener->queue, &size);
+}
+
+
+void listenerClose(Listener *listener)
+{
+    //its reference keeps the fanout, even if it is being deleted
+    Fanout *fanout = listener->fanout;
+    pthread_mutex_lock(&(fanout->mutex));
+    for (int i = 0 ; !listener->closed && i < fanout->count ; i++)
+        {
+        if (fanout->listeners[i] == listener)
+            {
+            fanoutDetach(fanout, i);
+            break;
+            }
+        }
+    pthread_mutex_unlock(&(fanout->mutex));
+}
+
+
+void listenerDelete(Listener *listener)
+{
+    if (!listener)
+        return;
+    listenerClose(listener);
+    //whatever its thread did not get to
+    Queue *queue = listener->queue;
+    while (queue->count > 0)
+        {
+        int size;
+        packetUnref((Packet *)queuePop(queue, &size));
+        }
+    queueDelete(queue);
+    fanoutUnref(listener->fanout);
+    free(listener);
+}
@@ -0,0 +1,168 @@
+#ifndef _FANOUT_H_
+#define _FANOUT_H_
+/**
+ * Encoded audio for many listeners.  A channel encodes each of its
+ * encodings once, for however many listeners want it, and each
+ * listener gets a reference to the same packet.  So the cost of
+ * encoding goes with the channels, and a listener costs only a copy
+ * of a pointer.
+ *
+ * The dsp thread publishes, and never waits:  a listener that falls
+ * more than FANOUT_QUEUE packets behind loses the newest ones, and
+ * they are counted.  Each listener is drained by a thread of its own,
+ * usually the one that sends to its client.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <pthread.h>
+
+#include "sdrlib.h"
+#include "queue.h"
+
+
+/**
+ * The most listeners on one channel
+ */
+#define FANOUT_MAX_LISTENERS 32
+
+/**
+ * How many packets a listener may fall behind before it loses them
+ */
+#define FANOUT_QUEUE 64
+
+
+/**
+ * One encoded packet, shared by every listener it is sent to
+ */
+struct Packet
+{
+    int refs;     //only touched atomically
+    int encoding;
+    int size;
+    unsigned char data[];
+};
+
+
+struct Listener
+{
+    Fanout *fanout;  //holds a reference on it, until listenerDelete()
+    int closed;      //under the fanout's mutex
+    int encoding;
+    Queue *queue;    //of Packets, with a NULL after the last
+    unsigned long dropped; //packets lost because the queue was full
+};
+
+
+/**
+ * Where a codec sends its output, as the context for fanoutOutput()
+ */
+typedef struct
+{
+    Fanout *fanout;
+    int encoding;
+} FanoutOutlet;
+
+
+struct Fanout
+{
+    int refs;        //the owner's, and one for each listener.  Only touched atomically
+    pthread_mutex_t mutex;
+    Listener *listeners[FANOUT_MAX_LISTENERS];
+    int count;
+    int wanted[ENCODINGS];  //listeners for each encoding
+    FanoutOutlet outlets[ENCODINGS];
+};
+
+
+/**
+ * Add a reference
+ */
+void packetRef(Packet *packet);
+
+/**
+ * Drop a reference, freeing the packet when nobody holds it
+ */
+void packetUnref(Packet *packet);
+
+
+/**
+ * Create a new Fanout, with no listeners
+ */
+Fanout *fanoutCreate();
+
+/**
+ * Delete a Fanout.  Any listeners still on it are closed, but they
+ * belong to their owners, who must still listenerDelete() them.  It is
+ * freed once the last of them has been.
+ */
+void fanoutDelete(Fanout *fanout);
+
+/**
+ * Add a listener, from any thread
+ * @param encoding one of the Encoding values
+ * @return the listener, or NULL if there are too many
+ */
+Listener *fanoutListen(Fanout *fanout, int encoding);
+
+/**
+ * Check whether anyone listens for an encoding.  This is for the dsp
+ * thread, to skip encodings nobody wants, so it takes no lock.
+ */
+int fanoutWants(Fanout *fanout, int encoding);
+
+/**
+ * Send a copy of some encoded data to every listener for its encoding
+ */
+void fanoutPublish(Fanout *fanout, int encoding, unsigned char *data, int size);
+
+/**
+ * A ByteOutputFunc for a codec, with fanoutOutlet() as its context
+ */
+void fanoutOutput(unsigned char *data, int size, void *ctx);
+
+/**
+ * The context for fanoutOutput(), for one encoding
+ */
+FanoutOutlet *fanoutOutlet(Fanout *fanout, int encoding);
+
+
+/**
+ * Wait for the next packet.  The caller owns a reference to it, and
+ * must packetUnref() it.
+ * @return the packet, or NULL once the listener is closed
+ */
+Packet *listenerNext(Listener *listener);
+
+/**
+ * Stop listening.  Anything queued is still returned by
+ * listenerNext(), and then NULL.
+ */
+void listenerClose(Listener *listener);
+
+/**
+ * Free a listener, once its thread is done with listenerNext()
+ */
+void listenerDelete(Listener *listener);
+
+
+#endif /* _FANOUT_H_ */
@@ -29,6 +29,7 @@
 #include <math.h>
 #include "private.h"
 #include "filter.h"
+#include "kernel.h"
 
 
 
@@ -43,9 +44,12 @@ Fir *firCreate(int size)
     if (!fir)
         return NULL;
     fir->size       = size;
+    fir->symmetric  = FALSE;
+    fir->dot        = dotReal;
+    fir->dotC       = dotComplex;
     fir->coeffs     = (float *)malloc(size * sizeof(float));
-    fir->delayLine  = (float *)malloc(size * sizeof(float));
-    fir->delayLineC = (float complex *)malloc(size * sizeof(float complex));
+    fir->delayLine  = (float *)malloc(2 * size * sizeof(float));
+    fir->delayLineC = (float complex *)malloc(2 * size * sizeof(float complex));
     if (!fir->coeffs || !fir->delayLine || !fir->delayLineC)
         {
         free(fir->coeffs);
@@ -55,8 +59,9 @@ Fir *firCreate(int size)
         return NULL;
         }
     for (int i=0 ; i<size ; i++)
-        {
         fir->coeffs[i] = 0.0;
+    for (int i=0 ; i<2*size ; i++)
+        {
         fir->delayLine[i] = 0.0;
         fir->delayLineC[i] = 0.0;
         }
@@ -78,6 +83,25 @@ void firDelete(Fir *fir)
 }
 
 
+void firReset(Fir *fir)
+{
+    memset(fir->delayLine, 0, 2 * fir->size * sizeof(float));
+    memset(fir->delayLineC, 0, 2 * fir->size * sizeof(float complex));
+    fir->delayIndex = 0;
+}
+
+
+/**
+ * Call after the coefficients change, to pick the kernels for them
+ */
+static void firSetCoeffs(Fir *fir)
+{
+    fir->symmetric = kernelIsSymmetric(fir->coeffs, fir->size);
+    fir->dot       = kernelSelect(fir->symmetric, fir->size);
+    fir->dotC      = kernelSelectC(fir->symmetric, fir->size);
+}
+
+
 /**
  * Add samples to the delay line in reverse order,
  * so we can walk them newest to oldest
@@ -86,19 +110,13 @@ float firUpdate(Fir *fir, float sample)
 {
     float *delayLine = fir->delayLine;
     int delayIndex = fir->delayIndex;
+    int size = fir->size;
     delayLine[delayIndex] = sample;
-    float sum = 0.0;
+    delayLine[delayIndex + size] = sample;
     //walk the coefficients from first to last
     //and the delay line from newest to oldest
-    int idx = delayIndex;
-    float *coeff = fir->coeffs;
-    int size = fir->size;
-    for (int count = size ; count > 0 ; count--)
-        {
-        float v = delayLine[idx];
-        idx = (idx+1) % size;
-        sum += v * (*coeff++);
-        }
+    float *x = delayLine + delayIndex;
+    float sum = fir->dot(x, fir->coeffs, size);
     fir->delayIndex = (delayIndex) ? delayIndex-1 : size-1;
     return sum;
 }
@@ -110,25 +128,41 @@ float complex firUpdateC(Fir *fir, float complex sample)
 {
     float complex *delayLine = fir->delayLineC;
     int delayIndex = fir->delayIndex;
+    int size = fir->size;
     delayLine[delayIndex] = sample;
-    float complex sum = 0.0;
+    delayLine[delayIndex + size] = sample;
     //walk the coefficients from first to last
     //and the delay line from newest to oldest
-    int idx = delayIndex;
-    float *coeff = fir->coeffs;
-    int size = fir->size;
-    int count = size;
-    while (count--)
-        {
-        float complex v = delayLine[idx];
-        idx = (idx+1) % size;
-        sum += v * (*coeff++);
-        }
+    float complex *x = delayLine + delayIndex;
+    float complex sum = fir->dotC(x, fir->coeffs, size);
     fir->delayIndex = (delayIndex) ? delayIndex-1 : size-1;
     return sum;
 }
 
 
+int firDecimateC(Fir *fir, float complex *out, const float complex *in, int len,
+                 int factor, int *phase)
+{
+    float complex *delayLine = fir->delayLineC;
+    int delayIndex = fir->delayIndex;
+    int size  = fir->size;
+    int ph    = *phase;
+    int count = 0;
+    for (int i = 0 ; i < len ; i++)
+        {
+        delayLine[delayIndex] = delayLine[delayIndex + size] = in[i];
+        if (!ph)
+            out[count++] = fir->dotC(delayLine + delayIndex, fir->coeffs, size);
+        if (++ph >= factor)
+            ph = 0;
+        delayIndex = (delayIndex) ? delayIndex-1 : size-1;
+        }
+    fir->delayIndex = delayIndex;
+    *phase = ph;
+    return count;
+}
+
+
 static void windowize(int size, float *coeffs, int windowType)
 {
     int i = 0;
@@ -164,16 +198,23 @@ static void windowize(int size, float *coeffs, int windowType)
 }
 
 
-static void normalize(int size, float *coeffs)
+/**
+ * Scale the coefficients for unity gain at omega, which should be
+ * in the passband:  0 for a lowpass, PI for a highpass, or the
+ * center of a bandpass
+ */
+static void normalize(int size, float *coeffs, float omega)
 {
+    int center = (size - 1) / 2;
     float sum = 0.0;
     int i = 0;
     for ( ; i < size ; i++)
-        sum += coeffs[i];
+        sum += coeffs[i] * cos(omega * (i - center));
+    if (sum == 0.0)
+        return;
     float scale = 1.0 / sum;
     for (i=0 ; i < size ; i++)
-        sum *= scale;
-    
+        coeffs[i] *= scale;
 }
 
 
@@ -198,11 +239,21 @@ Fir *firLP(int size, float cutoffFreq, float sampleRate, int windowType)
     Fir *fir = firCreate(size);
     firLPCoeffs(size, fir->coeffs, cutoffFreq, sampleRate);
     windowize(size, fir->coeffs, windowType);
-    normalize(size, fir->coeffs);
+    normalize(size, fir->coeffs, 0.0);
+    firSetCoeffs(fir);
     return fir;
 }
 
 
+void firSetLP(Fir *fir, float cutoffFreq, float sampleRate, int windowType)
+{
+    firLPCoeffs(fir->size, fir->coeffs, cutoffFreq, sampleRate);
+    windowize(fir->size, fir->coeffs, windowType);
+    normalize(fir->size, fir->coeffs, 0.0);
+    firSetCoeffs(fir);
+}
+
+
 static void firHPCoeffs(int size, float *coeffs, float cutoffFreq, float sampleRate)
 {
     float omega = 2.0 * PI * cutoffFreq / sampleRate;
@@ -222,7 +273,8 @@ Fir *firHP(int size, float cutoffFreq, float sampleRate, int windowType)
     Fir *fir = firCreate(size);
     firHPCoeffs(size, fir->coeffs, cutoffFreq, sampleRate);
     windowize(size, fir->coeffs, windowType);
-    normalize(size, fir->coeffs);
+    normalize(size, fir->coeffs, PI);
+    firSetCoeffs(fir);
     return fir;
 }
 
@@ -248,7 +300,25 @@ Fir *firBP(int size, float loCutoffFreq, float hiCutoffFreq, float sampleRate, i
     Fir *fir = firCreate(size);
     firBPCoeffs(size, fir->coeffs, loCutoffFreq, hiCutoffFreq, sampleRate);
     windowize(size, fir->coeffs, windowType);
-    normalize(size, fir->coeffs);
+    normalize(size, fir->coeffs, PI * (loCutoffFreq + hiCutoffFreq) / sampleRate);
+    firSetCoeffs(fir);
+    return fir;
+}
+
+
+Fir *firDesign(const FilterSpec *spec)
+{
+    float *coeffs = (float *)malloc(DESIGN_MAX_TAPS * sizeof(float));
+    if (!coeffs)
+        return NULL;
+    int size = designFilter(spec, coeffs);
+    Fir *fir = (size) ? firCreate(size) : NULL;
+    if (fir)
+        {
+        memcpy(fir->coeffs, coeffs, size * sizeof(float));
+        firSetCoeffs(fir);
+        }
+    free(coeffs);
     return fir;
 }
 
@@ -262,7 +332,10 @@ Fir *firBP(int size, float loCutoffFreq, float hiCutoffFreq, float sampleRate, i
 static Biquad *biquadCreate()
 {
     Biquad *bq = (Biquad *)malloc(sizeof(Biquad));
+    if (!bq)
+        return NULL;
     memset(bq, 0, sizeof(Biquad));
+    bq->b0 = 1.0;
     return bq;
 }
 
@@ -271,87 +344,421 @@ void biquadDelete(Biquad *bq)
     free(bq);
 }
 
+void biquadReset(Biquad *bq)
+{
+    bq->s1  = bq->s2  = 0.0;
+    bq->s1c = bq->s2c = 0.0;
+}
+
+/**
+ * Store a design, divided through by a0
+ */
+static void biquadSetCoeffs(Biquad *bq, double b0, double b1, double b2,
+                            double a0, double a1, double a2)
+{
+    bq->b0 = b0 / a0;
+    bq->b1 = b1 / a0;
+    bq->b2 = b2 / a0;
+    bq->a1 = a1 / a0;
+    bq->a2 = a2 / a0;
+}
+
 float biquadUpdate(Biquad *bq, float v)
 {
-   float y = v * bq->a0 + bq->x1 * bq->a1 + bq->x2 * bq->a2 - bq->y1 * bq->b1 - bq->y2 * bq->b2;
-   bq->x2 = bq->x1 ; bq->x1 = v ; bq->y2 = bq->y1 ; bq->y1 = y;
-   return y;
+    float y = bq->b0 * v + bq->s1;
+    bq->s1  = bq->b1 * v - bq->a1 * y + bq->s2;
+    bq->s2  = bq->b2 * v - bq->a2 * y;
+    return y;
 }
 
 float complex biquadUpdateC(Biquad *bq, float complex v)
 {
-   float y = v * bq->a0 + bq->x1c * bq->a1 + bq->x2c * bq->a2 - bq->y1c * bq->b1 - bq->y2c * bq->b2;
-   bq->x2c = bq->x1c ; bq->x1c = v ; bq->y2c = bq->y1c ; bq->y1c = y;
-   return y;
+    float complex y = bq->b0 * v + bq->s1c;
+    bq->s1c = bq->b1 * v - bq->a1 * y + bq->s2c;
+    bq->s2c = bq->b2 * v - bq->a2 * y;
+    return y;
 }
 
 Biquad *biquadLP(float frequency, float sampleRate, float q)
 {
     Biquad *bq = biquadCreate();
+    if (!bq)
+        return NULL;
     if (q == 0) q = 0.707;
-    float freq = TWOPI * frequency / sampleRate;
-    float alpha = sin(freq) / (2.0 * q);
-    bq->b0 = (1.0 - cos(freq)) / 2.0;
-    bq->b1 =  1.0 - cos(freq);
-    bq->b2 = (1.0 - cos(freq)) / 2.0;
-    bq->a0 =  1.0 + alpha;
-    bq->a1 = -2.0 * cos(freq);
-    bq->a2 =  1.0 - alpha;
+    double freq = TWOPI * frequency / sampleRate;
+    double alpha = sin(freq) / (2.0 * q);
+    double cs = cos(freq);
+    biquadSetCoeffs(bq, (1.0 - cs) / 2.0, 1.0 - cs, (1.0 - cs) / 2.0,
+                        1.0 + alpha, -2.0 * cs, 1.0 - alpha);
     return bq;
 }
 
 Biquad *biquadHP(float frequency, float sampleRate, float q)
 {
     Biquad *bq = biquadCreate();
+    if (!bq)
+        return NULL;
     if (q == 0) q = 0.707;
-    float freq = TWOPI * frequency / sampleRate;
-    float alpha = sin(freq) / (2.0 * q);
-    bq->b0 = (1.0 + cos(freq)) / 2.0;
-    bq->b1 =  1.0 + cos(freq);
-    bq->b2 = (1.0 + cos(freq)) / 2.0;
-    bq->a0 =  1.0 + alpha;
-    bq->a1 = -2.0 * cos(freq);
-    bq->a2 =  1.0 - alpha;
+    double freq = TWOPI * frequency / sampleRate;
+    double alpha = sin(freq) / (2.0 * q);
+    double cs = cos(freq);
+    biquadSetCoeffs(bq, (1.0 + cs) / 2.0, -(1.0 + cs), (1.0 + cs) / 2.0,
+                        1.0 + alpha, -2.0 * cs, 1.0 - alpha);
     return bq;
 }
 
+/**
+ * Constant 0dB peak gain
+ */
 Biquad *biquadBP(float frequency, float sampleRate, float q)
 {
     Biquad *bq = biquadCreate();
+    if (!bq)
+        return NULL;
     if (q == 0) q = 0.707;
-    float freq = TWOPI * frequency / sampleRate;
-    float alpha = sin(freq) / (2.0 * q);
-    bq->b0 = sin(freq) / 2.0;
-    bq->b1 =  0.0;
-    bq->b2 = -sin(freq) / 2.0;
-    bq->a0 =  1.0 + alpha;
-    bq->a1 = -2.0 * cos(freq);
-    bq->a2 =  1.0 - alpha;
+    double freq = TWOPI * frequency / sampleRate;
+    double alpha = sin(freq) / (2.0 * q);
+    double cs = cos(freq);
+    biquadSetCoeffs(bq, alpha, 0.0, -alpha,
+                        1.0 + alpha, -2.0 * cs, 1.0 - alpha);
     return bq;
 }
 
 Biquad *biquadBR(float frequency, float sampleRate, float q)
 {
     Biquad *bq = biquadCreate();
+    if (!bq)
+        return NULL;
     if (q == 0) q = 0.707;
-    float freq = TWOPI * frequency / sampleRate;
-    float alpha = sin(freq) / (2.0 * q);
-    bq->b0 =  1.0;
-    bq->b1 = -2.0 * cos(freq);
-    bq->b2 =  1.0;
-    bq->a0 =  1.0 + alpha;
-    bq->a1 = -2.0 * cos(freq);
-    bq->a2 =  1.0 - alpha;
+    double freq = TWOPI * frequency / sampleRate;
+    double alpha = sin(freq) / (2.0 * q);
+    double cs = cos(freq);
+    biquadSetCoeffs(bq, 1.0, -2.0 * cs, 1.0,
+                        1.0 + alpha, -2.0 * cs, 1.0 - alpha);
     return bq;
 }
 
 
 
-    
+//########################################################################
+//#  S O S    C A S C A D E S
+//########################################################################
+
+Sos *sosCreate(void)
+{
+    Sos *sos = (Sos *)malloc(sizeof(Sos));
+    if (!sos)
+        return NULL;
+    memset(sos, 0, sizeof(Sos));
+    return sos;
+}
+
+void sosDelete(Sos *sos)
+{
+    free(sos);
+}
+
+void sosReset(Sos *sos)
+{
+    for (int s = 0 ; s < SOS_MAX_SECTIONS ; s++)
+        {
+        sos->s1[s]  = sos->s2[s]  = 0.0;
+        sos->s1c[s] = sos->s2c[s] = 0.0;
+        }
+}
+
+int sosAppend(Sos *sos, const Biquad *bq)
+{
+    int s = sos->sections;
+    if (s >= SOS_MAX_SECTIONS)
+        {
+        error("sos: more than %d sections", SOS_MAX_SECTIONS);
+        return FALSE;
+        }
+    sos->b0[s]  = bq->b0;
+    sos->b1[s]  = bq->b1;
+    sos->b2[s]  = bq->b2;
+    sos->a1[s]  = bq->a1;
+    sos->a2[s]  = bq->a2;
+    sos->s1[s]  = sos->s2[s]  = 0.0;
+    sos->s1c[s] = sos->s2c[s] = 0.0;
+    sos->sections = s + 1;
+    return TRUE;
+}
+
+void sosUpdate(Sos *sos, float *out, const float *in, int len)
+{
+    if (!sos->sections)
+        {
+        if (out != in)
+            memmove(out, in, len * sizeof(float));
+        return;
+        }
+    const float *src = in;
+    for (int s = 0 ; s < sos->sections ; s++)
+        {
+        float b0 = sos->b0[s], b1 = sos->b1[s], b2 = sos->b2[s];
+        float a1 = sos->a1[s], a2 = sos->a2[s];
+        float s1 = sos->s1[s], s2 = sos->s2[s];
+        for (int i = 0 ; i < len ; i++)
+            {
+            float x = src[i];
+            float y = b0 * x + s1;
+            s1 = b1 * x - a1 * y + s2;
+            s2 = b2 * x - a2 * y;
+            out[i] = y;
+            }
+        sos->s1[s] = s1;
+        sos->s2[s] = s2;
+        src = out;
+        }
+}
+
+void sosUpdateC(Sos *sos, float complex *out, const float complex *in, int len)
+{
+    if (!sos->sections)
+        {
+        if (out != in)
+            memmove(out, in, len * sizeof(float complex));
+        return;
+        }
+    const float complex *src = in;
+    for (int s = 0 ; s < sos->sections ; s++)
+        {
+        float b0 = sos->b0[s], b1 = sos->b1[s], b2 = sos->b2[s];
+        float a1 = sos->a1[s], a2 = sos->a2[s];
+        float complex s1 = sos->s1c[s], s2 = sos->s2c[s];
+        for (int i = 0 ; i < len ; i++)
+            {
+            float complex x = src[i];
+            float complex y = b0 * x + s1;
+            s1 = b1 * x - a1 * y + s2;
+            s2 = b2 * x - a2 * y;
+            out[i] = y;
+            }
+        sos->s1c[s] = s1;
+        sos->s2c[s] = s2;
+        src = out;
+        }
+}
+
+
+/**
+ * Butterworth cascades.  Each pair of poles becomes a cookbook section
+ * with the Q of that pair, and an odd order adds one real pole, made
+ * with the bilinear transform.
+ */
+static Sos *sosButterworth(int order, float frequency, float sampleRate, int highpass)
+{
+    if (order < 1 || order > 2 * SOS_MAX_SECTIONS)
+        {
+        error("sos: order %d out of range", order);
+        return NULL;
+        }
+    Sos *sos = sosCreate();
+    if (!sos)
+        return NULL;
+    for (int k = 0 ; k < order / 2 ; k++)
+        {
+        float q = 1.0 / (2.0 * sin(PI * (2 * k + 1) / (2.0 * order)));
+        Biquad *bq = (highpass) ? biquadHP(frequency, sampleRate, q) :
+                                  biquadLP(frequency, sampleRate, q);
+        if (!bq)
+            {
+            sosDelete(sos);
+            return NULL;
+            }
+        sosAppend(sos, bq);
+        biquadDelete(bq);
+        }
+    if (order & 1)
+        {
+        Biquad bq;
+        double k = tan(PI * frequency / sampleRate);
+        if (highpass)
+            biquadSetCoeffs(&bq, 1.0, -1.0, 0.0, 1.0 + k, k - 1.0, 0.0);
+        else
+            biquadSetCoeffs(&bq, k, k, 0.0, 1.0 + k, k - 1.0, 0.0);
+        sosAppend(sos, &bq);
+        }
+    return sos;
+}
+
+Sos *sosLP(int order, float frequency, float sampleRate)
+{
+    return sosButterworth(order, frequency, sampleRate, FALSE);
+}
+
+Sos *sosHP(int order, float frequency, float sampleRate)
+{
+    return sosButterworth(order, frequency, sampleRate, TRUE);
+}
+
+/**
+ * The same one-pole response as the demodulators' own de-emphasis
+ */
+Sos *sosDeemphasis(float tau, float sampleRate)
+{
+    Sos *sos = sosCreate();
+    if (!sos)
+        return NULL;
+    Biquad bq;
+    double pole = exp(-1.0 / (tau * sampleRate));
+    biquadSetCoeffs(&bq, 1.0 - pole, 0.0, 0.0, 1.0, -pole, 0.0);
+    sosAppend(sos, &bq);
+    return sos;
+}
+
+/**
+ * Scaled by (1 + pole) / 2 for unity gain at Nyquist
+ */
+Sos *sosDcBlock(float frequency, float sampleRate)
+{
+    Sos *sos = sosCreate();
+    if (!sos)
+        return NULL;
+    Biquad bq;
+    double pole = exp(-TWOPI * frequency / sampleRate);
+    double gain = (1.0 + pole) / 2.0;
+    biquadSetCoeffs(&bq, gain, -gain, 0.0, 1.0, -pole, 0.0);
+    sosAppend(sos, &bq);
+    return sos;
+}
+
+
+
+//########################################################################
+//#  S O S    B A N K S
+//########################################################################
+
+/**
+ * GCC and clang lower this to whatever vector registers the target
+ * has, so the lanes of a bank move together without any intrinsics.
+ */
+#if defined(__GNUC__)
+#define SOS_VECTOR
+typedef float SosVec __attribute__((vector_size(SOS_LANES * sizeof(float))));
+#endif
 
 
+/**
+ * Make a section of every lane pass through
+ */
+static void sosBankClearSection(SosBank *bank, int s)
+{
+    for (int k = 0 ; k < SOS_LANES ; k++)
+        {
+        bank->b0[s][k] = 1.0;
+        bank->b1[s][k] = bank->b2[s][k] = 0.0;
+        bank->a1[s][k] = bank->a2[s][k] = 0.0;
+        bank->s1[s][k] = bank->s2[s][k] = 0.0;
+        }
+}
 
+SosBank *sosBankCreate(void)
+{
+    SosBank *bank = (SosBank *)malloc(sizeof(SosBank));
+    if (!bank)
+        return NULL;
+    bank->sections = 0;
+    for (int s = 0 ; s < SOS_MAX_SECTIONS ; s++)
+        sosBankClearSection(bank, s);
+    return bank;
+}
 
+void sosBankDelete(SosBank *bank)
+{
+    free(bank);
+}
+
+void sosBankReset(SosBank *bank)
+{
+    memset(bank->s1, 0, sizeof(bank->s1));
+    memset(bank->s2, 0, sizeof(bank->s2));
+}
+
+int sosBankSet(SosBank *bank, int lane, const Sos *sos)
+{
+    if (lane < 0 || lane >= SOS_LANES)
+        {
+        error("sosBank: no lane %d", lane);
+        return FALSE;
+        }
+    for (int s = 0 ; s < SOS_MAX_SECTIONS ; s++)
+        {
+        int used = (s < sos->sections);
+        bank->b0[s][lane] = (used) ? sos->b0[s] : 1.0;
+        bank->b1[s][lane] = (used) ? sos->b1[s] : 0.0;
+        bank->b2[s][lane] = (used) ? sos->b2[s] : 0.0;
+        bank->a1[s][lane] = (used) ? sos->a1[s] : 0.0;
+        bank->a2[s][lane] = (used) ? sos->a2[s] : 0.0;
+        bank->s1[s][lane] = bank->s2[s][lane] = 0.0;
+        }
+    //trailing sections that no lane uses any more can be skipped
+    int sections = 0;
+    for (int s = 0 ; s < SOS_MAX_SECTIONS ; s++)
+        for (int k = 0 ; k < SOS_LANES ; k++)
+            if (bank->b0[s][k] != 1.0 || bank->b1[s][k] != 0.0 || bank->b2[s][k] != 0.0 ||
+                bank->a1[s][k] != 0.0 || bank->a2[s][k] != 0.0)
+                sections = s + 1;
+    bank->sections = sections;
+    return TRUE;
+}
+
+void sosBankUpdate(SosBank *bank, float *out, const float *in, int len)
+{
+    if (!bank->sections)
+        {
+        if (out != in)
+            memmove(out, in, len * SOS_LANES * sizeof(float));
+        return;
+        }
+    const float *src = in;
+    for (int s = 0 ; s < bank->sections ; s++)
+        {
+#ifdef SOS_VECTOR
+        //memcpy, because neither the rows nor the samples need be
+        //aligned to the width of the vector
+        SosVec b0, b1, b2, a1, a2, s1, s2;
+        memcpy(&b0, bank->b0[s], sizeof(SosVec));
+        memcpy(&b1, bank->b1[s], sizeof(SosVec));
+        memcpy(&b2, bank->b2[s], sizeof(SosVec));
+        memcpy(&a1, bank->a1[s], sizeof(SosVec));
+        memcpy(&a2, bank->a2[s], sizeof(SosVec));
+        memcpy(&s1, bank->s1[s], sizeof(SosVec));
+        memcpy(&s2, bank->s2[s], sizeof(SosVec));
+        for (int i = 0 ; i < len ; i++)
+            {
+            SosVec x;
+            memcpy(&x, src + i * SOS_LANES, sizeof(SosVec));
+            SosVec y = b0 * x + s1;
+            s1 = b1 * x - a1 * y + s2;
+            s2 = b2 * x - a2 * y;
+            memcpy(out + i * SOS_LANES, &y, sizeof(SosVec));
+            }
+        memcpy(bank->s1[s], &s1, sizeof(SosVec));
+        memcpy(bank->s2[s], &s2, sizeof(SosVec));
+#else
+        float *b0 = bank->b0[s], *b1 = bank->b1[s], *b2 = bank->b2[s];
+        float *a1 = bank->a1[s], *a2 = bank->a2[s];
+        float *s1 = bank->s1[s], *s2 = bank->s2[s];
+        for (int i = 0 ; i < len ; i++)
+            {
+            const float *x = src + i * SOS_LANES;
+            float *y = out + i * SOS_LANES;
+            for (int k = 0 ; k < SOS_LANES ; k++)
+                {
+                float xk = x[k];
+                float yk = b0[k] * xk + s1[k];
+                s1[k] = b1[k] * xk - a1[k] * yk + s2[k];
+                s2[k] = b2[k] * xk - a2[k] * yk;
+                y[k] = yk;
+                }
+            }
+#endif
+        src = out;
+        }
+}
 
 
 
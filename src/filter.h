@@ -29,6 +29,8 @@
 
 
 #include "sdrlib.h"
+#include "design.h"
+#include "kernel.h"
 
 
 //########################################################################
@@ -44,13 +46,16 @@ struct Fir
 {
     int size;
     float *coeffs;
+    int symmetric;  //set by the factories, when the design is linear phase
+    DotFunc *dot;   //chosen along with symmetric
+    DotFuncC *dotC;
     int delayIndex;
-    float *delayLine;
-    float complex *delayLineC;
+    float *delayLine;          //2 * size, so the window never wraps
+    float complex *delayLineC; //the same
 };
 
 
-enum
+typedef enum
 {
     W_NONE,
     W_HAMMING,
@@ -71,6 +76,11 @@ Fir *firCreate(int size);
  */
 void firDelete(Fir *fir);
 
+/**
+ * Clear the delay line, such as after a gap in the input
+ */
+void firReset(Fir *fir);
+
 
 /**
  * Update a real-valued FIR filter with a sample.
@@ -91,11 +101,28 @@ float firUpdate(Fir *fir, float sample);
 float complex firUpdateC(Fir *fir, float complex sample);
 
 
+/**
+ * Run a block of complex samples through a filter, and keep only every
+ * factor'th output.  Only those are computed, so this costs 1/factor
+ * of running every sample through firUpdateC().
+ * @param phase samples since the last output, carried between calls
+ * @return the number of outputs
+ */
+int firDecimateC(Fir *fir, float complex *out, const float complex *in, int len,
+                 int factor, int *phase);
+
+
 /**
  * Create a FIR lowpass filter
  */
 Fir *firLP(int size, float cutoffFreq, float sampleRate, int windowType);
 
+/**
+ * Redesign a filter as a lowpass, in place, keeping its size.  This
+ * does not allocate, so the dsp thread may call it between blocks.
+ */
+void firSetLP(Fir *fir, float cutoffFreq, float sampleRate, int windowType);
+
 
 /**
  * Create a FIR highpass filter
@@ -109,37 +136,68 @@ Fir *firHP(int size, float cutoffFreq, float sampleRate, int windowType);
 Fir *firBP(int size, float loCutoffFreq, float hiCutoffFreq, float sampleRate, int windowType);
 
 
+/**
+ * Create the shortest FIR lowpass or bandpass filter that meets a spec
+ * @return the new filter, or NULL if the spec is impossible
+ */
+Fir *firDesign(const FilterSpec *spec);
+
+
 
 //########################################################################
 //#  B I Q U A D
 //########################################################################
 
+/**
+ * One second-order section, with its coefficients normalized so that
+ * a0 == 1:
+ *
+ *     y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+ *
+ * It runs in transposed direct form II, which needs only two state
+ * variables and keeps them small, so it behaves well in float.
+ */
 struct Biquad
 {
     float b0;
     float b1;
     float b2;
-    float a0;
     float a1;
     float a2;
-    float x1;
-    float x2;
-    float y1;
-    float y2;
-    float complex x1c;
-    float complex x2c;
-    float complex y1c;
-    float complex y2c;
+    float s1;
+    float s2;
+    float complex s1c;
+    float complex s2c;
 };
 
 
-
+/**
+ * Frees a biquad made by one of the factories below
+ */
 void biquadDelete(Biquad *bq);
 
+/**
+ * Clear the state, such as after a gap in the input
+ */
+void biquadReset(Biquad *bq);
+
+/**
+ * Update a real-valued biquad with a sample
+ * @return the output of the filter
+ */
 float biquadUpdate(Biquad *bq, float v);
 
+/**
+ * Update a complex-valued biquad with a sample.  The real and complex
+ * paths keep separate state.
+ * @return the output of the filter
+ */
 float complex biquadUpdateC(Biquad *bq, float complex v);
 
+/**
+ * The RBJ cookbook designs.  A q of 0 means 0.707, for a Butterworth
+ * response.
+ */
 Biquad *biquadLP(float frequency, float sampleRate, float q);
 
 Biquad *biquadHP(float frequency, float sampleRate, float q);
@@ -150,6 +208,147 @@ Biquad *biquadBR(float frequency, float sampleRate, float q);
 
 
 
+//########################################################################
+//#  S O S    C A S C A D E S
+//########################################################################
+
+/**
+ * The most sections in a cascade, enough for a 16th order design
+ */
+#define SOS_MAX_SECTIONS 8
+
+/**
+ * A cascade of second-order sections.  A few of these do the work of a
+ * FIR of hundreds of taps, where linear phase does not matter, as for
+ * de-emphasis, DC blocking or shaping audio.
+ *
+ * The updates run a whole block through one section before the next,
+ * so that each section's coefficients and state stay in registers.
+ */
+struct Sos
+{
+    int sections;
+    float b0[SOS_MAX_SECTIONS];
+    float b1[SOS_MAX_SECTIONS];
+    float b2[SOS_MAX_SECTIONS];
+    float a1[SOS_MAX_SECTIONS];
+    float a2[SOS_MAX_SECTIONS];
+    float s1[SOS_MAX_SECTIONS];
+    float s2[SOS_MAX_SECTIONS];
+    float complex s1c[SOS_MAX_SECTIONS];
+    float complex s2c[SOS_MAX_SECTIONS];
+};
+
+
+/**
+ * Create an empty cascade, which passes its input through
+ */
+Sos *sosCreate(void);
+
+void sosDelete(Sos *sos);
+
+/**
+ * Clear the state of every section
+ */
+void sosReset(Sos *sos);
+
+/**
+ * Append a section, copying the coefficients of a biquad
+ * @return TRUE if there was room, else FALSE
+ */
+int sosAppend(Sos *sos, const Biquad *bq);
+
+/**
+ * Filter a block of real samples.  out may be the same as in.
+ */
+void sosUpdate(Sos *sos, float *out, const float *in, int len);
+
+/**
+ * Filter a block of complex samples.  out may be the same as in.
+ */
+void sosUpdateC(Sos *sos, float complex *out, const float complex *in, int len);
+
+/**
+ * A Butterworth lowpass of the given order, up to 2 * SOS_MAX_SECTIONS.
+ * An odd order ends with a first-order section.
+ * @return the new cascade, or NULL if the order is out of range
+ */
+Sos *sosLP(int order, float frequency, float sampleRate);
+
+/**
+ * A Butterworth highpass, as for sosLP()
+ */
+Sos *sosHP(int order, float frequency, float sampleRate);
+
+/**
+ * The first-order lowpass used for FM de-emphasis, such as 75us
+ */
+Sos *sosDeemphasis(float tau, float sampleRate);
+
+/**
+ * A DC blocker, with a zero at DC and its corner at the given frequency
+ */
+Sos *sosDcBlock(float frequency, float sampleRate);
+
+
+
+//########################################################################
+//#  S O S    B A N K S
+//########################################################################
+
+/**
+ * The channels filtered at once by a bank.  Eight fill an AVX
+ * register, or two SSE or NEON registers.
+ */
+#define SOS_LANES 8
+
+/**
+ * Cascades for up to SOS_LANES channels, run side by side.  Each
+ * coefficient and state is kept as a row of SOS_LANES, one per
+ * channel, so that one vector operation steps every channel through a
+ * section at once.  Samples are interleaved the same way, with sample
+ * i of lane k at [i * SOS_LANES + k].
+ *
+ * The channels may have different designs.  Those with fewer sections
+ * than the longest are padded with sections that pass their input
+ * through, and unused lanes pass through too.
+ */
+struct SosBank
+{
+    int sections;
+    float b0[SOS_MAX_SECTIONS][SOS_LANES];
+    float b1[SOS_MAX_SECTIONS][SOS_LANES];
+    float b2[SOS_MAX_SECTIONS][SOS_LANES];
+    float a1[SOS_MAX_SECTIONS][SOS_LANES];
+    float a2[SOS_MAX_SECTIONS][SOS_LANES];
+    float s1[SOS_MAX_SECTIONS][SOS_LANES];
+    float s2[SOS_MAX_SECTIONS][SOS_LANES];
+};
+
+
+/**
+ * Create a bank with every lane passing its input through
+ */
+SosBank *sosBankCreate(void);
+
+void sosBankDelete(SosBank *bank);
+
+/**
+ * Clear the state of every lane
+ */
+void sosBankReset(SosBank *bank);
+
+/**
+ * Give a lane the coefficients of a cascade, and clear its state
+ * @return TRUE if the lane exists, else FALSE
+ */
+int sosBankSet(SosBank *bank, int lane, const Sos *sos);
+
+/**
+ * Filter a block of interleaved samples, len per lane.  out may be the
+ * same as in.
+ */
+void sosBankUpdate(SosBank *bank, float *out, const float *in, int len);
 
 
 
@@ -0,0 +1,670 @@
+/**
+ * The inner loops of the FIR filters, and the other hot loops of
+ * the dsp, with a registry of the variants of each.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "kernel.h"
+#include "kernelgen.h"
+#include "latency.h"
+#include "private.h"
+
+
+/**
+ * The vector variants need the GCC vector extensions.  AVX is left
+ * out on Windows, where the stack is not aligned for its spills.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define KERNEL_SSE
+#if !defined(_WIN32)
+#define KERNEL_AVX
+#endif
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define KERNEL_NEON
+#endif
+#endif
+
+
+int kernelIsSymmetric(const float *h, int n)
+{
+    for (int i = 0, j = n - 1 ; i < j ; i++, j--)
+        {
+        //designs are computed in single precision, so allow for rounding
+        float tol = 1.0e-6 * (fabs(h[i]) + fabs(h[j]));
+        if (fabs(h[i] - h[j]) > tol)
+            return FALSE;
+        }
+    return TRUE;
+}
+
+
+float dotReal(const float *x, const float *h, int n)
+{
+    float sum = 0.0;
+    while (n--)
+        sum += (*x++) * (*h++);
+    return sum;
+}
+
+
+float dotRealSym(const float *x, const float *h, int n)
+{
+    const float *xr = x + n - 1;
+    int half = n >> 1;
+    float sum = 0.0;
+    while (half--)
+        sum += ((*x++) + (*xr--)) * (*h++);
+    if (n & 1)
+        sum += (*x) * (*h);
+    return sum;
+}
+
+
+float complex dotComplex(const float complex *x, const float *h, int n)
+{
+    float complex sum = 0.0;
+    while (n--)
+        sum += (*x++) * (*h++);
+    return sum;
+}
+
+
+float complex dotComplexSym(const float complex *x, const float *h, int n)
+{
+    const float complex *xr = x + n - 1;
+    int half = n >> 1;
+    float complex sum = 0.0;
+    while (half--)
+        sum += ((*x++) + (*xr--)) * (*h++);
+    if (n & 1)
+        sum += (*x) * (*h);
+    return sum;
+}
+
+
+void rotateComplex(float complex *out, const float complex *in, int n,
+                   float complex *phase, float complex step)
+{
+    float complex ph = *phase;
+    for (int i = 0 ; i < n ; i++)
+        {
+        ph *= step;
+        out[i] = in[i] * ph;
+        }
+    *phase = ph;
+}
+
+
+void magnitudeComplex(float *out, const float complex *in, int n)
+{
+    for (int i = 0 ; i < n ; i++)
+        {
+        float re = crealf(in[i]);
+        float im = cimagf(in[i]);
+        out[i] = sqrtf(re * re + im * im);
+        }
+}
+
+
+void phaseComplex(float *out, const float complex *in, int n)
+{
+    for (int i = 0 ; i < n ; i++)
+        out[i] = atan2f(cimagf(in[i]), crealf(in[i]));
+}
+
+
+void convertU8(float complex *out, const unsigned char *in, int n)
+{
+    float *outf = (float *)out;
+    for (int i = 0 ; i < 2 * n ; i++)
+        outf[i] = ((float)in[i] - 127.0f) * (1.0f / 128.0f);
+}
+
+
+/**
+ * The polynomial's coefficients are fixed sums of the four samples,
+ * so only mu changes from one output to the next
+ */
+void farrowCubic(float *out, const float *x, const int *index, const float *mu, int n)
+{
+    for (int i = 0 ; i < n ; i++)
+        {
+        const float *p = x + index[i];
+        float xm1 = p[-1];
+        float x0  = p[0];
+        float x1  = p[1];
+        float x2  = p[2];
+        float c1  = x1 - (1.0f / 3.0f) * xm1 - 0.5f * x0 - (1.0f / 6.0f) * x2;
+        float c2  = 0.5f * (xm1 + x1) - x0;
+        float c3  = (1.0f / 6.0f) * (x2 - xm1) + 0.5f * (x0 - x1);
+        float m   = mu[i];
+        out[i] = ((c3 * m + c2) * m + c1) * m + x0;
+        }
+}
+
+
+
+//########################################################################
+//#  V E C T O R    V A R I A N T S
+//########################################################################
+
+#ifdef KERNEL_SSE
+#define KV_WIDTH   4
+#define KV_SUFFIX  Sse
+#define KV_ATTR
+#define KV_SQRT(v) ((KV(vf))_mm_sqrt_ps((__m128)(v)))
+#define KV_RSQRT(v) ((KV(vf))_mm_rsqrt_ps((__m128)(v)))
+#include "kernelvec.h"
+#endif
+
+#ifdef KERNEL_AVX
+#define KV_WIDTH   8
+#define KV_SUFFIX  Avx2
+#define KV_ATTR    __attribute__((target("avx2,fma")))
+#define KV_SQRT(v) ((KV(vf))_mm256_sqrt_ps((__m256)(v)))
+#define KV_RSQRT(v) ((KV(vf))_mm256_rsqrt_ps((__m256)(v)))
+#include "kernelvec.h"
+
+#define KV_WIDTH   16
+#define KV_SUFFIX  Avx512
+#define KV_ATTR    __attribute__((target("avx512f")))
+#define KV_SQRT(v) ((KV(vf))_mm512_sqrt_ps((__m512)(v)))
+#define KV_RSQRT(v) ((KV(vf))_mm512_rsqrt14_ps((__m512)(v)))
+#include "kernelvec.h"
+#endif
+
+#ifdef KERNEL_NEON
+#define KV_WIDTH   4
+#define KV_SUFFIX  Neon
+#define KV_ATTR
+#define KV_SQRT(v) ((KV(vf))vsqrtq_f32((float32x4_t)(v)))
+#define KV_RSQRT(v) ((KV(vf))vrsqrteq_f32((float32x4_t)(v)))
+#include "kernelvec.h"
+#endif
+
+
+
+//########################################################################
+//#  R E G I S T R Y
+//########################################################################
+
+typedef void KernelFunc(void);
+
+typedef struct
+{
+    const char *name;
+    KernelFunc *func;
+    int (*available)(void);
+} KernelVariant;
+
+
+static int haveAlways(void)
+{
+    return TRUE;
+}
+
+#ifdef KERNEL_AVX
+static int haveAvx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+static int haveAvx512(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+
+/**
+ * The vector variants of a kernel, for whichever targets were built
+ */
+#ifdef KERNEL_SSE
+#define SSE_VARIANT(f) { "sse", (KernelFunc *)f##Sse, haveAlways },
+#else
+#define SSE_VARIANT(f)
+#endif
+#ifdef KERNEL_AVX
+#define AVX_VARIANTS(f) { "avx2", (KernelFunc *)f##Avx2, haveAvx2 }, \
+                        { "avx512", (KernelFunc *)f##Avx512, haveAvx512 },
+#else
+#define AVX_VARIANTS(f)
+#endif
+#ifdef KERNEL_NEON
+#define NEON_VARIANT(f) { "neon", (KernelFunc *)f##Neon, haveAlways },
+#else
+#define NEON_VARIANT(f)
+#endif
+#define VECTOR_VARIANTS(f) SSE_VARIANT(f) AVX_VARIANTS(f) NEON_VARIANT(f)
+
+/**
+ * The reciprocal square root estimates are quick, but coarse, so
+ * whether they win over a true square root varies with the cpu
+ */
+#ifdef KERNEL_SSE
+#define SSE_RSQRT(f) { "sse-rsqrt", (KernelFunc *)f##Sse, haveAlways },
+#else
+#define SSE_RSQRT(f)
+#endif
+#ifdef KERNEL_AVX
+#define AVX_RSQRT(f) { "avx2-rsqrt", (KernelFunc *)f##Avx2, haveAvx2 }, \
+                     { "avx512-rsqrt", (KernelFunc *)f##Avx512, haveAvx512 },
+#else
+#define AVX_RSQRT(f)
+#endif
+#ifdef KERNEL_NEON
+#define NEON_RSQRT(f) { "neon-rsqrt", (KernelFunc *)f##Neon, haveAlways },
+#else
+#define NEON_RSQRT(f)
+#endif
+#define RSQRT_VARIANTS(f) SSE_RSQRT(f) AVX_RSQRT(f) NEON_RSQRT(f)
+
+
+//the vector dot products do not fold, but are still right for symmetric taps
+static const KernelVariant dotVariants[]       = { { "scalar", (KernelFunc *)dotReal, haveAlways },
+                                                   VECTOR_VARIANTS(dotReal) { NULL, NULL, NULL } };
+static const KernelVariant dotSymVariants[]    = { { "scalar", (KernelFunc *)dotRealSym, haveAlways },
+                                                   VECTOR_VARIANTS(dotReal) { NULL, NULL, NULL } };
+static const KernelVariant dotCVariants[]      = { { "scalar", (KernelFunc *)dotComplex, haveAlways },
+                                                   VECTOR_VARIANTS(dotComplex) { NULL, NULL, NULL } };
+static const KernelVariant dotCSymVariants[]   = { { "scalar", (KernelFunc *)dotComplexSym, haveAlways },
+                                                   VECTOR_VARIANTS(dotComplex) { NULL, NULL, NULL } };
+static const KernelVariant rotateVariants[]    = { { "scalar", (KernelFunc *)rotateComplex, haveAlways },
+                                                   VECTOR_VARIANTS(rotateComplex) { NULL, NULL, NULL } };
+static const KernelVariant magnitudeVariants[] = { { "scalar", (KernelFunc *)magnitudeComplex, haveAlways },
+                                                   VECTOR_VARIANTS(magnitudeComplex)
+                                                   RSQRT_VARIANTS(magnitudeRsqrt) { NULL, NULL, NULL } };
+static const KernelVariant phaseVariants[]     = { { "scalar", (KernelFunc *)phaseComplex, haveAlways },
+                                                   VECTOR_VARIANTS(phaseComplex) { NULL, NULL, NULL } };
+static const KernelVariant convertU8Variants[] = { { "scalar", (KernelFunc *)convertU8, haveAlways },
+                                                   VECTOR_VARIANTS(convertU8) { NULL, NULL, NULL } };
+static const KernelVariant farrowVariants[]    = { { "scalar", (KernelFunc *)farrowCubic, haveAlways },
+                                                   VECTOR_VARIANTS(farrowCubic) { NULL, NULL, NULL } };
+
+
+static const struct
+{
+    const char *name;
+    const KernelVariant *variants;
+} primitives[KERNEL_PRIMITIVES] =
+{
+    { "dot",       dotVariants       },
+    { "dotsym",    dotSymVariants    },
+    { "dotc",      dotCVariants      },
+    { "dotcsym",   dotCSymVariants   },
+    { "rotate",    rotateVariants    },
+    { "magnitude", magnitudeVariants },
+    { "phase",     phaseVariants     },
+    { "convertu8", convertU8Variants },
+    { "farrow",    farrowVariants    }
+};
+
+
+Kernels kernels =
+{
+    dotReal,
+    dotRealSym,
+    dotComplex,
+    dotComplexSym,
+    rotateComplex,
+    magnitudeComplex,
+    phaseComplex,
+    convertU8,
+    farrowCubic
+};
+
+static int bound[KERNEL_PRIMITIVES]; //the variant in use for each
+
+
+static int validPrimitive(int primitive)
+{
+    return primitive >= 0 && primitive < KERNEL_PRIMITIVES;
+}
+
+
+const char *kernelPrimitiveName(int primitive)
+{
+    return (validPrimitive(primitive)) ? primitives[primitive].name : NULL;
+}
+
+
+int kernelVariantCount(int primitive)
+{
+    if (!validPrimitive(primitive))
+        return 0;
+    int count = 0;
+    while (primitives[primitive].variants[count].name)
+        count++;
+    return count;
+}
+
+
+const char *kernelVariantName(int primitive, int variant)
+{
+    if (variant < 0 || variant >= kernelVariantCount(primitive))
+        return NULL;
+    return primitives[primitive].variants[variant].name;
+}
+
+
+int kernelVariantAvailable(int primitive, int variant)
+{
+    if (variant < 0 || variant >= kernelVariantCount(primitive))
+        return FALSE;
+    return primitives[primitive].variants[variant].available();
+}
+
+
+static void bindVariant(int primitive, int variant)
+{
+    KernelFunc *f = primitives[primitive].variants[variant].func;
+    switch (primitive)
+        {
+        case KERNEL_DOT:        kernels.dot       = (DotFunc *)f;       break;
+        case KERNEL_DOT_SYM:    kernels.dotSym    = (DotFunc *)f;       break;
+        case KERNEL_DOT_C:      kernels.dotC      = (DotFuncC *)f;      break;
+        case KERNEL_DOT_C_SYM:  kernels.dotCSym   = (DotFuncC *)f;      break;
+        case KERNEL_ROTATE:     kernels.rotate    = (RotateFunc *)f;    break;
+        case KERNEL_MAGNITUDE:  kernels.magnitude = (MagnitudeFunc *)f; break;
+        case KERNEL_PHASE:      kernels.phase     = (PhaseFunc *)f;     break;
+        case KERNEL_CONVERT_U8: kernels.convertU8 = (ConvertU8Func *)f; break;
+        case KERNEL_FARROW:     kernels.farrow    = (FarrowFunc *)f;    break;
+        }
+    bound[primitive] = variant;
+}
+
+
+int kernelBind(int primitive, const char *variant)
+{
+    int count = kernelVariantCount(primitive);
+    for (int i = 0 ; i < count ; i++)
+        {
+        if (strcmp(primitives[primitive].variants[i].name, variant) == 0)
+            {
+            if (!kernelVariantAvailable(primitive, i))
+                return FALSE;
+            bindVariant(primitive, i);
+            return TRUE;
+            }
+        }
+    return FALSE;
+}
+
+
+const char *kernelBound(int primitive)
+{
+    return kernelVariantName(primitive, bound[primitive]);
+}
+
+
+DotFunc *kernelSelect(int symmetric, int size)
+{
+    if (!symmetric)
+        return kernels.dot;
+    //the unrolled kernels are scalar, so only try them against the scalar loop
+    if (kernels.dotSym == dotRealSym)
+        {
+        DotFunc *gen = kernelGenDot(size);
+        if (gen)
+            return gen;
+        }
+    return kernels.dotSym;
+}
+
+
+DotFuncC *kernelSelectC(int symmetric, int size)
+{
+    if (!symmetric)
+        return kernels.dotC;
+    if (kernels.dotCSym == dotComplexSym)
+        {
+        DotFuncC *gen = kernelGenDotC(size);
+        if (gen)
+            return gen;
+        }
+    return kernels.dotCSym;
+}
+
+
+
+//########################################################################
+//#  P R O F I L E
+//########################################################################
+
+static const char *profilePath(const char *path)
+{
+    if (path)
+        return path;
+    const char *env = getenv("SDRLIB_KERNELS");
+    return (env) ? env : KERNEL_PROFILE;
+}
+
+
+int kernelLoadProfile(const char *path)
+{
+    path = profilePath(path);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return FALSE;
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+        {
+        char prim[64];
+        char variant[64];
+        if (line[0] == '#' || sscanf(line, "%63s %63s", prim, variant) != 2)
+            continue;
+        int i = 0;
+        while (i < KERNEL_PRIMITIVES && strcmp(primitives[i].name, prim) != 0)
+            i++;
+        if (i >= KERNEL_PRIMITIVES)
+            error("%s: unknown kernel '%s'", path, prim);
+        else if (!kernelBind(i, variant))
+            error("%s: variant '%s' of '%s' cannot run here", path, variant, prim);
+        }
+    fclose(f);
+    return TRUE;
+}
+
+
+/**
+ * Calibration works on one block, about the size the dsp sees
+ */
+#define CAL_SAMPLES 4096
+#define CAL_TAPS    127
+#define CAL_REPEAT  8
+#define CAL_RUNS    5
+
+typedef struct
+{
+    float x[CAL_SAMPLES];
+    float h[CAL_TAPS];
+    float complex xc[CAL_SAMPLES];
+    unsigned char bytes[2 * CAL_SAMPLES];
+    int index[CAL_SAMPLES];  //where the interpolator reads, a little under a sample apart
+    float mu[CAL_SAMPLES];
+    float out[CAL_SAMPLES];
+    float complex outc[CAL_SAMPLES];
+    float complex step;
+    float sink;
+} CalData;
+
+
+static void calRun(int primitive, KernelFunc *f, CalData *d)
+{
+    switch (primitive)
+        {
+        case KERNEL_DOT:
+        case KERNEL_DOT_SYM:
+            {
+            DotFunc *dot = (DotFunc *)f;
+            for (int i = 0 ; i + CAL_TAPS <= CAL_SAMPLES ; i++)
+                d->out[i] = dot(d->x + i, d->h, CAL_TAPS);
+            break;
+            }
+        case KERNEL_DOT_C:
+        case KERNEL_DOT_C_SYM:
+            {
+            DotFuncC *dot = (DotFuncC *)f;
+            for (int i = 0 ; i + CAL_TAPS <= CAL_SAMPLES ; i++)
+                d->outc[i] = dot(d->xc + i, d->h, CAL_TAPS);
+            break;
+            }
+        case KERNEL_ROTATE:
+            {
+            float complex phase = 1.0;
+            ((RotateFunc *)f)(d->outc, d->xc, CAL_SAMPLES, &phase, d->step);
+            break;
+            }
+        case KERNEL_MAGNITUDE:
+            ((MagnitudeFunc *)f)(d->out, d->xc, CAL_SAMPLES);
+            break;
+        case KERNEL_PHASE:
+            ((PhaseFunc *)f)(d->out, d->xc, CAL_SAMPLES);
+            break;
+        case KERNEL_CONVERT_U8:
+            ((ConvertU8Func *)f)(d->outc, d->bytes, CAL_SAMPLES);
+            break;
+        case KERNEL_FARROW:
+            ((FarrowFunc *)f)(d->out, d->x, d->index, d->mu, CAL_SAMPLES);
+            break;
+        }
+    d->sink += d->out[0] + crealf(d->outc[0]);
+}
+
+
+/**
+ * Run a variant and the scalar reference on the same data, and compare
+ */
+static int calCheck(int primitive, KernelFunc *f, CalData *d)
+{
+    static float out[CAL_SAMPLES];
+    static float complex outc[CAL_SAMPLES];
+    memset(d->out, 0, sizeof(d->out));
+    memset(d->outc, 0, sizeof(d->outc));
+    calRun(primitive, primitives[primitive].variants[0].func, d);
+    memcpy(out, d->out, sizeof(out));
+    memcpy(outc, d->outc, sizeof(outc));
+    memset(d->out, 0, sizeof(d->out));
+    memset(d->outc, 0, sizeof(d->outc));
+    calRun(primitive, f, d);
+    //the rotation drifts apart over the block, by a little each step
+    float tol = (primitive == KERNEL_ROTATE) ? 1.0e-3 : 1.0e-4;
+    for (int i = 0 ; i < CAL_SAMPLES ; i++)
+        {
+        if (fabs(out[i] - d->out[i]) > tol * (1.0 + fabs(out[i])))
+            return FALSE;
+        if (cabsf(outc[i] - d->outc[i]) > tol * (1.0 + cabsf(outc[i])))
+            return FALSE;
+        }
+    return TRUE;
+}
+
+
+int kernelCalibrate(const char *path)
+{
+    CalData *d = (CalData *)malloc(sizeof(CalData));
+    if (!d)
+        return FALSE;
+    memset(d, 0, sizeof(CalData));
+    unsigned int seed = 12345;
+    for (int i = 0 ; i < CAL_SAMPLES ; i++)
+        {
+        seed = seed * 1103515245 + 12345;
+        d->x[i]  = sin(i * 0.37) + (seed >> 16) / 65536.0 - 0.5;
+        d->xc[i] = d->x[i] + cos(i * 0.11) * I;
+        d->bytes[2 * i]     = (unsigned char)(seed >> 8);
+        d->bytes[2 * i + 1] = (unsigned char)(seed >> 20);
+        double pos = 1.0 + i * 0.9;
+        d->index[i] = (int)pos;
+        d->mu[i]    = pos - d->index[i];
+        }
+    for (int i = 0 ; i < CAL_TAPS ; i++)
+        d->h[i] = d->h[CAL_TAPS - 1 - i] = 1.0 / (1.0 + abs(i - CAL_TAPS / 2));
+    d->step = cos(0.01) + sin(0.01) * I;
+
+    for (int p = 0 ; p < KERNEL_PRIMITIVES ; p++)
+        {
+        int count = kernelVariantCount(p);
+        int best = 0;
+        long long bestTime = -1;
+        for (int v = 0 ; v < count ; v++)
+            {
+            KernelFunc *f = primitives[p].variants[v].func;
+            if (!kernelVariantAvailable(p, v))
+                continue;
+            if (!calCheck(p, f, d))
+                {
+                error("kernel %s/%s disagrees with the reference.  Not used",
+                    primitives[p].name, primitives[p].variants[v].name);
+                continue;
+                }
+            long long fastest = 0;
+            for (int run = 0 ; run < CAL_RUNS ; run++)
+                {
+                long long start = latencyNow();
+                for (int r = 0 ; r < CAL_REPEAT ; r++)
+                    calRun(p, f, d);
+                long long t = latencyNow() - start;
+                if (!run || t < fastest)
+                    fastest = t;
+                }
+            trace("kernel %-10s %-12s %6lldus", primitives[p].name,
+                primitives[p].variants[v].name, fastest);
+            if (bestTime < 0 || fastest < bestTime)
+                {
+                best = v;
+                bestTime = fastest;
+                }
+            }
+        bindVariant(p, best);
+        }
+    free(d);
+
+    path = profilePath(path);
+    FILE *f = fopen(path, "w");
+    if (!f)
+        {
+        error("could not write kernel profile %s", path);
+        return FALSE;
+        }
+    fprintf(f, "# sdrlib kernel profile, written by kernelCalibrate()\n");
+    for (int p = 0 ; p < KERNEL_PRIMITIVES ; p++)
+        fprintf(f, "%s %s\n", primitives[p].name, kernelBound(p));
+    if (fclose(f))
+        {
+        error("could not write kernel profile %s", path);
+        return FALSE;
+        }
+    return TRUE;
+}
+
@@ -0,0 +1,226 @@
+#ifndef _KERNEL_H_
+#define _KERNEL_H_
+/**
+ * The inner loops of the FIR filters.
+ *
+ * All of these take a delay line that is contiguous, newest sample
+ * first, and a set of coefficients, first to last.  Filters keep
+ * their delay lines twice as long as the filter, writing each sample
+ * to both halves, so that the last 'size' samples are always in one
+ * piece with no wraparound.
+ *
+ * Lowpass and bandpass designs are symmetric, with h[i] == h[n-1-i].
+ * The folded kernels add the two samples that share a coefficient
+ * before multiplying, which halves the multiplies.
+ *
+ * The other hot loops of the dsp are here too.  Each of these
+ * primitives has a scalar reference and, where the compiler can build
+ * them, vector variants for SSE, AVX2, AVX-512 or NEON.  The variant
+ * in use is bound in the 'kernels' table.  That starts with the scalar
+ * references, and kernelLoadProfile() binds whatever a run of
+ * kernelCalibrate() found fastest on this machine.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sdrlib.h"
+
+
+typedef float DotFunc(const float *x, const float *h, int n);
+typedef float complex DotFuncC(const float complex *x, const float *h, int n);
+
+/**
+ * Mix with an oscillator.  For each sample, phase *= step, then
+ * out = in * phase.  out may be the same as in.
+ */
+typedef void RotateFunc(float complex *out, const float complex *in, int n,
+                        float complex *phase, float complex step);
+
+/**
+ * |in| for each sample
+ */
+typedef void MagnitudeFunc(float *out, const float complex *in, int n);
+
+/**
+ * atan2(imag, real) for each sample.  Vector variants are within 1e-5 radians.
+ */
+typedef void PhaseFunc(float *out, const float complex *in, int n);
+
+/**
+ * Interleaved unsigned 8 bit I/Q pairs, as from an RTL dongle, to
+ * complex, with (b - 127) / 128 for each byte.
+ */
+typedef void ConvertU8Func(float complex *out, const unsigned char *in, int n);
+
+/**
+ * Cubic Lagrange interpolation, in Farrow form.  For each i, the value
+ * mu[i] of the way from x[index[i]] to x[index[i] + 1], from the four
+ * samples x[index[i] - 1] .. x[index[i] + 2].
+ */
+typedef void FarrowFunc(float *out, const float *x, const int *index, const float *mu, int n);
+
+
+/**
+ * The primitives that have variants
+ */
+typedef enum
+{
+    KERNEL_DOT,
+    KERNEL_DOT_SYM,
+    KERNEL_DOT_C,
+    KERNEL_DOT_C_SYM,
+    KERNEL_ROTATE,
+    KERNEL_MAGNITUDE,
+    KERNEL_PHASE,
+    KERNEL_CONVERT_U8,
+    KERNEL_FARROW,
+    KERNEL_PRIMITIVES
+} KernelPrimitive;
+
+
+/**
+ * The variant bound for each primitive
+ */
+typedef struct
+{
+    DotFunc       *dot;
+    DotFunc       *dotSym;
+    DotFuncC      *dotC;
+    DotFuncC      *dotCSym;
+    RotateFunc    *rotate;
+    MagnitudeFunc *magnitude;
+    PhaseFunc     *phase;
+    ConvertU8Func *convertU8;
+    FarrowFunc    *farrow;
+} Kernels;
+
+extern Kernels kernels;
+
+
+/**
+ * Where the profile is kept, unless SDRLIB_KERNELS names another file
+ */
+#define KERNEL_PROFILE "sdrlib-kernels.txt"
+
+
+/**
+ * Check whether a set of coefficients is symmetric
+ * @return TRUE if h[i] == h[n-1-i] for all i, else FALSE
+ */
+int kernelIsSymmetric(const float *h, int n);
+
+/**
+ * Real samples, any coefficients
+ */
+float dotReal(const float *x, const float *h, int n);
+
+/**
+ * Real samples, symmetric coefficients
+ */
+float dotRealSym(const float *x, const float *h, int n);
+
+/**
+ * Complex samples, any real coefficients
+ */
+float complex dotComplex(const float complex *x, const float *h, int n);
+
+/**
+ * Complex samples, symmetric real coefficients
+ */
+float complex dotComplexSym(const float complex *x, const float *h, int n);
+
+/**
+ * Scalar references for the other primitives
+ */
+void rotateComplex(float complex *out, const float complex *in, int n,
+                   float complex *phase, float complex step);
+void magnitudeComplex(float *out, const float complex *in, int n);
+void phaseComplex(float *out, const float complex *in, int n);
+void convertU8(float complex *out, const unsigned char *in, int n);
+void farrowCubic(float *out, const float *x, const int *index, const float *mu, int n);
+
+/**
+ * Pick the real kernel for a set of coefficients, from those bound.
+ * Symmetric sets of a size that has an unrolled kernel get that one,
+ * unless a vector variant is bound.
+ */
+DotFunc *kernelSelect(int symmetric, int size);
+
+/**
+ * Pick the complex kernel for a set of coefficients
+ */
+DotFuncC *kernelSelectC(int symmetric, int size);
+
+
+/**
+ * The name of a primitive, as it appears in the profile
+ */
+const char *kernelPrimitiveName(int primitive);
+
+/**
+ * The number of variants built for a primitive.  Variant 0 is the
+ * scalar reference.
+ */
+int kernelVariantCount(int primitive);
+
+/**
+ * The name of a variant, such as "scalar" or "avx2"
+ */
+const char *kernelVariantName(int primitive, int variant);
+
+/**
+ * @return TRUE if this cpu can run the variant, else FALSE
+ */
+int kernelVariantAvailable(int primitive, int variant);
+
+/**
+ * Bind a variant by name.  This is not synchronized with the dsp
+ * threads, so do it before they start.
+ * @return TRUE if the variant exists and this cpu can run it, else FALSE
+ */
+int kernelBind(int primitive, const char *variant);
+
+/**
+ * The name of the variant bound for a primitive
+ */
+const char *kernelBound(int primitive);
+
+/**
+ * Bind the variants named in a profile.  A missing profile leaves the
+ * bindings as they are.
+ * @param path the profile, or NULL for the default
+ * @return TRUE if a profile was read, else FALSE
+ */
+int kernelLoadProfile(const char *path);
+
+/**
+ * Time every variant this cpu can run, check each against the scalar
+ * reference, bind the fastest of those that agree, and write them to
+ * a profile for kernelLoadProfile().
+ * @param path the profile, or NULL for the default
+ * @return TRUE if the profile was written, else FALSE
+ */
+int kernelCalibrate(const char *path);
+
+
+#endif /* _KERNEL_H_ */
+
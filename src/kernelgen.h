@@ -0,0 +1,63 @@
+#ifndef _KERNELGEN_H_
+#define _KERNELGEN_H_
+/**
+ * Unrolled kernels for fixed sizes.  The code behind these is written
+ * at build time by misc/ppgen.c, which designs the same filters that
+ * the library will ask for, and emits a kernel for each size with
+ * every tap spelled out.  Each lookup returns NULL when no kernel was
+ * generated for the size, and the caller falls back to the generic one.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "kernel.h"
+
+
+/**
+ * Filter and decimate by a fixed integer factor, in one pass.
+ * Each input is written to both halves of the delay line, as
+ * decimatorUpdate() does, and an output is taken whenever the phase
+ * comes round to 0.
+ * @return the number of outputs written to out
+ */
+typedef int DecimateFuncC(float complex *delayLine, int *delayIndex, int *phase,
+                          const float *h, const float complex *in, int len, float complex *out);
+
+
+/**
+ * Unrolled symmetric real kernel for a size, or NULL
+ */
+DotFunc *kernelGenDot(int size);
+
+/**
+ * Unrolled symmetric complex kernel for a size, or NULL
+ */
+DotFuncC *kernelGenDotC(int size);
+
+/**
+ * Unrolled symmetric decimator for a size and factor, or NULL
+ */
+DecimateFuncC *kernelGenDecimatorC(int size, int factor);
+
+
+#endif /* _KERNELGEN_H_ */
+
@@ -0,0 +1,379 @@
+/**
+ * One width of the vector kernels.  This has no include guard, because
+ * kernel.c includes it once for each instruction set, after defining:
+ *
+ *   KV_WIDTH    floats per vector:  4, 8 or 16
+ *   KV_SUFFIX   appended to each function name
+ *   KV_ATTR     the target attribute, or nothing for the baseline
+ *   KV_SQRT(v)  a vector square root for the target
+ *   KV_RSQRT(v) optional, an estimate of 1/sqrt, good to about 12 bits
+ *
+ * The kernels are written with the GCC vector extensions, so that the
+ * compiler picks the instructions for each target.  Each one handles
+ * what does not fill a vector with the same code as the scalar kernel.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define KV_CAT2(a, b) a##b
+#define KV_CAT(a, b)  KV_CAT2(a, b)
+#define KV(name)      KV_CAT(name, KV_SUFFIX)
+
+typedef float         KV(vf) __attribute__((vector_size(4 * KV_WIDTH)));
+typedef int           KV(vi) __attribute__((vector_size(4 * KV_WIDTH)));
+typedef unsigned char KV(vb) __attribute__((vector_size(KV_WIDTH)));
+
+/**
+ * Lane orders for the shuffles.  Complex values take two lanes,
+ * real first.
+ */
+#if KV_WIDTH == 4
+#define KV_EVEN   { 0, 0, 2, 2 }
+#define KV_ODD    { 1, 1, 3, 3 }
+#define KV_SWAP   { 1, 0, 3, 2 }
+#define KV_DUPLO  { 0, 0, 1, 1 }
+#define KV_DUPHI  { 2, 2, 3, 3 }
+#define KV_PICKRE { 0, 2, 4, 6 }
+#define KV_PICKIM { 1, 3, 5, 7 }
+#elif KV_WIDTH == 8
+#define KV_EVEN   { 0, 0, 2, 2, 4, 4, 6, 6 }
+#define KV_ODD    { 1, 1, 3, 3, 5, 5, 7, 7 }
+#define KV_SWAP   { 1, 0, 3, 2, 5, 4, 7, 6 }
+#define KV_DUPLO  { 0, 0, 1, 1, 2, 2, 3, 3 }
+#define KV_DUPHI  { 4, 4, 5, 5, 6, 6, 7, 7 }
+#define KV_PICKRE { 0, 2, 4, 6, 8, 10, 12, 14 }
+#define KV_PICKIM { 1, 3, 5, 7, 9, 11, 13, 15 }
+#elif KV_WIDTH == 16
+#define KV_EVEN   { 0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14 }
+#define KV_ODD    { 1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15 }
+#define KV_SWAP   { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 }
+#define KV_DUPLO  { 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7 }
+#define KV_DUPHI  { 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15 }
+#define KV_PICKRE { 0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30 }
+#define KV_PICKIM { 1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31 }
+#else
+#error "KV_WIDTH must be 4, 8 or 16"
+#endif
+
+
+KV_ATTR static inline KV(vf) KV(load)(const float *p)
+{
+    KV(vf) v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+KV_ATTR static inline void KV(store)(float *p, KV(vf) v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+
+/**
+ * Lanes from a where the mask is set, else from b
+ */
+KV_ATTR static inline KV(vf) KV(select)(KV(vi) mask, KV(vf) a, KV(vf) b)
+{
+    return (KV(vf))(((KV(vi))a & mask) | ((KV(vi))b & ~mask));
+}
+
+
+/**
+ * Complex multiply, pairwise
+ */
+KV_ATTR static inline KV(vf) KV(cmul)(KV(vf) a, KV(vf) b)
+{
+    const KV(vi) even = KV_EVEN;
+    const KV(vi) odd  = KV_ODD;
+    const KV(vi) swap = KV_SWAP;
+    //odd - swap is 0 in the real lanes and 1 in the imaginary ones
+    KV(vf) sign = __builtin_convertvector(odd - swap, KV(vf)) * 2.0f - 1.0f;
+    return __builtin_shuffle(a, even) * b +
+           __builtin_shuffle(a, odd) * __builtin_shuffle(b, swap) * sign;
+}
+
+
+/**
+ * atan2(y, x) for each lane, to within 1e-5 radians.  The polynomial
+ * is Abramowitz and Stegun 4.4.49, on the octant, then unfolded.
+ */
+KV_ATTR static inline KV(vf) KV(atan2)(KV(vf) y, KV(vf) x)
+{
+    KV(vi) signBit = { 0 };
+    signBit |= (int)0x80000000;
+    KV(vi) xi   = (KV(vi))x;
+    KV(vi) yi   = (KV(vi))y;
+    KV(vf) ax   = (KV(vf))(xi & ~signBit);
+    KV(vf) ay   = (KV(vf))(yi & ~signBit);
+    KV(vi) steep = (ay > ax);
+    KV(vf) mn   = KV(select)(steep, ax, ay);
+    KV(vf) mx   = KV(select)(steep, ay, ax);
+    KV(vf) a    = mn / (mx + 1.0e-30f);
+    KV(vf) s    = a * a;
+    KV(vf) r    = ((((0.0208351f * s - 0.0851330f) * s + 0.1801410f) * s
+                      - 0.3302995f) * s + 0.9998660f) * a;
+    r = KV(select)(steep, (float)(PI / 2.0) - r, r);
+    r = KV(select)((xi & signBit) != 0, (float)PI - r, r);
+    return (KV(vf))((KV(vi))r ^ (yi & signBit));
+}
+
+
+KV_ATTR static float KV(dotReal)(const float *x, const float *h, int n)
+{
+    KV(vf) acc0 = { 0 };
+    KV(vf) acc1 = { 0 };
+    int i = 0;
+    for ( ; i + 2 * KV_WIDTH <= n ; i += 2 * KV_WIDTH)
+        {
+        acc0 += KV(load)(x + i) * KV(load)(h + i);
+        acc1 += KV(load)(x + i + KV_WIDTH) * KV(load)(h + i + KV_WIDTH);
+        }
+    for ( ; i + KV_WIDTH <= n ; i += KV_WIDTH)
+        acc0 += KV(load)(x + i) * KV(load)(h + i);
+    acc0 += acc1;
+    float sum = 0.0;
+    for (int k = 0 ; k < KV_WIDTH ; k++)
+        sum += acc0[k];
+    for ( ; i < n ; i++)
+        sum += x[i] * h[i];
+    return sum;
+}
+
+
+KV_ATTR static float complex KV(dotComplex)(const float complex *x, const float *h, int n)
+{
+    const float *xf = (const float *)x;
+    const KV(vi) lo = KV_DUPLO;
+    const KV(vi) hi = KV_DUPHI;
+    KV(vf) acc0 = { 0 };
+    KV(vf) acc1 = { 0 };
+    int i = 0;
+    for ( ; i + KV_WIDTH <= n ; i += KV_WIDTH)
+        {
+        //KV_WIDTH samples span two vectors, so each coefficient is doubled up
+        KV(vf) hv = KV(load)(h + i);
+        acc0 += KV(load)(xf + 2 * i) * __builtin_shuffle(hv, lo);
+        acc1 += KV(load)(xf + 2 * i + KV_WIDTH) * __builtin_shuffle(hv, hi);
+        }
+    acc0 += acc1;
+    float re = 0.0;
+    float im = 0.0;
+    for (int k = 0 ; k < KV_WIDTH ; k += 2)
+        {
+        re += acc0[k];
+        im += acc0[k + 1];
+        }
+    float complex sum = re + im * I;
+    for ( ; i < n ; i++)
+        sum += x[i] * h[i];
+    return sum;
+}
+
+
+KV_ATTR static void KV(rotateComplex)(float complex *out, const float complex *in, int n,
+                                      float complex *phase, float complex step)
+{
+    const float *inf = (const float *)in;
+    float *outf      = (float *)out;
+    float complex ph = *phase;
+    int i = 0;
+    if (n >= KV_WIDTH / 2)
+        {
+        //each pair of lanes runs its own phase, one step apart,
+        //and all of them advance by KV_WIDTH/2 steps at a time
+        float lanes[KV_WIDTH];
+        float strides[KV_WIDTH];
+        float complex p = ph;
+        float complex stride = 1.0;
+        for (int k = 0 ; k < KV_WIDTH ; k += 2)
+            {
+            p      *= step;
+            stride *= step;
+            lanes[k]     = crealf(p);
+            lanes[k + 1] = cimagf(p);
+            }
+        for (int k = 0 ; k < KV_WIDTH ; k += 2)
+            {
+            strides[k]     = crealf(stride);
+            strides[k + 1] = cimagf(stride);
+            }
+        KV(vf) pv = KV(load)(lanes);
+        KV(vf) sv = KV(load)(strides);
+        KV(vf) last = pv;
+        for ( ; i + KV_WIDTH / 2 <= n ; i += KV_WIDTH / 2)
+            {
+            KV(store)(outf + 2 * i, KV(cmul)(KV(load)(inf + 2 * i), pv));
+            last = pv;
+            pv = KV(cmul)(pv, sv);
+            }
+        ph = last[KV_WIDTH - 2] + last[KV_WIDTH - 1] * I;
+        }
+    for ( ; i < n ; i++)
+        {
+        ph *= step;
+        out[i] = in[i] * ph;
+        }
+    *phase = ph;
+}
+
+
+KV_ATTR static void KV(magnitudeComplex)(float *out, const float complex *in, int n)
+{
+    const float *inf = (const float *)in;
+    const KV(vi) re = KV_PICKRE;
+    const KV(vi) im = KV_PICKIM;
+    int i = 0;
+    for ( ; i + KV_WIDTH <= n ; i += KV_WIDTH)
+        {
+        KV(vf) a = KV(load)(inf + 2 * i);
+        KV(vf) b = KV(load)(inf + 2 * i + KV_WIDTH);
+        a *= a;
+        b *= b;
+        KV(vf) m = __builtin_shuffle(a, b, re) + __builtin_shuffle(a, b, im);
+        KV(store)(out + i, KV_SQRT(m));
+        }
+    for ( ; i < n ; i++)
+        {
+        float r = crealf(in[i]);
+        float q = cimagf(in[i]);
+        out[i] = sqrtf(r * r + q * q);
+        }
+}
+
+
+#ifdef KV_RSQRT
+/**
+ * |x|^2 * 1/sqrt(|x|^2), with one Newton step on the estimate.  The
+ * tiny offset keeps the estimate finite at 0, where the result is
+ * still 0.
+ */
+KV_ATTR static void KV(magnitudeRsqrt)(float *out, const float complex *in, int n)
+{
+    const float *inf = (const float *)in;
+    const KV(vi) re = KV_PICKRE;
+    const KV(vi) im = KV_PICKIM;
+    int i = 0;
+    for ( ; i + KV_WIDTH <= n ; i += KV_WIDTH)
+        {
+        KV(vf) a = KV(load)(inf + 2 * i);
+        KV(vf) b = KV(load)(inf + 2 * i + KV_WIDTH);
+        a *= a;
+        b *= b;
+        KV(vf) m = __builtin_shuffle(a, b, re) + __builtin_shuffle(a, b, im);
+        KV(vf) r = KV_RSQRT(m + 1.0e-30f);
+        r = r * (1.5f - 0.5f * m * r * r);
+        KV(store)(out + i, m * r);
+        }
+    for ( ; i < n ; i++)
+        {
+        float r = crealf(in[i]);
+        float q = cimagf(in[i]);
+        out[i] = sqrtf(r * r + q * q);
+        }
+}
+#endif
+
+
+KV_ATTR static void KV(phaseComplex)(float *out, const float complex *in, int n)
+{
+    const float *inf = (const float *)in;
+    const KV(vi) re = KV_PICKRE;
+    const KV(vi) im = KV_PICKIM;
+    int i = 0;
+    for ( ; i + KV_WIDTH <= n ; i += KV_WIDTH)
+        {
+        KV(vf) a = KV(load)(inf + 2 * i);
+        KV(vf) b = KV(load)(inf + 2 * i + KV_WIDTH);
+        KV(store)(out + i, KV(atan2)(__builtin_shuffle(a, b, im), __builtin_shuffle(a, b, re)));
+        }
+    for ( ; i < n ; i++)
+        out[i] = atan2f(cimagf(in[i]), crealf(in[i]));
+}
+
+
+KV_ATTR static void KV(convertU8)(float complex *out, const unsigned char *in, int n)
+{
+    float *outf = (float *)out;
+    int count = 2 * n;
+    int i = 0;
+    for ( ; i + KV_WIDTH <= count ; i += KV_WIDTH)
+        {
+        KV(vb) b;
+        memcpy(&b, in + i, sizeof(b));
+        KV(vf) v = __builtin_convertvector(b, KV(vf));
+        KV(store)(outf + i, (v - 127.0f) * (1.0f / 128.0f));
+        }
+    for ( ; i < count ; i++)
+        outf[i] = ((float)in[i] - 127.0f) * (1.0f / 128.0f);
+}
+
+
+KV_ATTR static void KV(farrowCubic)(float *out, const float *x, const int *index, const float *mu, int n)
+{
+    int i = 0;
+    for ( ; i + KV_WIDTH <= n ; i += KV_WIDTH)
+        {
+        //one output in each lane
+        float g[4][KV_WIDTH];
+        for (int k = 0 ; k < KV_WIDTH ; k++)
+            {
+            const float *p = x + index[i + k];
+            g[0][k] = p[-1];
+            g[1][k] = p[0];
+            g[2][k] = p[1];
+            g[3][k] = p[2];
+            }
+        KV(vf) xm1 = KV(load)(g[0]);
+        KV(vf) x0  = KV(load)(g[1]);
+        KV(vf) x1  = KV(load)(g[2]);
+        KV(vf) x2  = KV(load)(g[3]);
+        KV(vf) c1 = x1 - (1.0f / 3.0f) * xm1 - 0.5f * x0 - (1.0f / 6.0f) * x2;
+        KV(vf) c2 = 0.5f * (xm1 + x1) - x0;
+        KV(vf) c3 = (1.0f / 6.0f) * (x2 - xm1) + 0.5f * (x0 - x1);
+        KV(vf) m  = KV(load)(mu + i);
+        KV(store)(out + i, ((c3 * m + c2) * m + c1) * m + x0);
+        }
+    for ( ; i < n ; i++)
+        {
+        const float *p = x + index[i];
+        float c1 = p[1] - (1.0f / 3.0f) * p[-1] - 0.5f * p[0] - (1.0f / 6.0f) * p[2];
+        float c2 = 0.5f * (p[-1] + p[1]) - p[0];
+        float c3 = (1.0f / 6.0f) * (p[2] - p[-1]) + 0.5f * (p[0] - p[1]);
+        out[i] = ((c3 * mu[i] + c2) * mu[i] + c1) * mu[i] + p[0];
+        }
+}
+
+
+#undef KV_EVEN
+#undef KV_ODD
+#undef KV_SWAP
+#undef KV_DUPLO
+#undef KV_DUPHI
+#undef KV_PICKRE
+#undef KV_PICKIM
+#undef KV_WIDTH
+#undef KV_SUFFIX
+#undef KV_ATTR
+#undef KV_SQRT
+#undef KV_RSQRT
+
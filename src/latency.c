@@ -0,0 +1,103 @@
+/**
+ * Latency measurement.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+//for clock_gettime() with -std=c99
+#define _POSIX_C_SOURCE 200112L
+
+#include <string.h>
+
+#include "latency.h"
+#include "private.h"
+
+
+#ifdef _WIN32
+#include <windows.h>
+
+long long latencyNow()
+{
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (long long)(count.QuadPart * 1000000 / freq.QuadPart);
+}
+
+#else
+#include <time.h>
+
+long long latencyNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((long long)ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
+
+
+
+void latencyReset(Latency *lat)
+{
+    memset(lat, 0, sizeof(Latency));
+}
+
+
+
+void latencyRecord(Latency *lat, long long stamp)
+{
+    if (!stamp)
+        return;
+    long long age = latencyNow() - stamp;
+    if (age < 0)
+        age = 0;
+    int idx = 0;
+    long long v = age >> 1;
+    while (v && idx < LATENCY_BUCKETS - 1)
+        {
+        v >>= 1;
+        idx++;
+        }
+    lat->buckets[idx]++;
+    double usec = (double)age;
+    if (!lat->count || usec < lat->min)
+        lat->min = usec;
+    if (usec > lat->max)
+        lat->max = usec;
+    lat->sum += usec;
+    lat->count++;
+}
+
+
+
+void latencyGetStats(Latency *lat, LatencyStats *stats)
+{
+    unsigned long count = lat->count;
+    stats->count = count;
+    stats->min   = lat->min;
+    stats->max   = lat->max;
+    stats->mean  = (count) ? lat->sum / (double)count : 0.0;
+    for (int i = 0 ; i < LATENCY_BUCKETS ; i++)
+        stats->buckets[i] = lat->buckets[i];
+}
+
@@ -0,0 +1,72 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+/**
+ * Latency measurement.  Blocks are stamped with a monotonic
+ * time when they are acquired, and the stamp travels with the
+ * samples through the pipeline.  Each measuring point records
+ * the age of the samples it sees into a histogram.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sdrlib.h"
+
+
+/**
+ * Histogram of sample ages at one point in the pipeline.
+ * Bucket i counts ages in [2^i, 2^(i+1)) microseconds.
+ */
+struct Latency
+{
+    unsigned long count;
+    double sum;
+    double min;
+    double max;
+    unsigned long buckets[LATENCY_BUCKETS];
+};
+
+
+/**
+ * Return the current monotonic time in microseconds.
+ * Only differences between two values are meaningful.
+ */
+long long latencyNow();
+
+/**
+ * Clear all statistics
+ */
+void latencyReset(Latency *lat);
+
+/**
+ * Record the age of a sample that was acquired at time 'stamp'.
+ * A stamp of 0 means "unknown" and is ignored.
+ */
+void latencyRecord(Latency *lat, long long stamp);
+
+/**
+ * Copy the current statistics out to the caller
+ */
+void latencyGetStats(Latency *lat, LatencyStats *stats);
+
+
+#endif /* _LATENCY_H_ */
+
@@ -0,0 +1,118 @@
+/**
+ * A bounded, lock-free queue of control commands.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "mailbox.h"
+#include "private.h"
+
+
+Mailbox *mailboxCreate(int size)
+{
+    int n = 2;
+    while (n < size)
+        n <<= 1;
+    Mailbox *obj = (Mailbox *)malloc(sizeof(Mailbox));
+    if (!obj)
+        {
+        error("Could not allocate mailbox");
+        return NULL;
+        }
+    memset(obj, 0, sizeof(Mailbox));
+    obj->cells = (MailboxCell *)malloc(n * sizeof(MailboxCell));
+    if (!obj->cells)
+        {
+        error("Could not allocate mailbox");
+        free(obj);
+        return NULL;
+        }
+    for (int i = 0 ; i < n ; i++)
+        obj->cells[i].seq = i;
+    obj->mask = n - 1;
+    obj->head = 0;
+    obj->tail = 0;
+    return obj;
+}
+
+
+void mailboxDelete(Mailbox *obj)
+{
+    if (obj)
+        {
+        free(obj->cells);
+        free(obj);
+        }
+}
+
+
+int mailboxPost(Mailbox *obj, Command *cmd)
+{
+    unsigned long pos = __atomic_load_n(&(obj->head), __ATOMIC_RELAXED);
+    MailboxCell *cell;
+    while (1)
+        {
+        cell = &(obj->cells[pos & obj->mask]);
+        unsigned long seq = __atomic_load_n(&(cell->seq), __ATOMIC_ACQUIRE);
+        long diff = (long)(seq - pos);
+        if (diff == 0)
+            {
+            //the cell is free.  try to claim it
+            if (__atomic_compare_exchange_n(&(obj->head), &pos, pos + 1,
+                    TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+            //pos was reloaded by the failed exchange
+            }
+        else if (diff < 0)
+            {
+            //the consumer has not emptied this cell yet
+            return FALSE;
+            }
+        else
+            {
+            //another producer claimed it first
+            pos = __atomic_load_n(&(obj->head), __ATOMIC_RELAXED);
+            }
+        }
+    cell->cmd = *cmd;
+    __atomic_store_n(&(cell->seq), pos + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+
+int mailboxTake(Mailbox *obj, Command *cmd)
+{
+    unsigned long pos = obj->tail;
+    MailboxCell *cell = &(obj->cells[pos & obj->mask]);
+    unsigned long seq = __atomic_load_n(&(cell->seq), __ATOMIC_ACQUIRE);
+    if (seq != pos + 1)
+        return FALSE;
+    *cmd = cell->cmd;
+    //hand the cell back to the producers, one lap ahead
+    __atomic_store_n(&(cell->seq), pos + obj->mask + 1, __ATOMIC_RELEASE);
+    obj->tail = pos + 1;
+    return TRUE;
+}
+
@@ -0,0 +1,116 @@
+#ifndef _MAILBOX_H_
+#define _MAILBOX_H_
+/**
+ * A bounded, lock-free queue of control commands.  Any number of
+ * threads may post, and one dsp thread takes them between blocks,
+ * so that settings never change in the middle of a buffer.
+ *
+ * This is Dmitry Vyukov's bounded queue.  Each cell carries a
+ * sequence number that tells a producer whether the cell is free,
+ * and the consumer whether it has been filled.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sdrlib.h"
+
+
+typedef enum
+{
+    CMD_NONE=0,
+    CMD_MODE,
+    CMD_DDC,
+    CMD_AF_GAIN,
+    CMD_CENTER_FREQ,
+    CMD_RF_GAIN,
+    CMD_SAMPLE_RATE,
+    CMD_ADD_CHANNEL,
+    CMD_REMOVE_CHANNEL,
+    CMD_SQUELCH,
+    CMD_RESAMPLE_MODE,
+    CMD_TYPES
+} CommandType;
+
+
+/**
+ * One control change.  Only the fields for its type are used.
+ */
+typedef struct
+{
+    int    type;
+    Channel *channel;      //for the per-channel types
+    int    mode;
+    float  vfo;
+    Taps   *ddcTaps;       //new passband, designed by the poster, or NULL
+    Taps   *resamplerTaps; //the resampler rates that go with ddcTaps, or a new resample mode
+    Taps   *stereoTaps;    //and the stereo resampler's
+    float  pbLo;           //the passband ddcTaps was designed for
+    float  pbHi;
+    float  gain;           //or squelch level
+    double freq;           //center frequency or sample rate
+} Command;
+
+
+typedef struct
+{
+    unsigned long seq;
+    Command cmd;
+} MailboxCell;
+
+
+struct Mailbox
+{
+    int           mask;
+    MailboxCell   *cells;
+    char          pad0[64];
+    unsigned long head;  //next cell to post to.  Shared by the producers
+    char          pad1[64];
+    unsigned long tail;  //next cell to take from.  Only the consumer touches this
+};
+
+
+/**
+ * Create a new mailbox
+ * @param size the number of commands it holds, rounded up to a power of 2
+ */
+Mailbox *mailboxCreate(int size);
+
+/**
+ * Free the mailbox.  Commands still in it are discarded.
+ */
+void mailboxDelete(Mailbox *obj);
+
+/**
+ * Post a command.  Safe to call from any thread.
+ * @return TRUE if posted, FALSE if the mailbox is full
+ */
+int mailboxPost(Mailbox *obj, Command *cmd);
+
+/**
+ * Take the oldest command.  Only one thread may call this.
+ * @return TRUE if a command was taken, FALSE if the mailbox is empty
+ */
+int mailboxTake(Mailbox *obj, Command *cmd);
+
+
+#endif /* _MAILBOX_H_ */
+
@@ -99,6 +99,28 @@ int queuePush(Queue *queue, void *buf, int size)
     return TRUE;
 }
 
+/**
+ * Add a buffer to the queue, if there is room to spare
+ */   
+int queueTryPush(Queue *queue, void *buf, int size, int reserve)
+{
+    pthread_mutex_lock(&(queue->mutex));
+    if (queue->count + reserve >= queue->size)
+        {
+        pthread_mutex_unlock(&(queue->mutex));
+        return FALSE;
+        }
+    int head = (queue->head + 1) % queue->size;
+    QueueItem *qi = queue->queueItems + head;
+    qi->buf = buf;
+    qi->size = size;
+    queue->head = head;
+    queue->count++;
+    pthread_cond_signal(&(queue->cond));
+    pthread_mutex_unlock(&(queue->mutex));
+    return TRUE;
+}
+
 /**
  * Add a buffer to the queue
  * @param queue a queue instance.
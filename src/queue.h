@@ -65,6 +65,13 @@ void queueDelete(Queue *queue);
  */   
 int queuePush(Queue *queue, void *buf, int size);
 
+/**
+ * Add a buffer to the queue, unless that would leave fewer than
+ * 'reserve' places free.  This never waits.
+ * @return TRUE if added, FALSE if the queue was too full
+ */   
+int queueTryPush(Queue *queue, void *buf, int size, int reserve);
+
 /**
  * Pull a buffer from the  queue
  * @param queue a queue instance.
@@ -0,0 +1,1149 @@
+/**
+ * One device and the pipeline that processes its samples.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sched.h>
+
+#include "receiver.h"
+
+#include "agc.h"
+#include "audio.h"
+#include "codec.h"
+#include "encoder.h"
+#include "fanout.h"
+#include "demod.h"
+#include "device.h"
+#include "fft.h"
+#include "mailbox.h"
+#include "samplerate.h"
+#include "squelch.h"
+#include "taps.h"
+#include "thread.h"
+
+#include "private.h"
+
+
+static void *receiverThread(void *ctx);
+static void receiverDrain(Receiver *rcv);
+static void receiverReap(Receiver *rcv);
+static void ddcOutput(float complex *data, int size, void *ctx);
+
+/**
+ * How many control changes may wait for the reader thread.
+ * Bursts are coalesced when drained, so this only needs to
+ * cover what a UI can send in one block time.
+ */
+#define MAILBOX_SIZE 256
+
+
+/*############################################################################
+## C H A N N E L S
+############################################################################*/
+
+
+/**
+ * Let the demodulators know the rate and passband the ddc gives them
+ */
+static void channelSetRate(Channel *ch, float rate, float pbLo, float pbHi)
+{
+    Demodulator *demods[] = { ch->demodNull, ch->demodFm, ch->demodAm, ch->demodLsb, ch->demodUsb, ch->demodWfm };
+    for (int i = 0 ; i < (int)(sizeof(demods) / sizeof(Demodulator *)) ; i++)
+        {
+        demodSetPassband(demods[i], pbLo, pbHi);
+        demodSetRate(demods[i], rate);
+        }
+    agcSetRate(ch->agc, rate);
+    squelchSetRate(ch->squelch, rate);
+}
+
+
+static void channelDelete(Channel *ch)
+{
+    if (!ch)
+        return;
+    //first, since its thread uses the codecs and the fanout
+    encoderDelete(ch->encoder);
+    fanoutDelete(ch->fanout);
+    for (int e = 0 ; e < ENCODINGS ; e++)
+        codecDelete(ch->encoders[e]);
+    codecDelete(ch->codec);
+    ddcDelete(ch->ddc);
+    demodDelete(ch->demodNull);
+    demodDelete(ch->demodFm);
+    demodDelete(ch->demodAm);
+    demodDelete(ch->demodLsb);
+    demodDelete(ch->demodUsb);
+    demodDelete(ch->demodWfm);
+    agcDelete(ch->agc);
+    squelchDelete(ch->squelch);
+    resamplerDelete(ch->resampler);
+    resamplerDelete(ch->stereoResampler);
+    free(ch);
+}
+
+
+static void channelSetBlockTime(Channel *ch, float seconds)
+{
+    ddcSetBlockTime(ch->ddc, seconds);
+    resamplerSetBlockTime(ch->resampler, seconds);
+    resamplerSetBlockTime(ch->stereoResampler, seconds);
+}
+
+
+static void channelSetCodecFormat(Channel *ch, int format)
+{
+    codecSetFormat(ch->codec, format);
+    for (int e = 0 ; e < ENCODINGS ; e++)
+        codecSetFormat(ch->encoders[e], format);
+}
+
+
+static void channelEncoderOutput(float *buf, int size, int lost, long long stamp, void *ctx);
+
+
+static Channel *channelCreate(Receiver *rcv, int index, float vfo, float pbLo, float pbHi,
+                              void *context, ByteOutputFunc *codecFunc)
+{
+    Channel *ch = (Channel *) malloc(sizeof(Channel));
+    if (!ch)
+        {
+        error("Could not allocate channel");
+        return NULL;
+        }
+    memset(ch, 0, sizeof(Channel));
+    ch->receiver  = rcv;
+    ch->index     = index;
+    ch->context   = context;
+    ch->codecFunc = codecFunc;
+    ch->vfo       = vfo;
+    ch->pbLo      = pbLo;
+    ch->pbHi      = pbHi;
+    ch->ddc       = ddcCreate(vfo, pbLo, pbHi, 2048000.0);
+    ch->demodNull = demodNullCreate();
+    ch->demodFm   = demodFmCreate();
+    ch->demodAm   = demodAmCreate();
+    ch->demodLsb  = demodLsbCreate();
+    ch->demodUsb  = demodUsbCreate();
+    ch->demodWfm  = demodWfmCreate();
+    ch->agc       = agcCreate();
+    ch->squelch   = squelchCreate();
+    ch->squelchLevel = SQUELCH_OFF;
+    ch->demod     = ch->demodFm;
+    ch->mode      = MODE_FM;
+    ch->codec     = codecCreate();
+    ch->fanout    = fanoutCreate();
+    int encoders  = TRUE;
+    for (int e = 0 ; e < ENCODINGS ; e++)
+        {
+        ch->encoders[e] = codecCreateEncoding(e);
+        ch->outlets[e].channel  = ch;
+        ch->outlets[e].encoding = e;
+        if (!ch->encoders[e])
+            encoders = FALSE;
+        }
+    char name[16];
+    snprintf(name, sizeof(name), "sdr-enc-%d.%d", (rcv->device) ? rcv->device->index : 0, index);
+    ch->encoder   = encoderCreate(name, channelEncoderOutput, ch);
+    if (ch->ddc && ch->demodWfm)
+        {
+        float ifRate = ddcGetOutRate(ch->ddc);
+        ch->ifRate    = ifRate;
+        ch->resampler = resamplerCreate(ifRate, rcv->audio->sampleRate);
+        ch->stereoResampler = resamplerCreate(demodOutRate(ch->demodWfm, ifRate),
+                                              rcv->audio->sampleRate);
+        }
+    if (!ch->ddc || !ch->resampler || !ch->stereoResampler || !ch->agc || !ch->squelch ||
+        !ch->codec || !ch->fanout || !encoders || !ch->encoder)
+        {
+        error("Could not create channel %d", index);
+        channelDelete(ch);
+        return NULL;
+        }
+    //FM needs none, since its level is set by the deviation
+    ch->demodAm->agc  = ch->agc;
+    ch->demodLsb->agc = ch->agc;
+    ch->demodUsb->agc = ch->agc;
+    channelSetBlockTime(ch, rcv->blockTime);
+    channelSetCodecFormat(ch, rcv->codecFormat);
+    if (rcv->resampleMode != RESAMPLE_POLYPHASE)
+        {
+        //nothing runs it yet, so it can take its taps right here
+        resamplerSetMode(ch->resampler, rcv->resampleMode);
+        resamplerSetMode(ch->stereoResampler, rcv->resampleMode);
+        Taps *taps = resamplerDesign(ch->resampler, ch->ifRate, ch->resampler->outRate);
+        if (taps)
+            resamplerSetTaps(ch->resampler, taps);
+        taps = resamplerDesign(ch->stereoResampler, demodOutRate(ch->demodWfm, ch->ifRate),
+                               ch->stereoResampler->outRate);
+        if (taps)
+            resamplerSetTaps(ch->stereoResampler, taps);
+        }
+    channelSetRate(ch, ddcGetOutRate(ch->ddc), pbLo, pbHi);
+    return ch;
+}
+
+
+/*############################################################################
+## R E C E I V E R
+############################################################################*/
+
+
+Receiver *receiverCreate(Device *device, Audio *audio)
+{
+    Receiver *rcv = (Receiver *) malloc(sizeof(Receiver));
+    if (!rcv)
+        {
+        error("Could not allocate receiver");
+        return NULL;
+        }
+    memset(rcv, 0, sizeof(Receiver));
+    rcv->device    = device;
+    rcv->cpu       = -1;
+    rcv->audio     = audio;
+    rcv->fft       = fftCreate(16384);
+    rcv->mailbox   = mailboxCreate(MAILBOX_SIZE);
+    rcv->bank      = ddcBankCreate();
+    Channel *ch = channelCreate(rcv, 0, 0.0, -5000.0, 5000.0, NULL, NULL);
+    if (!rcv->bank || !ch)
+        {
+        channelDelete(ch);
+        ddcBankDelete(rcv->bank);
+        mailboxDelete(rcv->mailbox);
+        fftDelete(rcv->fft);
+        free(rcv);
+        return NULL;
+        }
+    rcv->channels[0] = ch;
+    ddcBankAdd(rcv->bank, ch->ddc, ddcOutput, ch);
+    receiverResetLatency(rcv);
+    return rcv;
+}
+
+
+void receiverDelete(Receiver *rcv)
+{
+    if (!rcv)
+        return;
+    receiverStop(rcv);
+    receiverDrain(rcv);
+    receiverReap(rcv);
+    mailboxDelete(rcv->mailbox);
+    fftDelete(rcv->fft);
+    for (int i = 0 ; i < RECEIVER_MAX_CHANNELS ; i++)
+        channelDelete(rcv->channels[i]);
+    ddcBankDelete(rcv->bank);
+    free(rcv);
+}
+
+
+int receiverStart(Receiver *rcv)
+{
+    pthread_t thread;
+    Device *d = rcv->device;
+    if (!d)
+        {
+        error("No devices found");
+        return FALSE;
+        }
+    if (rcv->running)
+        {
+        error("Device %d already started", d->index);
+        return FALSE;
+        }
+    int transferSize = rcv->transferSize;
+    if (!transferSize && rcv->blockTime > 0.0)
+        {
+        //a transfer is the first block of all, so it must be as short,
+        //at two bytes for each sample
+        transferSize = (int)(2.0 * rcv->channels[0]->ddc->inRate * rcv->blockTime);
+        }
+    if (d->setBuffering)
+        d->setBuffering(d->ctx, rcv->transferCount, transferSize, rcv->queueDepth);
+    if (d->setThreadPolicy)
+        {
+        ThreadPolicy policy;
+        threadGetPolicy(THREAD_ACQUISITION, &policy);
+        if (rcv->cpu >= 0)
+            policy.cpu = rcv->cpu;
+        d->setThreadPolicy(d->ctx, policy.cpu, policy.priority);
+        }
+    if (!d->open(d->ctx))
+        {
+        error("Could not start device %d", d->index);
+        return FALSE;
+        }
+    rcv->droppedBlocks = 0;
+    d->setGain(d->ctx, 1.0);
+    d->setCenterFrequency(d->ctx, 88700000.0);
+    trace("starting device %d", d->index);
+    rcv->running = 1;
+    rcv->started = 1;
+    int rc = pthread_create(&thread, NULL, receiverThread, (void *)rcv);
+    if (rc)
+        {
+        error("ERROR; return code from pthread_create() is %d", rc);
+        rcv->running = 0;
+        rcv->started = 0;
+        d->close(d->ctx);
+        return FALSE;
+        }
+    trace("started device %d", d->index);
+    rcv->thread = thread;
+    return TRUE;
+}
+
+
+int receiverStop(Receiver *rcv)
+{
+    if (!rcv->running)
+        return TRUE;
+    void *status;
+    rcv->running = 0;
+    pthread_join(rcv->thread, &status);
+    //apply anything that arrived while the thread was finishing up
+    receiverDrain(rcv);
+    receiverReap(rcv);
+    rcv->started = 0;
+    Device *d = rcv->device;
+    if (d)
+        d->close(d->ctx);
+    return TRUE;
+}
+
+
+void receiverSetOutput(Receiver *rcv, void *context,
+                       UintOutputFunc *psFunc, ByteOutputFunc *codecFunc)
+{
+    rcv->context   = context;
+    rcv->psFunc    = psFunc;
+    rcv->channels[0]->context   = context;
+    rcv->channels[0]->codecFunc = codecFunc;
+}
+
+
+void receiverSetCpu(Receiver *rcv, int cpu)
+{
+    rcv->cpu = cpu;
+}
+
+
+void receiverSetBlockTime(Receiver *rcv, float seconds)
+{
+    rcv->blockTime = seconds;
+    for (int i = 0 ; i < RECEIVER_MAX_CHANNELS ; i++)
+        if (rcv->channels[i])
+            channelSetBlockTime(rcv->channels[i], seconds);
+}
+
+
+void receiverSetCodecFormat(Receiver *rcv, int format)
+{
+    rcv->codecFormat = format;
+    for (int i = 0 ; i < RECEIVER_MAX_CHANNELS ; i++)
+        if (rcv->channels[i])
+            channelSetCodecFormat(rcv->channels[i], format);
+}
+
+
+/*############################################################################
+## C O N T R O L
+############################################################################*/
+
+
+/**
+ * Release what a command holds, when it is superseded or not applied
+ */
+static void commandRelease(Command *cmd)
+{
+    if (cmd->type == CMD_DDC || cmd->type == CMD_RESAMPLE_MODE)
+        {
+        tapsUnref(cmd->ddcTaps);
+        tapsUnref(cmd->resamplerTaps);
+        tapsUnref(cmd->stereoTaps);
+        }
+    else if (cmd->type == CMD_ADD_CHANNEL)
+        channelDelete(cmd->channel);
+}
+
+
+/**
+ * Hand a channel the pipeline is done with to the control side.  Deleting
+ * it waits for its encoder thread, which the reader thread must not do.
+ */
+static void receiverRetire(Receiver *rcv, Channel *ch)
+{
+    ch->next = __atomic_load_n(&(rcv->retired), __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&(rcv->retired), &(ch->next), ch,
+               TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+}
+
+
+/**
+ * Delete the channels the pipeline has retired.  Called by the control
+ * side, which may still have one whose add failed in its table.
+ */
+static void receiverReap(Receiver *rcv)
+{
+    Channel *ch = __atomic_exchange_n(&(rcv->retired), NULL, __ATOMIC_ACQUIRE);
+    while (ch)
+        {
+        Channel *next = ch->next;
+        if (rcv->channels[ch->index] == ch)
+            rcv->channels[ch->index] = NULL;
+        channelDelete(ch);
+        ch = next;
+        }
+}
+
+
+/**
+ * Make a change to the pipeline.  Only called by the thread that owns it.
+ */
+static void receiverApply(Receiver *rcv, Command *cmd)
+{
+    Device *d = rcv->device;
+    int open = (d && d->isOpen(d->ctx));
+    Channel *ch = cmd->channel;
+    switch (cmd->type)
+        {
+        case CMD_MODE:
+            {
+            Demodulator *demod = NULL;
+            switch (cmd->mode)
+                {
+                case MODE_NULL: demod = ch->demodNull; break;
+                case MODE_AM:   demod = ch->demodAm;   break;
+                case MODE_FM:   demod = ch->demodFm;   break;
+                case MODE_LSB:  demod = ch->demodLsb;  break;
+                case MODE_USB:  demod = ch->demodUsb;  break;
+                case MODE_WFM:  demod = ch->demodWfm;  break;
+                }
+            if (demod && demod != ch->demod)
+                {
+                //the level of the last mode means nothing to the new one
+                agcReset(ch->agc);
+                ch->demod = demod;
+                }
+            break;
+            }
+        case CMD_DDC:
+            if (cmd->ddcTaps)
+                {
+                ddcSetTaps(ch->ddc, cmd->vfo, cmd->ddcTaps);
+                trace("channel %d if rate: %f", ch->index, ddcGetOutRate(ch->ddc));
+                channelSetRate(ch, ddcGetOutRate(ch->ddc), cmd->pbLo, cmd->pbHi);
+                if (cmd->resamplerTaps)
+                    resamplerSetTaps(ch->resampler, cmd->resamplerTaps);
+                if (cmd->stereoTaps)
+                    resamplerSetTaps(ch->stereoResampler, cmd->stereoTaps);
+                }
+            else
+                ddcSetVfo(ch->ddc, cmd->vfo);
+            break;
+        case CMD_AF_GAIN:
+            audioSetGain(rcv->audio, cmd->gain);
+            break;
+        case CMD_CENTER_FREQ:
+            if (open)
+                d->setCenterFrequency(d->ctx, cmd->freq);
+            break;
+        case CMD_RF_GAIN:
+            if (open)
+                d->setGain(d->ctx, cmd->gain);
+            break;
+        case CMD_SAMPLE_RATE:
+            if (open)
+                d->setSampleRate(d->ctx, (float)cmd->freq);
+            break;
+        case CMD_ADD_CHANNEL:
+            if (!ddcBankAdd(rcv->bank, ch->ddc, ddcOutput, ch))
+                receiverRetire(rcv, ch);
+            break;
+        case CMD_REMOVE_CHANNEL:
+            ddcBankRemove(rcv->bank, ch->ddc);
+            receiverRetire(rcv, ch);
+            break;
+        case CMD_SQUELCH:
+            squelchSetLevel(ch->squelch, cmd->gain);
+            break;
+        case CMD_RESAMPLE_MODE:
+            if (cmd->resamplerTaps)
+                resamplerSetTaps(ch->resampler, cmd->resamplerTaps);
+            if (cmd->stereoTaps)
+                resamplerSetTaps(ch->stereoResampler, cmd->stereoTaps);
+            break;
+        default:
+            error("Unhandled command: %d", cmd->type);
+        }
+}
+
+
+/**
+ * Apply everything in the mailbox.  Only the newest command of each
+ * type matters, per channel for the channel settings, so a burst,
+ * such as from dragging the passband with the mouse, turns into a
+ * single update.  Channels come and go in the order they were asked for,
+ * and squelch levels, being cheap, are set in that order too.  The
+ * resampler taps for a new resample mode come after any ddc change
+ * posted before them, and give way to one posted after them.
+ */
+static void receiverDrain(Receiver *rcv)
+{
+    Command latest[CMD_TYPES];
+    int have = 0; //bit per type
+    Command latestDdc[RECEIVER_MAX_CHANNELS];
+    Command latestMode[RECEIVER_MAX_CHANNELS];
+    Command latestResample[RECEIVER_MAX_CHANNELS];
+    unsigned int haveDdc  = 0; //bit per channel
+    unsigned int haveMode = 0;
+    unsigned int haveResample = 0;
+    Command cmd;
+    while (mailboxTake(rcv->mailbox, &cmd))
+        {
+        int type = cmd.type;
+        if (type <= CMD_NONE || type >= CMD_TYPES)
+            continue;
+        if (type == CMD_ADD_CHANNEL || type == CMD_SQUELCH)
+            {
+            receiverApply(rcv, &cmd);
+            continue;
+            }
+        if (type == CMD_REMOVE_CHANNEL)
+            {
+            //anything still waiting for this channel is moot
+            unsigned int bit = 1u << cmd.channel->index;
+            if (haveDdc & bit)
+                commandRelease(&(latestDdc[cmd.channel->index]));
+            if (haveResample & bit)
+                commandRelease(&(latestResample[cmd.channel->index]));
+            haveDdc  &= ~bit;
+            haveMode &= ~bit;
+            haveResample &= ~bit;
+            receiverApply(rcv, &cmd);
+            continue;
+            }
+        if (type == CMD_RESAMPLE_MODE)
+            {
+            int index = cmd.channel->index;
+            if (haveResample & (1u << index))
+                commandRelease(&(latestResample[index]));
+            latestResample[index] = cmd;
+            haveResample |= 1u << index;
+            continue;
+            }
+        if (type == CMD_DDC || type == CMD_MODE)
+            {
+            int index = cmd.channel->index;
+            unsigned int bit = 1u << index;
+            if (type == CMD_MODE)
+                {
+                latestMode[index] = cmd;
+                haveMode |= bit;
+                continue;
+                }
+            if (haveDdc & bit)
+                {
+                Command *old = &(latestDdc[index]);
+                //a vfo move must not lose a passband change that came before it
+                if (!cmd.ddcTaps)
+                    {
+                    cmd.ddcTaps       = old->ddcTaps;
+                    cmd.resamplerTaps = old->resamplerTaps;
+                    cmd.stereoTaps    = old->stereoTaps;
+                    cmd.pbLo          = old->pbLo;
+                    cmd.pbHi          = old->pbHi;
+                    }
+                else
+                    commandRelease(old);
+                }
+            if (cmd.ddcTaps && (haveResample & bit))
+                {
+                //its resampler taps were designed for the new mode and rate both
+                commandRelease(&(latestResample[index]));
+                haveResample &= ~bit;
+                }
+            latestDdc[index] = cmd;
+            haveDdc |= bit;
+            continue;
+            }
+        if (have & (1 << type))
+            commandRelease(&(latest[type]));
+        latest[type] = cmd;
+        have |= 1 << type;
+        }
+    for (int type = CMD_NONE + 1 ; have && type < CMD_TYPES ; type++)
+        {
+        if (have & (1 << type))
+            receiverApply(rcv, &(latest[type]));
+        }
+    for (int i = 0 ; (haveDdc | haveMode | haveResample) && i < RECEIVER_MAX_CHANNELS ; i++)
+        {
+        unsigned int bit = 1u << i;
+        if (haveMode & bit)
+            receiverApply(rcv, &(latestMode[i]));
+        if (haveDdc & bit)
+            receiverApply(rcv, &(latestDdc[i]));
+        if (haveResample & bit)
+            receiverApply(rcv, &(latestResample[i]));
+        }
+}
+
+
+/**
+ * Send a change to whichever thread owns the pipeline
+ */
+static int receiverPost(Receiver *rcv, Command *cmd)
+{
+    if (!rcv->started)
+        {
+        receiverApply(rcv, cmd);
+        return TRUE;
+        }
+    if (!mailboxPost(rcv->mailbox, cmd))
+        {
+        error("Control mailbox is full, dropping command %d", cmd->type);
+        commandRelease(cmd);
+        return FALSE;
+        }
+    return TRUE;
+}
+
+
+int receiverAddChannel(Receiver *rcv, void *context, ByteOutputFunc *codecFunc)
+{
+    receiverReap(rcv);
+    int index = 1;
+    while (index < RECEIVER_MAX_CHANNELS && rcv->channels[index])
+        index++;
+    if (index >= RECEIVER_MAX_CHANNELS)
+        {
+        error("Too many channels.  The limit is %d", RECEIVER_MAX_CHANNELS);
+        return -1;
+        }
+    Channel *first = rcv->channels[0];
+    Channel *ch = channelCreate(rcv, index, first->vfo, first->pbLo, first->pbHi,
+                      context, codecFunc);
+    if (!ch)
+        return -1;
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type    = CMD_ADD_CHANNEL;
+    cmd.channel = ch;
+    //the channel is not visible until it has been posted
+    if (!receiverPost(rcv, &cmd))
+        return -1;
+    rcv->channels[index] = ch;
+    receiverSetMode(rcv, index, first->mode);
+    return index;
+}
+
+
+int receiverRemoveChannel(Receiver *rcv, int index)
+{
+    if (index == 0)
+        {
+        error("Channel 0 cannot be removed");
+        return FALSE;
+        }
+    receiverReap(rcv);
+    Channel *ch = receiverGetChannel(rcv, index);
+    if (!ch)
+        return FALSE;
+    rcv->channels[index] = NULL;
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type    = CMD_REMOVE_CHANNEL;
+    cmd.channel = ch;
+    if (!receiverPost(rcv, &cmd))
+        {
+        //it can not be freed while the pipeline may still be using it
+        rcv->channels[index] = ch;
+        return FALSE;
+        }
+    //if the post was applied here, there is no need to wait
+    receiverReap(rcv);
+    return TRUE;
+}
+
+
+Listener *receiverListen(Receiver *rcv, int index, int encoding)
+{
+    Channel *ch = receiverGetChannel(rcv, index);
+    if (!ch)
+        return NULL;
+    //the fanout takes care of its own locking, so no need for the mailbox
+    return fanoutListen(ch->fanout, encoding);
+}
+
+
+int receiverGetEncoderStats(Receiver *rcv, int index, EncoderStats *stats)
+{
+    Channel *ch = receiverGetChannel(rcv, index);
+    if (!ch)
+        return FALSE;
+    encoderGetStats(ch->encoder, stats);
+    return TRUE;
+}
+
+
+Channel *receiverGetChannel(Receiver *rcv, int index)
+{
+    if (index < 0 || index >= RECEIVER_MAX_CHANNELS || !rcv->channels[index])
+        {
+        error("No such channel: %d", index);
+        return NULL;
+        }
+    return rcv->channels[index];
+}
+
+
+int receiverSetDdcFreqs(Receiver *rcv, int index, float vfo, float pbLo, float pbHi)
+{
+    Channel *ch = receiverGetChannel(rcv, index);
+    if (!ch)
+        return FALSE;
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type    = CMD_DDC;
+    cmd.channel = ch;
+    cmd.vfo     = vfo;
+    if (pbLo != ch->pbLo || pbHi != ch->pbHi)
+        {
+        //do the slow part here, on the caller's thread
+        cmd.ddcTaps = ddcDesign(ch->ddc, pbLo, pbHi);
+        if (!cmd.ddcTaps)
+            return FALSE;
+        cmd.pbLo = pbLo;
+        cmd.pbHi = pbHi;
+        float ifRate = cmd.ddcTaps->outRate;
+        ch->ifRate = ifRate;
+        cmd.resamplerTaps = resamplerDesign(ch->resampler, ifRate, ch->resampler->outRate);
+        cmd.stereoTaps    = resamplerDesign(ch->stereoResampler,
+                                demodOutRate(ch->demodWfm, ifRate), ch->stereoResampler->outRate);
+        }
+    ch->vfo  = vfo;
+    ch->pbLo = pbLo;
+    ch->pbHi = pbHi;
+    return receiverPost(rcv, &cmd);
+}
+
+
+int receiverSetMode(Receiver *rcv, int index, Mode mode)
+{
+    if (mode < MODE_NULL || mode > MODE_WFM)
+        {
+        error("Unhandled mode: %d", mode);
+        return FALSE;
+        }
+    Channel *ch = receiverGetChannel(rcv, index);
+    if (!ch)
+        return FALSE;
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type    = CMD_MODE;
+    cmd.channel = ch;
+    cmd.mode    = mode;
+    ch->mode = mode;
+    return receiverPost(rcv, &cmd);
+}
+
+
+int receiverSetSquelch(Receiver *rcv, int index, float level)
+{
+    Channel *ch = receiverGetChannel(rcv, index);
+    if (!ch)
+        return FALSE;
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type    = CMD_SQUELCH;
+    cmd.channel = ch;
+    cmd.gain    = level;
+    ch->squelchLevel = level;
+    return receiverPost(rcv, &cmd);
+}
+
+
+void receiverSetResampleMode(Receiver *rcv, int mode)
+{
+    rcv->resampleMode = mode;
+    for (int i = 0 ; i < RECEIVER_MAX_CHANNELS ; i++)
+        {
+        Channel *ch = rcv->channels[i];
+        if (!ch)
+            continue;
+        resamplerSetMode(ch->resampler, mode);
+        resamplerSetMode(ch->stereoResampler, mode);
+        //design for the new number of branches here, on the caller's
+        //thread, so the pipeline only has to take them
+        Command cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.type          = CMD_RESAMPLE_MODE;
+        cmd.channel       = ch;
+        cmd.resamplerTaps = resamplerDesign(ch->resampler, ch->ifRate, ch->resampler->outRate);
+        cmd.stereoTaps    = resamplerDesign(ch->stereoResampler,
+                                demodOutRate(ch->demodWfm, ch->ifRate), ch->stereoResampler->outRate);
+        receiverPost(rcv, &cmd);
+        }
+}
+
+
+int receiverSetAfGain(Receiver *rcv, float gain)
+{
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = CMD_AF_GAIN;
+    cmd.gain = gain;
+    return receiverPost(rcv, &cmd);
+}
+
+
+int receiverSetCenterFrequency(Receiver *rcv, double freq)
+{
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = CMD_CENTER_FREQ;
+    cmd.freq = freq;
+    return receiverPost(rcv, &cmd);
+}
+
+
+int receiverSetRfGain(Receiver *rcv, float gain)
+{
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = CMD_RF_GAIN;
+    cmd.gain = gain;
+    return receiverPost(rcv, &cmd);
+}
+
+
+int receiverSetSampleRate(Receiver *rcv, float rate)
+{
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = CMD_SAMPLE_RATE;
+    cmd.freq = rate;
+    return receiverPost(rcv, &cmd);
+}
+
+
+void receiverResetLatency(Receiver *rcv)
+{
+    for (int i = 0 ; i < LATENCY_POINTS ; i++)
+        latencyReset(&(rcv->latency[i]));
+}
+
+
+
+
+/*############################################################################
+## R E A D E R    T H R E A D
+############################################################################*/
+
+
+
+/**
+ * How long the reader sleeps waiting for data before it
+ * checks again whether it should still be running
+ */
+#define READ_TIMEOUT_MS 100
+
+static void fftOutput(unsigned int *vals, int size, void *ctx)
+{
+    Receiver *rcv = (Receiver *)ctx;
+    UintOutputFunc *psFunc = rcv->psFunc;
+    if (psFunc)
+        (*psFunc)(vals, size, rcv->context);
+}
+
+
+static void codecOutput(unsigned char *buf, int size, void *ctx)
+{
+    Channel *ch = (Channel *)ctx;
+    latencyRecord(&(ch->receiver->latency[LATENCY_CODEC]), ch->codec->outStamp);
+    (*ch->codecFunc)(buf, size, ch->context);
+}
+
+
+/**
+ * One encoding's output, on its way to that encoding's listeners
+ */
+static void channelFanoutOutput(unsigned char *buf, int size, void *ctx)
+{
+    ChannelOutlet *outlet = (ChannelOutlet *)ctx;
+    Channel *ch = outlet->channel;
+    int e = outlet->encoding;
+    latencyRecord(&(ch->receiver->latency[LATENCY_CODEC]), ch->encoders[e]->outStamp);
+    fanoutOutput(buf, size, fanoutOutlet(ch->fanout, e));
+}
+
+
+/**
+ * Whether anyone wants the channel's audio encoded
+ */
+static int channelEncodes(Channel *ch)
+{
+    if (ch->codecFunc)
+        return TRUE;
+    for (int e = 0 ; e < ENCODINGS ; e++)
+        if (fanoutWants(ch->fanout, e))
+            return TRUE;
+    return FALSE;
+}
+
+
+/**
+ * Whether an encoding has listeners.  One that gains its first since
+ * the last block starts over, rather than sending what it held from
+ * before to the newcomer.
+ */
+static int channelWants(Channel *ch, int e)
+{
+    int wants = fanoutWants(ch->fanout, e);
+    if (wants && !ch->active[e])
+        codecReset(ch->encoders[e]);
+    ch->active[e] = wants;
+    return wants;
+}
+
+
+/**
+ * Encode for codecFunc, and once for each encoding that has listeners
+ */
+static void channelEncode(Channel *ch, float *buf, int size, long long stamp)
+{
+    if (ch->codecFunc)
+        {
+        ch->codec->stamp = stamp;
+        codecEncode(ch->codec, buf, size, codecOutput, ch);
+        }
+    for (int e = 0 ; e < ENCODINGS ; e++)
+        {
+        if (!channelWants(ch, e))
+            continue;
+        ch->encoders[e]->stamp = stamp;
+        codecEncode(ch->encoders[e], buf, size, channelFanoutOutput, &(ch->outlets[e]));
+        }
+}
+
+
+/**
+ * The same, for samples skipped by the squelch
+ */
+static void channelSilence(Channel *ch, int samples)
+{
+    if (ch->codecFunc)
+        codecSilence(ch->codec, samples, codecOutput, ch);
+    for (int e = 0 ; e < ENCODINGS ; e++)
+        {
+        if (channelWants(ch, e))
+            codecSilence(ch->encoders[e], samples, channelFanoutOutput, &(ch->outlets[e]));
+        }
+}
+
+
+/**
+ * Leave a gap where samples were dropped
+ */
+static void channelSkip(Channel *ch, int samples)
+{
+    if (ch->codecFunc)
+        codecSkip(ch->codec, samples, codecOutput, ch);
+    for (int e = 0 ; e < ENCODINGS ; e++)
+        {
+        if (channelWants(ch, e))
+            codecSkip(ch->encoders[e], samples, channelFanoutOutput, &(ch->outlets[e]));
+        }
+}
+
+
+/**
+ * Called on the encoder thread, with what the dsp thread queued
+ */
+static void channelEncoderOutput(float *buf, int size, int lost, long long stamp, void *ctx)
+{
+    Channel *ch = (Channel *)ctx;
+    if (buf)
+        channelEncode(ch, buf, size, stamp);
+    else if (lost)
+        channelSkip(ch, size);
+    else
+        channelSilence(ch, size);
+}
+
+
+static void resamplerOutput(float *buf, int size, void *ctx)
+{
+    Channel *ch = (Channel *)ctx;
+    Receiver *rcv = ch->receiver;
+    //trace("Push audio:%d", size);
+    long long stamp = resamplerGetOutStamp(ch->resampler);
+    latencyRecord(&(rcv->latency[LATENCY_RESAMPLER]), stamp);
+    //only the receiver that owns the speaker is heard
+    if (ch->index == 0 && audioPlay(rcv->audio, rcv, buf, size, stamp))
+        {
+        //follow the sound card's clock rather than the device's
+        resamplerSetDrift(ch->resampler, audioGetDrift(rcv->audio));
+        }
+    if (channelEncodes(ch))
+        encoderPush(ch->encoder, buf, size, stamp);
+}
+
+
+/**
+ * Left and right, as left + right * I.  The speaker plays both, and
+ * the codec, which is mono, gets their mean.
+ */
+static void stereoOutput(float complex *buf, int size, void *ctx)
+{
+    Channel *ch = (Channel *)ctx;
+    Receiver *rcv = ch->receiver;
+    long long stamp = resamplerGetOutStamp(ch->stereoResampler);
+    latencyRecord(&(rcv->latency[LATENCY_RESAMPLER]), stamp);
+    if (ch->index == 0 && audioPlayStereo(rcv->audio, rcv, buf, size, stamp))
+        resamplerSetDrift(ch->stereoResampler, audioGetDrift(rcv->audio));
+    if (channelEncodes(ch))
+        {
+        //in place, since sample i is written no later than it is read
+        float *mono = (float *)buf;
+        for (int i = 0 ; i < size ; i++)
+            mono[i] = 0.5 * (crealf(buf[i]) + cimagf(buf[i]));
+        encoderPush(ch->encoder, mono, size, stamp);
+        }
+}
+
+
+static void demodOutput(float *buf, int size, void *ctx)
+{
+    Channel *ch = (Channel *)ctx;
+    //trace("Demod:%d", size);
+    long long stamp = ch->demod->outStamp;
+    latencyRecord(&(ch->receiver->latency[LATENCY_DEMOD]), stamp);
+    ch->resampler->stamp = stamp;
+    resamplerUpdate(ch->resampler, buf, size, resamplerOutput, ch);
+}
+
+static void ddcOutput(float complex *data, int size, void *ctx)
+{
+    Channel *ch = (Channel *)ctx;
+    //trace("Ddc:%d", size);
+    long long stamp = ch->ddc->outStamp;
+    latencyRecord(&(ch->receiver->latency[LATENCY_DDC]), stamp);
+    if (!squelchUpdate(ch->squelch, data, size))
+        {
+        //nothing downstream runs until it opens again, and then
+        //it starts fresh, as after a gap
+        if (!ch->squelched)
+            {
+            ch->squelched = TRUE;
+            demodReset(ch->demod);
+            resamplerReset(ch->resampler);
+            resamplerReset(ch->stereoResampler);
+            }
+        if (channelEncodes(ch))
+            {
+            Resampler *r = ch->resampler;
+            int samples = (r->inRate > 0.0) ? (int)(size * r->outRate / r->inRate) : 0;
+            encoderSilence(ch->encoder, samples);
+            }
+        return;
+        }
+    ch->squelched = FALSE;
+    Demodulator *demod = ch->demod;
+    demod->stamp = stamp;
+    if (demod->stereo)
+        {
+        latencyRecord(&(ch->receiver->latency[LATENCY_DEMOD]), stamp);
+        demod->stereo(demod, data, size, ch->stereoResampler, stereoOutput, ch);
+        }
+    else if (demod->fused)
+        {
+        //straight through to the resampler, without a pass over memory between
+        latencyRecord(&(ch->receiver->latency[LATENCY_DEMOD]), stamp);
+        demod->fused(demod, data, size, ch->resampler, resamplerOutput, ch);
+        }
+    else
+        demod->update(demod, data, size, demodOutput, ch);
+}
+
+static void *receiverThread(void *ctx)
+{
+    Receiver *rcv = (Receiver *)ctx;
+    Device *dev = rcv->device;
+    
+    char name[16];
+    snprintf(name, sizeof(name), "sdr-read-%d", dev->index);
+    threadSetup(name, THREAD_READER, rcv->cpu);
+
+    int bufsize = 1024*1024;
+    float complex *readbuf = (float complex *)malloc(bufsize * sizeof(float complex));
+    
+    while (rcv->running && dev->isOpen(dev->ctx))
+        {
+        receiverDrain(rcv);
+        BlockInfo info;
+        int readCount = dev->read(dev->ctx, readbuf, bufsize, &info);
+        if (readCount)
+            {
+            if (info.dropped)
+                {
+                //the samples are not continuous, so do not let
+                //the filters integrate across the gap
+                rcv->droppedBlocks += info.dropped;
+                error("Device %d dropped %d blocks before block %lu",
+                    dev->index, info.dropped, info.seq);
+                DdcBank *bank = rcv->bank;
+                ddcBankReset(bank);
+                for (int k = 0 ; k < bank->count ; k++)
+                    {
+                    Channel *ch = (Channel *)bank->contexts[k];
+                    demodReset(ch->demod);
+                    resamplerReset(ch->resampler);
+                    resamplerReset(ch->stereoResampler);
+                    }
+                }
+            rcv->bank->stamp = info.timestamp;
+            fftUpdate(rcv->fft, readbuf, readCount, fftOutput, rcv);
+            ddcBankUpdate(rcv->bank, readbuf, readCount);
+            }
+        else if (dev->waitForData)
+            {
+            dev->waitForData(dev->ctx, READ_TIMEOUT_MS);
+            }
+        else
+            {
+            sched_yield();
+            }
+        }
+
+    free(readbuf);
+    return NULL;
+}
+
+
+
@@ -0,0 +1,271 @@
+#ifndef _RECEIVER_H_
+#define _RECEIVER_H_
+/**
+ * One device and the pipeline that processes its samples.
+ * SdrLib holds one of these for each device it finds, so that
+ * several dongles can run side by side, each on its own thread.
+ * Each receiver may listen to several channels within the device's
+ * bandwidth at once.  Channel 0 always exists, and is the one that
+ * the speaker plays.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <pthread.h>
+
+#include "sdrlib.h"
+#include "latency.h"
+#include "samplerate.h"
+
+
+/**
+ * The most channels one receiver may have
+ */
+#define RECEIVER_MAX_CHANNELS DDC_BANK_MAX
+
+
+/**
+ * Where one of a channel's encoders sends its output
+ */
+typedef struct
+{
+    Channel *channel;
+    int encoding;
+} ChannelOutlet;
+
+
+/**
+ * One signal within the device's bandwidth, with its own
+ * ddc, demodulator, resampler and encoder
+ */
+struct Channel
+{
+    Receiver       *receiver;
+    int            index;
+    void           *context;  //where the encoded audio goes
+    ByteOutputFunc *codecFunc;
+    Ddc            *ddc;
+    float          vfo;       //as last requested, which the pipeline may not have seen yet
+    float          pbLo;
+    float          pbHi;
+    float          ifRate;    //of the last passband asked for, to design the resamplers for
+    Mode           mode;
+    Demodulator    *demod;
+    Demodulator    *demodNull;
+    Demodulator    *demodAm;
+    Demodulator    *demodFm;
+    Demodulator    *demodLsb;
+    Demodulator    *demodUsb;
+    Demodulator    *demodWfm;
+    Agc            *agc;      //shared by the AM and SSB demodulators
+    float          squelchLevel; //as last requested
+    Squelch        *squelch;  //on the ddc output
+    int            squelched; //TRUE while the squelch is closed
+    Resampler      *resampler;
+    Resampler      *stereoResampler; //from the rate WFM splits at to the audio rate
+    Codec          *codec;    //for codecFunc
+    Fanout         *fanout;   //the listeners, for the encodings below
+    Codec          *encoders[ENCODINGS]; //each run only while someone listens
+    ChannelOutlet  outlets[ENCODINGS];   //the context for each one's output
+    int            active[ENCODINGS];    //encodings run at the last block.  Belongs to the encoder thread
+    Encoder        *encoder;  //runs the codecs on a thread of their own
+    Channel        *next;     //on the receiver's retired list
+};
+
+
+struct Receiver
+{
+    Device         *device;  //may be NULL if nothing is attached
+    int            cpu;      //cpu to pin our threads to, or -1
+    pthread_t      thread;
+    int            running;  //state of the reader thread
+    int            started;  //the reader thread owns the pipeline, so changes go by mailbox
+    Mailbox        *mailbox; //control changes waiting for the reader thread
+    Fft            *fft;
+    void           *context; //context for any client code calling me
+    UintOutputFunc *psFunc;  //for outputting the power spectrum
+    Channel        *channels[RECEIVER_MAX_CHANNELS]; //as the control threads see them
+    DdcBank        *bank;    //the channels the reader thread is running
+    Channel        *retired; //dropped by the reader thread, for the control side to delete
+    Audio          *audio;   //shared with the other receivers, not owned
+    Latency        latency[LATENCY_POINTS];
+    int            transferCount;
+    int            transferSize;
+    int            queueDepth;
+    float          blockTime;    //seconds per block down the pipeline, or 0 for the largest
+    int            codecFormat;  //CodecFormat for every channel
+    int            resampleMode; //ResampleMode for every channel
+    unsigned long  droppedBlocks;
+};
+
+
+/**
+ * Create a new Receiver for a device.
+ * @param device the device to read, or NULL
+ * @param audio the speaker output, which the receiver does not own
+ * @return a new Receiver instance
+ */
+Receiver *receiverCreate(Device *device, Audio *audio);
+
+/**
+ * Stop the receiver and free its resources.  The device itself
+ * belongs to the caller.
+ */
+void receiverDelete(Receiver *rcv);
+
+/**
+ * Open the device and start the reader thread
+ * @return TRUE if successful, else FALSE
+ */
+int receiverStart(Receiver *rcv);
+
+/**
+ * Stop the reader thread and close the device
+ * @return TRUE if successful, else FALSE
+ */
+int receiverStop(Receiver *rcv);
+
+/**
+ * Set where the power spectrum and channel 0's encoded audio go
+ */
+void receiverSetOutput(Receiver *rcv, void *context,
+                       UintOutputFunc *psFunc, ByteOutputFunc *codecFunc);
+
+/**
+ * Pin the receiver's threads to one cpu, or -1 to use the policy
+ * for their role.
+ * Takes effect at the next receiverStart().
+ */
+void receiverSetCpu(Receiver *rcv, int cpu);
+
+/**
+ * Set the length of the blocks passed down every channel's pipeline.
+ * The channels pick it up at their next block, and the device's
+ * transfers, unless set with sdrSetBuffering(), at the next
+ * receiverStart().
+ * @param seconds the length of a block, or 0 for the largest
+ */
+void receiverSetBlockTime(Receiver *rcv, float seconds);
+
+/**
+ * Set how every channel resamples its audio.  The channels pick it up
+ * at their next block.
+ * @param mode RESAMPLE_POLYPHASE or RESAMPLE_FARROW
+ */
+void receiverSetResampleMode(Receiver *rcv, int mode);
+
+/**
+ * Set how every channel sends its encoded audio.  The channels pick
+ * it up at their next frame.
+ * @param format CODEC_OGG or CODEC_RAW
+ */
+void receiverSetCodecFormat(Receiver *rcv, int format);
+
+/**
+ * Add a channel, tuned like channel 0.
+ * This and the setters below may be called from any thread.
+ * While the receiver is running, the change is posted to its mailbox
+ * and applied between blocks.  Otherwise it is applied right away.
+ * @param context the context for codecFunc
+ * @param codecFunc receives the channel's encoded audio, or NULL
+ * @return the channel index, or -1 on failure
+ */
+int receiverAddChannel(Receiver *rcv, void *context, ByteOutputFunc *codecFunc);
+
+/**
+ * Remove a channel.  Channel 0 cannot be removed.  The reader thread
+ * only takes it out of the pipeline, and it is freed by the next call
+ * here or to receiverAddChannel() or receiverStop().
+ * @return TRUE if successful, else FALSE
+ */
+int receiverRemoveChannel(Receiver *rcv, int index);
+
+/**
+ * Start listening to a channel's audio, in one of the Encodings.  It
+ * is encoded once for all of the listeners that want it.
+ * @return the listener, which belongs to the caller, or NULL on failure
+ */
+Listener *receiverListen(Receiver *rcv, int index, int encoding);
+
+/**
+ * Get the statistics of a channel's encoder queue
+ * @return TRUE if successful, else FALSE
+ */
+int receiverGetEncoderStats(Receiver *rcv, int index, EncoderStats *stats);
+
+/**
+ * Look up a channel, to read its requested settings
+ * @return the channel, or NULL if there is none at that index
+ */
+Channel *receiverGetChannel(Receiver *rcv, int index);
+
+/**
+ * Tune a channel's ddc, and make its resampler follow the output rate.
+ * @return TRUE if successful, else FALSE
+ */
+int receiverSetDdcFreqs(Receiver *rcv, int index, float vfo, float pbLo, float pbHi);
+
+/**
+ * Select a channel's demodulator
+ * @return TRUE if successful, else FALSE
+ */
+int receiverSetMode(Receiver *rcv, int index, Mode mode);
+
+/**
+ * Set a channel's squelch level
+ * @param level the opening level in dB relative to full scale, or SQUELCH_OFF
+ * @return TRUE if successful, else FALSE
+ */
+int receiverSetSquelch(Receiver *rcv, int index, float level);
+
+/**
+ * Set the speaker volume
+ * @return TRUE if successful, else FALSE
+ */
+int receiverSetAfGain(Receiver *rcv, float gain);
+
+/**
+ * Retune the device
+ * @return TRUE if successful, else FALSE
+ */
+int receiverSetCenterFrequency(Receiver *rcv, double freq);
+
+/**
+ * Set the device's RF gain, 0-1
+ * @return TRUE if successful, else FALSE
+ */
+int receiverSetRfGain(Receiver *rcv, float gain);
+
+/**
+ * Set the device's sample rate
+ * @return TRUE if successful, else FALSE
+ */
+int receiverSetSampleRate(Receiver *rcv, float rate);
+
+/**
+ * Clear all of the latency histograms
+ */
+void receiverResetLatency(Receiver *rcv);
+
+
+#endif /* _RECEIVER_H_ */
+
@@ -33,6 +33,14 @@ int ringbuffer_is_empty(volatile const ringbuffer *rb)
 	return rb->head == rb->tail;
 }
 
+int ringbuffer_count(volatile const ringbuffer *rb)
+{
+	int used = rb->head - rb->tail;
+	if (used < 0)
+		used += rb->total_size;
+	return used / rb->element_size;
+}
+
 int ringbuffer_write(volatile ringbuffer *rb, const void *element)
 {
     int newhead = (rb->head + rb->element_size) % rb->total_size;
@@ -23,6 +23,7 @@ ringbuffer *ringbuffer_create(int elem_count, int element_size);
 void ringbuffer_delete(ringbuffer *rb);
 int ringbuffer_is_empty(volatile const ringbuffer *rb);
 int ringbuffer_is_full(volatile const ringbuffer *rb);
+int ringbuffer_count(volatile const ringbuffer *rb);
 int ringbuffer_write(volatile ringbuffer *rb, const void *element);
 void *ringbuffer_wpeek(volatile ringbuffer *rb);
 void ringbuffer_wadvance(volatile ringbuffer *rb);
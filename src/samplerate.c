@@ -28,49 +28,77 @@
 #include <math.h>
 
 #include "samplerate.h"
+#include "kernel.h"
+#include "taps.h"
+#include "design.h"
 #include "private.h"
 
+
 /**
- * Copied from filter.c.   There is probably a better way
+ * The samples in a block that lasts 'seconds' at 'rate', no more
+ * than will fit the buffer, and the whole buffer for 0
  */
-static void firLPCoeffs(int size, float *coeffs, float cutoffFreq, float sampleRate)
+static int blockSize(float rate, float seconds, int bufSize)
 {
-    float omega = TWOPI * cutoffFreq / sampleRate;
-    int center = (size - 1) / 2;
-    int idx = 0;
-    for ( ; idx < size ; idx++)
-        {
-        int i = idx - center;
-        coeffs[idx] = (i == 0) ? omega / PI : sin(omega * i) / (PI * i);
-        }
-}
-
-static void firBPCoeffs(int size, float *coeffs, float loCutoffFreq, float hiCutoffFreq, float sampleRate)
-{
-    float omega1 = TWOPI * loCutoffFreq / sampleRate;
-    float omega2 = TWOPI * hiCutoffFreq / sampleRate;
-    int center = (size - 1) / 2;
-    int idx = 0;
-    for ( ; idx < size ; idx++)
-        {
-        int i = idx - center;
-        coeffs[idx] = (i == 0) ? (omega2-omega1) / PI : (sin(omega2*i) - sin(omega1 * i)) / (PI * i);
-        }
+    int size = (int)(rate * seconds + 0.5);
+    if (size <= 0 || size > bufSize)
+        return bufSize;
+    return size;
 }
 
 //########################################################################
 //#  D E C I M A T O R
 //########################################################################
 
-Decimator *decimatorCreate(int size, float highRate, float lowRate)
+/**
+ * The anti-alias lowpass for going from one rate to another
+ */
+static Taps *rateTaps(float inRate, float outRate)
+{
+    float m = (outRate < inRate) ? outRate : inRate;
+    FilterSpec spec;
+    spec.lo     = 0.0;
+    spec.hi     = m * RESAMPLER_PASS;
+    spec.width  = m * RESAMPLER_WIDTH;
+    spec.ripple = SAMPLERATE_RIPPLE;
+    spec.atten  = SAMPLERATE_ATTEN;
+    spec.rate   = inRate;
+    return tapsGet(&spec, outRate);
+}
+
+
+/**
+ * Set the ratio for the current taps, and look for an unrolled
+ * kernel when the ratio is the inverse of a whole number
+ */
+static void decimatorSelect(Decimator *dec)
+{
+    Taps *taps = dec->taps;
+    dec->ratio = taps->outRate / taps->spec.rate;
+    dec->factor = (int)(1.0 / dec->ratio + 0.5);
+    dec->decimate = NULL;
+    if (taps->symmetric && fabs(dec->factor * dec->ratio - 1.0) < 1.0e-6)
+        dec->decimate = kernelGenDecimatorC(taps->size, dec->factor);
+    if (dec->phase >= dec->factor)
+        dec->phase = 0;
+}
+
+
+Decimator *decimatorCreate(float highRate, float lowRate)
 {
     Decimator *dec = (Decimator *)malloc(sizeof(Decimator));
-    //FIR sizes must be odd
-    size |= 1;
-    dec->size = size;
-    dec->coeffs = (float *)malloc(size * sizeof(float));
-    decimatorSetRates(dec, highRate, lowRate);
-    int delayLineSize = size * sizeof(float complex);
+    if (!dec)
+        return NULL;
+    dec->taps = rateTaps(highRate, lowRate);
+    if (!dec->taps)
+        {
+        free(dec);
+        return NULL;
+        }
+    dec->pending = NULL;
+    dec->phase = 0;
+    decimatorSelect(dec);
+    int delayLineSize = 2 * DESIGN_MAX_TAPS * sizeof(float complex);
     dec->delayLine = (float complex *)malloc(delayLineSize);
     memset(dec->delayLine, 0, delayLineSize);
     dec->delayIndex = 0;
@@ -82,8 +110,9 @@ Decimator *decimatorCreate(int size, float highRate, float lowRate)
 
 void decimatorSetRates(Decimator *dec, float highRate, float lowRate)
 {
-    firLPCoeffs(dec->size, dec->coeffs, lowRate, highRate);
-    dec->ratio = lowRate/highRate;
+    Taps *taps = rateTaps(highRate, lowRate);
+    if (taps)
+        tapsPost(&(dec->pending), taps);
 }
 
 
@@ -92,16 +121,48 @@ void decimatorDelete(Decimator *dec)
     if (dec)
         {
         free(dec->delayLine);
-        free(dec->coeffs);
+        tapsUnref(dec->pending);
+        tapsUnref(dec->taps);
         free(dec);
         }
 }
 
+/**
+ * The unrolled path, which takes every factor'th sample by count
+ * rather than by accumulating the ratio
+ */
+static void decimatorUpdateFixed(Decimator *dec, float complex *data, int dataLen,
+                                 ComplexOutputFunc *func, void *context)
+{
+    while (dataLen > 0)
+        {
+        //no more inputs than will fit the outputs in the buffer
+        int room = DECIMATOR_BUFSIZE - dec->bufPtr;
+        int len  = (dataLen < room * dec->factor) ? dataLen : room * dec->factor;
+        dec->bufPtr += dec->decimate(dec->delayLine, &(dec->delayIndex), &(dec->phase),
+                           dec->taps->coeffs, data, len, dec->buf + dec->bufPtr);
+        if (dec->bufPtr >= DECIMATOR_BUFSIZE)
+            {
+            func(dec->buf, dec->bufPtr, context);
+            dec->bufPtr = 0;
+            }
+        data    += len;
+        dataLen -= len;
+        }
+}
+
 void decimatorUpdate(Decimator *dec, float complex *data, int dataLen, ComplexOutputFunc *func, void *context)
 {
-    int   size         = dec->size;
-    int   size1        = size - 1;
-    float *coeffs      = dec->coeffs;
+    if (tapsTake(&(dec->pending), &(dec->taps)))
+        decimatorSelect(dec);
+    if (dec->decimate)
+        {
+        decimatorUpdateFixed(dec, data, dataLen, func, context);
+        return;
+        }
+    int   size         = dec->taps->size;
+    float *coeffs      = dec->taps->coeffs;
+    DotFuncC *dot      = kernelSelectC(dec->taps->symmetric, dec->taps->size);
     float complex *delayLine = dec->delayLine;
     int   delayIndex   = dec->delayIndex;
     float ratio        = dec->ratio;
@@ -112,23 +173,13 @@ void decimatorUpdate(Decimator *dec, float complex *data, int dataLen, ComplexOu
     float complex *cpx = data;
     while (dataLen--)
         {
-        delayLine[delayIndex] = *cpx++;
+        delayLine[delayIndex] = delayLine[delayIndex + DESIGN_MAX_TAPS] = *cpx++;
         acc += ratio;
         if (acc > 0.0)
             {
             acc -= 1.0;
-            float complex sum = 0.0;
-            //walk the coefficients from first to last
-            //and the delay line from newest to oldest
-            int idx = delayIndex;
-            float *coeff = coeffs; 
-            int c = size;
-            while (c--)
-                {
-                sum += delayLine[idx++] * (*coeff++);
-                idx %= size;
-                }
-            //trace("sum:%f", sum * 1000.0);
+            //coefficients first to last, samples newest to oldest
+            float complex sum = dot(delayLine + delayIndex, coeffs, size);
             buf[bufPtr++] = sum;
             if (bufPtr >= DECIMATOR_BUFSIZE)
                 {
@@ -136,7 +187,7 @@ void decimatorUpdate(Decimator *dec, float complex *data, int dataLen, ComplexOu
                 bufPtr = 0;
                 }
             }
-        delayIndex = (delayIndex + size1) % size;
+        delayIndex = (delayIndex) ? delayIndex - 1 : DESIGN_MAX_TAPS - 1;
         }
     dec->delayIndex = delayIndex;
     dec->acc = acc;
@@ -149,64 +200,48 @@ void decimatorUpdate(Decimator *dec, float complex *data, int dataLen, ComplexOu
 //#  D D C
 //########################################################################
 
-DelayVal *delayCreate(int size)
-{
-    if (size < 2)
-        return NULL;
-    int allocSize = size * sizeof(DelayVal);
-    DelayVal *xs = (DelayVal *)malloc(allocSize);
-    if (!xs)
-        return NULL;
-    memset(xs, 0, allocSize);
-    DelayVal *prev = &(xs[size-1]);
-    DelayVal *curr = xs;
-    int i = 0;
-    for ( ; i < size ; i++)
-        {
-        prev->next = curr;
-        curr->prev = prev;
-        prev = curr;
-        curr++;
-        }
-    return xs;
-}
-
-
-void delayDelete(DelayVal *obj)
+/**
+ * The decimation ratio that goes with a set of bandpass coefficients
+ */
+static float ddcRatio(Taps *taps)
 {
-    if (obj)
-        {
-        free(obj);
-        }
+    return taps->outRate / taps->spec.rate;
 }
 
 
-
-Ddc *ddcCreate(int size, float vfoFreq, float pbLoOff, float pbHiOff, float sampleRate)
+Ddc *ddcCreate(float vfoFreq, float pbLoOff, float pbHiOff, float sampleRate)
 {
     Ddc *obj = (Ddc *)malloc(sizeof(Ddc));
-    //FIR sizes must be odd
-    size |= 1;
-    obj->size = size;
-    obj->coeffs = (float *)malloc(size * sizeof(float));
-    if (!obj->coeffs)
-        {
-        free(obj);
+    if (!obj)
         return NULL;
-        }
-    obj->delayLine  = delayCreate(size);
+    obj->taps    = NULL;
+    obj->pending = NULL;
+    int delayLineSize = 2 * DESIGN_MAX_TAPS * sizeof(float complex);
+    obj->delayLine  = (float complex *)malloc(delayLineSize);
     if (!obj->delayLine)
         {
-        free(obj->coeffs);
         free(obj);
         return NULL;
         }
-    obj->head = obj->delayLine;
+    memset(obj->delayLine, 0, delayLineSize);
+    obj->delayIndex = 0;
     obj->inRate = sampleRate;
     ddcSetFreqs(obj, vfoFreq, pbLoOff, pbHiOff);
+    //nobody else can see us yet, so take the first set right away
+    if (!tapsTake(&(obj->pending), &(obj->taps)))
+        {
+        free(obj->delayLine);
+        free(obj);
+        return NULL;
+        }
+    obj->ratio    = ddcRatio(obj->taps);
+    obj->ncoVfo   = obj->vfo;
     obj->acc      = -1.0;
     obj->bufPtr   = 0;
+    obj->blockTime = 0.0;
     obj->vfoPhase = 0.0 + 1.0 * I;
+    obj->stamp    = 0;
+    obj->outStamp = 0;
     return obj;
 }
 
@@ -214,8 +249,9 @@ void ddcDelete(Ddc *obj)
 {
     if (obj)
         {
-        delayDelete(obj->delayLine);
-        free(obj->coeffs);
+        free(obj->delayLine);
+        tapsUnref(obj->pending);
+        tapsUnref(obj->taps);
         free(obj);
         }
 }
@@ -227,17 +263,57 @@ void ddcDelete(Ddc *obj)
  */
 void ddcSetFreqs(Ddc *obj, float vfo, float pbLo, float pbHi)
 {
-    obj->vfo  = vfo;
-    obj->pbLo = pbLo;
-    obj->pbHi = pbHi;
-    float hiAbs = fabs(pbHi);
-    float loAbs = fabs(pbLo);
-    float maxOff = (hiAbs > loAbs) ? hiAbs : loAbs;
-    firBPCoeffs(obj->size, obj->coeffs, pbLo, pbHi, obj->inRate);
-    obj->outRate = maxOff * 2.0;
-    obj->ratio = obj->outRate/obj->inRate;
-    float omega = TWOPI * vfo / obj->inRate;
-    obj->vfoFreq = cos(omega) - sin(omega) * I;
+    if (obj->taps && pbLo == obj->pbLo && pbHi == obj->pbHi)
+        {
+        ddcSetVfo(obj, vfo);
+        return;
+        }
+    Taps *taps = ddcDesign(obj, pbLo, pbHi);
+    if (taps)
+        {
+        ddcSetTaps(obj, vfo, taps);
+        obj->pbLo = pbLo;
+        obj->pbHi = pbHi;
+        }
+}
+
+
+/**
+ * The passband is translated to 0 before filtering, so what we need
+ * is a lowpass out to the farther edge, or a bandpass when both edges
+ * are on the same side, far enough out for the lower transition band
+ * to fit.  A real filter passes the mirror image too, which the
+ * demodulators deal with, as they always have.
+ */
+Taps *ddcDesign(Ddc *obj, float pbLo, float pbHi)
+{
+    float loAbs  = fabs(pbLo);
+    float hiAbs  = fabs(pbHi);
+    float maxAbs = (hiAbs > loAbs) ? hiAbs : loAbs;
+    float minAbs = (hiAbs > loAbs) ? loAbs : hiAbs;
+    FilterSpec spec;
+    spec.hi     = maxAbs;
+    spec.width  = maxAbs * (DDC_GUARD - 1.0) * 2.0;
+    spec.lo     = (pbLo * pbHi > 0.0 && minAbs > spec.width) ? minAbs : 0.0;
+    spec.ripple = SAMPLERATE_RIPPLE;
+    spec.atten  = SAMPLERATE_ATTEN;
+    spec.rate   = obj->inRate;
+    return tapsGet(&spec, maxAbs * 2.0 * DDC_GUARD);
+}
+
+
+void ddcSetTaps(Ddc *obj, float vfo, Taps *taps)
+{
+    obj->outRate = taps->outRate;
+    tapsPost(&(obj->pending), taps);
+    ddcSetVfo(obj, vfo);
+}
+
+
+void ddcSetVfo(Ddc *obj, float vfo)
+{
+    //the dsp thread notices the change and retunes the nco itself
+    __atomic_store(&(obj->vfo), &vfo, __ATOMIC_RELEASE);
 }
 
 
@@ -247,13 +323,98 @@ float ddcGetOutRate(Ddc *obj)
 }
 
 
+void ddcReset(Ddc *obj)
+{
+    memset(obj->delayLine, 0, 2 * DESIGN_MAX_TAPS * sizeof(float complex));
+}
+
+
+void ddcSetBlockTime(Ddc *obj, float seconds)
+{
+    __atomic_store(&(obj->blockTime), &seconds, __ATOMIC_RELAXED);
+}
+
+
+
+/**
+ * Pick up any retuning.  Called between blocks, never in the middle of one.
+ */
+static void ddcPrepare(Ddc *obj)
+{
+    if (tapsTake(&(obj->pending), &(obj->taps)))
+        obj->ratio = ddcRatio(obj->taps);
+    float vfo;
+    __atomic_load(&(obj->vfo), &vfo, __ATOMIC_ACQUIRE);
+    if (vfo != obj->ncoVfo)
+        {
+        float omega = TWOPI * vfo / obj->inRate;
+        obj->vfoFreq = cos(omega) - sin(omega) * I;
+        obj->ncoVfo = vfo;
+        }
+}
+
+
+/**
+ * Decimate and filter samples that have already been mixed down.
+ * @param stride the distance between one sample and the next, which
+ *     is more than 1 when several channels share the buffer
+ */
+static void ddcFilter(Ddc *obj, const float complex *mixed, int stride, int dataLen,
+                      ComplexOutputFunc *func, void *context)
+{
+    int   size         = obj->taps->size;
+    float *coeffs      = obj->taps->coeffs;
+    DotFuncC *dot      = kernelSelectC(obj->taps->symmetric, obj->taps->size);
+    float complex *delayLine = obj->delayLine;
+    int   delayIndex   = obj->delayIndex;
+    float ratio        = obj->ratio;
+    float acc          = obj->acc;
+    float complex *buf = obj->buf;
+    int   bufPtr       = obj->bufPtr;
+    float blockTime;
+    __atomic_load(&(obj->blockTime), &blockTime, __ATOMIC_RELAXED);
+    int   bufSize      = blockSize(obj->taps->outRate, blockTime, DDC_BUFSIZE);
+    
+    while (dataLen--)
+        {
+        float complex sample = *mixed;
+        mixed += stride;
+        delayLine[delayIndex]                   = sample;
+        delayLine[delayIndex + DESIGN_MAX_TAPS] = sample;
+        //perform our fractional decimation
+        //do the Bresenham's thing
+        acc += ratio;
+        if (acc > 0.0)
+            {
+            acc -= 1.0;
+            //coefficients first to last, samples newest to oldest
+            float complex sum = dot(delayLine + delayIndex, coeffs, size);
+            //trace("sum:%f", sum * 1000.0);
+            if (!bufPtr)
+                obj->outStamp = obj->stamp;
+            buf[bufPtr++] = sum;
+            if (bufPtr >= bufSize)
+                {
+                func(buf, bufPtr, context);
+                bufPtr = 0;
+                }
+            }
+        delayIndex = (delayIndex) ? delayIndex - 1 : DESIGN_MAX_TAPS - 1;
+        }
+    obj->delayIndex = delayIndex;
+    obj->acc      = acc;
+    obj->bufPtr   = bufPtr;
+}
+
 
 /**
  * Downmix, downsample, and bandpass the input stream of sample, all in one go.
  *
  * For each data sample:
  *
- * 1.  Advance the VFO phase and convolve it with the sample
+ * 1.  Advance the VFO phase and convolve it with the sample.  This is done a
+ *     tile at a time, ahead of the filter, so that a DdcBank can do it for
+ *     many channels at once.
  * 2.  Increment the accumulator with the ratio until it is >= 0. then process a sample
  *     Example:  say the input rate is 1Ms/s and the desired output is 100ks/s.  Then the
  *     ratio is 0.1, and the decimation rate is 10.   The accumulator starts at -1. 
@@ -261,6 +422,8 @@ float ddcGetOutRate(Ddc *obj)
  *     accumulator and process the sample.
  * 3.  Process the sample with the FIR bandbass coefficients,  with  the coefficients
  *     first to last, and the samples in the delay line in reverse going from most recent.
+ *     The delay line is kept twice as long as the longest filter, so that this is one
+ *     contiguous run, and the folded kernel is used when the taps are symmetric.
  * 4.  Add the sample to the output buffer
  * 5.  When the output buffer is full, call the output function, clear the buffer, and
  *     continue the loop.
@@ -315,55 +478,154 @@ float ddcGetOutRate(Ddc *obj)
  */     
 void ddcUpdate(Ddc *obj, float complex *data, int dataLen, ComplexOutputFunc *func, void *context)
 {
-    int   size         = obj->size;
-    int   size1        = size - 1;
-    float *coeffs      = obj->coeffs;
-    DelayVal *head     = obj->head;
-    float ratio        = obj->ratio;
-    float acc          = obj->acc;
-    float complex *buf = obj->buf;
-    int   bufPtr       = obj->bufPtr;
-    float complex vfoPhase = obj->vfoPhase;
-    
-    while (dataLen--)
+    ddcPrepare(obj);
+    float complex tile[DDC_TILE];
+    float complex vfoFreq = obj->vfoFreq;
+    while (dataLen > 0)
         {
+        int n = (dataLen < DDC_TILE) ? dataLen : DDC_TILE;
         //advance the VFO and convolve the input stream
-        vfoPhase *= obj->vfoFreq;
-        float complex sample = (*data++) * vfoPhase;
-        head->c = sample;
-        //perform our fractional decimation
-        //do the Bresenham's thing
-        acc += ratio;
-        if (acc > 0.0)
+        float complex vfoPhase = obj->vfoPhase;
+        kernels.rotate(tile, data, n, &vfoPhase, vfoFreq);
+        obj->vfoPhase = vfoPhase / cabsf(vfoPhase); //heal
+        ddcFilter(obj, tile, 1, n, func, context);
+        data    += n;
+        dataLen -= n;
+        }
+}
+
+
+
+//########################################################################
+//#  D D C    B A N K
+//########################################################################
+
+
+DdcBank *ddcBankCreate()
+{
+    DdcBank *bank = (DdcBank *)malloc(sizeof(DdcBank));
+    if (!bank)
+        return NULL;
+    memset(bank, 0, sizeof(DdcBank));
+    return bank;
+}
+
+
+void ddcBankDelete(DdcBank *bank)
+{
+    free(bank);
+}
+
+
+int ddcBankAdd(DdcBank *bank, Ddc *ddc, ComplexOutputFunc *func, void *context)
+{
+    if (bank->count >= DDC_BANK_MAX)
+        {
+        error("ddc bank is full, at %d channels", DDC_BANK_MAX);
+        return FALSE;
+        }
+    int k = bank->count++;
+    bank->ddcs[k]     = ddc;
+    bank->funcs[k]    = func;
+    bank->contexts[k] = context;
+    return TRUE;
+}
+
+
+int ddcBankRemove(DdcBank *bank, Ddc *ddc)
+{
+    for (int k = 0 ; k < bank->count ; k++)
+        {
+        if (bank->ddcs[k] == ddc)
             {
-            acc -= 1.0;
-            float complex sum = 0.0;
-            DelayVal *v = head;
-            float *coeff = coeffs; 
-            int c = size;
-            while (c--)
-                {
-                sum += v->c * (*coeff++);
-                v = v->prev;
-                }
-            //trace("sum:%f", sum * 1000.0);
-            buf[bufPtr++] = sum;
-            if (bufPtr >= DDC_BUFSIZE)
+            //order does not matter, so fill the hole with the last one
+            int last = --bank->count;
+            bank->ddcs[k]     = bank->ddcs[last];
+            bank->funcs[k]    = bank->funcs[last];
+            bank->contexts[k] = bank->contexts[last];
+            return TRUE;
+            }
+        }
+    return FALSE;
+}
+
+
+void ddcBankReset(DdcBank *bank)
+{
+    for (int k = 0 ; k < bank->count ; k++)
+        ddcReset(bank->ddcs[k]);
+}
+
+
+/**
+ * Run every channel over the input one tile at a time, so that
+ * the tile is read from memory once, and stays in cache while each
+ * channel reads it.
+ *
+ * The ncos are the one part that is the same shape for every channel,
+ * so they are run side by side:  for each input sample, every channel's
+ * phasor is advanced and mixed in one loop over the channels, with the
+ * phasors kept as separate real and imaginary arrays so that the
+ * compiler can vectorize it.  The results are stored channel-interleaved.
+ * The filters differ in length and decimation per channel, so each
+ * channel then filters its own column of the tile, using the same
+ * vectorized dot products as a single ddc.
+ */
+void ddcBankUpdate(DdcBank *bank, float complex *data, int dataLen)
+{
+    int count = bank->count;
+    if (!count)
+        return;
+    float phRe[DDC_BANK_MAX];
+    float phIm[DDC_BANK_MAX];
+    float frRe[DDC_BANK_MAX];
+    float frIm[DDC_BANK_MAX];
+    for (int k = 0 ; k < count ; k++)
+        {
+        Ddc *ddc = bank->ddcs[k];
+        ddcPrepare(ddc);
+        ddc->stamp = bank->stamp;
+        phRe[k] = crealf(ddc->vfoPhase);
+        phIm[k] = cimagf(ddc->vfoPhase);
+        frRe[k] = crealf(ddc->vfoFreq);
+        frIm[k] = cimagf(ddc->vfoFreq);
+        }
+    float complex *mix = bank->mix;
+    while (dataLen > 0)
+        {
+        int n = (dataLen < DDC_TILE) ? dataLen : DDC_TILE;
+        for (int i = 0 ; i < n ; i++)
+            {
+            float re = crealf(data[i]);
+            float im = cimagf(data[i]);
+            float *out = (float *)(mix + i * count);
+            for (int k = 0 ; k < count ; k++)
                 {
-                func(buf, DDC_BUFSIZE, context);
-                bufPtr = 0;
-                vfoPhase /= cabsf(vfoPhase); //heal
+                float pr = phRe[k] * frRe[k] - phIm[k] * frIm[k];
+                float pi = phRe[k] * frIm[k] + phIm[k] * frRe[k];
+                phRe[k] = pr;
+                phIm[k] = pi;
+                out[2*k]   = re * pr - im * pi;
+                out[2*k+1] = re * pi + im * pr;
                 }
             }
-        head = head->next;
+        for (int k = 0 ; k < count ; k++)
+            {
+            //heal
+            float mag = sqrtf(phRe[k] * phRe[k] + phIm[k] * phIm[k]);
+            phRe[k] /= mag;
+            phIm[k] /= mag;
+            ddcFilter(bank->ddcs[k], mix + k, count, n, bank->funcs[k], bank->contexts[k]);
+            }
+        data    += n;
+        dataLen -= n;
         }
-    obj->vfoPhase = vfoPhase;
-    obj->head     = head;
-    obj->acc      = acc;
-    obj->bufPtr   = bufPtr;
+    for (int k = 0 ; k < count ; k++)
+        bank->ddcs[k]->vfoPhase = phRe[k] + phIm[k] * I;
 }
 
 
+
 //########################################################################
 //#  C I C
 //########################################################################
@@ -452,31 +714,108 @@ void cicUpdate(Cic *obj, float complex *data, int datalen, ComplexFunc func, voi
 
 
 
-Resampler *resamplerCreate(int size, float inRate, float outRate)
+/**
+ * Reduce outRate/inRate to up/down, L/M, by continued fractions.
+ * Rates that are whole numbers, or whole numbers over the same
+ * decimation, come out exact.  If that would take more than
+ * maxPhases branches, this is the nearest that does not.
+ * @return TRUE if successful, else FALSE
+ */
+static int resamplerRatio(double inRate, double outRate, int maxPhases, int *up, int *down)
+{
+    double x = outRate / inRate;
+    double r = x;
+    long h0 = 0, h1 = 1;  //numerators of the last two convergents
+    long k0 = 1, k1 = 0;  //and denominators
+    *up = 0;
+    for (int i = 0 ; i < 32 ; i++)
+        {
+        double a = floor(r);
+        long h = (long)a * h1 + h0;
+        long k = (long)a * k1 + k0;
+        if (h > maxPhases || k > 0x7fffffffL / maxPhases)
+            break;
+        if (h > 0)
+            {
+            *up   = (int)h;
+            *down = (int)k;
+            }
+        //as exact as a float rate can be
+        if (fabs((double)h / k - x) < 1.0e-7 * x || r - a < 1.0e-9)
+            break;
+        h0 = h1; h1 = h;
+        k0 = k1; k1 = k;
+        r = 1.0 / (r - a);
+        }
+    if (!*up)
+        {
+        error("Cannot resample from %f to %f", inRate, outRate);
+        return FALSE;
+        }
+    return TRUE;
+}
+
+
+/**
+ * The polyphase lowpass for going from one rate to another, in no
+ * more than maxPhases branches
+ */
+static Taps *resamplerTaps(float inRate, float outRate, int maxPhases)
+{
+    int up, down;
+    if (!resamplerRatio(inRate, outRate, maxPhases, &up, &down))
+        return NULL;
+    float m = (outRate < inRate) ? outRate : inRate;
+    FilterSpec spec;
+    spec.lo     = 0.0;
+    spec.hi     = m * RESAMPLER_PASS;
+    spec.width  = m * RESAMPLER_WIDTH;
+    spec.ripple = SAMPLERATE_RIPPLE;
+    spec.atten  = SAMPLERATE_ATTEN;
+    spec.rate   = inRate;
+    return tapsGetPolyphase(&spec, outRate, up, down);
+}
+
+
+static void resamplerApplyTaps(Resampler *obj, int glide);
+
+
+Resampler *resamplerCreate(float inRate, float outRate)
 {
     Resampler *obj = (Resampler *)malloc(sizeof(Resampler));
     if (!obj)
         return NULL;
-    //FIR sizes must be odd
-    size |= 1;
-    obj->size = size;
-    obj->coeffs = (float *)malloc(size * sizeof(float));
-    firLPCoeffs(size, obj->coeffs, outRate, inRate);
-    obj->delayLine  = (float *)malloc(size * sizeof(float));
-    obj->delayLineC = (float complex *)malloc(size * sizeof(float complex));
-    int i = 0;
-    for (; i < size ; i++)
-        {
-        obj->delayLine[i] = 0;
-        obj->delayLineC[i] = 0;
+    obj->taps = resamplerTaps(inRate, outRate, RESAMPLER_MAX_PHASES);
+    if (!obj->taps)
+        {
+        free(obj);
+        return NULL;
         }
+    obj->farrow = farrowCreate(inRate, outRate);
+    if (!obj->farrow)
+        {
+        tapsUnref(obj->taps);
+        free(obj);
+        return NULL;
+        }
+    obj->mode = RESAMPLE_POLYPHASE;
+    obj->running = RESAMPLE_POLYPHASE;
+    obj->pending = NULL;
+    //twice as long, so the window never wraps
+    obj->delayLine  = (float *)malloc(2 * DESIGN_MAX_TAPS * sizeof(float));
+    obj->delayLineC = (float complex *)malloc(2 * DESIGN_MAX_TAPS * sizeof(float complex));
     obj->delayIndex = 0;
+    resamplerReset(obj);
     obj->inRate = inRate;
     obj->outRate = outRate;
-    obj->updown = (outRate > inRate);
-    obj->ratio = (obj->updown) ? inRate/outRate : outRate/inRate;
-    obj->acc = 0.0;
+    obj->drift = 0.0;
+    obj->blockTime = 0.0;
+    obj->phase = 0;
+    obj->slip = 0.0;
+    resamplerApplyTaps(obj, 0);
     obj->bufPtr = 0;
+    obj->stamp = 0;
+    obj->outStamp = 0;
     return obj;
 }
 
@@ -487,183 +826,481 @@ void resamplerDelete(Resampler *obj)
         {
         free(obj->delayLine);
         free(obj->delayLineC);
-        free(obj->coeffs);
+        farrowDelete(obj->farrow);
+        tapsUnref(obj->pending);
+        tapsUnref(obj->taps);
         free(obj);
         }
 }
 
 
+/**
+ * Called by the dsp thread when it picks up a new set of coefficients,
+ * or a new drift.  L/M is exact for the rates, so the trim is 0 unless
+ * there is drift or L had to be limited.  With a farrow, the branches
+ * step exactly L/M, and the farrow takes up the difference.
+ * @param glide outputs over which the farrow should change its ratio
+ */
+static void resamplerApplyTaps(Resampler *obj, int glide)
+{
+    Taps *taps     = obj->taps;
+    double inRate  = taps->spec.rate;
+    double outRate = taps->outRate * (1.0 + obj->drift * 1.0e-6);
+    int mode = __atomic_load_n(&(obj->mode), __ATOMIC_ACQUIRE);
+    if (mode == RESAMPLE_FARROW)
+        {
+        if (obj->running != RESAMPLE_FARROW)
+            {
+            farrowReset(obj->farrow);
+            glide = 0;
+            }
+        obj->trim = 0.0;
+        farrowSetRates(obj->farrow, inRate * taps->phases / taps->step, outRate, glide);
+        }
+    else
+        obj->trim = (float)(taps->phases * inRate / outRate - taps->step);
+    obj->running = mode;
+}
+
+
+/**
+ * Pick up any new coefficients, keeping the time of the next output
+ * when the number of branches changes
+ */
+static void resamplerTakeTaps(Resampler *obj)
+{
+    int phases = obj->taps->phases;
+    if (tapsTake(&(obj->pending), &(obj->taps)))
+        {
+        obj->phase = (int)((long long)obj->phase * obj->taps->phases / phases);
+        resamplerApplyTaps(obj, 0);
+        }
+}
+
+
+void resamplerSetDrift(Resampler *obj, float ppm)
+{
+    if (ppm == obj->drift)
+        return;
+    obj->drift = ppm;
+    resamplerApplyTaps(obj, FARROW_GLIDE);
+}
+
+
 void resamplerSetInRate(Resampler *obj, float inRate)
 {
-    float outRate = obj->outRate;
-    obj->inRate = inRate;
-    firLPCoeffs(obj->size, obj->coeffs, outRate, inRate);
-    obj->updown = (outRate > inRate);
-    obj->ratio  = (obj->updown) ? inRate/outRate : outRate/inRate;
-    trace("in:%f out:%f ud:%d, ratio:%f", inRate, outRate, obj->updown, obj->ratio);
+    Taps *taps = resamplerDesign(obj, inRate, obj->outRate);
+    if (taps)
+        resamplerSetTaps(obj, taps);
+    trace("in:%f out:%f", inRate, obj->outRate);
 }
 
 void resamplerSetOutRate(Resampler *obj, float outRate)
 {
-    float inRate = obj->inRate;
-    obj->outRate = outRate;
-    firLPCoeffs(obj->size, obj->coeffs, outRate, inRate);
-    obj->updown = (outRate > inRate);
-    obj->ratio  = (obj->updown) ? inRate/outRate : outRate/inRate;
+    Taps *taps = resamplerDesign(obj, obj->inRate, outRate);
+    if (taps)
+        resamplerSetTaps(obj, taps);
 }
 
 
+Taps *resamplerDesign(Resampler *obj, float inRate, float outRate)
+{
+    int mode = __atomic_load_n(&(obj->mode), __ATOMIC_ACQUIRE);
+    int maxPhases = (mode == RESAMPLE_FARROW) ? RESAMPLER_FARROW_PHASES : RESAMPLER_MAX_PHASES;
+    return resamplerTaps(inRate, outRate, maxPhases);
+}
+
+
+void resamplerSetTaps(Resampler *obj, Taps *taps)
+{
+    obj->inRate  = taps->spec.rate;
+    obj->outRate = taps->outRate;
+    tapsPost(&(obj->pending), taps);
+}
+
+
+
+
+void resamplerSetMode(Resampler *obj, int mode)
+{
+    __atomic_store_n(&(obj->mode), mode, __ATOMIC_RELEASE);
+}
+
+
+void resamplerSetBlockTime(Resampler *obj, float seconds)
+{
+    __atomic_store(&(obj->blockTime), &seconds, __ATOMIC_RELAXED);
+    farrowSetBlockTime(obj->farrow, seconds);
+}
+
+
+void resamplerReset(Resampler *obj)
+{
+    for (int i = 0 ; i < 2 * DESIGN_MAX_TAPS ; i++)
+        {
+        obj->delayLine[i]  = 0.0;
+        obj->delayLineC[i] = 0.0;
+        }
+    farrowReset(obj->farrow);
+}
+
+
+long long resamplerGetOutStamp(Resampler *obj)
+{
+    return (obj->running == RESAMPLE_FARROW) ? obj->farrow->outStamp : obj->outStamp;
+}
+
+
+/**
+ * With a farrow, the branches' output goes through it on its way out
+ */
+static void resamplerFarrowOutput(float *buf, int size, void *ctx)
+{
+    Resampler *obj = (Resampler *)ctx;
+    obj->farrow->stamp = obj->outStamp;
+    farrowUpdate(obj->farrow, buf, size, obj->farrowFunc, obj->farrowContext);
+}
+
+
+static void resamplerFarrowOutputC(float complex *buf, int size, void *ctx)
+{
+    Resampler *obj = (Resampler *)ctx;
+    obj->farrow->stamp = obj->outStamp;
+    farrowUpdateC(obj->farrow, buf, size, obj->farrowFuncC, obj->farrowContext);
+}
+
 
 
 void resamplerUpdate(Resampler *obj, float *data, int dataLen, FloatOutputFunc *func, void *context)
 {
-    int   size       = obj->size;
-    int   size1      = size-1;
-    float *coeffs    = obj->coeffs;
+    resamplerTakeTaps(obj);
+    int   size       = obj->taps->size;
+    int   phases     = obj->taps->phases;
+    int   step       = obj->taps->step;
+    float *coeffs    = obj->taps->coeffs;
+    DotFunc *dot     = kernelSelect(obj->taps->symmetric, size);
     float *delayLine = obj->delayLine;
     int   delayIndex = obj->delayIndex;
-    float ratio      = obj->ratio;
-    float acc        = obj->acc;
+    int   phase      = obj->phase;
+    float trim       = obj->trim;
+    float slip       = obj->slip;
     float *buf       = obj->buf;
     int   bufPtr     = obj->bufPtr;
+    float blockTime;
+    __atomic_load(&(obj->blockTime), &blockTime, __ATOMIC_RELAXED);
+    int   bufSize    = blockSize(obj->taps->outRate, blockTime, RESAMPLER_BUFSIZE);
+    int   farrow     = (obj->running == RESAMPLE_FARROW);
+    if (farrow)
+        {
+        //the branches pass everything they make to the farrow, which
+        //does the blocking
+        obj->farrowFunc    = func;
+        obj->farrowContext = context;
+        func    = resamplerFarrowOutput;
+        context = obj;
+        bufSize = RESAMPLER_BUFSIZE;
+        }
+    else if (obj->farrow->bufPtr)
+        {
+        //what it still held when it was switched out
+        (*func)(obj->farrow->buf, obj->farrow->bufPtr, context);
+        obj->farrow->bufPtr = 0;
+        }
     
-    if (obj->updown)
+    while (dataLen--)
         {
-        //interpolate
-        while (dataLen--)
+        delayLine[delayIndex] = delayLine[delayIndex + DESIGN_MAX_TAPS] = *data++;
+        //every output that falls before the next input
+        while (phase < phases)
             {
-            delayLine[delayIndex] = *data++;
-            acc -= 1.0;
-            while (acc < 0.0)
+            float sum = dot(delayLine + delayIndex, coeffs + phase * size, size);
+            if (!bufPtr)
+                obj->outStamp = obj->stamp;
+            buf[bufPtr++] = sum;
+            if (bufPtr >= bufSize)
                 {
-                acc += ratio;
-                float sum = 0.0;
-                int idx = delayIndex;
-                float *coeff = coeffs; 
-                int c = size;
-                while (c--)
-                    {
-                    sum += delayLine[idx++] * (*coeff++);
-                    idx %= size;
-                    }
-                buf[bufPtr++] = sum;
-                if (bufPtr >= RESAMPLER_BUFSIZE)
-                    {
-                    (*func)(buf, RESAMPLER_BUFSIZE, context);
-                    bufPtr = 0;
-                    }
+                (*func)(buf, bufPtr, context);
+                bufPtr = 0;
                 }
-            delayIndex = (delayIndex + size1) % size;
+            slip += trim;
+            int extra = (int)slip;
+            slip -= extra;
+            phase += step + extra;
             }
+        phase -= phases;
+        delayIndex = (delayIndex) ? delayIndex - 1 : DESIGN_MAX_TAPS - 1;
         }
-    else
+    if (farrow && bufPtr)
         {
-        //decimate
-        while (dataLen--)
-            {
-            delayLine[delayIndex] = *data++;
-            acc += ratio;
-            if (acc >= 0.0)
-                {
-                acc -= 1.0;
-                float sum = 0.0;
-                int idx = delayIndex;
-                float *coeff = coeffs; 
-                int c = size;
-                while (c--)
-                    {
-                    sum += delayLine[idx++] * (*coeff++);
-                    idx %= size;
-                    }
-                buf[bufPtr++] = sum;
-                if (bufPtr >= RESAMPLER_BUFSIZE)
-                    {
-                    (*func)(buf, RESAMPLER_BUFSIZE, context);
-                    bufPtr = 0;
-                    }
-                }
-            delayIndex = (delayIndex + size1) % size;
-            }
+        (*func)(buf, bufPtr, context);
+        bufPtr = 0;
         }
     obj->delayIndex = delayIndex;
-    obj->acc = acc;
+    obj->phase = phase;
+    obj->slip = slip;
     obj->bufPtr = bufPtr;
 }
 
 
 void resamplerUpdateC(Resampler *obj, float complex *data, int dataLen, ComplexOutputFunc *func, void *context)
 {
-    int   size         = obj->size;
-    int   size1        = size-1;
-    float *coeffs      = obj->coeffs;
+    resamplerTakeTaps(obj);
+    int   size         = obj->taps->size;
+    int   phases       = obj->taps->phases;
+    int   step         = obj->taps->step;
+    float *coeffs      = obj->taps->coeffs;
+    DotFuncC *dot      = kernelSelectC(obj->taps->symmetric, size);
     float complex *delayLine = obj->delayLineC;
     int   delayIndex   = obj->delayIndex;
-    float ratio        = obj->ratio;
-    float acc          = obj->acc;
+    int   phase        = obj->phase;
+    float trim         = obj->trim;
+    float slip         = obj->slip;
     float complex *buf = obj->bufC;
     int   bufPtr       = obj->bufPtr;
+    float blockTime;
+    __atomic_load(&(obj->blockTime), &blockTime, __ATOMIC_RELAXED);
+    int   bufSize      = blockSize(obj->taps->outRate, blockTime, RESAMPLER_BUFSIZE);
+    int   farrow       = (obj->running == RESAMPLE_FARROW);
+    if (farrow)
+        {
+        obj->farrowFuncC   = func;
+        obj->farrowContext = context;
+        func    = resamplerFarrowOutputC;
+        context = obj;
+        bufSize = RESAMPLER_BUFSIZE;
+        }
+    else if (obj->farrow->bufPtr)
+        {
+        (*func)(obj->farrow->bufC, obj->farrow->bufPtr, context);
+        obj->farrow->bufPtr = 0;
+        }
     
-    if (obj->updown)
+    while (dataLen--)
         {
-        //interpolate
-        while (dataLen--)
+        delayLine[delayIndex] = delayLine[delayIndex + DESIGN_MAX_TAPS] = *data++;
+        while (phase < phases)
             {
-            delayLine[delayIndex] = *data++;
-            acc -= 1.0;
-            while (acc < 0.0)
+            float complex sum = dot(delayLine + delayIndex, coeffs + phase * size, size);
+            if (!bufPtr)
+                obj->outStamp = obj->stamp;
+            buf[bufPtr++] = sum;
+            if (bufPtr >= bufSize)
                 {
-                acc += ratio;
-                float complex sum = 0.0;
-                int idx = delayIndex;
-                float *coeff = coeffs; 
-                int c = size;
-                while (c--)
-                    {
-                    sum += delayLine[idx++] * (*coeff++);
-                    idx %= size;
-                    }
-                buf[bufPtr++] = sum;
-                if (bufPtr >= RESAMPLER_BUFSIZE)
-                    {
-                    (*func)(buf, RESAMPLER_BUFSIZE, context);
-                    bufPtr = 0;
-                    }
+                (*func)(buf, bufPtr, context);
+                bufPtr = 0;
                 }
-            delayIndex = (delayIndex + size1) % size;
+            slip += trim;
+            int extra = (int)slip;
+            slip -= extra;
+            phase += step + extra;
             }
+        phase -= phases;
+        delayIndex = (delayIndex) ? delayIndex - 1 : DESIGN_MAX_TAPS - 1;
+        }
+    if (farrow && bufPtr)
+        {
+        (*func)(buf, bufPtr, context);
+        bufPtr = 0;
+        }
+    obj->delayIndex = delayIndex;
+    obj->phase = phase;
+    obj->slip = slip;
+    obj->bufPtr = bufPtr;
+}
+
+
+
+
+
+//########################################################################
+//#  F A R R O W
+//########################################################################
+
+
+Farrow *farrowCreate(float inRate, float outRate)
+{
+    if (inRate <= 0.0 || outRate <= 0.0)
+        {
+        error("Cannot resample from %f to %f", inRate, outRate);
+        return NULL;
+        }
+    Farrow *obj = (Farrow *)malloc(sizeof(Farrow));
+    if (!obj)
+        return NULL;
+    obj->blockTime = 0.0;
+    farrowSetRates(obj, inRate, outRate, 0);
+    farrowReset(obj);
+    obj->bufPtr = 0;
+    obj->stamp = 0;
+    obj->outStamp = 0;
+    return obj;
+}
+
+
+void farrowDelete(Farrow *obj)
+{
+    free(obj);
+}
+
+
+void farrowSetRates(Farrow *obj, double inRate, double outRate, int glide)
+{
+    obj->outRate = (float)outRate;
+    obj->target  = inRate / outRate;
+    if (glide > 0)
+        {
+        obj->delta = (obj->target - obj->step) / glide;
+        obj->glide = glide;
         }
     else
         {
-        //decimate
-        while (dataLen--)
+        obj->step  = obj->target;
+        obj->glide = 0;
+        }
+}
+
+
+void farrowSetBlockTime(Farrow *obj, float seconds)
+{
+    __atomic_store(&(obj->blockTime), &seconds, __ATOMIC_RELAXED);
+}
+
+
+void farrowReset(Farrow *obj)
+{
+    for (int i = 0 ; i < FARROW_HISTORY ; i++)
+        {
+        obj->work[i]   = 0.0;
+        obj->workIm[i] = 0.0;
+        }
+    //the cubic for the first output needs one sample before it
+    obj->pos = 1.0;
+}
+
+
+/**
+ * Place the outputs that fall within the first 'total' samples of
+ * work, up to 'max' of them, gliding the step as it goes
+ * @return how many were placed
+ */
+static int farrowPlace(Farrow *obj, int total, int max)
+{
+    double pos  = obj->pos;
+    double step = obj->step;
+    int count = 0;
+    //each needs the sample two past the one it follows
+    while (count < max && (int)pos + 2 < total)
+        {
+        int i = (int)pos;
+        obj->index[count] = i;
+        obj->mu[count]    = (float)(pos - i);
+        count++;
+        if (obj->glide > 0)
+            step = (--obj->glide) ? step + obj->delta : obj->target;
+        pos += step;
+        }
+    obj->pos  = pos;
+    obj->step = step;
+    return count;
+}
+
+
+/**
+ * The outputs that fit in the block being gathered, up to a batch
+ */
+static int farrowRoom(Farrow *obj, int bufSize)
+{
+    int room = bufSize - obj->bufPtr;
+    return (room < FARROW_BATCH) ? room : FARROW_BATCH;
+}
+
+
+void farrowUpdate(Farrow *obj, float *data, int dataLen, FloatOutputFunc *func, void *context)
+{
+    float blockTime;
+    __atomic_load(&(obj->blockTime), &blockTime, __ATOMIC_RELAXED);
+    int   bufSize = blockSize(obj->outRate, blockTime, FARROW_BUFSIZE);
+    float *work   = obj->work;
+    float *buf    = obj->buf;
+    //a block that got shorter since the last update
+    if (obj->bufPtr >= bufSize)
+        {
+        (*func)(buf, obj->bufPtr, context);
+        obj->bufPtr = 0;
+        }
+
+    while (dataLen > 0)
+        {
+        int n = (dataLen < FARROW_CHUNK) ? dataLen : FARROW_CHUNK;
+        memcpy(work + FARROW_HISTORY, data, n * sizeof(float));
+        int count;
+        while ((count = farrowPlace(obj, FARROW_HISTORY + n, farrowRoom(obj, bufSize))) > 0)
             {
-            delayLine[delayIndex] = *data++;
-            acc += ratio;
-            if (acc > 0.0)
+            if (!obj->bufPtr)
+                obj->outStamp = obj->stamp;
+            kernels.farrow(buf + obj->bufPtr, work, obj->index, obj->mu, count);
+            obj->bufPtr += count;
+            if (obj->bufPtr >= bufSize)
                 {
-                acc -= 1.0;
-                float complex sum = 0.0;
-                int idx = delayIndex;
-                float *coeff = coeffs; 
-                int c = size;
-                while (c--)
-                    {
-                    sum += delayLine[idx++] * (*coeff++);
-                    idx %= size;
-                    }
-                buf[bufPtr++] = sum;
-                if (bufPtr >= RESAMPLER_BUFSIZE)
-                    {
-                    (*func)(buf, RESAMPLER_BUFSIZE, context);
-                    bufPtr = 0;
-                    }
+                (*func)(buf, obj->bufPtr, context);
+                obj->bufPtr = 0;
                 }
-            delayIndex = (delayIndex + size1) % size;
             }
+        //the last of the chunk is the history for the next
+        memmove(work, work + n, FARROW_HISTORY * sizeof(float));
+        obj->pos -= n;
+        data     += n;
+        dataLen  -= n;
+        }
+}
+
+
+void farrowUpdateC(Farrow *obj, float complex *data, int dataLen, ComplexOutputFunc *func, void *context)
+{
+    float blockTime;
+    __atomic_load(&(obj->blockTime), &blockTime, __ATOMIC_RELAXED);
+    int   bufSize = blockSize(obj->outRate, blockTime, FARROW_BUFSIZE);
+    float *work   = obj->work;
+    float *workIm = obj->workIm;
+    float complex *buf = obj->bufC;
+    if (obj->bufPtr >= bufSize)
+        {
+        (*func)(buf, obj->bufPtr, context);
+        obj->bufPtr = 0;
+        }
+
+    while (dataLen > 0)
+        {
+        int n = (dataLen < FARROW_CHUNK) ? dataLen : FARROW_CHUNK;
+        //the kernels are real, so the parts go through them separately
+        for (int i = 0 ; i < n ; i++)
+            {
+            work[FARROW_HISTORY + i]   = crealf(data[i]);
+            workIm[FARROW_HISTORY + i] = cimagf(data[i]);
+            }
+        int count;
+        while ((count = farrowPlace(obj, FARROW_HISTORY + n, farrowRoom(obj, bufSize))) > 0)
+            {
+            if (!obj->bufPtr)
+                obj->outStamp = obj->stamp;
+            kernels.farrow(obj->re, work,   obj->index, obj->mu, count);
+            kernels.farrow(obj->im, workIm, obj->index, obj->mu, count);
+            float complex *out = buf + obj->bufPtr;
+            for (int i = 0 ; i < count ; i++)
+                out[i] = obj->re[i] + obj->im[i] * I;
+            obj->bufPtr += count;
+            if (obj->bufPtr >= bufSize)
+                {
+                (*func)(buf, obj->bufPtr, context);
+                obj->bufPtr = 0;
+                }
+            }
+        memmove(work,   work   + n, FARROW_HISTORY * sizeof(float));
+        memmove(workIm, workIm + n, FARROW_HISTORY * sizeof(float));
+        obj->pos -= n;
+        data     += n;
+        dataLen  -= n;
         }
-    obj->delayIndex = delayIndex;
-    obj->acc = acc;
-    obj->bufPtr = bufPtr;
 }
 
 
@@ -29,6 +29,17 @@
 
 
 #include "sdrlib.h"
+#include "kernelgen.h"
+
+
+/**
+ * The quality every rate changing filter is designed for.  The delay
+ * lines hold DESIGN_MAX_TAPS samples, twice over so that the window
+ * never wraps, and a new design of any length just uses more or less
+ * of them.
+ */
+#define SAMPLERATE_RIPPLE 0.5  //passband ripple, dB
+#define SAMPLERATE_ATTEN  60.0 //alias rejection, dB
 
 
 
@@ -48,12 +59,15 @@
  */
 struct Decimator
 {
-    int size;
-    float *coeffs;
-    float complex *delayLine;
+    Taps *taps;     //in use by the dsp thread
+    Taps *pending;  //posted by decimatorSetRates()
+    float complex *delayLine; //2 * DESIGN_MAX_TAPS
     int delayIndex;
     float ratio;
     float acc;
+    DecimateFuncC *decimate; //unrolled kernel, when the ratio is 1/integer
+    int factor;
+    int phase;
     float complex buf[DECIMATOR_BUFSIZE];
     int bufPtr;
 };
@@ -61,7 +75,7 @@ struct Decimator
 /**
  *
  */
-Decimator *decimatorCreate(int size, float highRate, float lowRate);
+Decimator *decimatorCreate(float highRate, float lowRate);
 
 /**
  *
@@ -85,26 +99,23 @@ void decimatorUpdate(Decimator *dec, float complex *data, int dataLen, ComplexOu
 
 
 /**
- *
+ * The most output a ddc holds before passing it on.  A shorter block
+ * may be asked for with ddcSetBlockTime().
  */
 #define DDC_BUFSIZE (16384)
 
+/**
+ * Input is mixed down this many samples at a time, before filtering
+ */
+#define DDC_TILE (256)
 
-typedef struct DelayVal DelayVal;
-
-
-struct DelayVal
-{
-    DelayVal *prev;    
-    DelayVal *next;    
-    float f;
-    float complex c;    
-};
-
-
-DelayVal *delayCreate(int size);
-
-void delayDelete(DelayVal *obj);
+/**
+ * How far above the Nyquist rate of the passband the ddc output runs.
+ * The extra room is the filter's transition band, which is what lets
+ * it be short.  Anything that falls there is outside of the passband,
+ * so what aliases back into it stays in the transition band too.
+ */
+#define DDC_GUARD (1.25)
 
 
 /**
@@ -112,27 +123,31 @@ void delayDelete(DelayVal *obj);
  */
 struct Ddc
 {
-    int   size;
-    float *coeffs;
-    DelayVal *delayLine;
-    DelayVal *head;
+    Taps  *taps;    //in use by the dsp thread
+    Taps  *pending; //posted by ddcSetFreqs()
+    float complex *delayLine; //2 * DESIGN_MAX_TAPS
+    int   delayIndex;
     float ratio;
     float inRate;
     float outRate;
-    float vfo;  //cached
+    float vfo;  //cached.  Read by the dsp thread to retune the nco
     float pbLo; //cached
     float pbHi; //cached
+    float ncoVfo; //the vfo that vfoFreq was computed for
     float complex vfoPhase;
     float complex vfoFreq;
     float acc;
-    float complex buf[DECIMATOR_BUFSIZE];
+    float complex buf[DDC_BUFSIZE];
     int   bufPtr;
+    float blockTime;    //seconds of output per block, or 0 for a full buffer
+    long long stamp;    //acquisition time of the data passed to update
+    long long outStamp; //acquisition time of the oldest sample in buf
 };
 
 /**
  *
  */
-Ddc *ddcCreate(int size, float vfoFreq, float pbLoOff, float pbHiOff, float sampleRate);
+Ddc *ddcCreate(float vfoFreq, float pbLoOff, float pbHiOff, float sampleRate);
 
 /**
  *
@@ -140,32 +155,162 @@ Ddc *ddcCreate(int size, float vfoFreq, float pbLoOff, float pbHiOff, float samp
 void ddcDelete(Ddc *obj);
 
 /**
- *
+ * Get the output rate.  This follows the passband, at DDC_GUARD
+ * times its Nyquist rate.
  */
 float ddcGetOutRate(Ddc *obj);
 
 /**
- *
+ * Retune.  This may be called from any thread.  New filter
+ * coefficients are designed here, if the passband changed, and the
+ * dsp thread picks them up at the start of its next block.  Moving
+ * only the vfo just retunes the nco.
  */
 void ddcSetFreqs(Ddc *obj, float vfoFreq, float pbLoOff, float pbHiOff);
 
+/**
+ * Get the coefficients for a passband, without applying them.  This
+ * is the slow part of retuning, so it is kept apart from ddcSetTaps().
+ * The output rate that goes with the passband is taps->outRate.
+ * The caller owns the returned reference.
+ */
+Taps *ddcDesign(Ddc *obj, float pbLoOff, float pbHiOff);
+
+/**
+ * Apply a vfo and a passband made by ddcDesign().  Takes over the
+ * caller's reference to taps.
+ */
+void ddcSetTaps(Ddc *obj, float vfoFreq, Taps *taps);
+
+/**
+ * Move only the vfo.  This just retunes the nco.
+ */
+void ddcSetVfo(Ddc *obj, float vfoFreq);
+
+/**
+ * Clear the filter history, such as after a gap in the input
+ */
+void ddcReset(Ddc *obj);
+
+/**
+ * Set how much output to gather before passing it on.  Each block is
+ * that much delay, so shorter blocks are heard sooner, at the cost of
+ * more calls down the pipeline.  This may be called from any thread,
+ * and takes effect at the next block.
+ * @param seconds the length of a block, or 0 for DDC_BUFSIZE samples
+ */
+void ddcSetBlockTime(Ddc *obj, float seconds);
+
 /**
  *
  */
 void ddcUpdate(Ddc *obj, float complex *data, int dataLen, ComplexOutputFunc *func, void *context);
 
 
+//########################################################################
+//#  D D C    B A N K
+//#  Several ddcs on the same input, sharing one pass over it
+//########################################################################
+
+
+/**
+ * The most channels that one bank runs
+ */
+#define DDC_BANK_MAX (32)
+
+
+/**
+ * The channels may be tuned anywhere, with any passband.  The bank
+ * does not own the ddcs.
+ */
+struct DdcBank
+{
+    int               count;
+    Ddc               *ddcs[DDC_BANK_MAX];
+    ComplexOutputFunc *funcs[DDC_BANK_MAX];
+    void              *contexts[DDC_BANK_MAX];
+    long long         stamp; //acquisition time of the data passed to update
+    float complex     mix[DDC_TILE * DDC_BANK_MAX]; //one tile, channel-interleaved
+};
+
+/**
+ *
+ */
+DdcBank *ddcBankCreate();
+
+/**
+ * Free the bank, but not its ddcs
+ */
+void ddcBankDelete(DdcBank *bank);
+
+/**
+ * Add a channel.  Only call this from the thread that runs the bank.
+ * @param func receives the channel's output
+ * @return TRUE if successful, else FALSE
+ */
+int ddcBankAdd(DdcBank *bank, Ddc *ddc, ComplexOutputFunc *func, void *context);
+
+/**
+ * Remove a channel.  Only call this from the thread that runs the bank.
+ * @return TRUE if it was found, else FALSE
+ */
+int ddcBankRemove(DdcBank *bank, Ddc *ddc);
+
+/**
+ * Clear the history of every channel
+ */
+void ddcBankReset(DdcBank *bank);
+
+/**
+ * Run every channel over a block of input
+ */
+void ddcBankUpdate(DdcBank *bank, float complex *data, int dataLen);
+
+
 //########################################################################
 //#  R E S A M P L E R
 //#  A more general version of the decimator.  Goes both directions
+//#
+//#  This is an L/M polyphase resampler.  The ratio of the rates is
+//#  reduced to up/down, L/M, and the lowpass is designed at L times
+//#  the input rate and split into L branches.  Each output steps M
+//#  branches along, and runs only the branch it lands on, over the
+//#  input samples, never over the zeros an interpolator stuffs in.
+//#  A ratio that needs more than RESAMPLER_MAX_PHASES branches gets
+//#  the nearest that fits, and the difference, with any drift, is
+//#  made up by stepping one branch more or less now and then.
+//#
+//#  With RESAMPLE_FARROW, L is kept to RESAMPLER_FARROW_PHASES, and a
+//#  Farrow interpolator after the branches takes up the rest of the
+//#  ratio, and any drift, smoothly rather than a branch at a time.
 //########################################################################
 
 
 /**
- *
+ * The most output a resampler holds before passing it on
  */
 #define RESAMPLER_BUFSIZE (16384)
 
+/**
+ * The passband and transition band of the resampler and decimator
+ * filters, as fractions of the lower of the two rates
+ */
+#define RESAMPLER_PASS  (0.40)
+#define RESAMPLER_WIDTH (0.08)
+
+/**
+ * The most polyphase branches, L, a resampler will use.  44.1kHz
+ * to 48kHz needs 160.
+ */
+#define RESAMPLER_MAX_PHASES 256
+
+/**
+ * The most branches with RESAMPLE_FARROW.  The branches only need to
+ * keep the images out of the way of the interpolator, which is close
+ * enough at 2 or more samples per cycle of the passband.
+ */
+#define RESAMPLER_FARROW_PHASES 16
+
 
 
 /**
@@ -173,25 +318,35 @@ void ddcUpdate(Ddc *obj, float complex *data, int dataLen, ComplexOutputFunc *fu
  */
 struct Resampler
 {
-    int size;
-    float *coeffs;
-    float *delayLine;
-    float complex *delayLineC;
+    Taps *taps;     //in use by the dsp thread.  Carries its own rates, and L and M
+    Taps *pending;  //posted by resamplerSetInRate() and resamplerSetOutRate()
+    float *delayLine;          //2 * DESIGN_MAX_TAPS
+    float complex *delayLineC; //the same
     float inRate;
     float outRate;
     int delayIndex;
-    float ratio;
-    int updown;
-    float acc;
+    int phase;      //the branch of the next output, counted from the newest input
+    float trim;     //branches to add to each step, for drift and any ratio not exactly L/M
+    float slip;     //trim not yet taken
+    float drift;    //ppm, added to the output rate
+    int mode;       //ResampleMode, as asked for by resamplerSetMode()
+    int running;    //ResampleMode, as the dsp thread last applied it
+    Farrow *farrow; //the last stage, with RESAMPLE_FARROW
+    FloatOutputFunc *farrowFunc;    //where the farrow passes its output
+    ComplexOutputFunc *farrowFuncC;
+    void *farrowContext;
+    float blockTime;  //seconds of output per block, or 0 for a full buffer
     float buf[RESAMPLER_BUFSIZE];
     float complex bufC[RESAMPLER_BUFSIZE];
     int bufPtr;
+    long long stamp;    //acquisition time of the data passed to update
+    long long outStamp; //acquisition time of the oldest sample in buf
 };
 
 /**
  *
  */
-Resampler *resamplerCreate(int size, float highRate, float lowRate);
+Resampler *resamplerCreate(float inRate, float outRate);
 
 /**
  *
@@ -199,7 +354,8 @@ Resampler *resamplerCreate(int size, float highRate, float lowRate);
 void resamplerDelete(Resampler *obj);
 
 /**
- *
+ * Change the input rate.  Like ddcSetFreqs(), this may be called
+ * from any thread, and takes effect at the next block.
  */
 void resamplerSetInRate(Resampler *obj, float inRate);
 
@@ -208,6 +364,54 @@ void resamplerSetInRate(Resampler *obj, float inRate);
  */
 void resamplerSetOutRate(Resampler *obj, float outRate);
 
+/**
+ * Get the coefficients for a pair of rates, without applying them.
+ * The caller owns the returned reference.
+ */
+Taps *resamplerDesign(Resampler *obj, float inRate, float outRate);
+
+/**
+ * Apply coefficients made by resamplerDesign(), along with their rates.
+ * Takes over the caller's reference to taps.
+ */
+void resamplerSetTaps(Resampler *obj, Taps *taps);
+
+/**
+ * Trim the output rate, to follow a clock that is not quite what it
+ * says.  This belongs to the dsp thread, and is meant to be called
+ * from the output callback; it takes effect at the next block.
+ * @param ppm parts per million, positive for more output samples
+ */
+void resamplerSetDrift(Resampler *obj, float ppm);
+
+/**
+ * Set how much output to gather before passing it on, as with
+ * ddcSetBlockTime()
+ * @param seconds the length of a block, or 0 for RESAMPLER_BUFSIZE samples
+ */
+void resamplerSetBlockTime(Resampler *obj, float seconds);
+
+/**
+ * Choose plain polyphase, or polyphase with a Farrow stage after it.
+ * This may be called from any thread.  The dsp thread switches when it
+ * next picks up taps, so the thread that posts the rates should follow
+ * it with resamplerDesign() and resamplerSetTaps(), to get the number
+ * of branches the mode wants.
+ * @param mode RESAMPLE_POLYPHASE or RESAMPLE_FARROW
+ */
+void resamplerSetMode(Resampler *obj, int mode);
+
+/**
+ * Clear the filter history, such as after a gap in the input
+ */
+void resamplerReset(Resampler *obj);
+
+/**
+ * The acquisition time of the oldest sample in the block being passed
+ * on.  Call this from the output callback.
+ */
+long long resamplerGetOutStamp(Resampler *obj);
+
 /**
  *
  */
@@ -220,6 +424,110 @@ void resamplerUpdateC(Resampler *obj, float complex *data, int dataLen, ComplexO
 
 
 
+//########################################################################
+//#  F A R R O W
+//#  Fractional resampling by cubic interpolation, at any ratio
+//#
+//#  Each output is a cubic through the four inputs around it, in
+//#  Farrow form, so the only coefficients are the four fixed ones of
+//#  the polynomial, and the fraction of the way between two inputs.
+//#  The ratio need not reduce to anything, and may change with every
+//#  output.  The positions are worked out a batch at a time, and the
+//#  kernels evaluate a batch with one output per vector lane.
+//#
+//#  A cubic only keeps the images out of the passband when the input
+//#  is well oversampled, so this is meant to follow a filter, as the
+//#  last stage of a Resampler.
+//########################################################################
+
+
+/**
+ * The most output a farrow holds before passing it on
+ */
+#define FARROW_BUFSIZE (16384)
+
+/**
+ * Inputs taken at a time, and the earlier ones kept ahead of them for
+ * the interpolation
+ */
+#define FARROW_CHUNK   (1024)
+#define FARROW_HISTORY (3)
+
+/**
+ * Outputs positioned at a time, for the kernel
+ */
+#define FARROW_BATCH   (256)
+
+/**
+ * Outputs over which a resampler glides to a new drift
+ */
+#define FARROW_GLIDE   (4096)
+
+
+
+struct Farrow
+{
+    double step;    //inputs for each output
+    double target;  //the step being glided to
+    double delta;   //added to the step with each output while gliding
+    int glide;      //outputs left in the glide
+    double pos;     //of the next output, in work
+    float work[FARROW_HISTORY + FARROW_CHUNK];   //history, then the chunk
+    float workIm[FARROW_HISTORY + FARROW_CHUNK]; //the same, for the imaginary parts
+    int index[FARROW_BATCH];
+    float mu[FARROW_BATCH];
+    float re[FARROW_BATCH];
+    float im[FARROW_BATCH];
+    float outRate;
+    float blockTime;  //seconds of output per block, or 0 for a full buffer
+    float buf[FARROW_BUFSIZE];
+    float complex bufC[FARROW_BUFSIZE];
+    int bufPtr;
+    long long stamp;    //acquisition time of the data passed to update
+    long long outStamp; //acquisition time of the oldest sample in buf
+};
+
+/**
+ *
+ */
+Farrow *farrowCreate(float inRate, float outRate);
+
+/**
+ *
+ */
+void farrowDelete(Farrow *obj);
+
+/**
+ * Change the ratio.  This belongs to the dsp thread.
+ * @param glide the number of outputs over which to change it
+ *  evenly, or 0 for at once
+ */
+void farrowSetRates(Farrow *obj, double inRate, double outRate, int glide);
+
+/**
+ * Set how much output to gather before passing it on, as with
+ * ddcSetBlockTime()
+ * @param seconds the length of a block, or 0 for FARROW_BUFSIZE samples
+ */
+void farrowSetBlockTime(Farrow *obj, float seconds);
+
+/**
+ * Clear the history, such as after a gap in the input
+ */
+void farrowReset(Farrow *obj);
+
+/**
+ *
+ */
+void farrowUpdate(Farrow *obj, float *data, int dataLen, FloatOutputFunc *func, void *context);
+
+/**
+ *
+ */
+void farrowUpdateC(Farrow *obj, float complex *data, int dataLen, ComplexOutputFunc *func, void *context);
+
+
+
 
 #endif /* _SAMPLERATE_H_ */
 
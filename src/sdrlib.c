@@ -31,18 +31,15 @@
 
 #include "audio.h"
 #include "codec.h"
-#include "demod.h"
 #include "device.h"
-#include "fft.h"
-#include "filter.h"
-#include "samplerate.h"
-#include "vfo.h"
+#include "kernel.h"
+#include "latency.h"
+#include "receiver.h"
+#include "thread.h"
 
 #include "private.h"
 
 
-static void *sdrReaderThread(void *ctx);
-
 /**
  * Our main context
  */
@@ -50,57 +47,93 @@ struct SdrLib
 {
     int            deviceCount;
     Device         *devices[SDR_MAX_DEVICES];
-    Device         *device;
-    pthread_t      thread;
-    int            running; //state of the reader thread
-    Fft            *fft;
-    void           *context; //context for any client code calling me
-    UintOutputFunc *psFunc; //for outputting the power spectrum
-    ByteOutputFunc *codecFunc;
-    Ddc            *ddc;
-    Mode           mode;
-    Demodulator    *demod;
-    Demodulator    *demodNull;
-    Demodulator    *demodAm;
-    Demodulator    *demodFm;
-    Demodulator    *demodLsb;
-    Demodulator    *demodUsb;
-    Resampler      *resampler;
-    int            audioEnabled;
+    int            receiverCount;
+    Receiver       *receivers[SDR_MAX_DEVICES];
+    int            selected; //the receiver that the single-device calls act on
+    int            channel;  //the channel of that receiver that tuning and mode act on
     Audio          *audio;
-    Codec          *codec;
+    int            audioEnabled; //the selected receiver owns the speaker
+    BlockMode      blockMode;
+    ResampleMode   resampleMode;
 };
 
 
+/**
+ * The receiver that the single-device calls act on
+ */
+static Receiver *selected(SdrLib *sdr)
+{
+    return sdr->receivers[sdr->selected];
+}
+
+
+/**
+ * The channel that the tuning and mode calls act on
+ */
+static Channel *selectedChannel(SdrLib *sdr)
+{
+    return selected(sdr)->channels[sdr->channel];
+}
+
+
+/**
+ * Look up a receiver by device index
+ */
+static Receiver *receiverAt(SdrLib *sdr, int index)
+{
+    if (index < 0 || index >= sdr->receiverCount)
+        {
+        error("No such device: %d", index);
+        return NULL;
+        }
+    return sdr->receivers[index];
+}
+
+
 /**
  */  
 SdrLib *sdrCreate(void *context, UintOutputFunc *psFunc, ByteOutputFunc *codecFunc)
 {
     SdrLib * sdr = (SdrLib *) malloc(sizeof(SdrLib));
+    if (!sdr)
+        return NULL;
     memset(sdr, 0, sizeof(SdrLib));
+    kernelLoadProfile(NULL);
     sdr->deviceCount = deviceScan(DEVICE_SDR, sdr->devices, SDR_MAX_DEVICES);
     if (!sdr->deviceCount)
         {
         error("No devices found");
         //but dont fail. wait until start()
         }
-    sdr->context   = context;
-    sdr->psFunc    = psFunc;
-    sdr->codecFunc = codecFunc;
-    sdr->fft       = fftCreate(16384);
-    sdr->ddc       = ddcCreate(21, 0.0, -5000.0, 5000.0, 2048000.0);
-    sdr->demodNull = demodNullCreate();
-    sdr->demodFm   = demodFmCreate();
-    sdr->demodAm   = demodAmCreate();
-    sdr->demodLsb  = demodLsbCreate();
-    sdr->demodUsb  = demodUsbCreate();
-    sdr->demod     = sdr->demodFm;
-    sdr->mode      = MODE_FM;
-    sdr->audio     = audioCreate();
-    sdr->codec     = codecCreate();
-    sdr->resampler = resamplerCreate(21, sdr->audio->sampleRate, sdr->audio->sampleRate);
+    sdr->audio = audioCreate();
+    if (!sdr->audio)
+        {
+        error("Could not open the audio output");
+        sdrDelete(sdr);
+        return NULL;
+        }
+    //keep one receiver even with no devices, so that the settings have a home
+    int count = (sdr->deviceCount) ? sdr->deviceCount : 1;
+    for (int i = 0 ; i < count ; i++)
+        {
+        Device *d = (i < sdr->deviceCount) ? sdr->devices[i] : NULL;
+        Receiver *rcv = receiverCreate(d, sdr->audio);
+        if (!rcv)
+            {
+            error("Could not create receiver %d", i);
+            //sdrDelete() frees the ones made so far
+            sdrDelete(sdr);
+            return NULL;
+            }
+        sdr->receivers[i] = rcv;
+        sdr->receiverCount = i + 1;
+        }
+    sdr->selected = 0;
+    //the first device reports to the caller.  Others are routed with sdrSetDeviceOutput()
+    receiverSetOutput(sdr->receivers[0], context, psFunc, codecFunc);
     
     sdrSetAfGain(sdr, 0.0);
+    sdrResetLatency(sdr);
     
     return sdr;
 }
@@ -111,22 +144,14 @@ SdrLib *sdrCreate(void *context, UintOutputFunc *psFunc, ByteOutputFunc *codecFu
  */   
 int sdrDelete(SdrLib *sdr)
 {
+    for (int i = 0 ; i < sdr->receiverCount ; i++)
+        receiverDelete(sdr->receivers[i]);
     for (int i = 0 ; i < sdr->deviceCount ; i++)
         {
         Device *d = sdr->devices[i];
         d->delete(d->ctx);
         }
     audioDelete(sdr->audio);
-    codecDelete(sdr->codec);
-    fftDelete(sdr->fft);
-    //vfoDelete(sdr->vfo);
-    //firDelete(sdr->bpf);
-    ddcDelete(sdr->ddc);
-    demodDelete(sdr->demodFm);
-    demodDelete(sdr->demodAm);
-    demodDelete(sdr->demodLsb);
-    demodDelete(sdr->demodUsb);
-    resamplerDelete(sdr->resampler);
     free(sdr);
     return TRUE;
 }
@@ -138,64 +163,212 @@ int sdrDelete(SdrLib *sdr)
  */   
 int sdrStart(SdrLib *sdr)
 {
-    pthread_t thread;
-    if (sdr->running || sdr->device)
-        {
-        error("Device already started");
-        return FALSE;
-        }
     if (!sdr->deviceCount)
         {
         error("No devices found");
         return FALSE;
         }
-    Device *d = sdr->devices[0];
-    if (!d->open(d->ctx))
+    int started = 0;
+    for (int i = 0 ; i < sdr->receiverCount ; i++)
         {
-        error("Could not start device");
-        return FALSE;
+        if (sdr->receivers[i]->running)
+            continue;
+        if (receiverStart(sdr->receivers[i]))
+            started++;
         }
-    sdr->device = d;
-    d->setGain(d->ctx, 1.0);
-    d->setCenterFrequency(d->ctx, 88700000.0);
-    trace("starting");
-    int rc = pthread_create(&thread, NULL, sdrReaderThread, (void *)sdr);
-    if (rc)
+    return (started > 0);
+}
+
+
+/**
+ */   
+int sdrStop(SdrLib *sdr)
+{
+    for (int i = 0 ; i < sdr->receiverCount ; i++)
+        receiverStop(sdr->receivers[i]);
+    return TRUE;
+}
+
+
+/**
+ */   
+int sdrStartDevice(SdrLib *sdr, int index)
+{
+    Receiver *rcv = receiverAt(sdr, index);
+    return (rcv) ? receiverStart(rcv) : FALSE;
+}
+
+
+/**
+ */   
+int sdrStopDevice(SdrLib *sdr, int index)
+{
+    Receiver *rcv = receiverAt(sdr, index);
+    return (rcv) ? receiverStop(rcv) : FALSE;
+}
+
+
+/**
+ */   
+int sdrGetDeviceCount(SdrLib *sdr)
+{
+    return sdr->deviceCount;
+}
+
+
+/**
+ */   
+const char *sdrGetDeviceName(SdrLib *sdr, int index)
+{
+    if (index < 0 || index >= sdr->deviceCount)
+        return NULL;
+    return sdr->devices[index]->name;
+}
+
+
+/**
+ */   
+const char *sdrGetDeviceSerial(SdrLib *sdr, int index)
+{
+    if (index < 0 || index >= sdr->deviceCount)
+        return NULL;
+    return sdr->devices[index]->serial;
+}
+
+
+/**
+ */   
+int sdrFindDevice(SdrLib *sdr, const char *serial)
+{
+    for (int i = 0 ; i < sdr->deviceCount ; i++)
         {
-        error("ERROR; return code from pthread_create() is %d", rc);
-        return FALSE;
+        if (strcmp(sdr->devices[i]->serial, serial) == 0)
+            return i;
         }
-    trace("started");
-    sdr->thread = thread;
-    sdr->running = 1;
+    return -1;
+}
+
+
+/**
+ */   
+int sdrSelectDevice(SdrLib *sdr, int index)
+{
+    if (!receiverAt(sdr, index))
+        return FALSE;
+    sdr->selected = index;
+    //the speaker follows the selection
+    if (sdr->audioEnabled)
+        audioSetOwner(sdr->audio, selected(sdr));
+    sdr->channel  = 0;
     return TRUE;
 }
 
 
 /**
  */   
-int sdrStop(SdrLib *sdr)
+int sdrGetSelectedDevice(SdrLib *sdr)
+{
+    return sdr->selected;
+}
+
+
+/**
+ */   
+int sdrSetDeviceCpu(SdrLib *sdr, int index, int cpu)
+{
+    Receiver *rcv = receiverAt(sdr, index);
+    if (!rcv)
+        return FALSE;
+    receiverSetCpu(rcv, cpu);
+    return TRUE;
+}
+
+
+/**
+ */   
+int sdrSetThreadPolicy(ThreadRole role, int cpu, int priority)
+{
+    return threadSetPolicy(role, cpu, priority);
+}
+
+
+/**
+ */   
+int sdrCalibrateKernels(SdrLib *sdr)
 {
-    if (!sdr->running)
-        return TRUE;
-    void *status;
-    pthread_join(sdr->thread, &status);
-    Device *d = sdr->device;
-    if (d)
+    //the dsp threads call through the bindings without a lock, and
+    //their load would skew the timings anyway
+    for (int i = 0 ; i < sdr->receiverCount ; i++)
         {
-        d->close(d->ctx);
-        sdr->device = NULL;
+        if (sdr->receivers[i]->running)
+            {
+            error("Stop device %d before calibrating the kernels", i);
+            return FALSE;
+            }
         }
-    sdr->running = 0;
+    return kernelCalibrate(NULL);
+}
+
+
+/**
+ */   
+int sdrSetDeviceOutput(SdrLib *sdr, int index, void *context,
+                       UintOutputFunc *psFunc, ByteOutputFunc *codecFunc)
+{
+    Receiver *rcv = receiverAt(sdr, index);
+    if (!rcv)
+        return FALSE;
+    receiverSetOutput(rcv, context, psFunc, codecFunc);
+    return TRUE;
+}
+
+
+/**
+ */   
+int sdrAddChannel(SdrLib *sdr, void *context, ByteOutputFunc *codecFunc)
+{
+    return receiverAddChannel(selected(sdr), context, codecFunc);
+}
+
+
+/**
+ */   
+int sdrRemoveChannel(SdrLib *sdr, int index)
+{
+    if (!receiverRemoveChannel(selected(sdr), index))
+        return FALSE;
+    if (sdr->channel == index)
+        sdr->channel = 0;
     return TRUE;
 }
 
+
+/**
+ */   
+int sdrSelectChannel(SdrLib *sdr, int index)
+{
+    if (!receiverGetChannel(selected(sdr), index))
+        return FALSE;
+    sdr->channel = index;
+    return TRUE;
+}
+
+
+/**
+ */   
+int sdrGetSelectedChannel(SdrLib *sdr)
+{
+    return sdr->channel;
+}
+
+
 /**
  */   
 double sdrGetCenterFrequency(SdrLib *sdr)
 {
-    Device *d = sdr->device;
-    return (d) ? d->getCenterFrequency(d->ctx) : 0.0;
+    Receiver *rcv = selected(sdr);
+    Device *d = rcv->device;
+    return (d && rcv->running) ? d->getCenterFrequency(d->ctx) : 0.0;
 }
 
 
@@ -203,19 +376,15 @@ double sdrGetCenterFrequency(SdrLib *sdr)
  */   
 int sdrSetCenterFrequency(SdrLib *sdr, double freq)
 {
-    Device *d = sdr->device;
-    return (d) ? d->setCenterFrequency(d->ctx, freq) : 0;
+    Receiver *rcv = selected(sdr);
+    return (rcv->device && rcv->running) ? receiverSetCenterFrequency(rcv, freq) : 0;
 }
 
 /**
  */   
 void sdrSetDdcFreqs(SdrLib *sdr, float vfo, float pbLo, float pbHi)
 {
-    Ddc *ddc = sdr->ddc;
-    ddcSetFreqs(ddc, vfo, ddc->pbLo, ddc->pbHi);
-    float rate = ddcGetOutRate(ddc);
-    trace("if rate: %f", rate);
-    resamplerSetInRate(sdr->resampler, rate);
+    receiverSetDdcFreqs(selected(sdr), sdr->channel, vfo, pbLo, pbHi);
 }
 
 
@@ -223,8 +392,8 @@ void sdrSetDdcFreqs(SdrLib *sdr, float vfo, float pbLo, float pbHi)
  */   
 void sdrSetVfo(SdrLib *sdr, float vfo)
 {
-    Ddc *ddc = sdr->ddc;
-    sdrSetDdcFreqs(sdr, vfo, ddc->pbLo, ddc->pbHi);
+    Channel *ch = selectedChannel(sdr);
+    sdrSetDdcFreqs(sdr, vfo, ch->pbLo, ch->pbHi);
 }
 
 
@@ -232,15 +401,15 @@ void sdrSetVfo(SdrLib *sdr, float vfo)
  */   
 float sdrGetVfo(SdrLib *sdr)
 {
-    return sdr->ddc->vfo;
+    return selectedChannel(sdr)->vfo;
 }
 
 /**
  */   
 void sdrSetPbLo(SdrLib *sdr, float pbLo)
 {
-    Ddc *ddc = sdr->ddc;
-    sdrSetDdcFreqs(sdr, ddc->vfo, pbLo, ddc->pbHi);
+    Channel *ch = selectedChannel(sdr);
+    sdrSetDdcFreqs(sdr, ch->vfo, pbLo, ch->pbHi);
 }
 
 
@@ -248,15 +417,15 @@ void sdrSetPbLo(SdrLib *sdr, float pbLo)
  */   
 float sdrGetPbLo(SdrLib *sdr)
 {
-    return sdr->ddc->pbLo;
+    return selectedChannel(sdr)->pbLo;
 }
 
 /**
  */   
 void sdrSetPbHi(SdrLib *sdr, float pbHi)
 {
-    Ddc *ddc = sdr->ddc;
-    sdrSetDdcFreqs(sdr, ddc->vfo, ddc->pbLo, pbHi);
+    Channel *ch = selectedChannel(sdr);
+    sdrSetDdcFreqs(sdr, ch->vfo, ch->pbLo, pbHi);
 }
 
 
@@ -264,15 +433,16 @@ void sdrSetPbHi(SdrLib *sdr, float pbHi)
  */   
 float sdrGetPbHi(SdrLib *sdr)
 {
-    return sdr->ddc->pbHi;
+    return selectedChannel(sdr)->pbHi;
 }
 
 /**
  */   
 float sdrGetSampleRate(SdrLib *sdr)
 {
-    Device *d = sdr->device;
-    return (d) ? d->getSampleRate(d->ctx) : 0.0;
+    Receiver *rcv = selected(sdr);
+    Device *d = rcv->device;
+    return (d && rcv->running) ? d->getSampleRate(d->ctx) : 0.0;
 }
 
 
@@ -281,8 +451,8 @@ float sdrGetSampleRate(SdrLib *sdr)
  */   
 int sdrSetSampleRate(SdrLib *sdr, float rate)
 {
-    Device *d = sdr->device;
-    return (d) ? d->setSampleRate(d->ctx, rate) : 0;
+    Receiver *rcv = selected(sdr);
+    return (rcv->device && rcv->running) ? receiverSetSampleRate(rcv, rate) : 0;
 }
 
 
@@ -291,8 +461,9 @@ int sdrSetSampleRate(SdrLib *sdr, float rate)
  */   
 float sdrGetRfGain(SdrLib *sdr)
 {
-    Device *d = sdr->device;
-    return (d) ? d->getGain(d->ctx) : 0.0;
+    Receiver *rcv = selected(sdr);
+    Device *d = rcv->device;
+    return (d && rcv->running) ? d->getGain(d->ctx) : 0.0;
 }
 
 
@@ -301,8 +472,8 @@ float sdrGetRfGain(SdrLib *sdr)
  */   
 int sdrSetRfGain(SdrLib *sdr, float gain)
 {
-    Device *d = sdr->device;
-    return (d) ? d->setGain(d->ctx, gain) : 0;
+    Receiver *rcv = selected(sdr);
+    return (rcv->device && rcv->running) ? receiverSetRfGain(rcv, gain) : 0;
 }
 
 
@@ -320,8 +491,8 @@ float sdrGetAfGain(SdrLib *sdr)
  */   
 int sdrSetAfGain(SdrLib *sdr, float gain)
 {
-    Audio *a = sdr->audio;
-    return (a) ? audioSetGain(a, gain) : 0;
+    //the speaker belongs to the selected device's thread
+    return (sdr->audio) ? receiverSetAfGain(selected(sdr), gain) : 0;
 }
 
 
@@ -331,7 +502,7 @@ int sdrSetAfGain(SdrLib *sdr, float gain)
  */   
 int sdrGetMode(SdrLib *sdr)
 {
-    return sdr->mode;
+    return selectedChannel(sdr)->mode;
 }
 
 
@@ -342,29 +513,19 @@ int sdrGetMode(SdrLib *sdr)
  */   
 int sdrSetMode(SdrLib *sdr, Mode mode)
 {
-    int ret = TRUE;
-    switch (mode)
-        {
-        case MODE_NULL:
-            sdr->demod = sdr->demodNull;
-            break;
-        case MODE_AM:
-            sdr->demod = sdr->demodAm;
-            break;
-        case MODE_FM:
-            sdr->demod = sdr->demodFm;
-            break;
-        case MODE_LSB:
-            sdr->demod = sdr->demodLsb;
-            break;
-        case MODE_USB:
-            sdr->demod = sdr->demodUsb;
-            break;
-        default:
-            error("Unhandled mode: %d", mode);
-            ret = FALSE;
-        }
-    return ret;
+    return receiverSetMode(selected(sdr), sdr->channel, mode);
+}
+
+
+float sdrGetSquelch(SdrLib *sdr)
+{
+    return selectedChannel(sdr)->squelchLevel;
+}
+
+
+int sdrSetSquelch(SdrLib *sdr, float level)
+{
+    return receiverSetSquelch(selected(sdr), sdr->channel, level);
 }
 
 
@@ -375,81 +536,134 @@ int sdrSetMode(SdrLib *sdr, Mode mode)
  */   
 void sdrEnableAudio(SdrLib *sdr, int enabled)
 {
-    sdr->audioEnabled = enabled;   
+    //there is one speaker, so only the selected device may use it
+    sdr->audioEnabled = enabled;
+    audioSetOwner(sdr->audio, (enabled) ? selected(sdr) : NULL);
 }
 
 
+/**
+ * Set how much data the devices may buffer
+ */   
+void sdrSetBuffering(SdrLib *sdr, int transferCount, int transferSize, int queueDepth)
+{
+    for (int i = 0 ; i < sdr->receiverCount ; i++)
+        {
+        Receiver *rcv = sdr->receivers[i];
+        rcv->transferCount = transferCount;
+        rcv->transferSize  = transferSize;
+        rcv->queueDepth    = queueDepth;
+        }
+}
 
 
-/*############################################################################
-## R E A D E R    T H R E A D
-############################################################################*/
+/**
+ * Set the length of the blocks passed down the pipeline
+ */   
+void sdrSetBlockMode(SdrLib *sdr, BlockMode mode)
+{
+    float seconds = (mode == BLOCKS_SMALL) ? BLOCK_SMALL_TIME : 0.0;
+    sdr->blockMode = mode;
+    if (sdr->audio)
+        audioSetBlockTime(sdr->audio, seconds);
+    for (int i = 0 ; i < sdr->receiverCount ; i++)
+        receiverSetBlockTime(sdr->receivers[i], seconds);
+}
 
 
+BlockMode sdrGetBlockMode(SdrLib *sdr)
+{
+    return sdr->blockMode;
+}
 
-#define READSIZE (8 * 16384)
 
-static void fftOutput(unsigned int *vals, int size, void *ctx)
+/**
+ * Set how the channels resample their audio
+ */   
+void sdrSetResampleMode(SdrLib *sdr, ResampleMode mode)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    UintOutputFunc *psFunc = sdr->psFunc;
-    if (psFunc)
-        (*psFunc)(vals, size, sdr->context);
+    sdr->resampleMode = mode;
+    for (int i = 0 ; i < sdr->receiverCount ; i++)
+        receiverSetResampleMode(sdr->receivers[i], mode);
 }
 
 
-static void resamplerOutput(float *buf, int size, void *ctx)
+ResampleMode sdrGetResampleMode(SdrLib *sdr)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    //trace("Push audio:%d", size);
-    if (sdr->audioEnabled)
-        audioPlay(sdr->audio, buf, size);
-    if (sdr->codecFunc)
-        codecEncode(sdr->codec, buf, size, sdr->codecFunc, sdr->context);
+    return sdr->resampleMode;
 }
 
 
-static void demodOutput(float *buf, int size, void *ctx)
+/**
+ * Set how encoded audio is sent
+ */   
+void sdrSetCodecFormat(SdrLib *sdr, CodecFormat format)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    //trace("Demod:%d", size);
-    resamplerUpdate(sdr->resampler, buf, size, resamplerOutput, sdr);
+    for (int i = 0 ; i < sdr->receiverCount ; i++)
+        receiverSetCodecFormat(sdr->receivers[i], format);
 }
 
-static void ddcOutput(float complex *data, int size, void *ctx)
+
+Listener *sdrListen(SdrLib *sdr, int channel, Encoding encoding)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    //trace("Ddc:%d", size);
-    sdr->demod->update(sdr->demod, data, size, demodOutput, sdr);
+    return receiverListen(selected(sdr), channel, encoding);
 }
 
-static void *sdrReaderThread(void *ctx)
+
+int sdrGetCodecHeader(SdrLib *sdr, unsigned char *buf, int size)
 {
-    SdrLib *sdr = (SdrLib *)ctx;
-    Device *dev = sdr->device;
-    
-    int bufsize = 1024*1024;
-    float complex *readbuf = (float complex *)malloc(bufsize * sizeof(float complex));
-    
-    sdr->running = 1;
-    
-    while (sdr->running && dev->isOpen(dev->ctx))
+    if (size < CODEC_HEAD_LEN)
+        return 0;
+    return codecHeader(selectedChannel(sdr)->codec, buf);
+}
+
+
+/**
+ * Get the number of blocks the selected device has dropped since it started
+ */   
+unsigned long sdrGetDroppedBlocks(SdrLib *sdr)
+{
+    return selected(sdr)->droppedBlocks;
+}
+
+
+/**
+ * Get the statistics of one of the selected device's encoders
+ */   
+int sdrGetEncoderStats(SdrLib *sdr, int channel, EncoderStats *stats)
+{
+    return receiverGetEncoderStats(selected(sdr), channel, stats);
+}
+
+
+/**
+ * Get the latency histogram for one point of the pipeline
+ */   
+int sdrGetLatency(SdrLib *sdr, int point, LatencyStats *stats)
+{
+    if (point < 0 || point >= LATENCY_POINTS)
         {
-        int readCount = dev->read(dev->ctx, readbuf, bufsize);
-        if (readCount)
-            {
-            fftUpdate(sdr->fft, readbuf, readCount, fftOutput, sdr);
-            ddcUpdate(sdr->ddc, readbuf, readCount, ddcOutput, sdr);
-            }
-        else
-            {
-            sched_yield();
-            }
+        error("Unknown latency point: %d", point);
+        return FALSE;
         }
+    //the audio device keeps its own, since it is measured in its callback
+    if (point == LATENCY_AUDIO && sdr->audio)
+        latencyGetStats(&(sdr->audio->latency), stats);
+    else
+        latencyGetStats(&(selected(sdr)->latency[point]), stats);
+    return TRUE;
+}
+
 
-    free(readbuf);
-    sdr->running = 0;
-    return NULL;
+/**
+ * Clear all of the latency histograms
+ */   
+void sdrResetLatency(SdrLib *sdr)
+{
+    for (int i = 0 ; i < sdr->receiverCount ; i++)
+        receiverResetLatency(sdr->receivers[i]);
+    if (sdr->audio)
+        latencyReset(&(sdr->audio->latency));
 }
 
 
@@ -52,16 +52,33 @@ typedef void FloatOutputFunc(float *data, int size, void *ctx);
 /**
  * Forward declarations, hidden from clients
  */
+typedef struct Agc         Agc;
 typedef struct Audio       Audio; 
 typedef struct Biquad      Biquad;
+typedef struct Channel     Channel; 
 typedef struct Codec       Codec; 
 typedef struct Ddc         Ddc; 
+typedef struct DdcBank     DdcBank; 
 typedef struct Decimator   Decimator; 
 typedef struct Demodulator Demodulator; 
 typedef struct Device      Device; 
+typedef struct Drift       Drift;
+typedef struct Encoder     Encoder;
+typedef struct Event       Event; 
+typedef struct Fanout      Fanout;
+typedef struct Farrow      Farrow;
 typedef struct Fir         Fir; 
 typedef struct Fft         Fft; 
+typedef struct Latency     Latency; 
+typedef struct Listener    Listener;
+typedef struct Mailbox     Mailbox; 
+typedef struct Packet      Packet;
+typedef struct Receiver    Receiver; 
 typedef struct Resampler   Resampler;
+typedef struct Sos         Sos;
+typedef struct SosBank     SosBank;
+typedef struct Squelch     Squelch;
+typedef struct Taps        Taps; 
 typedef struct Queue       Queue; 
 typedef struct Vfo         Vfo; 
 
@@ -73,10 +90,132 @@ typedef enum
     MODE_AM,
     MODE_FM,
     MODE_LSB,
-    MODE_USB
+    MODE_USB,
+    MODE_WFM   //broadcast FM, in stereo when there is a pilot
 } Mode;
 
 
+/**
+ * Points in the pipeline where the age of samples is measured,
+ * counting from the moment the device delivered them.
+ */
+typedef enum
+{
+    LATENCY_DDC=0,
+    LATENCY_DEMOD,
+    LATENCY_RESAMPLER,
+    LATENCY_AUDIO,
+    LATENCY_CODEC,
+    LATENCY_POINTS
+} LatencyPoint;
+
+#define LATENCY_BUCKETS 24
+
+
+/**
+ * How long the blocks passed down the pipeline are.  Every stage
+ * holds a block before passing it on, so together they are most of
+ * the delay before a sound is heard.
+ */
+typedef enum
+{
+    BLOCKS_LARGE=0, //every stage's full buffer, for throughput on a busy server
+    BLOCKS_SMALL    //BLOCK_SMALL_TIME, for tuning by ear
+} BlockMode;
+
+/**
+ * The length of a block with BLOCKS_SMALL, in seconds
+ */
+#define BLOCK_SMALL_TIME (0.010)
+
+
+/**
+ * How the audio is brought to the speaker's rate
+ */
+typedef enum
+{
+    RESAMPLE_POLYPHASE=0, //L/M polyphase, exact for ratios that reduce to small L
+    RESAMPLE_FARROW       //a short polyphase stage, then cubic interpolation at any ratio
+} ResampleMode;
+
+
+/**
+ * How encoded audio is sent to the codec output
+ */
+typedef enum
+{
+    CODEC_OGG=0, //bundles of frames, each a complete Ogg Opus stream
+    CODEC_RAW    //each Opus packet as soon as it is encoded, after a short header
+} CodecFormat;
+
+
+/**
+ * The encodings a channel can publish to its listeners.  Each is
+ * encoded once for all of the listeners that want it.  The PCM
+ * encodings are always sent as with CODEC_RAW, since they need no
+ * setup.
+ */
+typedef enum
+{
+    ENCODING_OPUS_16K=0, //Opus at 16kbps
+    ENCODING_OPUS_32K,   //Opus at 32kbps
+    ENCODING_OPUS_64K,   //Opus at 64kbps
+    ENCODING_PCM16,      //16 bit little-endian samples
+    ENCODING_ULAW,       //G.711 mu-law, 8 bits a sample
+    ENCODINGS
+} Encoding;
+
+
+/**
+ * The kinds of thread the library runs, each of which
+ * can be given its own placement and scheduling.
+ */
+typedef enum
+{
+    THREAD_ACQUISITION=0, //the device's own USB thread
+    THREAD_READER,        //per-device dsp pipeline
+    THREAD_CLIENT,        //one per websocket client
+    THREAD_AUDIO,         //the PortAudio callback
+    THREAD_ENCODER,       //per-channel codecs
+    THREAD_ROLES
+} ThreadRole;
+
+/**
+ * Where a thread runs, and how it is scheduled
+ */
+typedef struct
+{
+    int cpu;      //pin to this cpu, or -1 to run anywhere
+    int priority; //SCHED_FIFO priority 1-99, or 0 for normal scheduling
+} ThreadPolicy;
+
+/**
+ * A snapshot of one latency histogram.  Times are in microseconds.
+ * buckets[i] counts the samples whose age was in [2^i, 2^(i+1)) usec.
+ */
+typedef struct
+{
+    unsigned long count;
+    double min;
+    double max;
+    double mean;
+    unsigned long buckets[LATENCY_BUCKETS];
+} LatencyStats;
+
+/**
+ * A snapshot of a channel's encoder queue, counted in frames
+ */
+typedef struct
+{
+    unsigned long frames;  //queued since the channel was created
+    unsigned long dropped; //lost because the encoder fell behind
+    unsigned long silences; //of the frames, runs of squelch silence
+    int backlog;           //waiting now
+    int maxBacklog;        //the most that have waited at once
+    int capacity;          //the most that can wait
+} EncoderStats;
+
+
 
 /**
  * Create a new SdrLib instance.
@@ -95,19 +234,165 @@ int sdrDelete(SdrLib *sdrlib);
 
 
 /**
- * Start sdrlib processing
+ * Start sdrlib processing on all of the devices found
  * @param sdrlib an SDRLib instance.
+ * @return TRUE if at least one device started, else FALSE
  */   
 int sdrStart(SdrLib *sdrlib);
 
 
 
 /**
- * Stop sdrlib processing
+ * Stop sdrlib processing on all devices
  * @param sdrlib an SDRLib instance.
  */   
 int sdrStop(SdrLib *sdrlib);
 
+
+/**
+ * Start a single device, each of which has its own thread and pipeline
+ * @param sdrlib an SDRLib instance.
+ * @param index the device index, 0 to sdrGetDeviceCount()-1
+ */   
+int sdrStartDevice(SdrLib *sdrlib, int index);
+
+
+/**
+ * Stop a single device
+ * @param sdrlib an SDRLib instance.
+ * @param index the device index, 0 to sdrGetDeviceCount()-1
+ */   
+int sdrStopDevice(SdrLib *sdrlib, int index);
+
+
+/**
+ * Get the number of devices found by sdrCreate()
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrGetDeviceCount(SdrLib *sdrlib);
+
+
+/**
+ * Get the name of a device
+ * @param sdrlib an SDRLib instance.
+ * @return the name, or NULL if there is no such device
+ */   
+const char *sdrGetDeviceName(SdrLib *sdrlib, int index);
+
+
+/**
+ * Get the serial number of a device, which stays the same
+ * when the dongles are plugged in a different order.
+ * @param sdrlib an SDRLib instance.
+ * @return the serial, which may be empty, or NULL if there is no such device
+ */   
+const char *sdrGetDeviceSerial(SdrLib *sdrlib, int index);
+
+
+/**
+ * Find a device by its serial number
+ * @param sdrlib an SDRLib instance.
+ * @return the device index, or -1 if not found
+ */   
+int sdrFindDevice(SdrLib *sdrlib, const char *serial);
+
+
+/**
+ * Select the device that the tuning, gain, mode and statistics
+ * calls act on.  The speaker follows the selected device.
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrSelectDevice(SdrLib *sdrlib, int index);
+
+
+/**
+ * Get the index of the selected device
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrGetSelectedDevice(SdrLib *sdrlib);
+
+
+/**
+ * Pin a device's threads to one cpu.  Takes effect at the next start.
+ * @param sdrlib an SDRLib instance.
+ * @param cpu the cpu number, or -1 to let the threads float
+ */   
+int sdrSetDeviceCpu(SdrLib *sdrlib, int index, int cpu);
+
+
+/**
+ * Set the placement and scheduling for one kind of thread.
+ * This applies to the whole process, and takes effect as threads
+ * start, so call it before sdrStart().  A cpu given to sdrSetDeviceCpu()
+ * takes precedence for that device's acquisition and reader threads.
+ * Realtime priorities usually need CAP_SYS_NICE or an rtprio limit.
+ * @param role one of the ThreadRole values
+ * @param cpu pin to this cpu, or -1 to run anywhere
+ * @param priority SCHED_FIFO priority 1-99, or 0 for normal scheduling
+ * @return TRUE if successful, else FALSE
+ */   
+int sdrSetThreadPolicy(ThreadRole role, int cpu, int priority);
+
+
+/**
+ * Time each variant of the dsp kernels on this machine, and write the
+ * fastest to the profile that sdrCreate() and the device modules load
+ * from then on.  That is $SDRLIB_KERNELS, or KERNEL_PROFILE in the
+ * working directory.  This takes a few seconds, and rebinds the
+ * kernels in use, so it is refused while any device is started.
+ * @param sdrlib an SDRLib instance.
+ * @return TRUE if successful, else FALSE
+ */   
+int sdrCalibrateKernels(SdrLib *sdr);
+
+
+/**
+ * Set where a device sends its power spectrum and encoded audio.
+ * sdrCreate() routes device 0 to the functions it was given.
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrSetDeviceOutput(SdrLib *sdrlib, int index, void *context,
+                       UintOutputFunc *psFunc, ByteOutputFunc *codecFunc);
+
+
+/**
+ * Listen to another signal within the selected device's bandwidth.
+ * The new channel starts out tuned like channel 0, and is tuned with
+ * the usual calls once it is selected.  All of a device's channels
+ * share one pass over its samples, so each one costs little more
+ * than its own filtering and demodulation.  Only channel 0 plays on
+ * the speaker.
+ * @param sdrlib an SDRLib instance.
+ * @param context the context for codecFunc
+ * @param codecFunc receives the channel's encoded audio, or NULL
+ * @return the channel index, or -1 on failure
+ */   
+int sdrAddChannel(SdrLib *sdrlib, void *context, ByteOutputFunc *codecFunc);
+
+
+/**
+ * Stop listening to a channel of the selected device.
+ * Channel 0 cannot be removed.
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrRemoveChannel(SdrLib *sdrlib, int index);
+
+
+/**
+ * Select the channel of the selected device that the vfo, passband
+ * and mode calls act on.  Selecting a device selects its channel 0.
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrSelectChannel(SdrLib *sdrlib, int index);
+
+
+/**
+ * Get the index of the selected channel
+ * @param sdrlib an SDRLib instance.
+ */   
+int sdrGetSelectedChannel(SdrLib *sdrlib);
+
+
 /**
  * Get the current center frequency
  * @param sdrlib an SDRLib instance.
@@ -123,6 +408,10 @@ double sdrGetCenterFrequency(SdrLib *sdrlib);
 int sdrSetCenterFrequency(SdrLib *sdrlib, double freq);
 
 /**
+ * Set the vfo and passband of the selected device.  Like the other
+ * setters, this may be called from any thread.  While the device is
+ * running, the change is queued and applied between blocks, and the
+ * getters return the requested value right away.
  */   
 void sdrSetDdcFreqs(SdrLib *sdr, float vfo, float pbLo, float pbHi);
 
@@ -209,6 +498,23 @@ int sdrGetMode(SdrLib *sdrlib);
 int sdrSetMode(SdrLib *sdrlib, Mode mode);
 
 
+/**
+ * Get the squelch level
+ * @param sdrlib an SDRLib instance.
+ */   
+float sdrGetSquelch(SdrLib *sdrlib);
+
+
+/**
+ * Set the squelch level, in dB relative to full scale.  While the
+ * channel's power is below it, the channel does no demodulation or
+ * encoding, and sends a short silence marker instead of audio.
+ * @param sdrlib an SDRLib instance.
+ * @param level the level, or -200 or below for no squelch
+ */   
+int sdrSetSquelch(SdrLib *sdrlib, float level);
+
+
 /**
  * Determine if we want speaker output
  * @param sdrlib an SDRLib instance.
@@ -217,6 +523,124 @@ int sdrSetMode(SdrLib *sdrlib, Mode mode);
 void sdrEnableAudio(SdrLib *sdr, int enabled);
 
 
+/**
+ * Set how much data the device may buffer.  Larger values trade
+ * memory for resistance to dropped blocks on busy hosts.
+ * Takes effect at the next sdrStart().  Use 0 to keep the device default.
+ * @param sdrlib an SDRLib instance.
+ * @param transferCount number of USB transfers kept in flight
+ * @param transferSize size of each transfer in bytes
+ * @param queueDepth number of blocks queued for the reader thread
+ */   
+void sdrSetBuffering(SdrLib *sdr, int transferCount, int transferSize, int queueDepth);
+
+
+/**
+ * Set the length of the blocks passed down the pipeline, from the
+ * device's transfers to the speaker's buffers.  The channels follow
+ * at their next block, and the device at the next sdrStart().  The
+ * speaker's stream is reopened by the device playing to it, at its
+ * next block, which drops what was queued.
+ * @param sdrlib an SDRLib instance.
+ * @param mode BLOCKS_SMALL or BLOCKS_LARGE
+ */   
+void sdrSetBlockMode(SdrLib *sdr, BlockMode mode);
+
+
+/**
+ * Get the length of the blocks passed down the pipeline
+ * @param sdrlib an SDRLib instance.
+ */   
+BlockMode sdrGetBlockMode(SdrLib *sdr);
+
+
+/**
+ * Set how every channel of every device resamples its audio.  The
+ * channels follow at their next block.
+ * @param sdrlib an SDRLib instance.
+ * @param mode RESAMPLE_POLYPHASE or RESAMPLE_FARROW
+ */   
+void sdrSetResampleMode(SdrLib *sdr, ResampleMode mode);
+
+
+/**
+ * Get how the channels resample their audio
+ * @param sdrlib an SDRLib instance.
+ */   
+ResampleMode sdrGetResampleMode(SdrLib *sdr);
+
+
+/**
+ * Set how encoded audio is sent, for every channel of every device.
+ * With CODEC_RAW, a client needs the header from sdrGetCodecHeader()
+ * once, when it connects, before the packets.
+ * @param sdrlib an SDRLib instance.
+ * @param format CODEC_OGG or CODEC_RAW
+ */   
+void sdrSetCodecFormat(SdrLib *sdr, CodecFormat format);
+
+
+/**
+ * Start listening to one of the selected device's channels.  Each
+ * encoding is done once for all of its listeners, so a listener costs
+ * little more than the copying of a pointer.  Call listenerNext() from
+ * fanout.h to take its packets, and listenerClose() and then
+ * listenerDelete() when done.
+ * @param sdrlib an SDRLib instance.
+ * @param channel the channel index
+ * @param encoding one of the Encoding values
+ * @return the listener, which belongs to the caller, or NULL on failure
+ */   
+Listener *sdrListen(SdrLib *sdr, int channel, Encoding encoding);
+
+
+/**
+ * Get the header that a CODEC_RAW client needs to set up its decoder
+ * @param sdrlib an SDRLib instance.
+ * @param buf receives the header
+ * @param size the size of buf
+ * @return the length of the header, or 0 if it does not fit
+ */   
+int sdrGetCodecHeader(SdrLib *sdr, unsigned char *buf, int size);
+
+
+/**
+ * Get the number of blocks the device has dropped since sdrStart(),
+ * because the reader thread did not keep up.
+ * @param sdrlib an SDRLib instance.
+ */   
+unsigned long sdrGetDroppedBlocks(SdrLib *sdr);
+
+
+/**
+ * Get the statistics of one of the selected device's encoders.  Each
+ * channel encodes on its own thread, fed through a queue, and the
+ * dsp drops audio rather than wait for it.
+ * @param sdrlib an SDRLib instance.
+ * @param channel the channel index
+ * @param stats receives the current statistics
+ * @return TRUE if successful, else FALSE
+ */   
+int sdrGetEncoderStats(SdrLib *sdr, int channel, EncoderStats *stats);
+
+
+/**
+ * Get the latency histogram for one point of the pipeline
+ * @param sdrlib an SDRLib instance.
+ * @param point one of the LatencyPoint values
+ * @param stats receives the current statistics
+ * @return TRUE if successful, else FALSE
+ */   
+int sdrGetLatency(SdrLib *sdr, int point, LatencyStats *stats);
+
+
+/**
+ * Clear all of the latency histograms
+ * @param sdrlib an SDRLib instance.
+ */   
+void sdrResetLatency(SdrLib *sdr);
+
+
 #ifdef __cplusplus
 }
 #endif
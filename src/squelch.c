@@ -0,0 +1,99 @@
+/**
+ * Power squelch
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "squelch.h"
+#include "private.h"
+
+
+Squelch *squelchCreate()
+{
+    Squelch *sq = (Squelch *)smalloc(sizeof(Squelch));
+    if (!sq)
+        return NULL;
+    memset(sq, 0, sizeof(Squelch));
+    sq->open = TRUE;
+    squelchSetLevel(sq, SQUELCH_OFF);
+    return sq;
+}
+
+
+void squelchDelete(Squelch *sq)
+{
+    free(sq);
+}
+
+
+void squelchSetRate(Squelch *sq, float rate)
+{
+    sq->rate        = rate;
+    sq->hangSamples = (int)(SQUELCH_HANG * rate);
+}
+
+
+void squelchSetLevel(Squelch *sq, float level)
+{
+    sq->level      = level;
+    sq->openPower  = pow(10.0, level / 10.0);
+    sq->closePower = pow(10.0, (level - SQUELCH_HYSTERESIS) / 10.0);
+    if (level <= SQUELCH_OFF)
+        sq->open = TRUE;
+}
+
+
+int squelchUpdate(Squelch *sq, const float complex *data, int size)
+{
+    if (sq->level <= SQUELCH_OFF || size <= 0)
+        return sq->open;
+    float sum = 0.0;
+    for (int i = 0 ; i < size ; i++)
+        {
+        float re = crealf(data[i]);
+        float im = cimagf(data[i]);
+        sum += re * re + im * im;
+        }
+    float power = sum / size;
+    sq->power = power;
+    if (power >= sq->openPower)
+        {
+        sq->open     = TRUE;
+        sq->hangLeft = sq->hangSamples;
+        }
+    else if (sq->open)
+        {
+        //between the two levels it holds, and below them it hangs on a while
+        if (power >= sq->closePower)
+            sq->hangLeft = sq->hangSamples;
+        else
+            {
+            sq->hangLeft -= size;
+            if (sq->hangLeft < 0)
+                sq->open = FALSE;
+            }
+        }
+    return sq->open;
+}
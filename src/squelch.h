@@ -0,0 +1,88 @@
+#ifndef _SQUELCH_H_
+#define _SQUELCH_H_
+
+/**
+ * Power squelch, on the ddc output.  While it is closed, the channel
+ * skips its demodulator, resampler and codec, and sends only a silence
+ * marker now and then.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ * 
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <complex.h>
+
+#include "sdrlib.h"
+
+
+/**
+ * A level at or below this, in dB, leaves the squelch open
+ */
+#define SQUELCH_OFF (-200.0)
+
+/**
+ * How far below the opening level the power must fall to close it, in dB
+ */
+#define SQUELCH_HYSTERESIS (3.0)
+
+/**
+ * How long it stays open after the power falls, in seconds, so that
+ * it does not chop the gaps between words
+ */
+#define SQUELCH_HANG (0.5)
+
+
+struct Squelch
+{
+    float level;      //opening level, in dB relative to full scale, or SQUELCH_OFF
+    float openPower;  //mean |x|^2 that opens it, for level
+    float closePower; //and that closes it, once the hang is over
+    float rate;       //input rate, set by squelchSetRate()
+    int   hangSamples;
+    int   hangLeft;   //samples until it may close
+    int   open;
+    float power;      //mean |x|^2 of the last block
+};
+
+
+Squelch *squelchCreate();
+
+void squelchDelete(Squelch *sq);
+
+/**
+ * Tell the squelch its input rate, which the hang is counted in
+ */
+void squelchSetRate(Squelch *sq, float rate);
+
+/**
+ * Set the opening level, in dB relative to full scale, or SQUELCH_OFF
+ */
+void squelchSetLevel(Squelch *sq, float level);
+
+/**
+ * Measure a block and decide whether it passes.  This costs one
+ * multiply-add per sample.
+ * @return TRUE if the squelch is open, else FALSE
+ */
+int squelchUpdate(Squelch *sq, const float complex *data, int size);
+
+
+#endif /* _SQUELCH_H_ */
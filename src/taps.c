@@ -0,0 +1,233 @@
+/**
+ * Shared, reference counted sets of FIR coefficients.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "taps.h"
+#include "kernel.h"
+#include "private.h"
+
+
+/**
+ * The cache is only used from control threads, never from the
+ * sample path, so a plain mutex is fine here.
+ */
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static Taps *cache = NULL;
+
+
+static int specEqual(const FilterSpec *a, const FilterSpec *b)
+{
+    return a->lo == b->lo && a->hi == b->hi && a->width == b->width &&
+           a->ripple == b->ripple && a->atten == b->atten && a->rate == b->rate;
+}
+
+
+/**
+ * The prototype for a polyphase set.  Each branch is as long as the
+ * filter would be at the input rate, so the prototype is designed
+ * to that length rather than to its own estimate, which may be
+ * longer than DESIGN_MAX_TAPS.  The window fills every branch, or
+ * when that is even, all but the last tap, which is left at 0.
+ * @return the taps in each branch, or 0 on failure
+ */
+static int tapsDesignPolyphase(const FilterSpec *spec, int phases, float **coeffs)
+{
+    int size = designKaiserSize(spec);
+    FilterSpec proto = *spec;
+    proto.rate = spec->rate * phases;
+    int total = size * phases;
+    *coeffs = (float *)malloc(total * sizeof(float));
+    if (!*coeffs)
+        return 0;
+    (*coeffs)[total - 1] = 0.0;
+    if (!designKaiser(&proto, *coeffs, total - !(total & 1)))
+        {
+        free(*coeffs);
+        *coeffs = NULL;
+        return 0;
+        }
+    return size;
+}
+
+
+static Taps *tapsCreate(const FilterSpec *spec, float outRate, int phases, int step)
+{
+    float *coeffs;
+    int size;
+    if (phases > 1)
+        size = tapsDesignPolyphase(spec, phases, &coeffs);
+    else
+        {
+        coeffs = (float *)malloc(DESIGN_MAX_TAPS * sizeof(float));
+        size = (coeffs) ? designFilter(spec, coeffs) : 0;
+        }
+    if (!size)
+        {
+        error("Could not design coefficients");
+        free(coeffs);
+        return NULL;
+        }
+    Taps *taps = (Taps *)malloc(sizeof(Taps) + phases * size * sizeof(float));
+    if (!taps)
+        {
+        error("Could not allocate coefficients");
+        free(coeffs);
+        return NULL;
+        }
+    taps->refs = 1;
+    taps->spec = *spec;
+    taps->outRate = outRate;
+    taps->size = size;
+    taps->phases = phases;
+    taps->step = step;
+    taps->next = NULL;
+    //branch p gets every phases'th tap, starting at p, scaled up
+    //to make up for the zeros between the input samples
+    for (int p = 0 ; p < phases ; p++)
+        for (int k = 0 ; k < size ; k++)
+            taps->coeffs[p * size + k] = phases * coeffs[k * phases + p];
+    free(coeffs);
+    //the branches of a polyphase set are not symmetric, even though the prototype is
+    taps->symmetric = (phases == 1) && kernelIsSymmetric(taps->coeffs, size);
+    return taps;
+}
+
+
+Taps *tapsGet(const FilterSpec *spec, float outRate)
+{
+    return tapsGetPolyphase(spec, outRate, 1, 0);
+}
+
+
+Taps *tapsGetPolyphase(const FilterSpec *spec, float outRate, int phases, int step)
+{
+    pthread_mutex_lock(&cacheLock);
+    Taps *prev = NULL;
+    Taps *taps = cache;
+    int count = 0;
+    for ( ; taps ; prev = taps, taps = taps->next, count++)
+        {
+        if (specEqual(&(taps->spec), spec) && taps->outRate == outRate &&
+            taps->phases == phases && taps->step == step)
+            break;
+        }
+    if (taps)
+        {
+        //move to the front
+        if (prev)
+            {
+            prev->next = taps->next;
+            taps->next = cache;
+            cache = taps;
+            }
+        tapsRef(taps);
+        pthread_mutex_unlock(&cacheLock);
+        return taps;
+        }
+    pthread_mutex_unlock(&cacheLock);
+
+    //design outside of the lock
+    taps = tapsCreate(spec, outRate, phases, step);
+    if (!taps)
+        return NULL;
+
+    pthread_mutex_lock(&cacheLock);
+    tapsRef(taps); //for the cache
+    taps->next = cache;
+    cache = taps;
+    //drop the least recently used
+    Taps *evicted = NULL;
+    if (count >= TAPS_CACHE_SIZE)
+        {
+        Taps *t = cache;
+        for (int i = 1 ; i < TAPS_CACHE_SIZE && t->next ; i++)
+            t = t->next;
+        evicted = t->next;
+        t->next = NULL;
+        }
+    pthread_mutex_unlock(&cacheLock);
+    while (evicted)
+        {
+        Taps *next = evicted->next;
+        tapsUnref(evicted);
+        evicted = next;
+        }
+    return taps;
+}
+
+
+void tapsRef(Taps *taps)
+{
+    __atomic_add_fetch(&(taps->refs), 1, __ATOMIC_RELAXED);
+}
+
+
+void tapsUnref(Taps *taps)
+{
+    if (taps && __atomic_sub_fetch(&(taps->refs), 1, __ATOMIC_ACQ_REL) == 0)
+        free(taps);
+}
+
+
+void tapsFlush()
+{
+    pthread_mutex_lock(&cacheLock);
+    Taps *taps = cache;
+    cache = NULL;
+    pthread_mutex_unlock(&cacheLock);
+    while (taps)
+        {
+        Taps *next = taps->next;
+        tapsUnref(taps);
+        taps = next;
+        }
+}
+
+
+
+void tapsPost(Taps **slot, Taps *taps)
+{
+    Taps *old = __atomic_exchange_n(slot, taps, __ATOMIC_ACQ_REL);
+    tapsUnref(old);
+}
+
+
+int tapsTake(Taps **slot, Taps **current)
+{
+    //cheap test first, since nearly every block finds nothing
+    if (!__atomic_load_n(slot, __ATOMIC_ACQUIRE))
+        return FALSE;
+    Taps *taps = __atomic_exchange_n(slot, NULL, __ATOMIC_ACQ_REL);
+    if (!taps)
+        return FALSE;
+    Taps *old = *current;
+    *current = taps;
+    tapsUnref(old);
+    return TRUE;
+}
+
@@ -0,0 +1,115 @@
+#ifndef _TAPS_H_
+#define _TAPS_H_
+/**
+ * Shared, reference counted sets of FIR coefficients.
+ *
+ * Designing a filter is slow compared to running it, so coefficient
+ * sets are built on the thread asking for a change, kept in a cache
+ * keyed by their design parameters, and handed to the dsp thread
+ * ready to use.  A filter that is running holds a reference to its
+ * Taps, so a set is never freed while a filter is still reading it.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sdrlib.h"
+#include "design.h"
+
+
+/**
+ * How many coefficient sets the cache keeps around
+ */
+#define TAPS_CACHE_SIZE 32
+
+
+struct Taps
+{
+    int   refs;    //only touched atomically
+    FilterSpec spec; //what the set was designed to meet
+    float outRate; //the rate a decimator or resampler takes its output at
+    int   size;    //chosen by the design, up to DESIGN_MAX_TAPS.  For each branch of a polyphase set
+    int   phases;  //polyphase branches, one after the other in coeffs, or 1
+    int   step;    //branches a polyphase resampler advances for each output, or 0
+    int   symmetric; //TRUE if linear phase, so the folded kernels may be used
+    Taps  *next;   //cache list, most recently used first
+    float coeffs[];
+};
+
+
+/**
+ * Get the shortest coefficient set that meets a spec, from the cache
+ * if we have designed it before.  The caller owns one reference,
+ * and must tapsUnref() it.
+ * @param outRate the output rate that goes with the set, so that a
+ *     filter on another thread can pick up both at once.  Use spec->rate
+ *     for a filter that does not change the rate.
+ * @return the set, or NULL if the spec is impossible or out of memory
+ */
+Taps *tapsGet(const FilterSpec *spec, float outRate);
+
+/**
+ * Get a polyphase set, for resampling by phases/step.  The lowpass
+ * is designed at phases times spec->rate, and split into 'phases'
+ * branches of 'size' taps, each ready to run on the delay line at
+ * spec->rate, with the gain that makes up for the zeros an
+ * interpolator would have stuffed in.  With one phase, this is the
+ * same set as tapsGet().
+ * @param phases the upsampling factor, L
+ * @param step the downsampling factor, M
+ * @return the set, or NULL if the spec is impossible or out of memory
+ */
+Taps *tapsGetPolyphase(const FilterSpec *spec, float outRate, int phases, int step);
+
+/**
+ * Add a reference
+ */
+void tapsRef(Taps *taps);
+
+/**
+ * Drop a reference, freeing the set when nobody uses it
+ */
+void tapsUnref(Taps *taps);
+
+/**
+ * Drop every set that the cache holds
+ */
+void tapsFlush();
+
+
+/**
+ * Hand a new set to a filter running on another thread.  Any set
+ * that was posted but not yet picked up is released.
+ * @param slot the filter's pending slot
+ * @param taps the new set.  The slot takes over the caller's reference
+ */
+void tapsPost(Taps **slot, Taps *taps);
+
+/**
+ * Called by the dsp thread between blocks.  If a new set was posted,
+ * it replaces *current and the old one is released.
+ * @return TRUE if *current changed, else FALSE
+ */
+int tapsTake(Taps **slot, Taps **current);
+
+
+#endif /* _TAPS_H_ */
+
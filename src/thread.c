@@ -0,0 +1,169 @@
+/**
+ * Helpers for placing the threads we create
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+//for the pthread *_np() calls
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+#include "thread.h"
+#include "private.h"
+
+
+/**
+ * The policy for each role.  These are process wide, since the
+ * websocket and audio threads do not belong to any one SdrLib.
+ */
+static ThreadPolicy policies[THREAD_ROLES] =
+{
+    { -1, 0 },  //THREAD_ACQUISITION
+    { -1, 0 },  //THREAD_READER
+    { -1, 0 },  //THREAD_CLIENT
+    { -1, 0 },  //THREAD_AUDIO
+    { -1, 0 }   //THREAD_ENCODER
+};
+
+
+int threadSetPolicy(ThreadRole role, int cpu, int priority)
+{
+    if (role < 0 || role >= THREAD_ROLES)
+        {
+        error("Unknown thread role: %d", role);
+        return FALSE;
+        }
+    if (priority < 0 || priority > 99)
+        {
+        error("Thread priority must be in the range 0 .. 99");
+        return FALSE;
+        }
+    policies[role].cpu      = cpu;
+    policies[role].priority = priority;
+    return TRUE;
+}
+
+
+int threadGetPolicy(ThreadRole role, ThreadPolicy *policy)
+{
+    if (role < 0 || role >= THREAD_ROLES)
+        {
+        error("Unknown thread role: %d", role);
+        return FALSE;
+        }
+    *policy = policies[role];
+    return TRUE;
+}
+
+
+int threadSetup(const char *name, ThreadRole role, int cpu)
+{
+    ThreadPolicy policy;
+    if (!threadGetPolicy(role, &policy))
+        return FALSE;
+    if (cpu >= 0)
+        policy.cpu = cpu;
+    return threadApply(name, policy.cpu, policy.priority);
+}
+
+
+int threadApply(const char *name, int cpu, int priority)
+{
+    int ret = TRUE;
+    if (name && !threadSetName(name))
+        ret = FALSE;
+    if (!threadSetAffinity(cpu))
+        ret = FALSE;
+    if (!threadSetPriority(priority))
+        ret = FALSE;
+    return ret;
+}
+
+
+int threadSetName(const char *name)
+{
+#if defined(__linux__)
+    char buf[16];
+    strncpy(buf, name, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    return (pthread_setname_np(pthread_self(), buf) == 0);
+#elif defined(__APPLE__)
+    return (pthread_setname_np(name) == 0);
+#else
+    return TRUE;
+#endif
+}
+
+
+int threadSetAffinity(int cpu)
+{
+    if (cpu < 0)
+        return TRUE;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc)
+        {
+        error("Could not pin thread to cpu %d: %d", cpu, rc);
+        return FALSE;
+        }
+    return TRUE;
+#elif defined(_WIN32)
+    if (!SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1) << cpu))
+        {
+        error("Could not pin thread to cpu %d", cpu);
+        return FALSE;
+        }
+    return TRUE;
+#else
+    error("Pinning threads to a cpu is not supported on this platform");
+    return FALSE;
+#endif
+}
+
+
+int threadSetPriority(int priority)
+{
+    if (priority <= 0)
+        return TRUE;
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc)
+        {
+        error("Could not set realtime priority %d: %d", priority, rc);
+        return FALSE;
+        }
+    return TRUE;
+}
+
@@ -0,0 +1,86 @@
+#ifndef _THREAD_H_
+#define _THREAD_H_
+/**
+ * Helpers for placing the threads we create.  Each thread has a
+ * role, and each role has a policy saying which cpu it runs on
+ * and whether it gets realtime scheduling.
+ *
+ * Authors:
+ *   Bob Jamison
+ *
+ * Copyright (C) 2013 Bob Jamison
+ *
+ *  This file is part of the SdrLib library.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sdrlib.h"
+
+
+/**
+ * Set the policy for one role.  Threads pick it up when they start.
+ * @return TRUE if successful, else FALSE
+ */
+int threadSetPolicy(ThreadRole role, int cpu, int priority);
+
+/**
+ * Get the policy for one role
+ * @return TRUE if successful, else FALSE
+ */
+int threadGetPolicy(ThreadRole role, ThreadPolicy *policy);
+
+/**
+ * Called by a thread as it starts.  Names it, and applies the policy
+ * for its role.
+ * @param name the thread name, 15 characters at most
+ * @param cpu if >= 0, overrides the cpu in the policy
+ * @return TRUE if everything asked for was applied, else FALSE
+ */
+int threadSetup(const char *name, ThreadRole role, int cpu);
+
+/**
+ * Name the calling thread and place it, without consulting the
+ * policy table.  For device plugins, which are given their
+ * policy through Device.setThreadPolicy().
+ * @return TRUE if everything asked for was applied, else FALSE
+ */
+int threadApply(const char *name, int cpu, int priority);
+
+/**
+ * Name the calling thread, so that it shows up in top and gdb.
+ * @param name the thread name, 15 characters at most
+ * @return TRUE if successful, else FALSE
+ */
+int threadSetName(const char *name);
+
+/**
+ * Pin the calling thread to one CPU.
+ * @param cpu the CPU number, or < 0 to do nothing
+ * @return TRUE if successful (or cpu < 0), else FALSE
+ */
+int threadSetAffinity(int cpu);
+
+/**
+ * Give the calling thread SCHED_FIFO scheduling.  This usually
+ * needs CAP_SYS_NICE or an rtprio limit.
+ * @param priority 1-99, or <= 0 to do nothing
+ * @return TRUE if successful (or priority <= 0), else FALSE
+ */
+int threadSetPriority(int priority);
+
+
+#endif /* _THREAD_H_ */
+
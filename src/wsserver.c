@@ -46,6 +46,7 @@ typedef socklen_t Socklen;
 
 
 #include "wsserver.h"
+#include "thread.h"
 
 
 #ifndef TRUE
@@ -728,6 +729,8 @@ static void *handleClient(void *ctx)
     char *buf     = ws->buf;
     int sock      = ws->socket;
     
+    threadSetup("sdr-ws-client", THREAD_CLIENT, -1);
+
     int wsrequest = FALSE;
     FILE *in = fdopen(sock, "r");
     
@@ -798,6 +801,7 @@ static void *handleClient(void *ctx)
 static void *listenForClients(void *ctx)
 {
     WsServer *obj = (WsServer *)ctx;
+    threadSetName("sdr-ws-listen");
     obj->cont = TRUE;
     while (obj->cont)
         {
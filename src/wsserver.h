@@ -36,6 +36,7 @@ struct WsHandler
     WsServer *server;
     int socket;
     void *context;
+    void *user;   //for the application, one for each client
     char resourceName[WS_BUFLEN];
     char buf[WS_BUFLEN];
 };
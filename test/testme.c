@@ -27,12 +27,28 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include <sdrlib.h>
 
 
+#include "agc.h"
 #include "audio.h"
+#include "codec.h"
 #include "device.h"
+#include "drift.h"
+#include "encoder.h"
+#include "event.h"
+#include "fanout.h"
+#include "demod.h"
+#include "design.h"
+#include "filter.h"
 #include "json.h"
+#include "kernel.h"
+#include "latency.h"
+#include "mailbox.h"
+#include "samplerate.h"
+#include "squelch.h"
+#include "taps.h"
 #include "private.h"
 
 int test_audio()
@@ -133,6 +149,1618 @@ int test_json()
 }
 
 
+/**
+ * Retuning should reuse cached coefficients, and only hand them
+ * to the filter at the start of a block.
+ */
+int test_taps()
+{
+    FilterSpec spec = { 0.0, 5000.0, 1000.0, 0.5, 60.0, 48000.0 };
+    Taps *a = tapsGet(&spec, 48000.0);
+    Taps *b = tapsGet(&spec, 48000.0);
+    spec.hi = 6000.0;
+    Taps *c = tapsGet(&spec, 48000.0);
+    if (!a || a != b || a == c)
+        error("test_taps: cache lookup failed");
+    else
+        trace("test_taps: cache success");
+    tapsUnref(a);
+    tapsUnref(b);
+    tapsUnref(c);
+
+    Ddc *ddc = ddcCreate(0.0, -5000.0, 5000.0, 2048000.0);
+    Taps *before = ddc->taps;
+    ddcSetFreqs(ddc, 1000.0, -5000.0, 5000.0);
+    if (ddc->pending)
+        error("test_taps: vfo move redesigned the filter");
+    ddcSetFreqs(ddc, 1000.0, -6000.0, 6000.0);
+    if (ddc->taps != before || !ddc->pending)
+        error("test_taps: retune was not deferred to the next block");
+    float complex buf[64];
+    memset(buf, 0, sizeof(buf));
+    ddcUpdate(ddc, buf, 64, NULL, NULL);
+    if (ddc->pending || ddc->taps->spec.hi != 6000.0 || ddcGetOutRate(ddc) != 6000.0 * 2.0 * DDC_GUARD)
+        error("test_taps: retune was not picked up");
+    else
+        trace("test_taps: retune success");
+    ddcDelete(ddc);
+    tapsFlush();
+    return TRUE;
+}
+
+
+/**
+ * The folded kernels must give the same answer as the plain ones,
+ * and a filter must give the same answer as a direct convolution.
+ */
+int test_fold()
+{
+    int ok = TRUE;
+    for (int n = 1 ; n <= 9 ; n++)
+        {
+        float h[9];
+        float x[9];
+        float complex xc[9];
+        for (int i = 0 ; i < n ; i++)
+            {
+            h[i] = h[n-1-i] = (float)(i + 1);
+            x[i] = (float)(3 * i - 7);
+            xc[i] = x[i] + (float)(i * i) * I;
+            }
+        if (!kernelIsSymmetric(h, n))
+            ok = FALSE;
+        if (fabs(dotReal(x, h, n) - dotRealSym(x, h, n)) > 1.0e-4)
+            ok = FALSE;
+        if (cabsf(dotComplex(xc, h, n) - dotComplexSym(xc, h, n)) > 1.0e-4)
+            ok = FALSE;
+        }
+
+    Fir *fir = firLP(21, 3000.0, 48000.0, W_HAMMING);
+    if (!fir->symmetric)
+        ok = FALSE;
+    float in[100];
+    for (int i = 0 ; i < 100 ; i++)
+        in[i] = sin(i * 0.3) + 0.5 * cos(i * 1.7);
+    for (int i = 0 ; i < 100 ; i++)
+        {
+        float y = firUpdate(fir, in[i]);
+        float expected = 0.0;
+        for (int k = 0 ; k < fir->size && k <= i ; k++)
+            expected += fir->coeffs[k] * in[i - k];
+        if (fabs(y - expected) > 1.0e-4)
+            ok = FALSE;
+        }
+    firDelete(fir);
+
+    if (ok)
+        trace("test_fold: success");
+    else
+        error("test_fold: folded and plain filters disagree");
+    return ok;
+}
+
+
+int test_kernelgen()
+{
+    int ok = TRUE;
+    int generated = 0;
+    float h[REMEZ_MAX_TAPS];
+    float x[REMEZ_MAX_TAPS];
+    float complex xc[REMEZ_MAX_TAPS];
+    for (int n = 3 ; n <= REMEZ_MAX_TAPS ; n += 2)
+        {
+        for (int i = 0 ; i < n ; i++)
+            {
+            h[i] = h[n-1-i] = 1.0 / (float)(i + 1);
+            x[i] = sin(i * 0.7);
+            xc[i] = x[i] + cos(i * 0.2) * I;
+            }
+        if (kernelSelect(FALSE, n) != dotReal || kernelSelectC(FALSE, n) != dotComplex)
+            ok = FALSE;
+        DotFunc *dot = kernelSelect(TRUE, n);
+        DotFuncC *dotC = kernelSelectC(TRUE, n);
+        if (dot != dotRealSym)
+            generated++;
+        if (fabs(dot(x, h, n) - dotReal(x, h, n)) > 1.0e-4)
+            ok = FALSE;
+        if (cabsf(dotC(xc, h, n) - dotComplex(xc, h, n)) > 1.0e-4)
+            ok = FALSE;
+        }
+    if (!generated)
+        ok = FALSE;
+
+    //the unrolled decimator, the generic one, and the sum done longhand
+    Decimator *fixed   = decimatorCreate(192000.0, 48000.0);
+    Decimator *generic = decimatorCreate(192000.0, 48000.0);
+    if (!fixed->decimate)
+        ok = FALSE;
+    generic->decimate = NULL;
+    float complex in[2000];
+    for (int i = 0 ; i < 2000 ; i++)
+        in[i] = sin(i * 0.05) + cos(i * 0.31) * I;
+    //uneven blocks, so the phase has to carry across them
+    for (int pos = 0, len = 1 ; pos < 2000 ; pos += len, len = len * 3 % 97 + 1)
+        {
+        int n = (pos + len > 2000) ? 2000 - pos : len;
+        decimatorUpdate(fixed, in + pos, n, NULL, NULL);
+        decimatorUpdate(generic, in + pos, n, NULL, NULL);
+        }
+    if (fixed->bufPtr != 500 || generic->bufPtr != 500)
+        ok = FALSE;
+    int size = fixed->taps->size;
+    for (int j = 0 ; j < 500 && ok ; j++)
+        {
+        float complex expected = 0.0;
+        for (int k = 0 ; k < size && k <= j * 4 ; k++)
+            expected += fixed->taps->coeffs[k] * in[j * 4 - k];
+        if (cabsf(fixed->buf[j] - expected) > 1.0e-4 ||
+            cabsf(generic->buf[j] - expected) > 1.0e-4)
+            ok = FALSE;
+        }
+    decimatorDelete(fixed);
+    decimatorDelete(generic);
+
+    if (ok)
+        trace("test_kernelgen: success, %d unrolled sizes", generated);
+    else
+        error("test_kernelgen: unrolled and generic kernels disagree");
+    return ok;
+}
+
+
+#define KT_SIZE 1000
+
+/**
+ * Run the bound variant of a primitive and its scalar reference on n samples.
+ * @return the largest difference, relative to the size of the values
+ */
+static float kernelDiff(int primitive, int n, const float *x, const float complex *xc,
+                        const unsigned char *bytes)
+{
+    static float h[KT_SIZE];
+    static float out[KT_SIZE];
+    static float ref[KT_SIZE];
+    static float complex outc[KT_SIZE];
+    static float complex refc[KT_SIZE];
+    for (int i = 0 ; i < n ; i++)
+        h[i] = h[n-1-i] = 1.0 / (1.0 + i);
+    float diff = 0.0;
+    switch (primitive)
+        {
+        case KERNEL_DOT:
+            diff = fabs(kernels.dot(x, h, n) - dotReal(x, h, n));
+            break;
+        case KERNEL_DOT_SYM:
+            diff = fabs(kernels.dotSym(x, h, n) - dotRealSym(x, h, n));
+            break;
+        case KERNEL_DOT_C:
+            diff = cabsf(kernels.dotC(xc, h, n) - dotComplex(xc, h, n));
+            break;
+        case KERNEL_DOT_C_SYM:
+            diff = cabsf(kernels.dotCSym(xc, h, n) - dotComplexSym(xc, h, n));
+            break;
+        case KERNEL_ROTATE:
+            {
+            float complex step = cos(0.3) + sin(0.3) * I;
+            float complex phase = I;
+            float complex refPhase = I;
+            kernels.rotate(outc, xc, n, &phase, step);
+            rotateComplex(refc, xc, n, &refPhase, step);
+            for (int i = 0 ; i < n ; i++)
+                diff = fmax(diff, cabsf(outc[i] - refc[i]));
+            diff = fmax(diff, cabsf(phase - refPhase));
+            break;
+            }
+        case KERNEL_MAGNITUDE:
+            kernels.magnitude(out, xc, n);
+            magnitudeComplex(ref, xc, n);
+            for (int i = 0 ; i < n ; i++)
+                diff = fmax(diff, fabs(out[i] - ref[i]));
+            break;
+        case KERNEL_PHASE:
+            kernels.phase(out, xc, n);
+            phaseComplex(ref, xc, n);
+            for (int i = 0 ; i < n ; i++)
+                diff = fmax(diff, fabs(out[i] - ref[i]));
+            break;
+        case KERNEL_CONVERT_U8:
+            kernels.convertU8(outc, bytes, n);
+            convertU8(refc, bytes, n);
+            for (int i = 0 ; i < n ; i++)
+                diff = fmax(diff, cabsf(outc[i] - refc[i]));
+            break;
+        case KERNEL_FARROW:
+            {
+            static int index[KT_SIZE];
+            static float mu[KT_SIZE];
+            for (int i = 0 ; i < n ; i++)
+                {
+                double pos = 1.0 + i * 0.9;
+                index[i] = (int)pos;
+                mu[i]    = pos - index[i];
+                }
+            kernels.farrow(out, x, index, mu, n);
+            farrowCubic(ref, x, index, mu, n);
+            for (int i = 0 ; i < n ; i++)
+                diff = fmax(diff, fabs(out[i] - ref[i]));
+            break;
+            }
+        }
+    return diff;
+}
+
+
+int test_kernels()
+{
+    int ok = TRUE;
+    static float x[KT_SIZE];
+    static float complex xc[KT_SIZE];
+    static unsigned char bytes[2 * KT_SIZE];
+    for (int i = 0 ; i < KT_SIZE ; i++)
+        {
+        x[i] = sin(i * 0.37) - 0.5 * cos(i * 1.3);
+        //every quadrant, and the axes
+        xc[i] = (i % 11 == 0) ? (float)(i % 4 - 2) : x[i] + cos(i * 0.71) * I;
+        bytes[2 * i]     = (unsigned char)(i * 7);
+        bytes[2 * i + 1] = (unsigned char)(255 - i * 3);
+        }
+    int lengths[] = { 0, 1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 65, 127, 255, KT_SIZE };
+    int nrLengths = sizeof(lengths) / sizeof(int);
+    for (int p = 0 ; p < KERNEL_PRIMITIVES ; p++)
+        {
+        for (int v = 1 ; v < kernelVariantCount(p) ; v++)
+            {
+            const char *name = kernelVariantName(p, v);
+            if (!kernelBind(p, name))
+                {
+                trace("test_kernels: %s/%s cannot run here", kernelPrimitiveName(p), name);
+                continue;
+                }
+            float worst = 0.0;
+            for (int l = 0 ; l < nrLengths ; l++)
+                worst = fmax(worst, kernelDiff(p, lengths[l], x, xc, bytes));
+            //the vector phase is a polynomial, and the rotation drifts
+            float tol = (p == KERNEL_PHASE) ? 2.0e-5 : 1.0e-4;
+            if (worst > tol)
+                {
+                error("test_kernels: %s/%s is off by %g", kernelPrimitiveName(p), name, worst);
+                ok = FALSE;
+                }
+            kernelBind(p, "scalar");
+            }
+        }
+
+    const char *profile = "test-kernels.txt";
+    if (!kernelCalibrate(profile))
+        ok = FALSE;
+    const char *chosen[KERNEL_PRIMITIVES];
+    for (int p = 0 ; p < KERNEL_PRIMITIVES ; p++)
+        {
+        chosen[p] = kernelBound(p);
+        kernelBind(p, "scalar");
+        }
+    if (!kernelLoadProfile(profile))
+        ok = FALSE;
+    for (int p = 0 ; p < KERNEL_PRIMITIVES ; p++)
+        {
+        if (strcmp(chosen[p], kernelBound(p)) != 0)
+            ok = FALSE;
+        kernelBind(p, "scalar");
+        }
+    remove(profile);
+
+    if (ok)
+        trace("test_kernels: success");
+    else
+        error("test_kernels: variants disagree with the reference");
+    return ok;
+}
+
+
+static void bankOutput(float complex *data, int size, void *ctx)
+{
+    int *calls = (int *)ctx;
+    (*calls)++;
+}
+
+/**
+ * A bank of channels must give the same output as running each
+ * ddc on its own.  The output is compared while it is still in
+ * the ddcs' buffers.
+ */
+int test_bank()
+{
+    float pb[3][3] = { { 10000.0, -5000.0, 5000.0 },
+                       { -250000.0, -12000.0, -3000.0 },
+                       { 400000.0, 1000.0, 8000.0 } };
+    int n = 3;
+    int len = 200000;
+    float complex *in = (float complex *)malloc(len * sizeof(float complex));
+    for (int i = 0 ; i < len ; i++)
+        in[i] = sin(i * 0.01) + cos(i * 0.37) * I;
+    int calls = 0;
+    Ddc *single[3];
+    Ddc *banked[3];
+    DdcBank *bank = ddcBankCreate();
+    for (int c = 0 ; c < n ; c++)
+        {
+        single[c] = ddcCreate(pb[c][0], pb[c][1], pb[c][2], 2048000.0);
+        ddcUpdate(single[c], in, len, bankOutput, &calls);
+        banked[c] = ddcCreate(pb[c][0], pb[c][1], pb[c][2], 2048000.0);
+        ddcBankAdd(bank, banked[c], bankOutput, &calls);
+        }
+    //in uneven pieces, to cross the tiles at odd places
+    for (int pos = 0 ; pos < len ; )
+        {
+        int count = (len - pos < 10007) ? len - pos : 10007;
+        ddcBankUpdate(bank, in + pos, count);
+        pos += count;
+        }
+    int ok = (calls == 0);
+    for (int c = 0 ; c < n ; c++)
+        {
+        Ddc *a = single[c];
+        Ddc *b = banked[c];
+        if (!a->bufPtr || a->bufPtr != b->bufPtr)
+            ok = FALSE;
+        for (int i = 0 ; ok && i < a->bufPtr ; i++)
+            {
+            if (cabsf(a->buf[i] - b->buf[i]) > 1.0e-3 * (1.0 + cabsf(a->buf[i])))
+                ok = FALSE;
+            }
+        ddcDelete(a);
+        ddcDelete(b);
+        }
+    ddcBankDelete(bank);
+    free(in);
+    tapsFlush();
+    if (ok)
+        trace("test_bank: success");
+    else
+        error("test_bank: bank and single ddc outputs differ");
+    return ok;
+}
+
+
+typedef struct
+{
+    float out[2 * 48000 + 1000];
+    int count;
+} ResamplerOutput;
+
+static void resamplerTestOutput(float *data, int size, void *ctx)
+{
+    ResamplerOutput *ro = (ResamplerOutput *)ctx;
+    for (int i = 0 ; i < size ; i++)
+        {
+        if (ro->count < (int)(sizeof(ro->out) / sizeof(float)))
+            ro->out[ro->count] = data[i];
+        ro->count++;
+        }
+}
+
+/**
+ * Two seconds of a tone through a resampler.  Returns the rms and
+ * the upward zero crossings in the second second of output.
+ */
+static int resamplerRun(float inRate, float outRate, int mode, float freq, float drift,
+                        ResamplerOutput *ro, float *rms, int *crossings)
+{
+    Resampler *res = resamplerCreate(inRate, outRate);
+    if (!res)
+        return FALSE;
+    resamplerSetMode(res, mode);
+    resamplerSetTaps(res, resamplerDesign(res, inRate, outRate));
+    resamplerSetDrift(res, drift);
+    ro->count = 0;
+    int len = (int)(2 * inRate);
+    float block[1000];
+    for (int i = 0 ; i < len ; i += 1000)
+        {
+        int n = (len - i < 1000) ? len - i : 1000;
+        for (int j = 0 ; j < n ; j++)
+            block[j] = sin(TWOPI * freq * (i + j) / inRate);
+        resamplerUpdate(res, block, n, resamplerTestOutput, ro);
+        }
+    //what is still held counts too
+    resamplerTestOutput(res->buf, res->bufPtr, ro);
+    resamplerTestOutput(res->farrow->buf, res->farrow->bufPtr, ro);
+    resamplerDelete(res);
+    int start = (int)outRate;
+    double sum = 0.0;
+    *crossings = 0;
+    for (int i = start ; i < 2 * start ; i++)
+        {
+        sum += ro->out[i] * ro->out[i];
+        if (ro->out[i - 1] < 0.0 && ro->out[i] >= 0.0)
+            (*crossings)++;
+        }
+    *rms = sqrt(sum / start);
+    return TRUE;
+}
+
+/**
+ * The ratio must be exact, so that a second in is a second out,
+ * a tone must keep its pitch and level, one above the output's
+ * Nyquist rate must be gone, and drift must come out as asked.
+ */
+int test_resampler()
+{
+    int ok = TRUE;
+    static ResamplerOutput ro;
+    Resampler *res = resamplerCreate(44100.0, 48000.0);
+    if (res->taps->phases != 160 || res->taps->step != 147 || fabs(res->trim) > 1.0e-3)
+        ok = FALSE;
+    resamplerDelete(res);
+    //a ddc's rate, 2048000 / 43, is 128/129 of 48000
+    res = resamplerCreate(2048000.0 / 43.0, 48000.0);
+    if (res->taps->phases != 129 || res->taps->step != 128 || fabs(res->trim) > 1.0e-3)
+        ok = FALSE;
+    resamplerDelete(res);
+
+    float rates[][2] = { { 44100.0, 48000.0 }, { 2048000.0 / 43.0, 48000.0 },
+                         { 240000.0, 48000.0 }, { 32000.0, 48000.0 } };
+    for (int r = 0 ; r < 4 ; r++)
+        {
+        float rms;
+        int crossings;
+        resamplerRun(rates[r][0], rates[r][1], RESAMPLE_POLYPHASE, 1000.0, 0.0, &ro, &rms, &crossings);
+        trace("test_resampler: %.1f to %.1f: %d out, rms %.3f, %d cycles",
+            rates[r][0], rates[r][1], ro.count, rms, crossings);
+        if (abs(ro.count - 96000) > 1 || fabs(rms - 0.7071) > 0.025 || abs(crossings - 1000) > 1)
+            ok = FALSE;
+        }
+
+    float rms;
+    int crossings;
+    resamplerRun(96000.0, 48000.0, RESAMPLE_POLYPHASE, 30000.0, 0.0, &ro, &rms, &crossings);
+    trace("test_resampler: 30khz into 48khz, rms %.5f", rms);
+    if (rms > 0.01)
+        ok = FALSE;
+
+    resamplerRun(44100.0, 48000.0, RESAMPLE_POLYPHASE, 1000.0, 100.0, &ro, &rms, &crossings);
+    trace("test_resampler: +100ppm: %d out", ro.count);
+    if (abs(ro.count - 96010) > 2)
+        ok = FALSE;
+
+    if (ok)
+        trace("test_resampler: success");
+    else
+        error("test_resampler: wrong rate, level or rejection");
+    return ok;
+}
+
+
+typedef struct
+{
+    float out[40000];
+    int count;
+} FarrowOutput;
+
+static void farrowTestOutput(float *data, int size, void *ctx)
+{
+    FarrowOutput *fo = (FarrowOutput *)ctx;
+    for (int i = 0 ; i < size ; i++)
+        {
+        if (fo->count < (int)(sizeof(fo->out) / sizeof(float)))
+            fo->out[fo->count] = data[i];
+        fo->count++;
+        }
+}
+
+/**
+ * A tone through a farrow alone, at a ratio that does not reduce,
+ * must land where the cubic says.  A ramp, which the cubic follows
+ * exactly, shows the ratio gliding with every output.  As the last
+ * stage of a resampler, the farrow must keep the rate, the level, the
+ * rejection and the drift of test_resampler().
+ */
+int test_farrow()
+{
+    int ok = TRUE;
+    static FarrowOutput fo;
+
+    //each output is 2 inputs late, for the history ahead of the first
+    double inRate  = 96000.0;
+    double outRate = inRate * sqrt(0.5);
+    Farrow *far = farrowCreate(inRate, outRate);
+    int len = 48000;
+    float block[1000];
+    fo.count = 0;
+    for (int i = 0 ; i < len ; i += 1000)
+        {
+        for (int j = 0 ; j < 1000 ; j++)
+            block[j] = sin(TWOPI * 1000.0 * (i + j) / inRate);
+        farrowUpdate(far, block, 1000, farrowTestOutput, &fo);
+        }
+    farrowTestOutput(far->buf, far->bufPtr, &fo);
+    double worst = 0.0;
+    for (int k = 10 ; k < fo.count ; k++)
+        {
+        double t = k * inRate / outRate - 2.0;
+        double err = fabs(fo.out[k] - sin(TWOPI * 1000.0 * t / inRate));
+        if (err > worst)
+            worst = err;
+        }
+    trace("test_farrow: %d out of %d, worst error %.6f", fo.count, len, worst);
+    if (abs(fo.count - (int)(len * sqrt(0.5))) > 3 || worst > 1.0e-4)
+        ok = FALSE;
+    farrowDelete(far);
+
+    //from 1 input an output to 1.5, evenly over 5000 outputs
+    int glideAt = 3000;
+    int glide   = 5000;
+    far = farrowCreate(48000.0, 48000.0);
+    fo.count = 0;
+    for (int i = 0 ; i < 40000 ; i += 1000)
+        {
+        for (int j = 0 ; j < 1000 ; j++)
+            block[j] = (i + j) * 0.001;
+        if (i == glideAt)
+            farrowSetRates(far, 48000.0, 32000.0, glide);
+        farrowUpdate(far, block, 1000, farrowTestOutput, &fo);
+        }
+    farrowTestOutput(far->buf, far->bufPtr, &fo);
+    double t = -2.0;
+    double step = 1.0;
+    worst = 0.0;
+    for (int k = 0 ; k < fo.count ; k++)
+        {
+        if (t >= 2.0)
+            {
+            double err = fabs(fo.out[k] - t * 0.001);
+            if (err > worst)
+                worst = err;
+            }
+        //the outputs placed before the change keep the old step
+        if (k >= glideAt && step < 1.5)
+            step = 1.0 + 0.5 * (k - glideAt + 1) / glide;
+        t += step;
+        }
+    trace("test_farrow: glide over %d outputs, worst position error %.4f samples",
+        glide, worst * 1000.0);
+    if (worst > 1.0e-4 || far->step != 1.5)
+        ok = FALSE;
+    farrowDelete(far);
+
+    static ResamplerOutput ro;
+    float rates[][2] = { { 44100.0, 48000.0 }, { 2048000.0 / 43.0, 48000.0 },
+                         { 240000.0, 48000.0 }, { 32000.0, 48000.0 } };
+    float rms;
+    int crossings;
+    for (int r = 0 ; r < 4 ; r++)
+        {
+        resamplerRun(rates[r][0], rates[r][1], RESAMPLE_FARROW, 1000.0, 0.0, &ro, &rms, &crossings);
+        trace("test_farrow: %.1f to %.1f: %d out, rms %.3f, %d cycles",
+            rates[r][0], rates[r][1], ro.count, rms, crossings);
+        if (abs(ro.count - 96000) > 3 || fabs(rms - 0.7071) > 0.025 || abs(crossings - 1000) > 1)
+            ok = FALSE;
+        }
+    Resampler *res = resamplerCreate(44100.0, 48000.0);
+    resamplerSetMode(res, RESAMPLE_FARROW);
+    resamplerSetTaps(res, resamplerDesign(res, 44100.0, 48000.0));
+    resamplerUpdate(res, block, 1000, resamplerTestOutput, &ro);
+    if (res->taps->phases > RESAMPLER_FARROW_PHASES || res->trim != 0.0)
+        ok = FALSE;
+    resamplerDelete(res);
+
+    resamplerRun(96000.0, 48000.0, RESAMPLE_FARROW, 30000.0, 0.0, &ro, &rms, &crossings);
+    trace("test_farrow: 30khz into 48khz, rms %.5f", rms);
+    if (rms > 0.01)
+        ok = FALSE;
+
+    resamplerRun(44100.0, 48000.0, RESAMPLE_FARROW, 1000.0, 100.0, &ro, &rms, &crossings);
+    trace("test_farrow: +100ppm: %d out", ro.count);
+    if (abs(ro.count - 96010) > 3)
+        ok = FALSE;
+
+    if (ok)
+        trace("test_farrow: success");
+    else
+        error("test_farrow: wrong position, rate, level or rejection");
+    return ok;
+}
+
+
+static void fusedOutput(float *data, int size, void *ctx)
+{
+}
+
+static void plainOutput(float *data, int size, void *ctx)
+{
+    resamplerUpdate((Resampler *)ctx, data, size, fusedOutput, NULL);
+}
+
+/**
+ * With its filter off, a fused demodulator must give the resampler
+ * the same samples as the plain one.  With it on, FM must be
+ * de-emphasized.
+ */
+int test_fused()
+{
+    int ok = TRUE;
+    int len = 20000;
+    float rate = 48000.0;
+    float complex *in = (float complex *)malloc(len * sizeof(float complex));
+    Demodulator *(*creators[2])() = { demodFmCreate, demodAmCreate };
+    for (int m = 0 ; m < 2 ; m++)
+        {
+        float phase = 0.0;
+        for (int i = 0 ; i < len ; i++)
+            {
+            phase += 0.5 * sin(TWOPI * 1000.0 * i / rate);
+            in[i] = (1.0 + 0.3 * cos(i * 0.05)) * (cos(phase) + sin(phase) * I);
+            }
+        Demodulator *plain = creators[m]();
+        Demodulator *fused = creators[m]();
+        Resampler *rp = resamplerCreate(rate, 12000.0);
+        Resampler *rf = resamplerCreate(rate, 12000.0);
+        plain->update(plain, in, len, plainOutput, rp);
+        fused->fused(fused, in, len, rf, fusedOutput, NULL);
+        if (!rp->bufPtr || rp->bufPtr != rf->bufPtr)
+            ok = FALSE;
+        for (int i = 0 ; ok && i < rp->bufPtr ; i++)
+            {
+            if (fabs(rp->buf[i] - rf->buf[i]) > 1.0e-4)
+                ok = FALSE;
+            }
+        demodDelete(plain);
+        demodDelete(fused);
+        resamplerDelete(rp);
+        resamplerDelete(rf);
+        }
+
+    //a 10khz tone should come out of the de-emphasis about 13dB down from 300hz
+    float level[2];
+    float tones[2] = { 300.0, 10000.0 };
+    for (int t = 0 ; t < 2 ; t++)
+        {
+        float phase = 0.0;
+        for (int i = 0 ; i < len ; i++)
+            {
+            phase += 0.1 * sin(TWOPI * tones[t] * i / rate);
+            in[i] = cos(phase) + sin(phase) * I;
+            }
+        Demodulator *dem = demodFmCreate();
+        demodSetRate(dem, rate);
+        Resampler *rs = resamplerCreate(rate, rate);
+        dem->fused(dem, in, len, rs, fusedOutput, NULL);
+        float peak = 0.0;
+        for (int i = rs->bufPtr / 2 ; i < rs->bufPtr ; i++)
+            peak = (fabs(rs->buf[i]) > peak) ? fabs(rs->buf[i]) : peak;
+        level[t] = peak;
+        demodDelete(dem);
+        resamplerDelete(rs);
+        }
+    float db = 20.0 * log10(level[0] / level[1]);
+    trace("test_fused: de-emphasis %.1fdB", db);
+    if (db < 11.0 || db > 16.0)
+        ok = FALSE;
+
+    free(in);
+    tapsFlush();
+    if (ok)
+        trace("test_fused: success");
+    else
+        error("test_fused: fused demodulation differs");
+    return ok;
+}
+
+
+typedef struct
+{
+    int calls;
+    int count;
+    float out[DEMOD_BUFSIZE];
+} BlockOutput;
+
+static void blockOutput(float *data, int size, void *ctx)
+{
+    BlockOutput *bo = (BlockOutput *)ctx;
+    memcpy(bo->out + bo->count, data, size * sizeof(float));
+    bo->calls++;
+    bo->count += size;
+}
+
+/**
+ * The level of one tone in the second half of a block
+ */
+static float toneLevel(float *data, int size, float freq, float rate)
+{
+    float complex sum = 0.0;
+    for (int i = size / 2 ; i < size ; i++)
+        sum += data[i] * cexpf(-I * TWOPI * freq * i / rate);
+    return cabsf(sum) / (size / 4);
+}
+
+/**
+ * The block demodulators must give one call per block.  Each SSB
+ * demodulator must keep its own sideband and reject the other.
+ */
+int test_ssb()
+{
+    int ok = TRUE;
+    int len = 8000;
+    float rate = 8000.0;
+    static BlockOutput bo;
+    float complex *in = (float complex *)malloc(len * sizeof(float complex));
+    //an upper sideband tone at 1000hz, and a lower one at 1500hz, half as loud
+    for (int i = 0 ; i < len ; i++)
+        in[i] = cexpf(I * TWOPI * 1000.0 * i / rate) + 0.5 * cexpf(-I * TWOPI * 1500.0 * i / rate);
+
+    Demodulator *am = demodAmCreate();
+    memset(&bo, 0, sizeof(bo));
+    am->update(am, in, len, blockOutput, &bo);
+    if (bo.calls != 1 || bo.count != len)
+        ok = FALSE;
+    for (int i = 0 ; i < len ; i++)
+        if (fabs(bo.out[i] - cabsf(in[i])) > 1.0e-4)
+            ok = FALSE;
+    demodDelete(am);
+
+    Demodulator *ssb[2] = { demodUsbCreate(), demodLsbCreate() };
+    float want[2]  = { 1000.0, 1500.0 };
+    float other[2] = { 1500.0, 1000.0 };
+    float gain[2]  = { 1.0, 0.5 };
+    for (int s = 0 ; s < 2 ; s++)
+        {
+        Demodulator *dem = ssb[s];
+        demodSetPassband(dem, -3000.0, 3000.0);
+        demodSetRate(dem, rate);
+        memset(&bo, 0, sizeof(bo));
+        dem->update(dem, in, len, blockOutput, &bo);
+        if (bo.calls != 1 || bo.count != len)
+            ok = FALSE;
+        float a = toneLevel(bo.out, len, want[s], rate);
+        float b = toneLevel(bo.out, len, other[s], rate);
+        trace("test_ssb: %s  wanted:%.3f  other:%.1fdB", (s) ? "lsb" : "usb",
+            a, 20.0 * log10(b / a));
+        if (fabs(a - gain[s]) > 0.05 * gain[s] || b > 0.01 * a)
+            ok = FALSE;
+        demodDelete(dem);
+        }
+    free(in);
+
+    if (ok)
+        trace("test_ssb: success");
+    else
+        error("test_ssb: sideband selection failed");
+    return ok;
+}
+
+
+/**
+ * Steady-state gain of a cascade for a real tone
+ */
+static float sosGain(Sos *sos, float freq, float rate)
+{
+    int len = 8000;
+    float *buf = (float *)malloc(len * sizeof(float));
+    for (int i = 0 ; i < len ; i++)
+        buf[i] = cos(TWOPI * freq * i / rate);
+    sosReset(sos);
+    sosUpdate(sos, buf, buf, len);
+    float level = toneLevel(buf, len, freq, rate);
+    free(buf);
+    return level;
+}
+
+/**
+ * The cascades must have the responses they are designed for, the
+ * block updates must agree with the biquad one sample at a time, and
+ * each lane of a bank must agree with its own cascade.
+ */
+int test_sos()
+{
+    int ok = TRUE;
+    float rate = 8000.0;
+
+    Sos *lp = sosLP(6, 1000.0, rate);
+    float pass   = sosGain(lp, 200.0, rate);
+    float corner = sosGain(lp, 1000.0, rate);
+    float stop   = sosGain(lp, 3000.0, rate);
+    trace("test_sos: lowpass  pass:%.3f  corner:%.3f  stop:%.1fdB",
+        pass, corner, 20.0 * log10(stop));
+    if (fabs(pass - 1.0) > 0.01 || fabs(corner - 0.7071) > 0.01 || stop > 1.0e-3)
+        ok = FALSE;
+    Sos *hp = sosHP(3, 300.0, rate);
+    if (sosGain(hp, 100.0, rate) > 0.05 || fabs(sosGain(hp, 2000.0, rate) - 1.0) > 0.01)
+        ok = FALSE;
+    Sos *dc = sosDcBlock(10.0, rate);
+    float dcOut[4000];
+    for (int i = 0 ; i < 4000 ; i++)
+        dcOut[i] = 1.0;
+    sosUpdate(dc, dcOut, dcOut, 4000);
+    if (fabs(dcOut[3999]) > 1.0e-3 || fabs(sosGain(dc, 1000.0, rate) - 1.0) > 0.01)
+        ok = FALSE;
+
+    //block against one at a time, real and complex
+    int len = 1000;
+    Biquad *bq = biquadBP(1000.0, rate, 2.0);
+    Sos *one = sosCreate();
+    sosAppend(one, bq);
+    float x[1000], y[1000];
+    float complex xc[1000], yc[1000];
+    for (int i = 0 ; i < len ; i++)
+        {
+        x[i]  = sin(i * 0.3) + 0.5 * cos(i * 1.7);
+        xc[i] = x[i] + I * cos(i * 0.11);
+        }
+    sosUpdate(one, y, x, len);
+    sosUpdateC(one, yc, xc, len);
+    for (int i = 0 ; i < len ; i++)
+        {
+        float complex v = biquadUpdateC(bq, xc[i]);
+        if (fabs(biquadUpdate(bq, x[i]) - y[i]) > 1.0e-5 || cabsf(v - yc[i]) > 1.0e-5)
+            ok = FALSE;
+        }
+
+    //lanes of different lengths, and one left to pass through
+    Sos *designs[SOS_LANES];
+    SosBank *bank = sosBankCreate();
+    float *in  = (float *)malloc(len * SOS_LANES * sizeof(float));
+    float *out = (float *)malloc(len * SOS_LANES * sizeof(float));
+    for (int i = 0 ; i < len * SOS_LANES ; i++)
+        in[i] = sin(i * 0.013) + cos(i * 0.71);
+    for (int k = 0 ; k < SOS_LANES - 1 ; k++)
+        {
+        designs[k] = sosLP(k + 1, 500.0 + 300.0 * k, rate);
+        sosBankSet(bank, k, designs[k]);
+        }
+    sosBankUpdate(bank, out, in, len / 2);
+    sosBankUpdate(bank, out + len / 2 * SOS_LANES, in + len / 2 * SOS_LANES, len / 2);
+    for (int k = 0 ; k < SOS_LANES ; k++)
+        {
+        for (int i = 0 ; i < len ; i++)
+            x[i] = in[i * SOS_LANES + k];
+        if (k < SOS_LANES - 1)
+            sosUpdate(designs[k], y, x, len);
+        else
+            memcpy(y, x, len * sizeof(float));
+        for (int i = 0 ; i < len ; i++)
+            if (fabs(out[i * SOS_LANES + k] - y[i]) > 1.0e-5)
+                ok = FALSE;
+        if (k < SOS_LANES - 1)
+            sosDelete(designs[k]);
+        }
+
+    free(in);
+    free(out);
+    sosBankDelete(bank);
+    sosDelete(one);
+    biquadDelete(bq);
+    sosDelete(dc);
+    sosDelete(hp);
+    sosDelete(lp);
+    if (ok)
+        trace("test_sos: success");
+    else
+        error("test_sos: a cascade did not give its response");
+    return ok;
+}
+
+
+/**
+ * The peak of a stretch of samples
+ */
+static float peakLevel(float *data, int from, int to)
+{
+    float peak = 0.0;
+    for (int i = from ; i < to ; i++)
+        peak = (fabs(data[i]) > peak) ? fabs(data[i]) : peak;
+    return peak;
+}
+
+/**
+ * A tone that jumps 40dB up and back down must come out at the target
+ * level either side, never clip, and hold its gain through the hang.
+ */
+int test_agc()
+{
+    int ok = TRUE;
+    float rate = 8000.0;
+    int len = 4 * (int)rate;
+    int up = (int)rate;
+    int down = 2 * (int)rate;
+    float *data = (float *)malloc(len * sizeof(float));
+    for (int i = 0 ; i < len ; i++)
+        {
+        float amp = (i >= up && i < down) ? 1.0 : 0.01;
+        data[i] = amp * sin(TWOPI * 700.0 * i / rate);
+        }
+    Agc *agc = agcCreate();
+    agcSetRate(agc, rate);
+    //odd sizes, to cross the envelope blocks
+    for (int i = 0 ; i < len ; i += 1000)
+        agcUpdate(agc, data + i, (len - i < 1000) ? len - i : 1000);
+    float quiet = peakLevel(data, up - 800, up);
+    float loud  = peakLevel(data, down - 800, down);
+    float hang  = peakLevel(data, down + 100, down + 800);
+    float after = peakLevel(data, len - 800, len);
+    float most  = peakLevel(data, 0, len);
+    trace("test_agc: quiet:%.3f loud:%.3f hang:%.4f recovered:%.3f peak:%.3f",
+        quiet, loud, hang, after, most);
+    if (fabs(quiet - AGC_TARGET) > 0.05 || fabs(loud - AGC_TARGET) > 0.05 ||
+        fabs(after - AGC_TARGET) > 0.05 || hang > 0.02 || most > 1.0)
+        ok = FALSE;
+    agcDelete(agc);
+    free(data);
+    if (ok)
+        trace("test_agc: success");
+    else
+        error("test_agc: level not held");
+    return ok;
+}
+
+
+/**
+ * Run blocks of one power through a squelch
+ * @return how many blocks it was open for
+ */
+static int squelchBlocks(Squelch *sq, float db, int blocks)
+{
+    float complex buf[100];
+    float amp = pow(10.0, db / 20.0);
+    int open = 0;
+    for (int b = 0 ; b < blocks ; b++)
+        {
+        for (int i = 0 ; i < 100 ; i++)
+            buf[i] = amp * cexpf(I * 0.3 * (b * 100 + i));
+        open += squelchUpdate(sq, buf, 100);
+        }
+    return open;
+}
+
+/**
+ * The squelch must open above its level, hold between the level and
+ * the hysteresis, and close only once the hang has run out.
+ */
+int test_squelch()
+{
+    int ok = TRUE;
+    float rate = 10000.0;
+    int hang = (int)(SQUELCH_HANG * rate / 100);
+    Squelch *sq = squelchCreate();
+    squelchSetRate(sq, rate);
+    if (squelchBlocks(sq, -60.0, 10) != 10)
+        ok = FALSE;  //off
+    squelchSetLevel(sq, -30.0);
+    if (squelchBlocks(sq, -60.0, 10) != 0)
+        ok = FALSE;
+    if (squelchBlocks(sq, -20.0, 10) != 10)
+        ok = FALSE;
+    if (squelchBlocks(sq, -31.5, 2 * hang) != 2 * hang)
+        ok = FALSE;
+    int held = squelchBlocks(sq, -60.0, 2 * hang);
+    if (held != hang)
+        ok = FALSE;
+    if (squelchBlocks(sq, -31.5, 10) != 0)
+        ok = FALSE;
+    squelchSetLevel(sq, SQUELCH_OFF);
+    if (squelchBlocks(sq, -60.0, 10) != 10)
+        ok = FALSE;
+    squelchDelete(sq);
+    if (ok)
+        trace("test_squelch: success");
+    else
+        error("test_squelch: wrong state, hang held for %d of %d blocks", held, hang);
+    return ok;
+}
+
+
+/**
+ * A sound card that is off from the device's clock by 'offset' ppm,
+ * taking one buffer each tick, fed by a producer that the loop
+ * corrects.  The depth is only ever seen in whole buffers.
+ * @return the mean correction over the second half
+ */
+static float driftRun(float offset, int ticks, int *minDepth, int *maxDepth)
+{
+    int buffer = 1000;
+    Drift drift;
+    driftReset(&drift, 2 * buffer);
+    int depth = 2;
+    double made = 0.0;
+    double sum = 0.0;
+    *minDepth = *maxDepth = depth;
+    for (int t = 0 ; t < ticks ; t++)
+        {
+        made += (1.0 + offset * 1.0e-6) * (1.0 + drift.ppm * 1.0e-6);
+        while (made >= 1.0)
+            {
+            made -= 1.0;
+            depth++;
+            driftUpdate(&drift, depth * buffer);
+            }
+        if (depth > 0)
+            depth--;
+        if (t >= ticks / 2)
+            {
+            sum += drift.ppm;
+            if (depth < *minDepth)
+                *minDepth = depth;
+            if (depth > *maxDepth)
+                *maxDepth = depth;
+            }
+        }
+    return sum / (ticks - ticks / 2);
+}
+
+/**
+ * The loop must find the offset, and keep the queue where it started
+ */
+int test_drift()
+{
+    int ok = TRUE;
+    float offsets[] = { 100.0, -100.0, 0.0 };
+    for (int i = 0 ; i < 3 ; i++)
+        {
+        int minDepth, maxDepth;
+        float ppm = driftRun(offsets[i], 400000, &minDepth, &maxDepth);
+        trace("test_drift: offset %.0fppm correction %.1fppm depth %d-%d",
+            offsets[i], ppm, minDepth, maxDepth);
+        if (fabs(ppm + offsets[i]) > 5.0 || minDepth < 1 || maxDepth > 2)
+            ok = FALSE;
+        }
+    if (ok)
+        trace("test_drift: success");
+    else
+        error("test_drift: did not hold the queue");
+    return ok;
+}
+
+
+typedef struct
+{
+    float complex out[48000];
+    int count;
+} StereoOutput;
+
+static void stereoOutput(float complex *data, int size, void *ctx)
+{
+    StereoOutput *so = (StereoOutput *)ctx;
+    for (int i = 0 ; i < size && so->count < 48000 ; i++)
+        so->out[so->count++] = data[i];
+}
+
+/**
+ * Broadcast a tone on one side, and the left and right levels that come out
+ */
+static void wfmSide(int right, int pilot, float *left, float *rightLevel, float *leak, int *locked)
+{
+    float rate = 250000.0;
+    int len = (int)rate;
+    static StereoOutput so;
+    static float side[48000];
+    float complex *in = (float complex *)malloc(len * sizeof(float complex));
+    double phase = 0.0;
+    for (int i = 0 ; i < len ; i++)
+        {
+        double t = i / rate;
+        double tone = 0.4 * sin(TWOPI * 1000.0 * t);
+        double l = (right) ? 0.0 : tone;
+        double r = (right) ? tone : 0.0;
+        double mpx = 0.45 * (l + r) + 0.45 * (l - r) * sin(TWOPI * 38000.0 * t);
+        if (pilot)
+            mpx += 0.09 * sin(TWOPI * 19000.0 * t);
+        phase += TWOPI * WFM_DEVIATION * mpx / rate;
+        in[i] = cexp(I * phase);
+        }
+    Demodulator *dem = demodWfmCreate();
+    demodSetRate(dem, rate);
+    Resampler *res = resamplerCreate(demodOutRate(dem, rate), 48000.0);
+    memset(&so, 0, sizeof(so));
+    for (int i = 0 ; i < len ; i += 10000)
+        dem->stereo(dem, in + i, 10000, res, stereoOutput, &so);
+    for (int i = 0 ; i < so.count ; i++)
+        side[i] = crealf(so.out[i]);
+    *left = toneLevel(side, so.count, 1000.0, 48000.0);
+    *leak = toneLevel(side, so.count, 19000.0, 48000.0);
+    for (int i = 0 ; i < so.count ; i++)
+        side[i] = cimagf(so.out[i]);
+    *rightLevel = toneLevel(side, so.count, 1000.0, 48000.0);
+    *locked = dem->locked;
+    resamplerDelete(res);
+    demodDelete(dem);
+    free(in);
+}
+
+/**
+ * A tone on one side must come out on that side, once the pilot is
+ * found, and on both without one.
+ */
+int test_wfm()
+{
+    int ok = TRUE;
+    float l, r, leak;
+    int locked;
+    wfmSide(FALSE, TRUE, &l, &r, &leak, &locked);
+    trace("test_wfm: left   left:%.3f right:%.3f separation:%.1fdB pilot:%.1fdB",
+        l, r, 20.0 * log10(l / r), 20.0 * log10(leak / l));
+    if (!locked || l < 0.1 || r > 0.03 * l || leak > 0.01 * l)
+        ok = FALSE;
+    wfmSide(TRUE, TRUE, &l, &r, &leak, &locked);
+    trace("test_wfm: right  left:%.3f right:%.3f separation:%.1fdB", l, r, 20.0 * log10(r / l));
+    if (!locked || r < 0.1 || l > 0.03 * r)
+        ok = FALSE;
+    wfmSide(FALSE, FALSE, &l, &r, &leak, &locked);
+    trace("test_wfm: mono   left:%.3f right:%.3f", l, r);
+    if (locked || fabs(l - r) > 0.01 * l)
+        ok = FALSE;
+    tapsFlush();
+    if (ok)
+        trace("test_wfm: success");
+    else
+        error("test_wfm: stereo not decoded");
+    return ok;
+}
+
+
+/**
+ * The gain of a filter at one frequency
+ */
+static float response(float *coeffs, int size, float freq, float rate)
+{
+    float complex sum = 0.0;
+    for (int i = 0 ; i < size ; i++)
+        sum += coeffs[i] * cexpf(-I * TWOPI * freq * i / rate);
+    return cabsf(sum);
+}
+
+/**
+ * Designed filters must meet their specs, and the equiripple ones
+ * should be shorter than a Kaiser window would be.
+ */
+int test_design()
+{
+    FilterSpec specs[] =
+        {
+        { 0.0,    5000.0, 625.0, 0.5, 60.0, 12500.0 },
+        { 0.0,    1000.0, 200.0, 0.1, 80.0, 10000.0 },
+        { 300.0,  3000.0, 300.0, 0.5, 60.0, 48000.0 }, //too long for remez
+        };
+    int nrSpecs = sizeof(specs) / sizeof(FilterSpec);
+    float coeffs[DESIGN_MAX_TAPS];
+    int ok = TRUE;
+    for (int s = 0 ; s < nrSpecs ; s++)
+        {
+        FilterSpec *spec = &specs[s];
+        int size = designFilter(spec, coeffs);
+        if (!size || !kernelIsSymmetric(coeffs, size))
+            {
+            ok = FALSE;
+            continue;
+            }
+        if (size <= REMEZ_MAX_TAPS && size >= designKaiserSize(spec))
+            ok = FALSE;
+        float pbMin = 1.0e9;
+        float pbMax = 0.0;
+        float sbMax = 0.0;
+        float step = spec->rate / 4000.0;
+        for (float f = 0.0 ; f <= spec->rate / 2.0 ; f += step)
+            {
+            float r = response(coeffs, size, f, spec->rate);
+            if (f >= spec->lo && f <= spec->hi)
+                {
+                if (r < pbMin) pbMin = r;
+                if (r > pbMax) pbMax = r;
+                }
+            else if (f >= spec->hi + spec->width ||
+                     (spec->lo > 0.0 && f <= spec->lo - spec->width))
+                {
+                if (r > sbMax) sbMax = r;
+                }
+            }
+        float ripple = 20.0 * log10(pbMax / pbMin);
+        float atten  = -20.0 * log10(sbMax);
+        trace("test_design: %d taps, ripple %.2fdB, atten %.1fdB", size, ripple, atten);
+        if (ripple > spec->ripple * 1.05 || atten < spec->atten * 0.98)
+            ok = FALSE;
+        }
+    if (ok)
+        trace("test_design: success");
+    else
+        error("test_design: a filter did not meet its spec");
+    return ok;
+}
+
+/**
+ * A design far longer than the spec needs does not converge, and its
+ * reported deviation must be what it achieved, not what it aimed for,
+ * so that designFilter() does not take it for one that meets the spec
+ */
+int test_remez()
+{
+    FilterSpec spec = { 0.0, 5000.0, 625.0, 0.5, 60.0, 12500.0 };
+    float coeffs[DESIGN_MAX_TAPS];
+    double g  = pow(10.0, spec.ripple / 20.0);
+    double dp = (g - 1.0) / (g + 1.0);
+    double stopWeight = dp / pow(10.0, -spec.atten / 20.0);
+    int ok = TRUE;
+    int sizes[] = { 31, 175, 223 };
+    for (int s = 0 ; s < 3 ; s++)
+        {
+        int size = sizes[s];
+        double deviation;
+        if (!designRemez(&spec, coeffs, size, &deviation))
+            {
+            ok = FALSE;
+            continue;
+            }
+        double peak = 0.0;
+        float step = spec.rate / 4000.0;
+        for (float f = 0.0 ; f <= spec.rate / 2.0 ; f += step)
+            {
+            double e = 0.0;
+            if (f <= spec.hi)
+                e = fabs(response(coeffs, size, f, spec.rate) - 1.0);
+            else if (f >= spec.hi + spec.width)
+                e = stopWeight * response(coeffs, size, f, spec.rate);
+            if (e > peak)
+                peak = e;
+            }
+        trace("test_remez: %d taps, reported %g, measured %g", size, deviation, peak);
+        if (deviation < 0.9 * peak)
+            ok = FALSE;
+        }
+    if (ok)
+        trace("test_remez: success");
+    else
+        error("test_remez: deviation reported below what was achieved");
+    return ok;
+}
+
+
+int test_mailbox()
+{
+    Mailbox *mb = mailboxCreate(4);
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    int posted = 0;
+    for (int i = 0 ; i < 6 ; i++)
+        {
+        cmd.type = CMD_AF_GAIN;
+        cmd.gain = (float)i;
+        if (mailboxPost(mb, &cmd))
+            posted++;
+        }
+    if (posted != 4)
+        error("test_mailbox: expected 4 posts to fit, got %d", posted);
+    int ok = TRUE;
+    for (int i = 0 ; i < 4 ; i++)
+        {
+        if (!mailboxTake(mb, &cmd) || cmd.gain != (float)i)
+            ok = FALSE;
+        }
+    if (mailboxTake(mb, &cmd))
+        ok = FALSE;
+    //the cells should be reusable after a lap
+    cmd.gain = 9.0;
+    if (!mailboxPost(mb, &cmd) || !mailboxTake(mb, &cmd) || cmd.gain != 9.0)
+        ok = FALSE;
+    if (ok)
+        trace("test_mailbox: success");
+    else
+        error("test_mailbox: commands lost or out of order");
+    mailboxDelete(mb);
+    return ok;
+}
+
+
+/**
+ * Every listener for an encoding gets the same packet, a listener that
+ * falls behind loses packets rather than holding up the others, and a
+ * closed listener still gets what was queued before it ends.
+ */
+typedef struct
+{
+    int count;
+    int len[16];
+    unsigned char data[16][CODEC_RAW_HEADER + 2 * CODEC_RAW_FRAME];
+} CodecOutput;
+
+static void codecTestOutput(unsigned char *data, int size, void *ctx)
+{
+    CodecOutput *co = (CodecOutput *)ctx;
+    if (co->count >= 16)
+        return;
+    int n = (size < (int)sizeof(co->data[0])) ? size : (int)sizeof(co->data[0]);
+    memcpy(co->data[co->count], data, n);
+    co->len[co->count++] = size;
+}
+
+static unsigned int getLong(const unsigned char *buf)
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int)buf[3] << 24);
+}
+
+/**
+ * With CODEC_RAW, every packet carries its sequence number and the
+ * timestamp of its first sample.  A squelch pads out the partial frame
+ * and sends a header with no audio, and the timestamps count the
+ * silence.  Changing from Ogg sends the partial bundle first.
+ */
+int test_codec()
+{
+    int ok = TRUE;
+    static CodecOutput co;
+    static float frame[FRAME_SIZE];
+    for (int i = 0 ; i < FRAME_SIZE ; i++)
+        frame[i] = 0.5 * sin(TWOPI * 1000.0 * i / 48000.0);
+
+    Codec *codec = codecCreateEncoding(ENCODING_OPUS_32K);
+    codecSetFormat(codec, CODEC_RAW);
+    memset(&co, 0, sizeof(co));
+    codecEncode(codec, frame, 3 * CODEC_RAW_FRAME, codecTestOutput, &co);
+    codecEncode(codec, frame, 100, codecTestOutput, &co);
+    codecSilence(codec, 500, codecTestOutput, &co);
+    codecSilence(codec, CODEC_RAW_FRAME * CODEC_BUNDLE, codecTestOutput, &co);
+    codecEncode(codec, frame, CODEC_RAW_FRAME, codecTestOutput, &co);
+    //three frames, the padded partial one, a marker as the squelch
+    //closes, one for a bundle's worth of silence, and the audio after
+    unsigned int stamps[] = { 0, 960, 1920, 2880, 3840,
+                              3840 + 500 + CODEC_RAW_FRAME * CODEC_BUNDLE,
+                              3840 + 500 + CODEC_RAW_FRAME * CODEC_BUNDLE };
+    int markers[] = { FALSE, FALSE, FALSE, FALSE, TRUE, TRUE, FALSE };
+    if (co.count != 7)
+        ok = FALSE;
+    for (int i = 0 ; ok && i < 7 ; i++)
+        {
+        unsigned int seq = getLong(co.data[i]);
+        unsigned int ts  = getLong(co.data[i] + 4);
+        int marker = (co.len[i] == CODEC_RAW_HEADER);
+        if (seq != (unsigned int)i || ts != stamps[i] || marker != markers[i])
+            {
+            error("test_codec: packet %d seq %u ts %u len %d", i, seq, ts, co.len[i]);
+            ok = FALSE;
+            }
+        }
+    codecDelete(codec);
+
+    //a gap finishes the frame too, but shows only in the timestamps
+    codec = codecCreateEncoding(ENCODING_OPUS_32K);
+    codecSetFormat(codec, CODEC_RAW);
+    memset(&co, 0, sizeof(co));
+    codecEncode(codec, frame, 100, codecTestOutput, &co);
+    codecSkip(codec, 500, codecTestOutput, &co);
+    codecEncode(codec, frame, CODEC_RAW_FRAME, codecTestOutput, &co);
+    if (co.count != 2 || co.len[0] <= CODEC_RAW_HEADER || co.len[1] <= CODEC_RAW_HEADER ||
+        getLong(co.data[1]) != 1 || getLong(co.data[1] + 4) != CODEC_RAW_FRAME + 500)
+        ok = FALSE;
+    codecDelete(codec);
+
+    codec = codecCreateEncoding(ENCODING_OPUS_32K);
+    memset(&co, 0, sizeof(co));
+    codecEncode(codec, frame, FRAME_SIZE, codecTestOutput, &co);
+    codecEncode(codec, frame, FRAME_SIZE, codecTestOutput, &co);
+    if (co.count != 0)
+        ok = FALSE;
+    codecSetFormat(codec, CODEC_RAW);
+    codecEncode(codec, frame, CODEC_RAW_FRAME, codecTestOutput, &co);
+    if (co.count != 2 || memcmp(co.data[0], "OggS", 4) != 0 ||
+        co.len[1] <= CODEC_RAW_HEADER || getLong(co.data[1]) != 0 || getLong(co.data[1] + 4) != 0)
+        ok = FALSE;
+    codecDelete(codec);
+
+    //a reset, as for a new listener, forgets the partial frame and the count
+    codec = codecCreateEncoding(ENCODING_OPUS_32K);
+    codecSetFormat(codec, CODEC_RAW);
+    memset(&co, 0, sizeof(co));
+    codecEncode(codec, frame, CODEC_RAW_FRAME + 100, codecTestOutput, &co);
+    codecReset(codec);
+    codecEncode(codec, frame, CODEC_RAW_FRAME, codecTestOutput, &co);
+    if (co.count != 2 || getLong(co.data[1]) != 0 || getLong(co.data[1] + 4) != 0)
+        ok = FALSE;
+    codecDelete(codec);
+
+    if (ok)
+        trace("test_codec: success");
+    else
+        error("test_codec: wrong framing, timestamps, gap, flush or reset");
+    return ok;
+}
+
+
+/**
+ * The PCM encodings must give known bytes for known samples, clipping
+ * past full scale, after the same header as raw Opus
+ */
+int test_pcm()
+{
+    int ok = TRUE;
+    static CodecOutput co;
+    float values[] = { 0.0, 0.5, -0.5, 1.0, -1.0, 2.0, -2.0 };
+    unsigned char pcm16[][2] = { { 0x00, 0x00 }, { 0xff, 0x3f }, { 0x01, 0xc0 },
+                                 { 0xff, 0x7f }, { 0x01, 0x80 }, { 0xff, 0x7f }, { 0x00, 0x80 } };
+    unsigned char ulaw[] = { 0xff, 0x8f, 0x0f, 0x80, 0x00, 0x80, 0x00 };
+    int nrValues = sizeof(values) / sizeof(float);
+    float frame[CODEC_RAW_FRAME];
+    for (int i = 0 ; i < CODEC_RAW_FRAME ; i++)
+        frame[i] = values[i % nrValues];
+
+    Codec *codec = codecCreateEncoding(ENCODING_PCM16);
+    memset(&co, 0, sizeof(co));
+    codecEncode(codec, frame, CODEC_RAW_FRAME, codecTestOutput, &co);
+    if (co.count != 1 || co.len[0] != CODEC_RAW_HEADER + 2 * CODEC_RAW_FRAME ||
+        getLong(co.data[0]) != 0 || getLong(co.data[0] + 4) != 0)
+        ok = FALSE;
+    for (int i = 0 ; ok && i < CODEC_RAW_FRAME ; i++)
+        {
+        unsigned char *b = co.data[0] + CODEC_RAW_HEADER + 2 * i;
+        if (b[0] != pcm16[i % nrValues][0] || b[1] != pcm16[i % nrValues][1])
+            {
+            error("test_pcm: pcm16 %f gave %02x %02x", values[i % nrValues], b[0], b[1]);
+            ok = FALSE;
+            }
+        }
+    codecDelete(codec);
+
+    codec = codecCreateEncoding(ENCODING_ULAW);
+    memset(&co, 0, sizeof(co));
+    codecEncode(codec, frame, CODEC_RAW_FRAME, codecTestOutput, &co);
+    codecEncode(codec, frame, CODEC_RAW_FRAME, codecTestOutput, &co);
+    if (co.count != 2 || co.len[1] != CODEC_RAW_HEADER + CODEC_RAW_FRAME ||
+        getLong(co.data[1]) != 1 || getLong(co.data[1] + 4) != CODEC_RAW_FRAME)
+        ok = FALSE;
+    for (int i = 0 ; ok && i < CODEC_RAW_FRAME ; i++)
+        {
+        unsigned char b = co.data[1][CODEC_RAW_HEADER + i];
+        if (b != ulaw[i % nrValues])
+            {
+            error("test_pcm: ulaw %f gave %02x", values[i % nrValues], b);
+            ok = FALSE;
+            }
+        }
+    codecDelete(codec);
+
+    if (ok)
+        trace("test_pcm: success");
+    else
+        error("test_pcm: wrong header or samples");
+    return ok;
+}
+
+
+int test_fanout()
+{
+    int ok = TRUE;
+    Fanout *fanout = fanoutCreate();
+    Listener *a = fanoutListen(fanout, ENCODING_OPUS_32K);
+    Listener *b = fanoutListen(fanout, ENCODING_OPUS_32K);
+    Listener *c = fanoutListen(fanout, ENCODING_ULAW);
+    if (!fanoutWants(fanout, ENCODING_ULAW) || fanoutWants(fanout, ENCODING_PCM16))
+        ok = FALSE;
+    unsigned char data[4] = { 1, 2, 3, 4 };
+    fanoutPublish(fanout, ENCODING_OPUS_32K, data, 4);
+    fanoutPublish(fanout, ENCODING_PCM16, data, 4);  //nobody listens
+    Packet *pa = listenerNext(a);
+    Packet *pb = listenerNext(b);
+    if (!pa || pa != pb || pa->size != 4 || memcmp(pa->data, data, 4) != 0)
+        ok = FALSE;
+    packetUnref(pa);
+    packetUnref(pb);
+    if (c->queue->count != 0)
+        ok = FALSE;
+    //a keeps up, b never reads
+    for (int i = 0 ; i < FANOUT_QUEUE + 10 ; i++)
+        {
+        fanoutPublish(fanout, ENCODING_OPUS_32K, data, 4);
+        packetUnref(listenerNext(a));
+        }
+    if (a->dropped != 0 || b->dropped != 10)
+        ok = FALSE;
+    listenerClose(b);
+    int queued = 0;
+    Packet *p;
+    while ((p = listenerNext(b)))
+        {
+        queued++;
+        packetUnref(p);
+        }
+    if (queued != FANOUT_QUEUE || fanoutWants(fanout, ENCODING_OPUS_32K) != TRUE)
+        ok = FALSE;
+    listenerDelete(b);
+    //the owner's, and a's and c's
+    if (fanout->refs != 3)
+        ok = FALSE;
+    fanoutDelete(fanout);
+    if (listenerNext(a) != NULL || listenerNext(c) != NULL)
+        ok = FALSE;
+    //the fanout lives until the last listener is done with it
+    listenerClose(a);
+    listenerDelete(a);
+    listenerDelete(c);
+    if (ok)
+        trace("test_fanout: success");
+    else
+        error("test_fanout: packets not shared or not dropped as expected");
+    return ok;
+}
+
+
+typedef struct
+{
+    Event *entered; //signaled as each frame starts
+    Event *gate;    //holds up the first frame until signaled
+    int calls;
+    int samples;
+    int silence;
+    int lost;
+    int lostCall;  //the call that had the gap
+} EncoderOutput;
+
+static void encoderOutput(float *buf, int size, int lost, long long stamp, void *ctx)
+{
+    EncoderOutput *out = (EncoderOutput *)ctx;
+    eventSignal(out->entered);
+    if (out->calls++ == 0)
+        eventWait(out->gate, 5000);
+    if (buf)
+        out->samples += size;
+    else if (lost)
+        {
+        out->lost += size;
+        out->lostCall = out->calls;
+        }
+    else
+        out->silence += size;
+}
+
+/**
+ * While the encoder is stuck on a frame, the pusher must not wait.
+ * It drops what does not fit, and that comes out later as a gap,
+ * so that no time is lost.  Squelch silence that does not fit waits,
+ * after the gap, and is not counted as dropped.
+ */
+int test_encoder()
+{
+    EncoderOutput out;
+    memset(&out, 0, sizeof(out));
+    out.entered = eventCreate();
+    out.gate    = eventCreate();
+    Encoder *enc = encoderCreate("test-enc", encoderOutput, &out);
+    float buf[ENCODER_FRAME];
+    memset(buf, 0, sizeof(buf));
+    int ok = TRUE;
+    encoderPush(enc, buf, ENCODER_FRAME, 0);
+    if (!eventWait(out.entered, 1000))
+        ok = FALSE;
+    //the frame being encoded keeps its place until it is done
+    int dropped = 5;
+    for (int i = 0 ; i < ENCODER_QUEUE - 1 + dropped ; i++)
+        encoderPush(enc, buf, ENCODER_FRAME, 0);
+    if (encoderSilence(enc, 500))
+        ok = FALSE;
+    EncoderStats stats;
+    encoderGetStats(enc, &stats);
+    if (stats.dropped != (unsigned long)dropped || stats.backlog != ENCODER_QUEUE ||
+        stats.maxBacklog != ENCODER_QUEUE || stats.silences != 0)
+        ok = FALSE;
+    eventSignal(out.gate);
+    //this one waits behind the silence
+    for (int i = 0 ; i < 100 && encoderBacklog(enc) > 0 ; i++)
+        eventWait(out.entered, 10);
+    encoderPush(enc, buf, ENCODER_FRAME, 0);
+    for (int i = 0 ; i < 100 && encoderBacklog(enc) > 0 ; i++)
+        eventWait(out.entered, 10);
+    encoderGetStats(enc, &stats);
+    encoderDelete(enc);
+    if (out.samples != (ENCODER_QUEUE + 1) * ENCODER_FRAME ||
+        out.lost != dropped * ENCODER_FRAME || out.silence != 500 ||
+        out.lostCall != ENCODER_QUEUE + 1 || stats.silences != 1 ||
+        stats.dropped != (unsigned long)dropped)
+        ok = FALSE;
+    if (ok)
+        trace("test_encoder: success");
+    else
+        error("test_encoder: samples %d lost %d silence %d dropped %lu backlog %d",
+            out.samples, out.lost, out.silence, stats.dropped, stats.backlog);
+    eventDelete(out.entered);
+    eventDelete(out.gate);
+    return ok;
+}
+
+
 #if 0
 
 static void test_ws1()
@@ -180,13 +1808,385 @@ static void test_ws3()
 int dotests()
 {
     test_json();
+    test_fold();
+    test_kernelgen();
+    test_kernels();
+    test_taps();
+    test_design();
+    test_remez();
+    test_bank();
+    test_fused();
+    test_resampler();
+    test_farrow();
+    test_ssb();
+    test_sos();
+    test_agc();
+    test_squelch();
+    test_drift();
+    test_wfm();
+    test_mailbox();
+    test_codec();
+    test_pcm();
+    test_fanout();
+    test_encoder();
+    return TRUE;
+}
+
+
+
+/*############################################################################
+## B E N C H M A R K S
+############################################################################*/
+
+
+static void benchReport(char *name, Latency *lat)
+{
+    LatencyStats stats;
+    latencyGetStats(lat, &stats);
+    trace("%-20s count:%lu min:%.1fus mean:%.1fus max:%.1fus", name,
+        stats.count, stats.min, stats.mean, stats.max);
+}
+
+
+#define WAKEUP_COUNT 1000
+
+typedef struct
+{
+    Event *event;
+    volatile long long stamp;
+} WakeupBench;
+
+static void *wakeupProducer(void *ctx)
+{
+    WakeupBench *bench = (WakeupBench *)ctx;
+    for (int i = 0 ; i < WAKEUP_COUNT ; i++)
+        {
+        Pa_Sleep(2);
+        bench->stamp = latencyNow();
+        eventSignal(bench->event);
+        }
+    return NULL;
+}
+
+/**
+ * How long does it take for a thread sleeping in eventWait()
+ * to wake up after another thread signals it?  This is the
+ * delay the reader thread adds to every block from the device.
+ */
+int bench_wakeup()
+{
+    WakeupBench bench;
+    bench.event = eventCreate();
+    bench.stamp = 0;
+    Latency lat;
+    latencyReset(&lat);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, wakeupProducer, &bench))
+        {
+        error("bench_wakeup: could not start thread");
+        eventDelete(bench.event);
+        return FALSE;
+        }
+    for (int i = 0 ; i < WAKEUP_COUNT ; i++)
+        {
+        if (!eventWait(bench.event, 1000))
+            {
+            error("bench_wakeup: timed out");
+            break;
+            }
+        latencyRecord(&lat, bench.stamp);
+        }
+    pthread_join(thread, NULL);
+    eventDelete(bench.event);
+    benchReport("event wakeup", &lat);
+    return TRUE;
+}
+
+
+#define BANK_CHANNELS 16
+#define BANK_SAMPLES  (1024*1024)
+
+/**
+ * Run many channels over one device block, each on its own and
+ * then sharing a pass in a bank.
+ */
+int bench_bank()
+{
+    float complex *in = (float complex *)malloc(BANK_SAMPLES * sizeof(float complex));
+    for (int i = 0 ; i < BANK_SAMPLES ; i++)
+        in[i] = sin(i * 0.01) + cos(i * 0.37) * I;
+    int calls = 0;
+    Ddc *ddcs[BANK_CHANNELS];
+    DdcBank *bank = ddcBankCreate();
+    for (int c = 0 ; c < BANK_CHANNELS ; c++)
+        {
+        float vfo = -900000.0 + c * 117000.0; //irregular spacing
+        float width = 6000.0 + 1500.0 * (c % 5);
+        ddcs[c] = ddcCreate(vfo, -width, width, 2048000.0);
+        ddcBankAdd(bank, ddcs[c], bankOutput, &calls);
+        }
+    long long start = latencyNow();
+    for (int c = 0 ; c < BANK_CHANNELS ; c++)
+        ddcUpdate(ddcs[c], in, BANK_SAMPLES, bankOutput, &calls);
+    long long separate = latencyNow() - start;
+    start = latencyNow();
+    ddcBankUpdate(bank, in, BANK_SAMPLES);
+    long long banked = latencyNow() - start;
+    trace("%d channels, %d samples.  separate:%lldus bank:%lldus",
+        BANK_CHANNELS, BANK_SAMPLES, separate, banked);
+    for (int c = 0 ; c < BANK_CHANNELS ; c++)
+        ddcDelete(ddcs[c]);
+    ddcBankDelete(bank);
+    free(in);
+    tapsFlush();
+    return TRUE;
+}
+
+
+static void decimOutput(float complex *data, int size, void *context)
+{
+    *(int *)context += size;
+}
+
+int bench_kernelgen()
+{
+    float complex *in = (float complex *)malloc(BANK_SAMPLES * sizeof(float complex));
+    for (int i = 0 ; i < BANK_SAMPLES ; i++)
+        in[i] = sin(i * 0.01) + cos(i * 0.37) * I;
+    int outs = 0;
+    for (int factor = 2 ; factor <= 8 ; factor += 2)
+        {
+        Decimator *fixed   = decimatorCreate(48000.0 * factor, 48000.0);
+        Decimator *generic = decimatorCreate(48000.0 * factor, 48000.0);
+        generic->decimate = NULL;
+        long long start = latencyNow();
+        decimatorUpdate(fixed, in, BANK_SAMPLES, decimOutput, &outs);
+        long long unrolled = latencyNow() - start;
+        start = latencyNow();
+        decimatorUpdate(generic, in, BANK_SAMPLES, decimOutput, &outs);
+        long long plain = latencyNow() - start;
+        trace("decimate by %d, %d taps.  generic:%lldus unrolled:%lldus",
+            factor, fixed->taps->size, plain, unrolled);
+        decimatorDelete(fixed);
+        decimatorDelete(generic);
+        }
+    free(in);
+    tapsFlush();
+    return TRUE;
+}
+
+
+#define SOS_BENCH_SAMPLES (256*1024)
+
+/**
+ * Eight channels of 8th order lowpass, each on its own and then
+ * side by side in a bank
+ */
+int bench_sos()
+{
+    float *in  = (float *)malloc(SOS_BENCH_SAMPLES * SOS_LANES * sizeof(float));
+    float *out = (float *)malloc(SOS_BENCH_SAMPLES * SOS_LANES * sizeof(float));
+    for (int i = 0 ; i < SOS_BENCH_SAMPLES * SOS_LANES ; i++)
+        in[i] = sin(i * 0.01) + cos(i * 0.37);
+    Sos *sos[SOS_LANES];
+    SosBank *bank = sosBankCreate();
+    for (int k = 0 ; k < SOS_LANES ; k++)
+        {
+        sos[k] = sosLP(8, 3000.0 + 100.0 * k, 48000.0);
+        sosBankSet(bank, k, sos[k]);
+        }
+    long long start = latencyNow();
+    for (int k = 0 ; k < SOS_LANES ; k++)
+        sosUpdate(sos[k], out + k * SOS_BENCH_SAMPLES, in + k * SOS_BENCH_SAMPLES, SOS_BENCH_SAMPLES);
+    long long separate = latencyNow() - start;
+    start = latencyNow();
+    sosBankUpdate(bank, out, in, SOS_BENCH_SAMPLES);
+    long long banked = latencyNow() - start;
+    trace("%d channels, 4 sections, %d samples.  separate:%lldus bank:%lldus",
+        SOS_LANES, SOS_BENCH_SAMPLES, separate, banked);
+    for (int k = 0 ; k < SOS_LANES ; k++)
+        sosDelete(sos[k]);
+    sosBankDelete(bank);
+    free(in);
+    free(out);
+    return TRUE;
+}
+
+
+static void stereoDiscard(float complex *data, int size, void *ctx)
+{
+    *(int *)ctx += size;
+}
+
+/**
+ * One second of a stereo station, at the rate a +-100khz passband gives
+ */
+int bench_wfm()
+{
+    float rate = 250000.0;
+    int len = (int)rate;
+    float complex *in = (float complex *)malloc(len * sizeof(float complex));
+    for (int i = 0 ; i < len ; i++)
+        in[i] = cexpf(I * 3.0 * sinf(i * 0.01));
+    Demodulator *dem = demodWfmCreate();
+    demodSetRate(dem, rate);
+    Resampler *res = resamplerCreate(demodOutRate(dem, rate), 48000.0);
+    int outs = 0;
+    long long start = latencyNow();
+    for (int i = 0 ; i < len ; i += 16384)
+        dem->stereo(dem, in + i, (len - i < 16384) ? len - i : 16384, res, stereoDiscard, &outs);
+    long long elapsed = latencyNow() - start;
+    trace("wfm stereo, 1s at %.0f:  %lldus", rate, elapsed);
+    resamplerDelete(res);
+    demodDelete(dem);
+    free(in);
+    tapsFlush();
+    return TRUE;
+}
+
+
+static void resamplerDiscard(float *data, int size, void *ctx)
+{
+}
+
+/**
+ * Ten seconds of audio to 48khz, from rates that need many branches,
+ * one, and a few
+ */
+int bench_resampler()
+{
+    float rates[] = { 44100.0, 96000.0, 32000.0 };
+    for (int mode = RESAMPLE_POLYPHASE ; mode <= RESAMPLE_FARROW ; mode++)
+        {
+        for (int r = 0 ; r < 3 ; r++)
+            {
+            int len = (int)rates[r];
+            float *in = (float *)malloc(len * sizeof(float));
+            for (int i = 0 ; i < len ; i++)
+                in[i] = sinf(i * 0.1);
+            Resampler *res = resamplerCreate(rates[r], 48000.0);
+            resamplerSetMode(res, mode);
+            resamplerSetTaps(res, resamplerDesign(res, rates[r], 48000.0));
+            long long start = latencyNow();
+            for (int sec = 0 ; sec < 10 ; sec++)
+                resamplerUpdate(res, in, len, resamplerDiscard, NULL);
+            long long elapsed = latencyNow() - start;
+            trace("resample %.0f to 48000, %s, L/M %d/%d, %d taps a branch, 10s:  %lldus",
+                rates[r], (mode == RESAMPLE_FARROW) ? "farrow" : "polyphase",
+                res->taps->phases, res->taps->step, res->taps->size, elapsed);
+            resamplerDelete(res);
+            free(in);
+            }
+        }
+    tapsFlush();
+    return TRUE;
+}
+
+
+typedef struct
+{
+    Ddc *ddc;
+    Demodulator *dem;
+    Resampler *res;
+    long long now;   //the simulated time, in usec
+    long long age;   //summed over the blocks
+    int blocks;
+} BlocksBench;
+
+static void blocksOutput(float *data, int size, void *ctx)
+{
+    BlocksBench *bb = (BlocksBench *)ctx;
+    bb->age += bb->now - bb->res->outStamp;
+    bb->blocks++;
+}
+
+static void blocksDdcOutput(float complex *data, int size, void *ctx)
+{
+    BlocksBench *bb = (BlocksBench *)ctx;
+    bb->dem->stamp = bb->ddc->outStamp;
+    bb->dem->fused(bb->dem, data, size, bb->res, blocksOutput, bb);
+}
+
+#define BLOCKS_SECONDS 4
+
+/**
+ * A few seconds of a channel, ddc to resampler, in large and small
+ * blocks.  The device's transfers are the size each mode asks for.
+ * The delay is how long samples wait in the pipeline's buffers on a
+ * clock that is not the cpu's, so it does not count computing time.
+ * The speaker's queue adds what audioSetBlockTime() would hold.
+ */
+int bench_blocks()
+{
+    float rate = 2048000.0;
+    int len = (int)rate;
+    float complex *in = (float complex *)malloc(len * sizeof(float complex));
+    for (int i = 0 ; i < len ; i++)
+        in[i] = cexpf(I * 3.0 * sinf(i * 0.001));
+    float times[2] = { 0.0, BLOCK_SMALL_TIME };
+    char *names[2] = { "large", "small" };
+    for (int m = 0 ; m < 2 ; m++)
+        {
+        int transfer = (times[m] > 0.0) ? (int)(rate * times[m]) : 16 * 32 * 512 / 2;
+        BlocksBench bb;
+        memset(&bb, 0, sizeof(bb));
+        bb.ddc = ddcCreate(0.0, -5000.0, 5000.0, rate);
+        bb.dem = demodFmCreate();
+        float ifRate = ddcGetOutRate(bb.ddc);
+        demodSetRate(bb.dem, ifRate);
+        bb.res = resamplerCreate(ifRate, 48000.0);
+        ddcSetBlockTime(bb.ddc, times[m]);
+        resamplerSetBlockTime(bb.res, times[m]);
+        long long start = latencyNow();
+        for (int sec = 0 ; sec < BLOCKS_SECONDS ; sec++)
+            {
+            for (int i = 0 ; i < len ; i += transfer)
+                {
+                int n = (len - i < transfer) ? len - i : transfer;
+                //delivered when its last sample is in
+                bb.now = (long long)((sec * rate + i + n) * 1.0e6 / rate);
+                bb.ddc->stamp = bb.now;
+                ddcUpdate(bb.ddc, in + i, n, blocksDdcOutput, &bb);
+                }
+            }
+        long long elapsed = latencyNow() - start;
+        int frames = (times[m] > 0.0) ? (int)(44100.0 * times[m]) : AUDIO_FRAMES_PER_BUFFER;
+        float queue = AUDIO_QUEUE_TARGET * frames;
+        if (queue < AUDIO_QUEUE_MIN * 44100.0)
+            queue = AUDIO_QUEUE_MIN * 44100.0;
+        double held = (bb.blocks) ? bb.age / 1000.0 / bb.blocks : 0.0;
+        double speaker = (queue + frames) * 1000.0 / 44100.0;
+        trace("%s blocks, %ds at %.0f:  %lldus, %d blocks, held %.1fms + speaker %.1fms",
+            names[m], BLOCKS_SECONDS, rate, elapsed, bb.blocks, held, speaker);
+        resamplerDelete(bb.res);
+        demodDelete(bb.dem);
+        ddcDelete(bb.ddc);
+        }
+    free(in);
+    tapsFlush();
+    return TRUE;
+}
+
+
+int dobenchmarks()
+{
+    bench_wakeup();
+    bench_bank();
+    bench_kernelgen();
+    bench_sos();
+    bench_wfm();
+    bench_resampler();
+    bench_blocks();
     return TRUE;
 }
 
 
 int main(int argc, char **argv)
 {
-    dotests();
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        dobenchmarks();
+    else
+        dotests();
     return 0;
 }
 